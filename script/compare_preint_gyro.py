@@ -0,0 +1,85 @@
+import os
+import os.path as osp
+import argparse
+import csv
+import shlex
+
+# Compares STEAM-RO on Boreas Navtech with one gyro factor per sample against the preintegrated yaw-rate factor per
+# knot interval (odometry_options.steam.preint_gyro). Both configurations run as a sweep on the same loaded frames, one
+# at a time so their timings do not interfere; reported per sequence are the registration time per frame, the sliding
+# window and in-ICP solve times, and the drift (RPE) of each.
+
+CONFIGS = [
+    'odometry_options.steam.preint_gyro:=false',
+    'odometry_options.steam.preint_gyro:=true',
+]
+
+STAGES = ['registration/icp/optimization', 'registration/icp/sliding_window']
+
+
+def read_sweep(filename):
+  rows = []
+  with open(filename, 'r') as f:
+    for line in f:
+      if line.startswith('#'):
+        continue
+      fields = shlex.split(line)
+      rows.append({
+          'config': int(fields[0]),
+          'success': fields[1] == '1',
+          'ms_per_frame': float(fields[3]),
+          't_rpe': float(fields[4]),
+          'r_rpe': float(fields[5]),
+          't_rpe_2d': float(fields[6]),
+          'r_rpe_2d': float(fields[7]),
+      })
+  return rows
+
+
+def read_latency(filename):
+  latency = {}
+  if not osp.exists(filename):
+    return latency
+  with open(filename, 'r') as f:
+    for row in csv.DictReader(f):
+      latency[row['stage']] = row
+  return latency
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser()
+  # example:
+  # python3 compare_preint_gyro.py --output /home/krb/ASRL/temp/steam_icp/preint_gyro --sequence boreas-2021-09-07-09-35
+  parser.add_argument('--config', default=osp.join(osp.dirname(osp.abspath(__file__)), '..', 'steam_icp', 'config',
+                                                   'boreas_navtech_steamro_config.yaml'), type=str)
+  parser.add_argument('--output', type=str, help='output directory of the sweep')
+  parser.add_argument('--sequence', type=str, help='sequence to run, all those of the config if not given')
+  parser.add_argument('--skip_run', action='store_true', help='only report the results already in --output')
+  args = parser.parse_args()
+  output_dir = osp.join(args.output, '')
+
+  if not args.skip_run:
+    params = ['--params-file', args.config, '-p', 'output_dir:=' + output_dir, '-p', 'log_dir:=' + output_dir,
+              '-p', 'sweep_num_parallel:=1', '-p', 'sweep_configs:=[' + ','.join(f'"{c}"' for c in CONFIGS) + ']']
+    if args.sequence:
+      params += ['-p', 'dataset_options.all_sequences:=false', '-p', 'dataset_options.sequence:=' + args.sequence]
+    command = 'ros2 run steam_icp steam_icp --ros-args ' + ' '.join(shlex.quote(p) for p in params)
+    print(command)
+    os.system(command)
+
+  sweeps = sorted(f[:-len('_sweep.txt')] for f in os.listdir(output_dir) if f.endswith('_sweep.txt'))
+  sequences = [args.sequence] if args.sequence else sweeps
+  for sequence in sequences:
+    print(f'\n{sequence}')
+    print(f'{"config":>44} {"ms/frame":>9} {"opt p50":>8} {"opt p99":>8} {"swf p50":>8} {"swf p99":>8} '
+          f'{"t_rpe":>7} {"r_rpe":>7} {"t_rpe_2d":>8} {"r_rpe_2d":>8}')
+    for row in read_sweep(osp.join(output_dir, sequence + '_sweep.txt')):
+      latency = read_latency(osp.join(output_dir, f'sweep_{row["config"]}', sequence + '_latency.csv'))
+      solve = []
+      for stage in STAGES:
+        summary = latency.get(stage, {})
+        solve += [float(summary.get('p50_ms', 'nan')), float(summary.get('p99_ms', 'nan'))]
+      status = '' if row['success'] else ' (failed)'
+      print(f'{CONFIGS[row["config"]] + status:>44} {row["ms_per_frame"]:9.2f} ' +
+            ' '.join(f'{t:8.2f}' for t in solve) +
+            f' {row["t_rpe"]:7.3f} {row["r_rpe"]:7.4f} {row["t_rpe_2d"]:8.3f} {row["r_rpe_2d"]:8.4f}')
@@ -0,0 +1,95 @@
+// Microbenchmark of the point-to-plane residual weighting per loss type: the inline kernels of loss_kernels.hpp in a
+// loop instantiated per kernel, against the same loop calling the matching steam loss function through its virtual
+// interface. Built with -DSTEAM_ICP_BENCHMARKS=ON; run as bench_loss_kernels [num_residuals] [repetitions].
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "steam_icp/utils/loss_kernels.hpp"
+
+using namespace steam_icp;
+
+namespace {
+
+enum class LossFunc { L2, DCS, CAUCHY, GM, HUBER };
+
+constexpr double kSigma = 0.1;
+
+// residuals of a converged registration: mostly inliers within the loss scale, a tail of outliers
+std::vector<double> makeResiduals(size_t n) {
+  std::mt19937 gen(42);
+  std::normal_distribution<double> inlier(0.0, 0.5 * kSigma);
+  std::uniform_real_distribution<double> outlier(-1.0, 1.0);
+  std::uniform_real_distribution<double> pick(0.0, 1.0);
+  std::vector<double> residuals(n);
+  for (auto &r : residuals) r = pick(gen) < 0.9 ? inlier(gen) : outlier(gen);
+  return residuals;
+}
+
+// the weighted normal equations of a 1D residual, the part of the p2p loop that depends on the loss
+template <typename Kernel>
+double weightedSum(const Kernel &kernel, const std::vector<double> &residuals) {
+  double sum = 0.0;
+  for (const double r : residuals) {
+    const double e2 = r * r;
+    sum += kernel.weight(e2) * e2;
+  }
+  return sum;
+}
+
+double weightedSum(const steam::BaseLossFunc &loss_func, const std::vector<double> &residuals) {
+  double sum = 0.0;
+  for (const double r : residuals) sum += loss_func.weight(std::abs(r)) * r * r;  // steam takes the error norm
+  return sum;
+}
+
+template <typename Func>
+double bestOf(int repetitions, double &result, Func &&func) {
+  double best = std::numeric_limits<double>::max();
+  for (int i = 0; i < repetitions; ++i) {
+    const auto begin = std::chrono::steady_clock::now();
+    result = func();
+    best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const size_t num_residuals = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  const int repetitions = argc > 2 ? std::atoi(argv[2]) : 20;
+  const auto residuals = makeResiduals(num_residuals);
+
+  std::cout << num_residuals << " residuals, best of " << repetitions << " (ms)" << std::endl;
+  std::cout << std::setw(8) << "loss" << std::setw(12) << "kernel" << std::setw(12) << "steam" << std::setw(12)
+            << "speedup" << std::endl;
+  const std::pair<LossFunc, const char *> losses[] = {
+      {LossFunc::L2, "L2"}, {LossFunc::DCS, "DCS"}, {LossFunc::CAUCHY, "CAUCHY"}, {LossFunc::GM, "GM"},
+      {LossFunc::HUBER, "HUBER"}};
+  int status = 0;
+  for (const auto &[loss_func, name] : losses) {
+    double kernel_sum = 0.0, steam_sum = 0.0;
+    const double kernel_ms = loss::dispatchLossKernel(loss_func, kSigma, [&](const auto &kernel) {
+      return bestOf(repetitions, kernel_sum, [&] { return weightedSum(kernel, residuals); });
+    });
+    const auto steam_loss = loss::makeSteamLoss(loss_func, kSigma);
+    const double steam_ms = bestOf(repetitions, steam_sum, [&] { return weightedSum(*steam_loss, residuals); });
+    std::cout << std::setw(8) << name << std::setw(12) << std::fixed << std::setprecision(3) << kernel_ms
+              << std::setw(12) << steam_ms << std::setw(11) << std::setprecision(2) << steam_ms / kernel_ms << "x"
+              << std::endl;
+    if (std::abs(kernel_sum - steam_sum) > 1e-9 * std::max(1.0, std::abs(steam_sum))) {
+      std::cerr << name << ": kernel and steam weights differ (" << kernel_sum << " vs " << steam_sum << ")"
+                << std::endl;
+      status = 1;
+    }
+  }
+  return status;
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <utility>
+#include <vector>
+
 #include <Eigen/Dense>
 
 #include "steam/problem/cost_term/imu_super_cost_term.hpp"
@@ -13,6 +16,8 @@ struct DataFrame {
   std::vector<Point3D> pointcloud;
   std::vector<steam::IMUData> imu_data_vec;
   std::vector<PoseData> pose_data_vec;
+  // time (ms) spent in the stages of loading this frame, when the sequence reports them; recorded under "load/"
+  std::vector<std::pair<const char *, double>> load_timings;
 };
 
 }  // namespace steam_icp
\ No newline at end of file
@@ -12,14 +12,15 @@
 
 namespace steam_icp {
 
+class ThreadPool;
+
 class Sequence {
  public:
   using Ptr = std::shared_ptr<Sequence>;
   using ConstPtr = std::shared_ptr<const Sequence>;
 
-  ArrayPoses T_i_r_gt_poses;
-
   struct Options {
+    std::string dataset;  // name the dataset is registered under, set by Dataset::Get
     std::string root_path;
     std::string sequence;
     int init_frame = 0;
@@ -42,12 +43,19 @@ class Sequence {
     int modified_cacfar_num_threads = 1;
     bool lidar_timestamp_round = false;
     double lidar_timestamp_round_hz = 400.0;
+    // replay from <archive_dir>/<sequence>.pack, or else .qpack, when it exists (see datasets/archive.hpp and
+    // datasets/quantized_archive.hpp)
+    std::string archive_dir;
+    // cache of the frame listing and measurement offsets of every sequence (see datasets/sequence_index.hpp), not
+    // cached when empty; steam_icp defaults it to <output_dir>/index
+    std::string index_dir;
   };
 
   Sequence(const Options &options) : options_(options) {}
   virtual ~Sequence() = default;
 
   std::string name() const { return options_.sequence; }
+  const Options &options() const { return options_; }
   virtual int currFrame() const = 0;
   virtual int numFrames() const = 0;
   virtual void setInitFrame(int /* frame_index */) {
@@ -59,6 +67,13 @@ class Sequence {
   virtual std::vector<Point3D> frame(size_t /* index */) const {
     throw std::runtime_error("random access not supported");
   }
+  /// Frame index with its IMU and pose measurements, the same as next() would return, whatever was read before.
+  virtual DataFrame frameAt(size_t /* index */) const { throw std::runtime_error("random access not supported"); }
+  /// Runs the parallel loops of frame loading on thread_pool, the odometry's, instead of a pool of the sequence's own,
+  /// so that a loader prefetching alongside the registration does not oversubscribe the cores. The sequence holds on
+  /// to the pool, which may then outlive the odometry. To be called before reading frames; sequences without parallel
+  /// loading ignore it.
+  virtual void shareThreadPool(std::shared_ptr<ThreadPool> /* thread_pool */) {}
 
   virtual void save(const std::string &path, const Trajectory &trajectory) const = 0;
 
@@ -82,6 +97,8 @@ class Sequence {
     double mean_num_attempts;
   };
   virtual bool hasGroundTruth() const { return false; }
+  /// Ground truth poses T_i_r of the frames of the sequence, when it has them; read from disk on every call
+  virtual ArrayPoses groundTruthPoses() const { return {}; }
   virtual SeqError evaluate(const std::string & /* path */, const Trajectory & /* trajectory */) const {
     throw std::runtime_error("no ground truth available");
   }
@@ -103,7 +120,9 @@ class Dataset {
   };
 
   static Dataset::Ptr Get(const std::string &dataset, const Options &options) {
-    return name2Ctor().at(dataset)(options);
+    Options dataset_options(options);
+    dataset_options.dataset = dataset;
+    return name2Ctor().at(dataset)(dataset_options);
   }
 
   Dataset(const Options &options) : options_(options) {}
@@ -111,8 +130,15 @@ class Dataset {
 
   virtual bool hasNext() const = 0;
   virtual Sequence::Ptr next() = 0;
+  /// Names of every sequence next() goes through, in order
+  virtual std::vector<std::string> sequences() const = 0;
 
  protected:
+  /// The sequence replayed from its archive in options.archive_dir if there is one written with the same frame options
+  /// (see frameOptionsHash) that holds every frame of [init_frame, last_frame), make() otherwise. With an archive,
+  /// make() is only called if the original sequence is needed (save, evaluate).
+  static Sequence::Ptr open(const Sequence::Options &options, const std::function<Sequence::Ptr()> &make);
+
   const Options options_;
 
  private:
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "steam_icp/point.hpp"
+#include "steam_icp/utils/mapped_file.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Radial velocity calibration of the Boreas Aeva lidar (aeva_calib/), flattened into lookup tables. Every beam
+ * splits the frame into time partitions (rt_part.csv); within a partition, the azimuth range of the beam
+ * (azi_minmax_<beam>.csv) is cut into bins, each with the mean velocity to subtract (vel_mean_<beam>.csv).
+ */
+struct AevaVelocityCalibration {
+  static constexpr int kNumBeams = 4;
+
+  int num_parts = 0;
+  std::vector<double> rt_parts;   // [beam][part], relative time at which each partition starts
+  std::vector<double> azi_min;    // [beam][part]
+  std::vector<double> azi_res;    // [beam][part], azimuth width of a bin
+  std::vector<int> num_bins;      // [beam]
+  std::vector<size_t> bin_begin;  // [beam][part], index of the first bin of the partition in vel_means
+  std::vector<double> vel_means;  // [beam][part][bin]
+
+  /// Values are rounded to float, as they always were.
+  static AevaVelocityCalibration load(const std::string &dir);
+};
+
+/**
+ * \brief Points of a Boreas Aeva frame (records of float x, y, z, intensity, radial velocity, time, and beam id when
+ * calibration is given) with a range strictly within (min_dist, max_dist), in one fused pass: range filter and time
+ * bounds (over every record) straight out of the mapped records into columns, then time normalization and velocity
+ * calibration over the columns, branch free but for the lookups. timestamp is the time of the point plus
+ * time_delta_sec, alpha_timestamp that time normalized over the frame.
+ */
+std::vector<Point3D> readAevaFrame(const MappedFile &file, double time_delta_sec, double min_dist, double max_dist,
+                                   const AevaVelocityCalibration *calibration);
+
+}  // namespace steam_icp
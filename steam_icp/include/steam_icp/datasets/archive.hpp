@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "steam_icp/dataset.hpp"
+#include "steam_icp/utils/mapped_file.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Packed archive of the frames of a sequence, as loaded by its Sequence: one file, written once by
+ * writeArchive, then replayed through a read-only mapping with no per-frame file opens and in any order.
+ *
+ * Layout (native endianness, every block and column 64 byte aligned):
+ *   ArchiveHeader
+ *   per frame, at ArchiveFrame::offset:
+ *     points: x, y, z, radial_velocity, alpha_timestamp, dt (float[num_points] each, dt being the timestamp of the
+ *             point minus the one of the frame), beam_id (int32[num_points]); pt is raw_pt as read
+ *     imu:    double[num_imu][7] (timestamp, ang_vel, lin_acc)
+ *     poses:  double[num_poses][13] (timestamp, 3x4 row-major)
+ *   ArchiveFrame[num_frames] at index_offset
+ *   ground truth poses (Sequence::groundTruthPoses), double[num_gt_poses][16] column-major at gt_offset
+ * An archive only replays for the frame options it was written with, whose hash the header holds, and for frame
+ * ranges it covers whole, so that the frames replayed match the ground truth of the source sequence.
+ */
+struct ArchiveHeader {
+  static constexpr char kMagic[8] = {'S', 'I', 'C', 'P', 'P', 'A', 'C', 'K'};
+  static constexpr uint32_t kVersion = 3;
+  static constexpr uint32_t kHasGroundTruth = 1u << 0;
+  static constexpr uint32_t kToSequenceEnd = 1u << 1;  // the last archived frame is the last one of the sequence
+
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t first_frame;  // index of the first archived frame in the original sequence
+  uint64_t num_frames;
+  uint64_t index_offset;
+  uint64_t num_gt_poses;
+  uint64_t gt_offset;
+  uint64_t options_hash;  // frameOptionsHash of the sequence written
+};
+
+/// Hash of the options that shape the frames of a sequence: the dataset, the range filter, the timestamp rounding and
+/// the radar extraction parameters.
+uint64_t frameOptionsHash(const Sequence::Options &options);
+
+struct ArchiveFrame {
+  double timestamp;
+  uint64_t offset;
+  uint32_t num_points;
+  uint32_t num_imu;
+  uint32_t num_poses;
+  uint32_t reserved;
+};
+
+constexpr size_t kArchiveAlignment = 64;
+
+inline size_t archiveAligned(size_t size) {
+  return (size + kArchiveAlignment - 1) / kArchiveAlignment * kArchiveAlignment;
+}
+
+/// Sequential writer of an archive file, blocks padded to kArchiveAlignment with pad() or column().
+class ArchiveWriter {
+ public:
+  explicit ArchiveWriter(const std::string &path) : path_(path), ofs_(path, std::ios::binary | std::ios::trunc) {
+    if (!ofs_.is_open()) throw std::runtime_error{"failed to open file: " + path};
+  }
+
+  size_t offset() const { return offset_; }
+
+  void write(const void *data, size_t size) {
+    ofs_.write(static_cast<const char *>(data), size);
+    offset_ += size;
+  }
+
+  template <typename T>
+  void column(const std::vector<T> &values) {
+    write(values.data(), values.size() * sizeof(T));
+    pad();
+  }
+
+  void pad() {
+    static const char zeros[kArchiveAlignment] = {};
+    write(zeros, archiveAligned(offset_) - offset_);
+  }
+
+  void writeAt(size_t offset, const void *data, size_t size) {
+    ofs_.seekp(offset);
+    ofs_.write(static_cast<const char *>(data), size);
+    ofs_.seekp(offset_);
+  }
+
+  void close() {
+    ofs_.close();
+    if (!ofs_) throw std::runtime_error{"failed to write file: " + path_};
+  }
+
+ private:
+  const std::string path_;
+  std::ofstream ofs_;
+  size_t offset_ = 0;
+};
+
+/// IMU and pose measurements of a frame as laid out in an archive (imu, then poses, see above), which takes
+/// measurementsSize bytes.
+void writeMeasurements(ArchiveWriter &writer, const DataFrame &frame);
+void readMeasurements(const char *block, size_t num_imu, size_t num_poses, DataFrame &frame);
+inline size_t measurementsSize(size_t num_imu, size_t num_poses) {
+  return archiveAligned(num_imu * 7 * sizeof(double)) + archiveAligned(num_poses * 13 * sizeof(double));
+}
+
+/// Ground truth poses of an archive, double[16] column-major each.
+void writeGroundTruth(ArchiveWriter &writer, const ArrayPoses &poses);
+ArrayPoses readGroundTruth(const char *data, size_t num_poses);
+
+/// Path of the archive of a sequence in archive_dir.
+inline std::string archivePath(const std::string &archive_dir, const std::string &sequence) {
+  return archive_dir + "/" + sequence + ".pack";
+}
+
+/// Writes the frames left in sequence to path, through a temporary file renamed once complete.
+void writeArchive(Sequence &sequence, const std::string &path);
+
+/// Replays an archive. Frames are numbered as in the original sequence, which is only built (by make_source) when
+/// needed to save or evaluate a trajectory.
+class ArchiveSequence : public Sequence {
+ public:
+  ArchiveSequence(const std::string &path, const Options &options, std::function<Sequence::Ptr()> make_source);
+
+  int currFrame() const override { return curr_frame_; }
+  int numFrames() const override { return last_frame_ - init_frame_; }
+  void setInitFrame(int frame_index) override;
+  bool hasNext() const override { return curr_frame_ < last_frame_; }
+  DataFrame next() override;
+  bool withRandomAccess() const override { return true; }
+  std::vector<Point3D> frame(size_t index) const override { return read(index, false).pointcloud; }
+  DataFrame frameAt(size_t index) const override { return read(index); }
+
+  void save(const std::string &path, const Trajectory &trajectory) const override {
+    source()->save(path, trajectory);
+  }
+
+  bool hasGroundTruth() const override { return header_->flags & ArchiveHeader::kHasGroundTruth; }
+  ArrayPoses groundTruthPoses() const override {
+    return readGroundTruth(file_.data() + header_->gt_offset, header_->num_gt_poses);
+  }
+  SeqError evaluate(const std::string &path, const Trajectory &trajectory) const override {
+    return source()->evaluate(path, trajectory);
+  }
+  SeqError evaluate(const std::string &path) const override { return source()->evaluate(path); }
+
+ private:
+  DataFrame read(size_t index, bool with_measurements = true) const;
+  const Sequence::Ptr &source() const;
+
+  const MappedFile file_;
+  const ArchiveHeader *header_;
+  const ArchiveFrame *index_;
+  int init_frame_;
+  int curr_frame_;
+  int last_frame_;  // exclusive bound
+
+  const std::function<Sequence::Ptr()> make_source_;
+  mutable std::once_flag source_once_;
+  mutable Sequence::Ptr source_;
+};
+
+}  // namespace steam_icp
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "steam_icp/dataset.hpp"
+#include "steam_icp/datasets/aeva_frame.hpp"
+#include "steam_icp/datasets/sequence_index.hpp"
 
 namespace steam_icp {
 
@@ -10,8 +12,12 @@ class BoreasAevaSequence : public Sequence {
 
   int currFrame() const override { return curr_frame_; }
   int numFrames() const override { return last_frame_ - init_frame_; }
+  void setInitFrame(int frame_index) override;
   bool hasNext() const override { return curr_frame_ < last_frame_; }
   DataFrame next() override;
+  bool withRandomAccess() const override { return true; }
+  std::vector<Point3D> frame(size_t index) const override { return frameAt(index).pointcloud; }
+  DataFrame frameAt(size_t index) const override;
 
   void save(const std::string& path, const Trajectory& trajectory) const override;
 
@@ -20,19 +26,15 @@ class BoreasAevaSequence : public Sequence {
 
  private:
   std::string dir_path_;
-  std::vector<std::string> filenames_;
+  const SequenceIndex index_;  // frames, then rows of applanix/imu_raw.csv
   int64_t initial_timestamp_;
-  std::vector<steam::IMUData> imu_data_vec_;
-  unsigned curr_imu_idx_ = 0;
   int init_frame_ = 0;
   int curr_frame_ = 0;
   int last_frame_ = std::numeric_limits<int>::max();  // exclusive bound
   double filename_to_time_convert_factor_ = 1.0e-6;   // may change depending on length of timestamp (ns vs. us)
 
   // velocity calibration parameters
-  Eigen::MatrixXd rt_parts_;
-  std::vector<Eigen::MatrixXd> azi_ranges_;
-  std::vector<Eigen::MatrixXd> vel_means_;
+  AevaVelocityCalibration calibration_;
   bool has_beam_id_ = false;
 };
 
@@ -46,11 +48,12 @@ class BoreasAevaDataset : public Dataset {
   }
 
   bool hasNext() const override { return next_sequence_ < sequences_.size(); }
+  std::vector<std::string> sequences() const override { return sequences_; }
   Sequence::Ptr next() override {
     if (!hasNext()) return nullptr;
     Sequence::Options options(options_);
     options.sequence = sequences_[next_sequence_++];
-    return std::make_shared<BoreasAevaSequence>(options);
+    return open(options, [options] { return std::make_shared<BoreasAevaSequence>(options); });
   }
 
  private:
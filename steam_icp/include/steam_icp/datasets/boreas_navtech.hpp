@@ -1,6 +1,9 @@
 #pragma once
 
 #include "steam_icp/dataset.hpp"
+#include "steam_icp/datasets/sequence_index.hpp"
+#include "steam_icp/utils/thread_pool.hpp"
+#include "steam_icp/utils/timer_table.hpp"
 
 namespace steam_icp {
 
@@ -10,8 +13,13 @@ class BoreasNavtechSequence : public Sequence {
 
   int currFrame() const override { return curr_frame_; }
   int numFrames() const override { return last_frame_ - init_frame_; }
+  void setInitFrame(int frame_index) override;
   bool hasNext() const override { return curr_frame_ < last_frame_; }
   DataFrame next() override;
+  bool withRandomAccess() const override { return true; }
+  std::vector<Point3D> frame(size_t index) const override { return frameAt(index).pointcloud; }
+  DataFrame frameAt(size_t index) const override;
+  void shareThreadPool(std::shared_ptr<ThreadPool> thread_pool) override;
 
   void save(const std::string &path, const Trajectory &trajectory) const override;
 
@@ -21,17 +29,18 @@ class BoreasNavtechSequence : public Sequence {
 
  private:
   std::string dir_path_;
-  std::vector<std::string> filenames_;
+  const SequenceIndex index_;  // frames, then rows of applanix/imu_raw.csv
   int64_t initial_timestamp_;
-  std::vector<steam::IMUData> imu_data_vec_;
-  unsigned curr_imu_idx_ = 0;
   int init_frame_ = 0;
   int curr_frame_ = 0;
   int last_frame_ = std::numeric_limits<int>::max();  // exclusive bound
   double filename_to_time_convert_factor_ = 1.0e-6;   // may change depending on length of timestamp (ns vs. us)
   double beta = 0.049;
+  // of modified_cacfar_num_threads, until the pool of the odometry is shared; its loops are serialized
+  std::shared_ptr<ThreadPool> cacfar_pool_;
 
-  std::vector<Point3D> readPointCloud(const std::string &path, const double &radar_resolution);
+  std::vector<Point3D> readPointCloud(const std::string &path, const double &radar_resolution,
+                                      TimerTable &timer) const;
 };
 
 class BoreasNavtechDataset : public Dataset {
@@ -44,11 +53,12 @@ class BoreasNavtechDataset : public Dataset {
   }
 
   bool hasNext() const override { return next_sequence_ < sequences_.size(); }
+  std::vector<std::string> sequences() const override { return sequences_; }
   Sequence::Ptr next() override {
     if (!hasNext()) return nullptr;
     Sequence::Options options(options_);
     options.sequence = sequences_[next_sequence_++];
-    return std::make_shared<BoreasNavtechSequence>(options);
+    return open(options, [options] { return std::make_shared<BoreasNavtechSequence>(options); });
   }
 
  private:
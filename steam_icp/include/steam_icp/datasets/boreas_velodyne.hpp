@@ -1,6 +1,7 @@
 #pragma once
 
 #include "steam_icp/dataset.hpp"
+#include "steam_icp/datasets/sequence_index.hpp"
 
 namespace steam_icp {
 
@@ -10,28 +11,31 @@ class BoreasVelodyneSequence : public Sequence {
 
   int currFrame() const override { return curr_frame_; }
   int numFrames() const override { return last_frame_ - init_frame_; }
+  void setInitFrame(int frame_index) override;
   bool hasNext() const override { return curr_frame_ < last_frame_; }
   DataFrame next() override;
+  bool withRandomAccess() const override { return true; }
+  std::vector<Point3D> frame(size_t index) const override { return frameAt(index).pointcloud; }
+  DataFrame frameAt(size_t index) const override;
 
   void save(const std::string& path, const Trajectory& trajectory) const override;
 
   bool hasGroundTruth() const override { return true; }
+  ArrayPoses groundTruthPoses() const override;
   SeqError evaluate(const std::string& path, const Trajectory& trajectory) const override;
   SeqError evaluate(const std::string& path) const override;
 
  private:
   std::string dir_path_;
-  std::vector<std::string> filenames_;
+  const SequenceIndex index_;  // frames, then rows of applanix/imu_raw.csv and applanix/lidar_pose_meas.csv
   int64_t initial_timestamp_;
-  std::vector<steam::IMUData> imu_data_vec_;
-  std::vector<PoseData> pose_data_vec_;
-  unsigned curr_imu_idx_ = 0;
-  unsigned curr_pose_meas_idx_ = 0;
+  Eigen::Matrix4d T_lidar_robot_;
   int init_frame_ = 0;
   int curr_frame_ = 0;
   int last_frame_ = std::numeric_limits<int>::max();  // exclusive bound
   double filename_to_time_convert_factor_ = 1.0e-6;   // may change depending on length of timestamp (ns vs. us)
-  std::vector<uint64_t> timestamps_;
+
+  ArrayPoses loadGroundTruth() const;  // applanix/lidar_poses.csv, only read when needed
 };
 
 class BoreasVelodyneDataset : public Dataset {
@@ -44,11 +48,12 @@ class BoreasVelodyneDataset : public Dataset {
   }
 
   bool hasNext() const override { return next_sequence_ < sequences_.size(); }
+  std::vector<std::string> sequences() const override { return sequences_; }
   Sequence::Ptr next() override {
     if (!hasNext()) return nullptr;
     Sequence::Options options(options_);
     options.sequence = sequences_[next_sequence_++];
-    return std::make_shared<BoreasVelodyneSequence>(options);
+    return open(options, [options] { return std::make_shared<BoreasVelodyneSequence>(options); });
   }
 
  private:
@@ -10,8 +10,12 @@ class Kitti360Sequence : public Sequence {
 
   int currFrame() const override { return curr_frame_; }
   int numFrames() const override { return last_frame_ - init_frame_; }
+  void setInitFrame(int frame_index) override;
   bool hasNext() const override { return curr_frame_ < last_frame_; }
   DataFrame next() override;
+  bool withRandomAccess() const override { return true; }
+  std::vector<Point3D> frame(size_t index) const override { return frameAt(index).pointcloud; }
+  DataFrame frameAt(size_t index) const override;
 
   void save(const std::string& path, const Trajectory& trajectory) const override;
 
@@ -37,11 +41,12 @@ class Kitti360Dataset : public Dataset {
   }
 
   bool hasNext() const override { return next_sequence_ < sequences_.size(); }
+  std::vector<std::string> sequences() const override { return sequences_; }
   Sequence::Ptr next() override {
     if (!hasNext()) return nullptr;
     Sequence::Options options(options_);
     options.sequence = sequences_[next_sequence_++];
-    return std::make_shared<Kitti360Sequence>(options);
+    return open(options, [options] { return std::make_shared<Kitti360Sequence>(options); });
   }
 
  private:
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "steam_icp/point.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Rotates every point (x[i], y[i], z[i]) by angle (rad) about the horizontal axis normalize(p x z), i.e. raises
+ * its elevation by angle. Same as the Eigen::AngleAxisd rotation per point, in closed form and branch free so that it
+ * vectorizes: with rho = |(x, y)|, p' = (x (c - s z / rho), y (c - s z / rho), c z + s rho).
+ */
+void correctVerticalAngle(double *x, double *y, double *z, size_t n, double angle);
+
+/**
+ * \brief Points of a KITTI-raw / KITTI-360 frame (.ply of float x, y, z, time), read through a PlyView: the ones with a
+ * range strictly within (min_dist, max_dist) and above the KITTI minimum height, with the HDL64 vertical angle
+ * correction applied to raw_pt and pt. timestamp holds the time of the point, rounded down to a multiple of
+ * timestamp_round_dt when it is positive, and alpha_timestamp that time normalized over every point of the frame.
+ */
+std::vector<Point3D> readKittiPly(const std::string &path, double min_dist, double max_dist,
+                                  double timestamp_round_dt = 0.0);
+
+}  // namespace steam_icp
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "steam_icp/point.hpp"
+#include "steam_icp/utils/mapped_file.hpp"
+
+namespace steam_icp {
+
+/// Layout of a binary lidar frame: packed records of num_fields float32, x, y, z first. Optional fields are -1.
+struct LidarBinLayout {
+  int num_fields = 3;
+  int radial_velocity = -1;
+  int time = -1;
+  int beam_id = -1;
+};
+
+struct LidarBinFrame {
+  /// Points within range, raw_pt = pt, alpha_timestamp holding the raw time of the point (not normalized yet).
+  std::vector<Point3D> points;
+  size_t num_records = 0;
+  /// Time bounds over every record of the frame, filtered out or not.
+  double first_time = 0.0;
+  double last_time = 0.0;
+};
+
+inline size_t numLidarBinRecords(const MappedFile &file, const LidarBinLayout &layout) {
+  return file.count<float>() / layout.num_fields;
+}
+
+/**
+ * \brief Unpacks the records of a frame in place, keeping the points with a range strictly within
+ * (min_dist, max_dist). When times is given (one per record), it replaces the time field.
+ */
+LidarBinFrame readLidarBin(const MappedFile &file, const LidarBinLayout &layout, double min_dist, double max_dist,
+                           const double *times = nullptr);
+
+}  // namespace steam_icp
@@ -10,12 +10,17 @@ class NewerCollegeSequence : public Sequence {
 
   int currFrame() const override { return curr_frame_; }
   int numFrames() const override { return last_frame_ - init_frame_; }
+  void setInitFrame(int frame_index) override;
   bool hasNext() const override { return curr_frame_ < last_frame_; }
   DataFrame next() override;
+  bool withRandomAccess() const override { return true; }
+  std::vector<Point3D> frame(size_t index) const override { return frameAt(index).pointcloud; }
+  DataFrame frameAt(size_t index) const override;
 
   void save(const std::string& path, const Trajectory& trajectory) const override;
 
   bool hasGroundTruth() const override { return true; }
+  ArrayPoses groundTruthPoses() const override;
   SeqError evaluate(const std::string& path, const Trajectory& trajectory) const override;
   SeqError evaluate(const std::string& path) const override;
 
@@ -25,8 +30,6 @@ class NewerCollegeSequence : public Sequence {
   int64_t initial_timestamp_;
   std::vector<steam::IMUData> imu_data_vec_;
   std::vector<PoseData> pose_data_vec_;
-  unsigned curr_imu_idx_ = 0;
-  unsigned curr_pose_meas_idx_ = 0;
   int init_frame_ = 0;
   int curr_frame_ = 0;
   int last_frame_ = std::numeric_limits<int>::max();  // exclusive bound
@@ -36,6 +39,8 @@ class NewerCollegeSequence : public Sequence {
   Eigen::Matrix4d T_imu_lidar_ = Eigen::Matrix4d::Identity();
   Eigen::Matrix4d T_lidar_base2_ = Eigen::Matrix4d::Identity();
   std::vector<uint64_t> timestamps_;
+
+  ArrayPoses loadGroundTruth() const;  // ground_truth/registered_poses.csv, only read when needed
 };
 
 class NewerCollegeDataset : public Dataset {
@@ -48,11 +53,12 @@ class NewerCollegeDataset : public Dataset {
   }
 
   bool hasNext() const override { return next_sequence_ < sequences_.size(); }
+  std::vector<std::string> sequences() const override { return sequences_; }
   Sequence::Ptr next() override {
     if (!hasNext()) return nullptr;
     Sequence::Options options(options_);
     options.sequence = sequences_[next_sequence_++];
-    return std::make_shared<NewerCollegeSequence>(options);
+    return open(options, [options] { return std::make_shared<NewerCollegeSequence>(options); });
   }
 
  private:
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <thread>
+
+#include "steam_icp/dataset.hpp"
+#include "steam_icp/utils/spsc_queue.hpp"
+
+namespace steam_icp {
+
+/// Wraps any sequence and loads its frames ahead of time on a dedicated thread, so that disk reads and point cloud
+/// extraction overlap with registration. next() only pops from a bounded queue of depth frames, waiting if the loader
+/// fell behind. Destroying the wrapper stops the loader after the frame it is currently reading.
+class PrefetchingSequence : public Sequence {
+ public:
+  PrefetchingSequence(const Sequence::Ptr &sequence, int depth);
+  ~PrefetchingSequence() override;
+
+  int currFrame() const override { return curr_frame_; }
+  int numFrames() const override { return sequence_->numFrames(); }
+  bool hasNext() const override { return !exhausted_; }
+  DataFrame next() override;
+
+  void save(const std::string &path, const Trajectory &trajectory) const override {
+    sequence_->save(path, trajectory);
+  }
+
+  bool hasGroundTruth() const override { return sequence_->hasGroundTruth(); }
+  ArrayPoses groundTruthPoses() const override { return sequence_->groundTruthPoses(); }
+  SeqError evaluate(const std::string &path, const Trajectory &trajectory) const override {
+    return sequence_->evaluate(path, trajectory);
+  }
+  SeqError evaluate(const std::string &path) const override { return sequence_->evaluate(path); }
+
+ private:
+  struct Prefetched {
+    DataFrame frame;
+    bool last = false;
+  };
+
+  void run();
+
+  const Sequence::Ptr sequence_;
+  SpscQueue<Prefetched> queue_;
+  int curr_frame_;
+  bool exhausted_;
+
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> failed_{false};
+  std::exception_ptr error_;
+  std::thread thread_;
+};
+
+}  // namespace steam_icp
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "steam_icp/datasets/archive.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Quantized archive of the frames of a sequence: the layout of a packed archive (see archive.hpp), but with the
+ * point columns stored as integer codes rather than floats, for sequences replayed from slow or network storage.
+ * Written once by writeQuantizedArchive, replayed by QuantizedArchiveSequence.
+ *
+ * Each column of each frame is decoded as value = offset + step * code (QuantizedColumn), codes being unsigned
+ * integers of 0 (a constant column, nothing stored), 1, 2 or 4 bytes, whichever is the narrowest to hold them:
+ *   x, y, z, radial_velocity: 16 bits at most over the extent of the column in the frame, the step being the
+ *                             resolution, or coarser when the extent does not fit (over 131 m at 2 mm)
+ *   alpha_timestamp, dt:      ticks of the resolution, as they are or, when narrower, as zigzag coded differences to
+ *                             the code of the previous point (of the first point, to 0)
+ *   beam_id:                  offset from the smallest id of the frame
+ * so that every value is within step / 2 of the original.
+ */
+struct QuantizationOptions {
+  double position = 0.002;  // m
+  double velocity = 0.01;   // m/s
+  double time = 1e-6;       // s
+  double alpha = 1e-6;      // of the frame duration
+};
+
+struct QuantizedArchiveHeader : ArchiveHeader {
+  static constexpr char kMagic[8] = {'S', 'I', 'C', 'P', 'Q', 'P', 'A', 'K'};
+};
+
+struct QuantizedColumn {
+  double offset;
+  double step;
+  uint64_t position;  // of the codes, within the block of the frame
+  uint32_t width;     // bytes per code
+  uint32_t delta;     // codes are zigzag coded differences
+};
+
+struct QuantizedArchiveFrame {
+  static constexpr int kNumColumns = 7;  // x, y, z, radial_velocity, alpha_timestamp, dt, beam_id
+
+  double timestamp;
+  uint64_t offset;
+  uint64_t size;                 // of the whole block: point codes, then measurements
+  uint64_t measurements_offset;  // within the block
+  uint32_t num_points;
+  uint32_t num_imu;
+  uint32_t num_poses;
+  uint32_t reserved;
+  QuantizedColumn columns[kNumColumns];
+};
+
+/// Path of the quantized archive of a sequence in archive_dir.
+inline std::string quantizedArchivePath(const std::string &archive_dir, const std::string &sequence) {
+  return archive_dir + "/" + sequence + ".qpack";
+}
+
+/// Writes the frames left in sequence to path, through a temporary file renamed once complete.
+void writeQuantizedArchive(Sequence &sequence, const std::string &path, const QuantizationOptions &options);
+
+/// Replays a quantized archive, as ArchiveSequence does a packed one.
+class QuantizedArchiveSequence : public Sequence {
+ public:
+  QuantizedArchiveSequence(const std::string &path, const Options &options, std::function<Sequence::Ptr()> make_source);
+
+  int currFrame() const override { return curr_frame_; }
+  int numFrames() const override { return last_frame_ - init_frame_; }
+  void setInitFrame(int frame_index) override;
+  bool hasNext() const override { return curr_frame_ < last_frame_; }
+  DataFrame next() override;
+  bool withRandomAccess() const override { return true; }
+  std::vector<Point3D> frame(size_t index) const override { return read(index, false).pointcloud; }
+  DataFrame frameAt(size_t index) const override { return read(index); }
+
+  void save(const std::string &path, const Trajectory &trajectory) const override {
+    source()->save(path, trajectory);
+  }
+
+  bool hasGroundTruth() const override { return header_->flags & ArchiveHeader::kHasGroundTruth; }
+  ArrayPoses groundTruthPoses() const override {
+    return readGroundTruth(file_.data() + header_->gt_offset, header_->num_gt_poses);
+  }
+  SeqError evaluate(const std::string &path, const Trajectory &trajectory) const override {
+    return source()->evaluate(path, trajectory);
+  }
+  SeqError evaluate(const std::string &path) const override { return source()->evaluate(path); }
+
+ private:
+  DataFrame read(size_t index, bool with_measurements = true) const;
+  const Sequence::Ptr &source() const;
+
+  const MappedFile file_;
+  const QuantizedArchiveHeader *header_;
+  const QuantizedArchiveFrame *index_;
+  int init_frame_;
+  int curr_frame_;
+  int last_frame_;  // exclusive bound
+
+  const std::function<Sequence::Ptr()> make_source_;
+  mutable std::once_flag source_once_;
+  mutable Sequence::Ptr source_;
+};
+
+}  // namespace steam_icp
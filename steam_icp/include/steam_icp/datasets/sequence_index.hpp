@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "steam_icp/utils/csv.hpp"
+#include "steam_icp/utils/mapped_file.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief What a sequence needs before serving its first frame, cached in a small binary file so that only the first
+ * run pays for it: the sorted names of the frame files of a directory with their timestamps (the leading digits of
+ * the name, 0 if none), and for each measurement CSV, the timestamp (first column) and byte offset of every
+ * kCsvStride-th row. Measurements are then parsed only for the rows around each frame (rowsBetween), out of a CSV
+ * mapped without being read. The cache is rebuilt when the directory or a CSV no longer has the size and
+ * modification time it recorded; failing to write it, or an empty cache_path, only costs the next run a rebuild.
+ */
+class SequenceIndex {
+ public:
+  static constexpr size_t kCsvStride = 64;
+
+  struct Csv {
+    std::string path;  // a CSV that does not exist has no rows
+    size_t skip_rows = 1;
+    size_t num_columns = 0;
+    char delimiter = ',';
+  };
+
+  SequenceIndex(const std::string &frames_dir, const std::vector<Csv> &csvs, const std::string &cache_path);
+
+  size_t size() const { return filenames_.size(); }
+  const std::vector<std::string> &filenames() const { return filenames_; }
+  const std::vector<int64_t> &timestamps() const { return timestamps_; }
+
+  /// Rows of CSV csv, sorted by their first column t, including at least every row with tmin <= t < tmax.
+  CsvTable rowsBetween(size_t csv, double tmin, double tmax) const;
+
+ private:
+  struct CsvRows {
+    Csv csv;
+    std::unique_ptr<MappedFile> file;
+    std::vector<double> timestamps;  // of rows 0, kCsvStride, 2 kCsvStride... then the end of the file
+    std::vector<uint64_t> offsets;
+  };
+
+  bool load(const std::string &cache_path);
+  void build(const std::string &frames_dir);
+  void save(const std::string &cache_path) const;
+
+  std::vector<std::string> filenames_;
+  std::vector<int64_t> timestamps_;
+  std::vector<CsvRows> csvs_;
+  std::vector<int64_t> stamps_;  // size and modification time of the directory and of each CSV
+};
+
+/// Where the index of the frames in <sequence>/<frames_dir> is cached: <index_dir>/<sequence>.<frames_dir>.index, or
+/// nowhere (empty, rebuilt every run) when there is no index_dir. The dataset tree itself is never written to.
+inline std::string sequenceIndexPath(const std::string &sequence, const std::string &frames_dir,
+                                     const std::string &index_dir) {
+  if (index_dir.empty()) return "";
+  return index_dir + "/" + sequence + "." + frames_dir + ".index";
+}
+
+}  // namespace steam_icp
@@ -1,11 +1,32 @@
 #pragma once
 
+#include <algorithm>
+
 #include <Eigen/Core>
 
 #include "steam_icp/dataset.hpp"
+#include "steam_icp/utils/csv.hpp"
 
 namespace steam_icp {
 
+/// Poses as rows of the 12 whitespace separated values of their upper 3x4 block (KITTI format).
+ArrayPoses loadKittiPoses(const std::string &file_path);
+
+/// Applanix poses of a Boreas sequence: a header, then timestamp, x, y, z, vx, vy, vz, roll, pitch, yaw per row.
+ArrayPoses loadBoreasPoses(const std::string &file_path);
+
+/// Boreas applanix/imu_raw.csv (timestamp, ang_vel z y x, lin_acc z y x) in the robot frame, x-forwards, y-left,
+/// z-up, timestamps relative to initial_timestamp_sec, out of its rows already parsed (7 columns, no header).
+std::vector<steam::IMUData> boreasImu(const CsvTable &table, double initial_timestamp_sec);
+
+/// Measurements of data, sorted by timestamp, with tmin <= timestamp < tmax, found by binary search.
+template <typename T>
+std::vector<T> measurementsBetween(const std::vector<T> &data, double tmin, double tmax) {
+  const auto before = [](const T &measurement, double t) { return measurement.timestamp < t; };
+  const auto first = std::lower_bound(data.begin(), data.end(), tmin, before);
+  return std::vector<T>(first, std::lower_bound(first, data.end(), tmax, before));
+}
+
 Sequence::SeqError evaluateOdometry(const std::string &filename, const ArrayPoses &poses_gt,
                                     const ArrayPoses &poses_estimated, int step_size = 10);
 
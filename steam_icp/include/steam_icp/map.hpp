@@ -177,6 +177,21 @@ class Map {
     }
   }
 
+  // Fraction of (every stride-th of) the raw points that fall into an occupied voxel once moved into the map by (R, t)
+  double overlap(const std::vector<Point3D> &points, const Eigen::Matrix3d &R, const Eigen::Vector3d &t,
+                 double voxel_size, int stride = 10) const {
+    if (points.empty() || voxel_map_.empty()) return 0.0;
+    size_t num_tested = 0, num_occupied = 0;
+    for (size_t i = 0; i < points.size(); i += stride) {
+      const Eigen::Vector3d pt = R * points[i].raw_pt + t;
+      const Voxel voxel(static_cast<short>(pt[0] / voxel_size), static_cast<short>(pt[1] / voxel_size),
+                        static_cast<short>(pt[2] / voxel_size));
+      if (voxel_map_.find(voxel) != voxel_map_.end()) ++num_occupied;
+      ++num_tested;
+    }
+    return static_cast<double>(num_occupied) / static_cast<double>(num_tested);
+  }
+
   using pair_distance_t = std::tuple<double, Eigen::Vector3d, Voxel>;
 
   struct Comparator {
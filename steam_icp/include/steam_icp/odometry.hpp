@@ -5,6 +5,11 @@
 #include "steam_icp/map.hpp"
 #include "steam_icp/pose.hpp"
 #include "steam_icp/trajectory.hpp"
+#include "steam_icp/utils/map_update_pipeline.hpp"
+#include "steam_icp/utils/map_update_scheduler.hpp"
+#include "steam_icp/utils/telemetry.hpp"
+#include "steam_icp/utils/thread_pool.hpp"
+#include "steam_icp/utils/timer_table.hpp"
 
 namespace steam_icp {
 
@@ -13,8 +18,6 @@ class Odometry {
   using Ptr = std::shared_ptr<Odometry>;
   using ConstPtr = std::shared_ptr<const Odometry>;
 
-  ArrayPoses T_i_r_gt_poses;
-
   struct Options {
     using Ptr = std::shared_ptr<Options>;
     using ConstPtr = std::shared_ptr<const Options>;
@@ -43,6 +46,24 @@ class Odometry {
     double threshold_translation_norm = 0.001;   // Threshold on translation (m) for ICP's stopping criterion
     int min_number_keypoints = 100;
 
+    // sliding window bounds (steam based odometry), older states are marginalized early when exceeded
+    int max_num_variables = 100;
+    int max_num_cost_terms = 100000;
+    double solve_time_budget_ms = 0.0;  // on the sliding window solve of the previous frame, 0 disables it
+
+    // map update scheduling, a frame is integrated into the map when any enabled criterion triggers (0 disables)
+    double keyframe_translation_threshold_m = 0.0;
+    double keyframe_rotation_threshold_deg = 0.0;
+    double keyframe_min_overlap = 0.0;  // fraction of the frame's points falling into occupied voxels
+    double keyframe_max_elapsed_s = 0.0;
+
+    // insert points into the map on a background thread, overlapping with the preprocessing of the next frame
+    bool pipelined_map_update = false;
+
+    // threads of the pool running every parallel loop of the odometry, including the calling thread
+    int num_threads = 1;
+    std::vector<int> thread_pool_cores;  // cores to pin the pool threads to, empty to not pin them
+
     //
     bool debug_print = false;  // Whether to output debug information to std::cout
     std::string debug_path = "/tmp/";
@@ -52,7 +73,14 @@ class Odometry {
     return name2Ctor().at(odometry)(options);
   }
 
-  Odometry(const Options &options) : options_(options) { map_.setDefaultLifeTime(options_.voxel_lifetime); }
+  Odometry(const Options &options)
+      : options_(options),
+        map_update_scheduler_({options.keyframe_translation_threshold_m, options.keyframe_rotation_threshold_deg,
+                               options.keyframe_min_overlap, options.keyframe_max_elapsed_s}),
+        map_pipeline_(options.pipelined_map_update),
+        thread_pool_(std::make_shared<ThreadPool>(options.num_threads, options.thread_pool_cores)) {
+    map_.setDefaultLifeTime(options_.voxel_lifetime);
+  }
   virtual ~Odometry() = default;
 
   // trajectory
@@ -60,8 +88,14 @@ class Odometry {
   virtual Trajectory trajectory() = 0;
 
   // map
-  size_t size() const { return map_.size(); }
-  ArrayVector3d map() const { return map_.pointcloud(); }
+  size_t size() const {
+    const auto lock = map_pipeline_.readLock();
+    return map_.size();
+  }
+  ArrayVector3d map() const {
+    const auto lock = map_pipeline_.readLock();
+    return map_.pointcloud();
+  }
 
   // The Output of a registration, including metrics,
   struct RegistrationSummary {
@@ -75,12 +109,62 @@ class Odometry {
   // Registers a new Frame to the Map with an initial estimate
   virtual RegistrationSummary registerFrame(const DataFrame &frame) = 0;
 
+  // Per frame latency of the registration stages, the caller closes each frame with nextFrame()
+  Telemetry &telemetry() const { return telemetry_; }
+
+  // Runs the parallel loops of the odometry, and those of the frame loader it is shared with (see Sequence), which
+  // keeps it alive for as long as it may still load frames
+  ThreadPool &threadPool() const { return *thread_pool_; }
+  std::shared_ptr<ThreadPool> sharedThreadPool() const { return thread_pool_; }
+
  protected:
+  // Whether update_frame should be integrated into the map. The points of a skipped frame are released right away.
+  bool scheduleMapUpdate(int update_frame) {
+    auto &frame = trajectory_[update_frame];
+    const bool update = map_update_scheduler_.shouldUpdate(frame.end_R, frame.end_t, frame.end_timestamp, [&] {
+      const auto lock = map_pipeline_.readLock();
+      return map_.overlap(frame.points, frame.end_R, frame.end_t, options_.size_voxel_map);
+    });
+    if (!update) {
+      frame.points.clear();
+      frame.points.shrink_to_fit();
+    }
+    return update;
+  }
+
+  // Adds deskewed points to the map, then drops the voxels farther than max_distance from location. With
+  // pipelined_map_update this returns right away and the map is updated in the background.
+  void addToMap(std::vector<Point3D> &&points, const Eigen::Vector3d &location, bool filter_lifetimes) {
+    map_pipeline_.submit([this, points = std::move(points), location, filter_lifetimes] {
+      map_.add(points, options_.size_voxel_map, options_.max_num_points_in_voxel, options_.min_distance_points);
+      if (filter_lifetimes) map_.update_and_filter_lifetimes();
+      map_.remove(location, options_.max_distance);
+    });
+  }
+
+  // Records the time accumulated by each timer during the frame as a sample of stage/<timer name>
+  void recordTimers(const std::string &stage, const TimerTable &timers) const {
+    for (size_t i = 0; i < timers.size(); ++i)
+      telemetry_.add(stage + "/" + Telemetry::stageName(timers.name(i)),
+                     timers[i].count<std::chrono::microseconds>() * 1.0e-3);
+  }
+
+  // Runs func, the registration against the map, once pending map updates landed and with the map read-locked.
+  template <typename Func>
+  auto readMap(Func &&func) {
+    return map_pipeline_.read(std::forward<Func>(func));
+  }
+
   Trajectory trajectory_;
   Map map_;
 
  private:
   const Options options_;
+  MapUpdateScheduler map_update_scheduler_;
+  // declared after map_ so that pending updates land before the map is destroyed
+  mutable MapUpdatePipeline map_pipeline_;
+  std::shared_ptr<ThreadPool> thread_pool_;
+  mutable Telemetry telemetry_;
 
  private:
   using CtorFunc = std::function<Ptr(const Options &)>;
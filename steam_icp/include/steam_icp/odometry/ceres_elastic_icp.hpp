@@ -23,7 +23,6 @@ class CeresElasticOdometry : public Odometry {
     int max_iterations = 5;
     double weight_alpha = 0.9;
     double weight_neighborhood = 0.1;
-    int num_threads = 1;
   };
 
   CeresElasticOdometry(const Options &options);
@@ -10,6 +10,7 @@
 #include "steam/problem/cost_term/preintegrated_accel_cost_term.hpp"
 #include "steam/problem/cost_term/p2p_global_perturb_super_cost_term.hpp"
 #include "steam_icp/odometry.hpp"
+#include "steam_icp/utils/marginalization_policy.hpp"
 
 namespace steam_icp {
 
@@ -28,7 +29,6 @@ class DiscreteLIOOdometry : public Odometry {
     // optimization
     bool verbose = false;
     int max_iterations = 5;
-    unsigned int num_threads = 1;
     //
     int delay_adding_points = 4;
     // Gyro
@@ -55,8 +55,6 @@ class DiscreteLIOOdometry : public Odometry {
     bool filter_lifetimes = false;
     bool swf_inside_icp_at_begin = true;
     bool break_icp_early = false;
-    double keyframe_translation_threshold_m = 0.0;
-    double keyframe_rotation_threshold_deg = 0.0;
     bool use_line_search = false;
     Eigen::Matrix<double, 6, 1> r_pose = Eigen::Matrix<double, 6, 1>::Zero();
   };
@@ -100,13 +98,14 @@ class DiscreteLIOOdometry : public Odometry {
   };
   std::vector<TrajectoryVar> trajectory_vars_;
   size_t to_marginalize_ = 0;
+  size_t marginalized_until_ = 0;  // states before this index already left the window early
 
 
   steam::SlidingWindowFilter::Ptr sliding_window_filter_;
+  MarginalizationPolicy marginalization_policy_{
+      {options_.max_num_variables, options_.max_num_cost_terms, options_.solve_time_budget_ms}};
   std::vector<steam::IMUData> prev_imu_data_vec_;
 
-  Eigen::Vector3d t_prev_ = Eigen::Vector3d::Zero();
-  Eigen::Matrix3d r_prev_ = Eigen::Matrix3d::Identity();
   Eigen::Vector3d gravity_ = {0, 0, -9.8042};
 
   STEAM_ICP_REGISTER_ODOMETRY("DiscreteLIO", DiscreteLIOOdometry);
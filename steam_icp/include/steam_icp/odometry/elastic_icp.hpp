@@ -8,13 +8,16 @@ namespace steam_icp {
 
 class ElasticOdometry : public Odometry {
  public:
+  enum class LOSS_FUNC { L2, DCS, CAUCHY, GM };
+
   struct Options : public Odometry::Options {
     double power_planarity = 2.0;
+    LOSS_FUNC p2p_loss_func = LOSS_FUNC::L2;  // robust reweighting of point-to-plane residuals
+    double p2p_loss_sigma = 0.1;
     double beta_location_consistency = 0.001;
     double beta_constant_velocity = 0.001;
     double max_dist_to_plane = 0.3;
     double convergence_threshold = 0.0001;
-    int num_threads = 1;
   };
 
   ElasticOdometry(const Options &options);
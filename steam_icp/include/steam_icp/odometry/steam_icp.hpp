@@ -4,6 +4,7 @@
 
 #include "steam.hpp"
 #include "steam_icp/odometry.hpp"
+#include "steam_icp/utils/marginalization_policy.hpp"
 
 namespace steam_icp {
 
@@ -32,7 +33,6 @@ class SteamOdometry : public Odometry {
     // optimization
     bool verbose = false;
     int max_iterations = 5;
-    unsigned int num_threads = 1;
     //
     int delay_adding_points = 4;
     bool use_final_state_value = false;
@@ -69,8 +69,11 @@ class SteamOdometry : public Odometry {
   };
   std::vector<TrajectoryVar> trajectory_vars_;
   size_t to_marginalize_ = 0;
+  size_t marginalized_until_ = 0;  // states before this index already left the window early
 
   steam::SlidingWindowFilter::Ptr sliding_window_filter_;
+  MarginalizationPolicy marginalization_policy_{
+      {options_.max_num_variables, options_.max_num_cost_terms, options_.solve_time_budget_ms}};
 
   STEAM_ICP_REGISTER_ODOMETRY("STEAM", SteamOdometry);
 };
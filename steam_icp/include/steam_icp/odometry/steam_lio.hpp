@@ -8,6 +8,8 @@
 #include "steam/problem/cost_term/p2p_super_cost_term.hpp"
 #include "steam/solver/gauss_newton_solver_nva.hpp"
 #include "steam_icp/odometry.hpp"
+#include "steam_icp/utils/cost_term_pool.hpp"
+#include "steam_icp/utils/marginalization_policy.hpp"
 
 namespace steam_icp {
 
@@ -39,7 +41,6 @@ class SteamLioOdometry : public Odometry {
     // optimization
     bool verbose = false;
     int max_iterations = 5;
-    unsigned int num_threads = 1;
     //
     int delay_adding_points = 4;
     bool use_final_state_value = false;
@@ -114,10 +115,21 @@ class SteamLioOdometry : public Odometry {
   };
   std::vector<TrajectoryVar> trajectory_vars_;
   size_t to_marginalize_ = 0;
+  size_t marginalized_until_ = 0;  // states before this index already left the window early
 
   std::map<double, std::pair<Matrix18d, Matrix18d>> interp_mats_;
 
   steam::SlidingWindowFilter::Ptr sliding_window_filter_;
+  MarginalizationPolicy marginalization_policy_{
+      {options_.max_num_variables, options_.max_num_cost_terms, options_.solve_time_budget_ms}};
+
+  // IMU noise models and losses are fixed by the options and shared by every measurement
+  steam::StaticNoiseModel<3>::Ptr acc_noise_model_;
+  steam::StaticNoiseModel<3>::Ptr gyro_noise_model_;
+  steam::BaseLossFunc::Ptr acc_loss_func_;
+  steam::BaseLossFunc::Ptr gyro_loss_func_;
+  steam::StaticNoiseModel<6>::Ptr bias_noise_model_;
+  CostTermPool::Ptr cost_term_pool_ = CostTermPool::MakeShared();
 
   STEAM_ICP_REGISTER_ODOMETRY("STEAMLIO", SteamLioOdometry);
 };
@@ -8,6 +8,7 @@
 #include "steam/problem/cost_term/p2p_const_vel_super_cost_term.hpp"
 #include "steam/problem/cost_term/preintegrated_accel_cost_term.hpp"
 #include "steam_icp/odometry.hpp"
+#include "steam_icp/utils/marginalization_policy.hpp"
 
 namespace steam_icp {
 
@@ -37,7 +38,6 @@ class SteamLoOdometry : public Odometry {
     // optimization
     bool verbose = false;
     int max_iterations = 5;
-    unsigned int num_threads = 1;
     //
     int delay_adding_points = 4;
     bool use_final_state_value = false;
@@ -64,8 +64,6 @@ class SteamLoOdometry : public Odometry {
     bool swf_inside_icp_at_begin = true;
     bool break_icp_early = false;
     bool use_elastic_initialization = false;
-    double keyframe_translation_threshold_m = 0.0;
-    double keyframe_rotation_threshold_deg = 0.0;
     bool use_line_search = false;
     bool use_pointtopoint_factors = false;
   };
@@ -105,13 +103,13 @@ class SteamLoOdometry : public Odometry {
   };
   std::vector<TrajectoryVar> trajectory_vars_;
   size_t to_marginalize_ = 0;
+  size_t marginalized_until_ = 0;  // states before this index already left the window early
 
   std::map<double, std::pair<Matrix12d, Matrix12d>> interp_mats_;
 
   steam::SlidingWindowFilter::Ptr sliding_window_filter_;
-
-  Eigen::Vector3d t_prev_ = Eigen::Vector3d::Zero();
-  Eigen::Matrix3d r_prev_ = Eigen::Matrix3d::Identity();
+  MarginalizationPolicy marginalization_policy_{
+      {options_.max_num_variables, options_.max_num_cost_terms, options_.solve_time_budget_ms}};
 
   STEAM_ICP_REGISTER_ODOMETRY("STEAMLO", SteamLoOdometry);
 };
@@ -37,7 +37,6 @@ class SteamLoCVOdometry : public Odometry {
     // optimization
     bool verbose = false;
     int max_iterations = 5;
-    unsigned int num_threads = 1;
     //
     int delay_adding_points = 4;
     bool use_final_state_value = false;
@@ -62,8 +61,6 @@ class SteamLoCVOdometry : public Odometry {
     bool swf_inside_icp_at_begin = true;
     bool break_icp_early = false;
     bool use_elastic_initialization = false;
-    double keyframe_translation_threshold_m = 0.0;
-    double keyframe_rotation_threshold_deg = 0.0;
     bool use_line_search = false;
   };
 
@@ -107,9 +104,6 @@ class SteamLoCVOdometry : public Odometry {
 
   steam::SlidingWindowFilter::Ptr sliding_window_filter_;
 
-  Eigen::Vector3d t_prev_ = Eigen::Vector3d::Zero();
-  Eigen::Matrix3d r_prev_ = Eigen::Matrix3d::Identity();
-
   STEAM_ICP_REGISTER_ODOMETRY("STEAMLOCV", SteamLoCVOdometry);
 };
 
@@ -8,6 +8,7 @@
 #include "steam/problem/cost_term/p2p_doppler_const_acc_super_cost_term.hpp"
 #include "steam/solver/gauss_newton_solver_nva.hpp"
 #include "steam_icp/odometry.hpp"
+#include "steam_icp/utils/marginalization_policy.hpp"
 
 namespace steam_icp {
 
@@ -30,7 +31,6 @@ class SteamRioOdometry : public Odometry {
     // optimization
     bool verbose = false;
     int max_iterations = 5;
-    unsigned int num_threads = 1;
     //
     int delay_adding_points = 4;
     bool use_final_state_value = false;
@@ -95,10 +95,13 @@ class SteamRioOdometry : public Odometry {
   };
   std::vector<TrajectoryVar> trajectory_vars_;
   size_t to_marginalize_ = 0;
+  size_t marginalized_until_ = 0;  // states before this index already left the window early
 
   std::map<double, std::pair<Matrix18d, Matrix18d>> interp_mats_;
 
   steam::SlidingWindowFilter::Ptr sliding_window_filter_;
+  MarginalizationPolicy marginalization_policy_{
+      {options_.max_num_variables, options_.max_num_cost_terms, options_.solve_time_budget_ms}};
 
   STEAM_ICP_REGISTER_ODOMETRY("STEAMRIO", SteamRioOdometry);
 };
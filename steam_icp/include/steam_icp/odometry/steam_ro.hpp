@@ -7,6 +7,8 @@
 #include "steam/problem/cost_term/p2p_doppler_const_vel_super_cost_term.hpp"
 #include "steam/problem/cost_term/preintegrated_accel_cost_term.hpp"
 #include "steam_icp/odometry.hpp"
+#include "steam_icp/utils/cost_term_pool.hpp"
+#include "steam_icp/utils/marginalization_policy.hpp"
 
 namespace steam_icp {
 
@@ -17,6 +19,7 @@ class SteamRoOdometry : public Odometry {
   enum class STEAM_LOSS_FUNC { L2, DCS, CAUCHY, GM, HUBER };
 
   struct Options : public Odometry::Options {
+    Options() { keyframe_translation_threshold_m = 1.0; }
     // sensor vehicle transformation
     Eigen::Matrix<double, 4, 4> T_sr = Eigen::Matrix<double, 4, 4>::Identity();
     // trajectory
@@ -37,7 +40,6 @@ class SteamRoOdometry : public Odometry {
     // optimization
     bool verbose = false;
     int max_iterations = 5;
-    unsigned int num_threads = 1;
     //
     int delay_adding_points = 4;
     bool use_final_state_value = false;
@@ -48,6 +50,7 @@ class SteamRoOdometry : public Odometry {
     bool use_imu = false;
     bool use_accel = false;
     double r_imu_ang = 1.0;
+    bool preint_gyro = false;  // one integrated heading-change factor per knot interval instead of one per sample
     double p0_bias_gyro = 0.0001;
     double q_bias_gyro = 0.0001;
     // Accelerometer
@@ -57,7 +60,6 @@ class SteamRoOdometry : public Odometry {
     Eigen::Matrix<double, 3, 1> q_bias_accel = Eigen::Matrix<double, 3, 1>::Ones();
     std::string acc_loss_func = "L2";
     double acc_loss_sigma = 1.0;
-    double keyframe_translation_threshold_m = 1.0;
     bool use_line_search = false;
     bool break_icp_early = false;
   };
@@ -95,12 +97,20 @@ class SteamRoOdometry : public Odometry {
   };
   std::vector<TrajectoryVar> trajectory_vars_;
   size_t to_marginalize_ = 0;
+  size_t marginalized_until_ = 0;  // states before this index already left the window early
 
   std::map<double, std::pair<Matrix12d, Matrix12d>> interp_mats_;
 
   steam::SlidingWindowFilter::Ptr sliding_window_filter_;
-
-  Eigen::Vector3d t_prev_ = Eigen::Vector3d::Zero();
+  MarginalizationPolicy marginalization_policy_{
+      {options_.max_num_variables, options_.max_num_cost_terms, options_.solve_time_budget_ms}};
+
+  // noise models and loss functions only depend on options, build them once and share them across frames
+  steam::StaticNoiseModel<1>::Ptr gyro_noise_model_;
+  steam::BaseLossFunc::Ptr gyro_loss_func_;
+  steam::StaticNoiseModel<6>::Ptr bias_noise_model_;
+  // per-measurement cost terms are recycled from here instead of the heap
+  CostTermPool::Ptr cost_term_pool_ = CostTermPool::MakeShared();
 
   STEAM_ICP_REGISTER_ODOMETRY("STEAMRO", SteamRoOdometry);
 };
@@ -22,6 +22,7 @@
 
 #include "opencv2/opencv.hpp"
 #include "steam_icp/point.hpp"
+#include "steam_icp/utils/thread_pool.hpp"
 
 namespace steam_icp {
 
@@ -38,14 +39,15 @@ class Detector {
 class ModifiedCACFAR : public Detector /*<PointT>*/ {
  public:
   ModifiedCACFAR() = default;
-  ModifiedCACFAR(int width, int guard, double threshold, double threshold2, double threshold3, int num_threads,
+  /// Rows (azimuths) are processed on thread_pool when given, which must outlive the detector.
+  ModifiedCACFAR(int width, int guard, double threshold, double threshold2, double threshold3, ThreadPool *thread_pool,
                  double minr, double maxr, double range_offset, int64_t initial_timestamp_micro)
       : width_(width),
         guard_(guard),
         threshold_(threshold),
         threshold2_(threshold2),
         threshold3_(threshold3),
-        num_threads_(num_threads),
+        thread_pool_(thread_pool),
         minr_(minr),
         maxr_(maxr),
         range_offset_(range_offset),
@@ -60,7 +62,7 @@ class ModifiedCACFAR : public Detector /*<PointT>*/ {
   double threshold_ = 3.0;
   double threshold2_ = 1.1;
   double threshold3_ = 0.22;
-  int num_threads_ = 1;
+  ThreadPool *thread_pool_ = nullptr;
   double minr_ = 2.0;
   double maxr_ = 100.0;
   double range_offset_ = -0.31;
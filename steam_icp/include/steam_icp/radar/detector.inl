@@ -43,10 +43,7 @@ std::vector<Point3D> ModifiedCACFAR::run(const cv::Mat &raw_scan, const float &r
 
   const double time_delta = azimuth_times.back() - azimuth_times.front();
 
-#pragma omp declare reduction(merge_points : std::vector<Point3D> : omp_out.insert( \
-        omp_out.end(), omp_in.begin(), omp_in.end())) initializer(omp_priv = decltype(omp_orig)(omp_orig.size()))
-#pragma omp parallel for num_threads(num_threads_) reduction(merge_points : raw_points)
-  for (int i = 0; i < rows; ++i) {
+  const auto detect = [&](size_t i, std::vector<Point3D> &points) {
     const double azimuth = azimuth_angles[i];
     const double time = (azimuth_times[i] - initial_timestamp_) * 1.0e-6;
     const double alpha_time = std::min(1.0, std::max(0.0, 1 - (azimuth_times.back() - azimuth_times[i]) / time_delta));
@@ -81,11 +78,18 @@ std::vector<Point3D> ModifiedCACFAR::run(const cv::Mat &raw_scan, const float &r
         p.timestamp = time;
         p.alpha_timestamp = alpha_time;
         p.radial_velocity = rho;
-        raw_points.push_back(p);
+        points.push_back(p);
         peak_points = 0;
         num_peak_points = 0;
       }
     }
+  };
+  if (thread_pool_ != nullptr) {
+    auto points = thread_pool_->parallelReduce("cacfar.rows", 0, rows, std::vector<Point3D>(), detect,
+                                               ThreadPool::Append());
+    ThreadPool::Append()(raw_points, std::move(points));
+  } else {
+    for (int i = 0; i < rows; ++i) detect(i, raw_points);
   }
 
   raw_points.shrink_to_fit();
@@ -20,6 +20,8 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "steam_icp/utils/thread_pool.hpp"
+
 // #include "vtr_radar/data_types/point.hpp"
 
 namespace steam_icp {
@@ -27,8 +29,16 @@ namespace steam_icp {
 void load_radar(const std::string &path, std::vector<int64_t> &timestamps, std::vector<double> &azimuths,
                 cv::Mat &fft_data);
 
+/**
+ * \brief Splits a raw scan into its azimuth timestamps and angles and its power returns normalized to [0, 1].
+ * The outputs are only reallocated when the scan size changes, so buffers kept across scans are reused. Rows are
+ * processed on thread_pool when given.
+ */
 void load_radar(const cv::Mat &raw_data, std::vector<int64_t> &timestamps, std::vector<double> &azimuths,
-                cv::Mat &fft_data);
+                cv::Mat &fft_data, ThreadPool *thread_pool = nullptr);
+
+/** \brief Decodes the png of a raw scan into raw_data (grayscale), reusing its buffer when the size matches */
+void decode_radar(const std::string &path, cv::Mat &raw_data);
 
 /** \brief Returns the cartesian image of a radar scan */
 // clang-format off
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <glog/logging.h>
+
+#include "steam_icp/utils/trace.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Runs a callback on a dedicated thread for every task pushed to it. Tasks are moved in and out of the queue,
+ * never copied. The queue holds at most depth tasks: under backpressure the oldest (stalest) one is dropped, so the
+ * pushing thread never waits on the callback. Pending tasks are discarded on destruction.
+ */
+template <typename Task>
+class AsyncWorker {
+ public:
+  using Callback = std::function<void(Task &&)>;
+
+  AsyncWorker(size_t depth, Callback callback)
+      : depth_(std::max<size_t>(depth, 1)), callback_(std::move(callback)), thread_(&AsyncWorker::run, this) {}
+
+  ~AsyncWorker() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  AsyncWorker(const AsyncWorker &) = delete;
+  AsyncWorker &operator=(const AsyncWorker &) = delete;
+
+  void push(Task &&task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (queue_.size() >= depth_) {
+        queue_.pop_front();
+        num_dropped_++;
+      }
+      queue_.emplace_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  size_t numDropped() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_dropped_;
+  }
+
+ private:
+  void run() {
+    STEAM_ICP_TRACE_THREAD_NAME("async worker");
+    while (true) {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (stop_) return;
+        task = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      try {
+        STEAM_ICP_TRACE_SCOPE("async task");
+        callback_(std::move(task));
+      } catch (const std::exception &e) {
+        LOG(WARNING) << "async worker task failed: " << e.what() << std::endl;
+      }
+    }
+  }
+
+  const size_t depth_;
+  const Callback callback_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Task> queue_;
+  size_t num_dropped_ = 0;
+  bool stop_ = false;
+
+  // started last, once every member above is initialized
+  std::thread thread_;
+};
+
+}  // namespace steam_icp
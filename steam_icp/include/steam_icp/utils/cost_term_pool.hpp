@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace steam_icp {
+
+/**
+ * \brief Size-class free-list pool for the small, short-lived objects created per measurement (cost terms, error
+ * evaluators, interpolators). Blocks released by the previous frame are recycled by the next one, so in steady state no
+ * call reaches the system allocator. Chunks are only returned to the system when the pool itself is destroyed; objects
+ * created through make() keep the pool alive through their allocator.
+ *
+ * The pool is not thread safe: each odometry owns one, and its objects are made and released on the thread that
+ * registers frames, never from the workers of a parallel loop.
+ */
+class CostTermPool : public std::enable_shared_from_this<CostTermPool> {
+ public:
+  using Ptr = std::shared_ptr<CostTermPool>;
+
+  static Ptr MakeShared(size_t blocks_per_chunk = 1024) { return Ptr(new CostTermPool(blocks_per_chunk)); }
+
+  ~CostTermPool() {
+    for (void *chunk : chunks_) ::operator delete(chunk, std::align_val_t(kAlignment));
+  }
+
+  template <typename T>
+  class Allocator {
+   public:
+    using value_type = T;
+
+    explicit Allocator(const Ptr &pool) : pool_(pool) {}
+    template <typename U>
+    Allocator(const Allocator<U> &other) : pool_(other.pool_) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(pool_->allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { pool_->deallocate(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const Allocator<U> &other) const {
+      return pool_ == other.pool_;
+    }
+    template <typename U>
+    bool operator!=(const Allocator<U> &other) const {
+      return pool_ != other.pool_;
+    }
+
+   private:
+    template <typename U>
+    friend class Allocator;
+    Ptr pool_;
+  };
+
+  /// Equivalent of T::MakeShared(args...) with the object and its control block taken from the pool.
+  template <typename T, typename... Args>
+  std::shared_ptr<T> make(Args &&...args) {
+    return std::allocate_shared<T>(Allocator<T>(shared_from_this()), std::forward<Args>(args)...);
+  }
+
+  void *allocate(size_t bytes) {
+    const size_t size = roundUp(bytes);
+    if (size > kMaxBlockSize) return ::operator new(size, std::align_val_t(kAlignment));
+    auto &free_list = free_lists_[size];
+    if (free_list.empty()) refill(free_list, size);
+    void *p = free_list.back();
+    free_list.pop_back();
+    return p;
+  }
+
+  void deallocate(void *p, size_t bytes) {
+    const size_t size = roundUp(bytes);
+    if (size > kMaxBlockSize) return ::operator delete(p, std::align_val_t(kAlignment));
+    free_lists_[size].push_back(p);
+  }
+
+  size_t numChunks() const { return chunks_.size(); }
+
+ private:
+  // large enough for fixed-size Eigen members under AVX
+  static constexpr size_t kAlignment = 32;
+  static constexpr size_t kMaxBlockSize = 1024;
+
+  explicit CostTermPool(size_t blocks_per_chunk) : blocks_per_chunk_(blocks_per_chunk) {}
+
+  static size_t roundUp(size_t bytes) { return (bytes + kAlignment - 1) / kAlignment * kAlignment; }
+
+  void refill(std::vector<void *> &free_list, size_t size) {
+    char *chunk = static_cast<char *>(::operator new(size * blocks_per_chunk_, std::align_val_t(kAlignment)));
+    chunks_.emplace_back(chunk);
+    free_list.reserve(free_list.size() + blocks_per_chunk_);
+    for (size_t i = 0; i < blocks_per_chunk_; ++i) free_list.emplace_back(chunk + i * size);
+  }
+
+  const size_t blocks_per_chunk_;
+  std::unordered_map<size_t, std::vector<void *>> free_lists_;
+  std::vector<void *> chunks_;
+};
+
+}  // namespace steam_icp
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "steam_icp/utils/mapped_file.hpp"
+
+namespace steam_icp {
+
+/// Parses the double at the beginning of [first, last) into value, returning the end of the number or nullptr when
+/// there is none. std::from_chars where the standard library has it for floating point (GCC 11 on), otherwise strtod
+/// on a bounded, null terminated copy, which is locale dependent (the decimal point is the "C" locale's by default).
+inline const char *parseDouble(const char *first, const char *last, double &value) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  const auto [next, ec] = std::from_chars(first, last, value);
+  return ec == std::errc() ? next : nullptr;
+#else
+  char buffer[64];
+  const size_t size = std::min<size_t>(last - first, sizeof(buffer) - 1);
+  std::memcpy(buffer, first, size);
+  buffer[size] = '\0';
+  char *next = nullptr;
+  const double parsed = std::strtod(buffer, &next);
+  if (next == buffer) return nullptr;
+  value = parsed;
+  return first + (next - buffer);
+#endif
+}
+
+/**
+ * \brief Numeric table read out of a delimited text file (CSV, or whitespace separated with delimiter ' '). The file is
+ * mapped, split into lines, then every line is parsed with parseDouble straight into one preallocated row-major
+ * array. Blank lines are skipped; missing or non-numeric fields read as NaN and fields past num_columns are ignored.
+ */
+class CsvTable {
+ public:
+  struct Options {
+    char delimiter = ',';
+    size_t skip_rows = 0;    // header lines
+    size_t num_columns = 0;  // 0 takes the number of fields of the first row
+  };
+
+  CsvTable() = default;
+
+  explicit CsvTable(const std::string &path) : CsvTable(path, Options{}) {}
+
+  CsvTable(const std::string &path, const Options &options) {
+    const MappedFile file(path);
+    parse(file.data(), file.data() + file.size(), options);
+  }
+
+  /// Table of the lines in [data, end), e.g. a range of rows of a mapped file, header lines being skipped from data.
+  CsvTable(const char *data, const char *end, const Options &options) { parse(data, end, options); }
+
+  size_t rows() const { return rows_; }
+  size_t cols() const { return cols_; }
+  double operator()(size_t row, size_t col) const { return values_[row * cols_ + col]; }
+  const double *row(size_t row) const { return values_.data() + row * cols_; }
+
+ private:
+  void parse(const char *const data, const char *const end, const Options &options) {
+    // line boundaries, minus the header and blank lines
+    std::vector<std::pair<const char *, const char *>> lines;
+    lines.reserve((end - data) / 32);
+    size_t skipped = 0;
+    for (const char *p = data; p < end;) {
+      const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+      if (eol == nullptr) eol = end;
+      const char *last = eol;
+      while (last > p && (last[-1] == '\r' || last[-1] == ' ' || last[-1] == '\t')) --last;
+      if (skipped < options.skip_rows)
+        skipped++;
+      else if (last > p)
+        lines.emplace_back(p, last);
+      p = eol + 1;
+    }
+
+    delimiter_ = options.delimiter;
+    rows_ = lines.size();
+    cols_ = options.num_columns > 0 ? options.num_columns : (rows_ > 0 ? countFields(lines[0].first, lines[0].second) : 0);
+    values_.assign(rows_ * cols_, std::numeric_limits<double>::quiet_NaN());
+    for (size_t i = 0; i < rows_; ++i) parseRow(lines[i].first, lines[i].second, values_.data() + i * cols_);
+  }
+
+  bool isDelimiter(char c) const { return c == delimiter_ || (delimiter_ == ' ' && c == '\t'); }
+
+  static const char *skipBlanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+  }
+
+  size_t countFields(const char *p, const char *end) const {
+    size_t count = 0;
+    while (true) {
+      p = skipBlanks(p, end);
+      if (p >= end) return count;
+      count++;
+      while (p < end && !isDelimiter(*p)) ++p;
+      if (p >= end) return count;
+      ++p;
+    }
+  }
+
+  void parseRow(const char *p, const char *end, double *out) const {
+    for (size_t c = 0; c < cols_; ++c) {
+      p = skipBlanks(p, end);
+      if (p >= end) return;
+      if (*p == '+') ++p;
+      if (const char *next = parseDouble(p, end, out[c])) p = next;
+      // to the next field, a field that did not parse stays NaN
+      while (p < end && !isDelimiter(*p)) ++p;
+      if (p < end) ++p;
+    }
+  }
+
+  char delimiter_ = ',';
+  size_t rows_ = 0;
+  size_t cols_ = 0;
+  std::vector<double> values_;
+};
+
+}  // namespace steam_icp
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+#include "steam.hpp"
+
+namespace steam_icp {
+
+/// Robust loss kernels: the weights of the steam loss functions, evaluated inline on the squared whitened error. They
+/// are selected once per frame through dispatchLossKernel so that per-residual loops are instantiated per loss type
+/// (no virtual call, no branch, no allocation per point); ElasticOdometry reweights its normal equations with them.
+/// The STEAM odometries evaluate their residuals inside steam cost terms, which take a steam::BaseLossFunc: for those
+/// the kernel only builds the loss, once per frame (makeSteamLoss). bench/loss_kernels.cpp times both per loss type.
+namespace loss {
+
+struct L2Kernel {
+  explicit L2Kernel(double /* sigma */ = 1.0) {}
+  inline double weight(double /* e2 */) const { return 1.0; }
+  steam::BaseLossFunc::Ptr steamLoss() const { return steam::L2LossFunc::MakeShared(); }
+};
+
+struct DcsKernel {
+  explicit DcsKernel(double sigma) : k(sigma), k2(sigma * sigma) {}
+  inline double weight(double e2) const {
+    const double d = k2 + e2;
+    return e2 <= k2 ? 1.0 : 4.0 * k2 * k2 / (d * d);
+  }
+  steam::BaseLossFunc::Ptr steamLoss() const { return steam::DcsLossFunc::MakeShared(k); }
+  double k, k2;
+};
+
+struct CauchyKernel {
+  explicit CauchyKernel(double sigma) : k(sigma), k2(sigma * sigma), inv_k2(1.0 / (sigma * sigma)) {}
+  inline double weight(double e2) const { return 1.0 / (1.0 + e2 * inv_k2); }
+  steam::BaseLossFunc::Ptr steamLoss() const { return steam::CauchyLossFunc::MakeShared(k); }
+  double k, k2, inv_k2;
+};
+
+struct GemanMcClureKernel {
+  explicit GemanMcClureKernel(double sigma) : k(sigma), k2(sigma * sigma) {}
+  inline double weight(double e2) const {
+    const double d = k2 + e2;
+    return k2 * k2 / (d * d);
+  }
+  steam::BaseLossFunc::Ptr steamLoss() const { return steam::GemanMcClureLossFunc::MakeShared(k); }
+  double k, k2;
+};
+
+struct HuberKernel {
+  explicit HuberKernel(double sigma) : k(sigma), k2(sigma * sigma) {}
+  inline double weight(double e2) const { return e2 < k2 ? 1.0 : k / std::sqrt(e2); }
+  steam::BaseLossFunc::Ptr steamLoss() const { return steam::HuberLossFunc::MakeShared(k); }
+  double k, k2;
+};
+
+/// Whether LossEnum has a HUBER value, which only some of the odometries offer.
+template <typename LossEnum, typename = void>
+struct HasHuber : std::false_type {};
+template <typename LossEnum>
+struct HasHuber<LossEnum, std::void_t<decltype(LossEnum::HUBER)>> : std::true_type {};
+
+/// Calls func(kernel) with the kernel matching loss_func; LossEnum is any of the odometry STEAM_LOSS_FUNC enums.
+template <typename LossEnum, typename Func>
+decltype(auto) dispatchLossKernel(LossEnum loss_func, double sigma, Func &&func) {
+  if constexpr (HasHuber<LossEnum>::value) {
+    if (loss_func == LossEnum::HUBER) return func(HuberKernel(sigma));
+  }
+  switch (loss_func) {
+    case LossEnum::L2:
+      return func(L2Kernel(sigma));
+    case LossEnum::DCS:
+      return func(DcsKernel(sigma));
+    case LossEnum::CAUCHY:
+      return func(CauchyKernel(sigma));
+    case LossEnum::GM:
+      return func(GemanMcClureKernel(sigma));
+    default:
+      throw std::invalid_argument("unsupported loss function");
+  }
+}
+
+/// Builds the steam loss function once so that it can be shared by all cost terms of a frame. Every odometry builds
+/// its steam losses here rather than switching on its enum itself.
+template <typename LossEnum>
+steam::BaseLossFunc::Ptr makeSteamLoss(LossEnum loss_func, double sigma) {
+  return dispatchLossKernel(loss_func, sigma, [](const auto &kernel) { return kernel.steamLoss(); });
+}
+
+}  // namespace loss
+
+}  // namespace steam_icp
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "steam_icp/utils/trace.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Serializes writes to and reads from the map. Map updates submitted to it run on a dedicated thread, so the
+ * insertion of an older frame overlaps with the preprocessing of the next one; reads wait for the pending update to
+ * land and then hold a shared lock. When disabled, updates run inline and nothing changes compared to a plain map.
+ * Tracks the busy time of the reading (ICP) and writing (map update) stages and the time spent stalled on each other.
+ */
+class MapUpdatePipeline {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit MapUpdatePipeline(bool enabled) : enabled_(enabled) {
+    if (enabled_) thread_ = std::thread(&MapUpdatePipeline::run, this);
+  }
+
+  ~MapUpdatePipeline() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    if (num_updates_ > 0) LOG(INFO) << report() << std::endl;
+  }
+
+  MapUpdatePipeline(const MapUpdatePipeline &) = delete;
+  MapUpdatePipeline &operator=(const MapUpdatePipeline &) = delete;
+
+  /// Queues a map update behind the previous one, waiting only if that one has not started yet.
+  void submit(std::function<void()> task) {
+    start();
+    if (!enabled_) {
+      const auto begin = clock::now();
+      std::unique_lock<std::shared_mutex> lock(map_mutex_);
+      task();
+      write_busy_ += clock::now() - begin;
+      num_updates_++;
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    const auto begin = clock::now();
+    cv_.wait(lock, [this] { return !pending_; });
+    stalled_ += clock::now() - begin;
+    task_ = std::move(task);
+    pending_ = true;
+    num_updates_++;
+    cv_.notify_all();
+  }
+
+  /// Runs func once every submitted update landed, holding a shared lock on the map for its duration.
+  template <typename Func>
+  auto read(Func &&func) {
+    start();
+    const auto begin = clock::now();
+    waitIdle();
+    std::shared_lock<std::shared_mutex> lock(map_mutex_);
+    const auto locked = clock::now();
+    stalled_ += locked - begin;
+    auto result = func();
+    read_busy_ += clock::now() - locked;
+    return result;
+  }
+
+  /// For occasional reads outside of the registration (map size, visualization), not accounted for.
+  std::shared_lock<std::shared_mutex> readLock() {
+    waitIdle();
+    return std::shared_lock<std::shared_mutex>(map_mutex_);
+  }
+
+  /// Busy time of each stage and stall time as a fraction of the time since the first frame.
+  std::string report() const {
+    using ms = std::chrono::duration<double, std::milli>;
+    std::lock_guard<std::mutex> lock(mutex_);
+    const double wall = ms(clock::now() - first_).count();
+    const auto percent = [&](clock::duration d) { return wall > 0.0 ? 100.0 * ms(d).count() / wall : 0.0; };
+    std::stringstream ss;
+    ss << "map pipeline (" << (enabled_ ? "pipelined" : "serial") << ") occupancy over " << wall
+       << " ms: icp " << percent(read_busy_) << "%, map update " << percent(write_busy_) << "%, stalled "
+       << percent(stalled_) << "%";
+    return ss.str();
+  }
+
+ private:
+  void start() {
+    if (first_ == clock::time_point()) first_ = clock::now();
+  }
+
+  void waitIdle() {
+    if (!enabled_) return;
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !pending_ && !running_; });
+    if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+
+  void run() {
+    STEAM_ICP_TRACE_THREAD_NAME("map update");
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || pending_; });
+        if (!pending_) return;  // pending updates are applied before stopping
+        task = std::move(task_);
+        pending_ = false;
+        running_ = true;
+      }
+      cv_.notify_all();
+      const auto begin = clock::now();
+      std::exception_ptr error;
+      try {
+        std::unique_lock<std::shared_mutex> lock(map_mutex_);
+        STEAM_ICP_TRACE_SCOPE("map update");
+        task();
+      } catch (...) {
+        error = std::current_exception();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        write_busy_ += clock::now() - begin;
+        running_ = false;
+        if (error) error_ = error;
+      }
+      cv_.notify_all();
+    }
+  }
+
+  const bool enabled_;
+
+  std::shared_mutex map_mutex_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::function<void()> task_;
+  bool pending_ = false;
+  bool running_ = false;
+  bool stop_ = false;
+  std::exception_ptr error_;
+
+  clock::time_point first_;
+  clock::duration read_busy_ = clock::duration(0);
+  clock::duration write_busy_ = clock::duration(0);
+  clock::duration stalled_ = clock::duration(0);
+  size_t num_updates_ = 0;
+
+  // started last, once every member above is initialized
+  std::thread thread_;
+};
+
+}  // namespace steam_icp
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+namespace steam_icp {
+
+/**
+ * \brief Decides per frame whether its points are worth integrating into the map. A frame becomes a keyframe when it
+ * moved or rotated enough since the last keyframe, when enough time elapsed, or when too few of its points fall into
+ * already occupied voxels. With every criterion disabled (all thresholds 0) every frame is integrated.
+ */
+class MapUpdateScheduler {
+ public:
+  struct Options {
+    double translation_m = 0.0;  // 0 disables the criterion
+    double rotation_deg = 0.0;   // 0 disables the criterion
+    double min_overlap = 0.0;    // in [0, 1], 0 disables the criterion
+    double max_elapsed_s = 0.0;  // 0 disables the criterion
+  };
+
+  explicit MapUpdateScheduler(const Options &options) : options_(options) {}
+
+  bool enabled() const {
+    return options_.translation_m > 0.0 || options_.rotation_deg > 0.0 || options_.min_overlap > 0.0 ||
+           options_.max_elapsed_s > 0.0;
+  }
+
+  /// Returns true and records the frame as the new keyframe when it should be integrated. overlap() is only evaluated
+  /// when the overlap criterion is enabled and none of the cheaper ones triggered already.
+  template <typename OverlapFunc>
+  bool shouldUpdate(const Eigen::Matrix3d &R, const Eigen::Vector3d &t, double timestamp, OverlapFunc &&overlap) {
+    if (!has_keyframe_ || !enabled() || triggered(R, t, timestamp) ||
+        (options_.min_overlap > 0.0 && overlap() < options_.min_overlap)) {
+      has_keyframe_ = true;
+      R_prev_ = R;
+      t_prev_ = t;
+      timestamp_prev_ = timestamp;
+      return true;
+    }
+    ++num_skipped_;
+    return false;
+  }
+
+  size_t numSkipped() const { return num_skipped_; }
+
+ private:
+  bool triggered(const Eigen::Matrix3d &R, const Eigen::Vector3d &t, double timestamp) const {
+    if (options_.translation_m > 0.0 && (t - t_prev_).norm() > options_.translation_m) return true;
+    if (options_.max_elapsed_s > 0.0 && timestamp - timestamp_prev_ > options_.max_elapsed_s) return true;
+    if (options_.rotation_deg > 0.0) {
+      const double cos_angle = std::clamp(0.5 * ((R_prev_.transpose() * R).trace() - 1.0), -1.0, 1.0);
+      if (std::acos(cos_angle) * 180.0 / M_PI > options_.rotation_deg) return true;
+    }
+    return false;
+  }
+
+  const Options options_;
+  bool has_keyframe_ = false;
+  Eigen::Matrix3d R_prev_ = Eigen::Matrix3d::Identity();
+  Eigen::Vector3d t_prev_ = Eigen::Vector3d::Zero();
+  double timestamp_prev_ = 0.0;
+  size_t num_skipped_ = 0;
+};
+
+}  // namespace steam_icp
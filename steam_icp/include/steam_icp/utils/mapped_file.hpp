@@ -0,0 +1,94 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace steam_icp {
+
+/**
+ * \brief Read-only view of a whole file. The file is memory mapped, with its pages populated up front when it is meant
+ * to be read through once (populate), or faulted in on access, hinted by prefetch(), for large files read piecemeal.
+ * When it cannot be mapped, it is read with a single pread into an owned buffer instead. Either way the data is at
+ * least 8 byte aligned, so records of floats or doubles can be read in place.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string &path, bool populate = true) : path_(path) {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) throw std::runtime_error{"failed to open " + path + ": " + std::strerror(errno)};
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) fail("fstat");
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) return;
+    void *map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd_, 0);
+    if (map != MAP_FAILED) {
+      map_ = map;
+      data_ = static_cast<const char *>(map);
+      return;
+    }
+    buffer_.reset(new char[size_]);
+    for (size_t read = 0; read < size_;) {
+      const ssize_t n = ::pread(fd_, buffer_.get() + read, size_ - read, static_cast<off_t>(read));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) fail("pread");
+      read += static_cast<size_t>(n);
+    }
+    data_ = buffer_.get();
+  }
+
+  ~MappedFile() {
+    if (map_ != nullptr) ::munmap(map_, size_);
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const std::string &path() const { return path_; }
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  /// Asks the kernel to start reading [offset, offset + size) in, without waiting for it.
+  void prefetch(size_t offset, size_t size) const {
+    if (map_ == nullptr || offset >= size_) return;
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    const size_t begin = offset / page * page;
+    ::madvise(static_cast<char *>(map_) + begin, std::min(offset + size, size_) - begin, MADV_WILLNEED);
+  }
+
+  /// Number of whole records of T in the file, and the file viewed as an array of them.
+  template <typename T>
+  size_t count() const {
+    return size_ / sizeof(T);
+  }
+  template <typename T>
+  const T *as() const {
+    return reinterpret_cast<const T *>(data_);
+  }
+
+ private:
+  [[noreturn]] void fail(const char *call) {
+    const std::string error = std::strerror(errno);
+    if (map_ != nullptr) ::munmap(map_, size_);
+    ::close(fd_);
+    throw std::runtime_error{call + std::string(" failed on ") + path_ + ": " + error};
+  }
+
+  const std::string path_;
+  int fd_ = -1;
+  void *map_ = nullptr;
+  std::unique_ptr<char[]> buffer_;
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace steam_icp
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+
+#include <glog/logging.h>
+
+#include "steam.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Bounds the size of a sliding window filter. The time window given by delay_adding_points decides what must be
+ * marginalized; this policy decides when older states should additionally be marginalized early, so that the number
+ * of variables, the number of cost terms and the solve time per frame stay bounded on long sequences.
+ */
+class MarginalizationPolicy {
+ public:
+  struct Options {
+    int max_num_variables = 100;
+    int max_num_cost_terms = 100000;
+    double solve_time_budget_ms = 0.0;  // on the sliding window solve of the previous frame, 0 disables it
+  };
+
+  explicit MarginalizationPolicy(const Options &options) : options_(options) {}
+
+  /// Whether the oldest remaining state should be marginalized before the next frame is solved, given that
+  /// num_marginalized_early states have already been marginalized early for this frame.
+  bool exceeded(steam::SlidingWindowFilter &filter, int num_marginalized_early) const {
+    if ((int)filter.getNumberOfVariables() > options_.max_num_variables) return true;
+    // the cost terms of the incoming frame are added after marginalization, expect as many as the last frame
+    if ((int)(filter.getNumberOfCostTerms() + last_num_new_cost_terms_) > options_.max_num_cost_terms) return true;
+    // shrink the window by one state per frame while over the time budget
+    if (options_.solve_time_budget_ms > 0.0 && last_solve_time_ms_ > options_.solve_time_budget_ms)
+      return num_marginalized_early == 0;
+    return false;
+  }
+
+  /// Records the cost terms added for the latest frame, once they are all in the filter.
+  void update(steam::SlidingWindowFilter &filter, size_t num_cost_terms_before) {
+    const size_t num_cost_terms = filter.getNumberOfCostTerms();
+    last_num_new_cost_terms_ = num_cost_terms > num_cost_terms_before ? num_cost_terms - num_cost_terms_before : 0;
+    if ((int)filter.getNumberOfVariables() > options_.max_num_variables)
+      LOG(WARNING) << "sliding window holds " << filter.getNumberOfVariables() << " variables, above the cap of "
+                   << options_.max_num_variables << std::endl;
+    if ((int)num_cost_terms > options_.max_num_cost_terms)
+      LOG(WARNING) << "sliding window holds " << num_cost_terms << " cost terms, above the cap of "
+                   << options_.max_num_cost_terms << std::endl;
+  }
+
+  /// Solves the sliding window, timing the solve for the budget of the next frame. When the window is solved inside
+  /// ICP, every iteration goes through here and the last one, on the complete window of the frame, counts.
+  template <typename Solver>
+  void solve(Solver &solver) {
+    const auto begin = std::chrono::steady_clock::now();
+    solver.optimize();
+    last_solve_time_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  }
+
+ private:
+  const Options options_;
+  size_t last_num_new_cost_terms_ = 0;
+  double last_solve_time_ms_ = 0.0;
+};
+
+}  // namespace steam_icp
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "steam_icp/utils/mapped_file.hpp"
+#include "steam_icp/utils/ply_view.hpp"
+
+namespace steam_icp {
+
+/// One field of the points of a PcdView; same strided view as a PLY column.
+template <typename T>
+using PcdColumn = PlyColumn<T>;
+
+/**
+ * \brief Points of a binary or binary_compressed PCD file, without PCL. Binary files are mapped and their fields read
+ * in place out of the packed records; binary_compressed files are LZF decompressed once into an owned buffer, which
+ * holds every field as a contiguous array. Either way each field is exposed as a typed, strided column. ascii files
+ * are not supported.
+ */
+class PcdView {
+ public:
+  struct Field {
+    std::string name;
+    char type;     // 'F', 'I' or 'U'
+    size_t size;   // bytes per element
+    size_t count;  // elements per point
+  };
+
+  explicit PcdView(const std::string &path);
+
+  size_t numPoints() const { return num_points_; }
+  const std::vector<Field> &fields() const { return fields_; }
+  bool compressed() const { return compressed_; }
+
+  bool has(const std::string &name) const { return find(name) >= 0; }
+
+  /// Column of a single element field; T must match its type and size.
+  template <typename T>
+  PcdColumn<T> column(const std::string &name) const {
+    const int index = find(name);
+    if (index < 0) throw std::runtime_error{"no field " + name + " in PCD file " + file_.path()};
+    const Field &field = fields_[index];
+    const char type = std::is_floating_point_v<T> ? 'F' : (std::is_signed_v<T> ? 'I' : 'U');
+    if (field.type != type || field.size != sizeof(T) || field.count != 1)
+      throw std::runtime_error{"field " + name + " of PCD file " + file_.path() + " has another type"};
+    if (compressed_) return PcdColumn<T>(data_ + offsets_[index] * num_points_, sizeof(T), num_points_);
+    return PcdColumn<T>(data_ + offsets_[index], point_size_, num_points_);
+  }
+
+ private:
+  int find(const std::string &name) const {
+    for (size_t i = 0; i < fields_.size(); ++i)
+      if (fields_[i].name == name) return static_cast<int>(i);
+    return -1;
+  }
+
+  const MappedFile file_;
+  std::vector<Field> fields_;
+  std::vector<size_t> offsets_;  // of each field within a point record
+  size_t point_size_ = 0;
+  size_t num_points_ = 0;
+  bool compressed_ = false;
+  std::vector<char> decompressed_;
+  const char *data_ = nullptr;
+};
+
+/// LZF decompression (the format of binary_compressed PCD files); returns the number of bytes written to out, 0 on
+/// malformed input or if out is too small.
+size_t lzfDecompress(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size);
+
+}  // namespace steam_icp
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "steam_icp/utils/mapped_file.hpp"
+
+namespace steam_icp {
+
+/// Scalar type of a PLY property.
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+template <typename T>
+constexpr PlyType plyTypeOf();
+template <> constexpr PlyType plyTypeOf<int8_t>() { return PlyType::Int8; }
+template <> constexpr PlyType plyTypeOf<uint8_t>() { return PlyType::UInt8; }
+template <> constexpr PlyType plyTypeOf<int16_t>() { return PlyType::Int16; }
+template <> constexpr PlyType plyTypeOf<uint16_t>() { return PlyType::UInt16; }
+template <> constexpr PlyType plyTypeOf<int32_t>() { return PlyType::Int32; }
+template <> constexpr PlyType plyTypeOf<uint32_t>() { return PlyType::UInt32; }
+template <> constexpr PlyType plyTypeOf<float>() { return PlyType::Float32; }
+template <> constexpr PlyType plyTypeOf<double>() { return PlyType::Float64; }
+
+/// One property of the vertices of a PlyView, read in place: element i is at data + i * stride.
+template <typename T>
+class PlyColumn {
+ public:
+  PlyColumn(const char *data, size_t stride, size_t size) : data_(data), stride_(stride), size_(size) {}
+
+  size_t size() const { return size_; }
+  size_t stride() const { return stride_; }
+  T operator[](size_t i) const {
+    T value;
+    std::memcpy(&value, data_ + i * stride_, sizeof(T));
+    return value;
+  }
+
+ private:
+  const char *data_;
+  size_t stride_;
+  size_t size_;
+};
+
+/**
+ * \brief Vertices of a binary little endian PLY file, mapped rather than read: the header is parsed out of the
+ * mapping, then every scalar vertex property is exposed as a typed, strided column over the mapped records. The vertex
+ * element must come first; list properties are not supported.
+ */
+class PlyView {
+ public:
+  struct Property {
+    std::string name;
+    PlyType type;
+    size_t offset;  // within a vertex record
+  };
+
+  explicit PlyView(const std::string &path) : file_(path) {
+    const char *const data = file_.data();
+    const char *const end = data + file_.size();
+    static constexpr char kEndHeader[] = "end_header";
+    const char *p = data;
+    bool element = false, vertex = false, after_vertex = false, little_endian = false;
+    while (true) {
+      const char *eol = p < end ? static_cast<const char *>(std::memchr(p, '\n', end - p)) : nullptr;
+      if (eol == nullptr) throw std::runtime_error{"no end_header in PLY file " + path};
+      std::string line(p, eol);
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      p = eol + 1;
+      if (line.compare(0, sizeof(kEndHeader) - 1, kEndHeader) == 0) break;
+
+      std::istringstream ss(line);
+      std::string keyword;
+      ss >> keyword;
+      if (keyword == "format") {
+        std::string format;
+        ss >> format;
+        little_endian = format == "binary_little_endian";
+      } else if (keyword == "element") {
+        std::string name;
+        ss >> name;
+        if (name == "vertex") {
+          if (element) throw std::runtime_error{"vertex is not the first element of " + path};
+          vertex = true;
+          ss >> num_vertices_;
+        } else if (vertex) {
+          after_vertex = true;
+        }
+        element = true;
+      } else if (keyword == "property" && vertex && !after_vertex) {
+        std::string type, name;
+        ss >> type >> name;
+        if (type == "list") throw std::runtime_error{"PLY list property not supported in " + path};
+        const PlyType ply_type = parseType(type, path);
+        properties_.push_back({name, ply_type, record_size_});
+        record_size_ += sizeOf(ply_type);
+      }
+    }
+    if (!little_endian) throw std::runtime_error{"only binary_little_endian PLY files are supported: " + path};
+    if (!vertex) throw std::runtime_error{"no vertex element in PLY file " + path};
+    vertices_ = p;
+    if (static_cast<size_t>(end - p) < num_vertices_ * record_size_)
+      throw std::runtime_error{"truncated PLY file " + path};
+  }
+
+  size_t numVertices() const { return num_vertices_; }
+  size_t recordSize() const { return record_size_; }
+  const std::vector<Property> &properties() const { return properties_; }
+  const char *vertices() const { return vertices_; }
+
+  bool has(const std::string &name) const { return find(name) != nullptr; }
+
+  /// Column of a property, by name or by position; T must be the type of the property.
+  template <typename T>
+  PlyColumn<T> column(const std::string &name) const {
+    const Property *property = find(name);
+    if (property == nullptr) throw std::runtime_error{"no property " + name + " in PLY file " + file_.path()};
+    return column<T>(*property);
+  }
+  template <typename T>
+  PlyColumn<T> column(size_t index) const {
+    if (index >= properties_.size())
+      throw std::runtime_error{"no property " + std::to_string(index) + " in PLY file " + file_.path()};
+    return column<T>(properties_[index]);
+  }
+
+  static size_t sizeOf(PlyType type) {
+    switch (type) {
+      case PlyType::Int8: case PlyType::UInt8: return 1;
+      case PlyType::Int16: case PlyType::UInt16: return 2;
+      case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+      case PlyType::Float64: return 8;
+    }
+    return 0;
+  }
+
+ private:
+  static PlyType parseType(const std::string &type, const std::string &path) {
+    if (type == "char" || type == "int8") return PlyType::Int8;
+    if (type == "uchar" || type == "uint8") return PlyType::UInt8;
+    if (type == "short" || type == "int16") return PlyType::Int16;
+    if (type == "ushort" || type == "uint16") return PlyType::UInt16;
+    if (type == "int" || type == "int32") return PlyType::Int32;
+    if (type == "uint" || type == "uint32") return PlyType::UInt32;
+    if (type == "float" || type == "float32") return PlyType::Float32;
+    if (type == "double" || type == "float64") return PlyType::Float64;
+    throw std::runtime_error{"unknown PLY property type " + type + " in " + path};
+  }
+
+  template <typename T>
+  PlyColumn<T> column(const Property &property) const {
+    if (property.type != plyTypeOf<T>())
+      throw std::runtime_error{"property " + property.name + " of PLY file " + file_.path() + " has another type"};
+    return PlyColumn<T>(vertices_ + property.offset, record_size_, num_vertices_);
+  }
+
+  const Property *find(const std::string &name) const {
+    for (const auto &property : properties_)
+      if (property.name == name) return &property;
+    return nullptr;
+  }
+
+  const MappedFile file_;
+  std::vector<Property> properties_;
+  size_t num_vertices_ = 0;
+  size_t record_size_ = 0;
+  const char *vertices_ = nullptr;
+};
+
+}  // namespace steam_icp
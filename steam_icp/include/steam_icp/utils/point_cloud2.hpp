@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "sensor_msgs/msg/point_cloud2.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Writes points straight into a sensor_msgs::msg::PointCloud2, in one pass and without an intermediate PCL
+ * cloud. The layout is the one pcl::toROSMsg used to produce for our PCL point type: x, y, z, pad, then
+ * alpha_timestamp, timestamp, radial_velocity (published as flex11, flex12, flex13) and flex14, all float32, 32 bytes
+ * per point. The message is owned by the serializer and reused across frames, so its buffer is only reallocated when
+ * a cloud is larger than any cloud before it; one serializer per topic.
+ */
+class PointCloud2Serializer {
+ public:
+  static constexpr uint32_t kPointStep = 32;
+  static constexpr size_t kFloatsPerPoint = kPointStep / sizeof(float);
+
+  PointCloud2Serializer() {
+    const std::vector<std::pair<std::string, uint32_t>> fields{{"x", 0},       {"y", 4},       {"z", 8},
+                                                               {"flex11", 16}, {"flex12", 20}, {"flex13", 24},
+                                                               {"flex14", 28}};
+    for (const auto &[name, offset] : fields) {
+      sensor_msgs::msg::PointField field;
+      field.name = name;
+      field.offset = offset;
+      field.datatype = sensor_msgs::msg::PointField::FLOAT32;
+      field.count = 1;
+      msg_.fields.emplace_back(field);
+    }
+    msg_.height = 1;
+    msg_.point_step = kPointStep;
+    msg_.is_bigendian = false;
+    msg_.is_dense = true;
+  }
+
+  /// PointT is a Point3D-like struct (pt, alpha_timestamp, timestamp, radial_velocity) or Eigen::Vector3d. The
+  /// returned message stays valid until the next call.
+  template <typename PointT, typename Alloc>
+  const sensor_msgs::msg::PointCloud2 &serialize(const std::vector<PointT, Alloc> &points,
+                                                 const std::string &frame_id) {
+    msg_.header.frame_id = frame_id;
+    msg_.width = static_cast<uint32_t>(points.size());
+    msg_.row_step = kPointStep * msg_.width;
+    msg_.data.resize(msg_.row_step);  // keeps the capacity of previous frames
+    float *out = reinterpret_cast<float *>(msg_.data.data());
+    const size_t num_points = points.size();
+    for (size_t i = 0; i < num_points; ++i) write(points[i], out + i * kFloatsPerPoint);
+    return msg_;
+  }
+
+ private:
+  template <typename PointT>
+  static inline void write(const PointT &p, float *out) {
+    out[0] = static_cast<float>(p.pt[0]);
+    out[1] = static_cast<float>(p.pt[1]);
+    out[2] = static_cast<float>(p.pt[2]);
+    out[3] = 1.0f;
+    out[4] = static_cast<float>(p.alpha_timestamp);
+    out[5] = static_cast<float>(p.timestamp);
+    out[6] = static_cast<float>(p.radial_velocity);
+    out[7] = 0.0f;
+  }
+
+  static inline void write(const Eigen::Vector3d &p, float *out) {
+    out[0] = static_cast<float>(p[0]);
+    out[1] = static_cast<float>(p[1]);
+    out[2] = static_cast<float>(p[2]);
+    out[3] = 1.0f;
+    out[4] = out[5] = out[6] = out[7] = 0.0f;
+  }
+
+  sensor_msgs::msg::PointCloud2 msg_;
+};
+
+}  // namespace steam_icp
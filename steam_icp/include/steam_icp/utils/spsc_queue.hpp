@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace steam_icp {
+
+/// Bounded lock-free queue for exactly one producer thread and one consumer thread. Slots are preallocated, push and
+/// pop never block; callers decide how to wait when the queue is full or empty.
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity) : slots_(capacity + 1) {}
+
+  size_t capacity() const { return slots_.size() - 1; }
+
+  /// Returns false, leaving value untouched, when the queue is full.
+  bool tryPush(T &&value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t next = increment(tail);
+    if (next == head_.load(std::memory_order_acquire)) return false;
+    slots_[tail] = std::move(value);
+    tail_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  /// Returns false when the queue is empty.
+  bool tryPop(T &value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) return false;
+    value = std::move(slots_[head]);
+    head_.store(increment(head), std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+ private:
+  size_t increment(size_t index) const { return index + 1 == slots_.size() ? 0 : index + 1; }
+
+  // producer and consumer indices on separate cache lines
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+  std::vector<T> slots_;
+};
+
+}  // namespace steam_icp
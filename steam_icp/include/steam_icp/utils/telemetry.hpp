@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "steam_icp/utils/trace.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Per-frame latency samples of named stages. Stage names are hierarchical, '/' separated (e.g.
+ * "registration/icp/association"). Every time recorded for a stage during a frame adds up into the sample of that
+ * frame; nextFrame() closes the frame. Stages that did not run during a frame have no sample for it. Not thread safe,
+ * samples are recorded by the thread driving the odometry.
+ */
+class Telemetry {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  /// Times the lifetime of the scope, or until stop(). Also traced when tracing is compiled in.
+  class Scope {
+   public:
+    Scope(Telemetry &telemetry, const char *stage)
+        : telemetry_(&telemetry), name_(stage), stage_(telemetry.stage(stage)), start_(clock::now()) {}
+    ~Scope() { stop(); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    void stop() {
+      if (telemetry_ == nullptr) return;
+      const auto now = clock::now();
+      STEAM_ICP_TRACE_EVENT(name_, start_, now);
+      telemetry_->add(stage_, std::chrono::duration<double, std::milli>(now - start_).count());
+      telemetry_ = nullptr;
+    }
+
+   private:
+    Telemetry *telemetry_;
+    const char *const name_;
+    const size_t stage_;
+    const clock::time_point start_;
+  };
+
+  /// Id of the stage, registered on first use.
+  size_t stage(const std::string &name) {
+    const auto [it, inserted] = ids_.try_emplace(name, names_.size());
+    if (inserted) {
+      names_.emplace_back(name);
+      samples_.emplace_back(num_frames_, kNoSample);
+      current_.emplace_back(kNoSample);
+    }
+    return it->second;
+  }
+
+  void add(size_t stage, double ms) { current_[stage] = std::isnan(current_[stage]) ? ms : current_[stage] + ms; }
+  void add(const std::string &name, double ms) { add(stage(name), ms); }
+
+  void nextFrame() {
+    for (size_t i = 0; i < names_.size(); ++i) {
+      samples_[i].emplace_back(current_[i]);
+      current_[i] = kNoSample;
+    }
+    num_frames_++;
+  }
+
+  size_t numFrames() const { return num_frames_; }
+
+  /// Lowercase stage name out of a timer label: "Update Transform ...... " gives "update_transform".
+  static std::string stageName(const std::string &label) {
+    std::string name = label.substr(0, label.find(" ."));
+    name.erase(name.find_last_not_of(' ') + 1);
+    for (auto &c : name) c = c == ' ' ? '_' : static_cast<char>(std::tolower(c));
+    return name;
+  }
+
+  struct Summary {
+    size_t count = 0;
+    double mean = 0.0, p50 = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0;
+  };
+
+  Summary summary(size_t stage) const {
+    std::vector<double> values;
+    values.reserve(num_frames_);
+    for (const double v : samples_[stage])
+      if (!std::isnan(v)) values.emplace_back(v);
+    Summary summary;
+    if (values.empty()) return summary;
+    std::sort(values.begin(), values.end());
+    // nearest rank
+    const auto percentile = [&](double p) {
+      const size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+      return values[std::max<size_t>(rank, 1) - 1];
+    };
+    summary.count = values.size();
+    for (const double v : values) summary.mean += v;
+    summary.mean /= values.size();
+    summary.p50 = percentile(0.50);
+    summary.p90 = percentile(0.90);
+    summary.p99 = percentile(0.99);
+    summary.max = values.back();
+    return summary;
+  }
+
+  /// Stages in name order, so that the children of a stage follow it.
+  std::string report() const {
+    std::stringstream ss;
+    ss << "latency over " << num_frames_ << " frames (ms): count / mean / p50 / p90 / p99 / max";
+    for (const size_t i : sorted()) {
+      const auto s = summary(i);
+      ss << "\n  " << std::left << std::setw(48) << names_[i] << std::right << std::fixed << std::setprecision(3)
+         << s.count << " / " << s.mean << " / " << s.p50 << " / " << s.p90 << " / " << s.p99 << " / " << s.max;
+    }
+    return ss.str();
+  }
+
+  /// Writes the per stage percentiles to <prefix>_latency.csv and the per frame timeline (one column per stage,
+  /// empty when the stage did not run) to <prefix>_timeline.csv.
+  void write(const std::string &prefix) const {
+    const auto order = sorted();
+    std::ofstream latency(prefix + "_latency.csv", std::ios::out);
+    if (!latency.is_open()) throw std::runtime_error{"failed to open " + prefix + "_latency.csv"};
+    latency << "stage,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n" << std::fixed << std::setprecision(6);
+    for (const size_t i : order) {
+      const auto s = summary(i);
+      latency << names_[i] << ',' << s.count << ',' << s.mean << ',' << s.p50 << ',' << s.p90 << ',' << s.p99 << ','
+              << s.max << '\n';
+    }
+
+    std::ofstream timeline(prefix + "_timeline.csv", std::ios::out);
+    if (!timeline.is_open()) throw std::runtime_error{"failed to open " + prefix + "_timeline.csv"};
+    timeline << "frame";
+    for (const size_t i : order) timeline << ',' << names_[i];
+    timeline << '\n' << std::fixed << std::setprecision(6);
+    for (size_t f = 0; f < num_frames_; ++f) {
+      timeline << f;
+      for (const size_t i : order) {
+        timeline << ',';
+        if (!std::isnan(samples_[i][f])) timeline << samples_[i][f];
+      }
+      timeline << '\n';
+    }
+  }
+
+ private:
+  static constexpr double kNoSample = std::numeric_limits<double>::quiet_NaN();
+
+  std::vector<size_t> sorted() const {
+    std::vector<size_t> order(names_.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return names_[a] < names_[b]; });
+    return order;
+  }
+
+  std::unordered_map<std::string, size_t> ids_;
+  std::vector<std::string> names_;
+  std::vector<std::vector<double>> samples_;  // [stage][frame]
+  std::vector<double> current_;               // samples of the frame being recorded
+  size_t num_frames_ = 0;
+};
+
+}  // namespace steam_icp
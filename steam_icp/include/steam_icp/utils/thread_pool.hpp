@@ -0,0 +1,271 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "steam_icp/utils/trace.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Persistent pool of num_threads - 1 workers, the calling thread taking part as participant 0. A parallel loop
+ * gives each participant a contiguous block of the range; participants run their block in chunks and, once done,
+ * steal the remaining chunks of the others. Loops are serialized, a loop started from inside a loop runs inline.
+ * When cores is not empty, worker i is pinned to cores[i % cores.size()] (cores[0] is meant for the calling thread,
+ * which the pool never pins). Every loop is accounted to its stage: calls, wall time and chunks stolen.
+ */
+class ThreadPool {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit ThreadPool(int num_threads, std::vector<int> cores = {})
+      : num_threads_(std::max(num_threads, 1)), cores_(std::move(cores)), ranges_(new Range[num_threads_]) {
+    for (size_t i = 1; i < num_threads_; ++i) workers_.emplace_back(&ThreadPool::run, this, i);
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_) worker.join();
+    if (!stages_.empty()) LOG(INFO) << report() << std::endl;
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t numThreads() const { return num_threads_; }
+
+  /// Calls func(i) for every i in [begin, end).
+  template <typename Func>
+  void parallelFor(const char *stage, size_t begin, size_t end, Func &&func) {
+    const auto chunk = [&func](size_t /* participant */, size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i) func(i);
+    };
+    parallelChunks(stage, begin, end, chunk);
+  }
+
+  /// Calls func(i, local) for every i in [begin, end), local being the accumulator of the participant running i and
+  /// starting from identity, then folds the accumulators into identity with combine(result, std::move(local)).
+  template <typename T, typename Func, typename Combine>
+  T parallelReduce(const char *stage, size_t begin, size_t end, const T &identity, Func &&func, Combine &&combine) {
+    std::vector<T> locals(num_threads_, identity);
+    const auto chunk = [&func, &locals](size_t participant, size_t first, size_t last) {
+      auto &local = locals[participant];
+      for (size_t i = first; i < last; ++i) func(i, local);
+    };
+    parallelChunks(stage, begin, end, chunk);
+    T result = identity;
+    for (auto &local : locals) combine(result, std::move(local));
+    return result;
+  }
+
+  /// Combine for parallelReduce over vectors, or pairs of vectors: appends the local items to the result.
+  struct Append {
+    template <typename T, typename Alloc>
+    void operator()(std::vector<T, Alloc> &result, std::vector<T, Alloc> &&local) const {
+      result.insert(result.end(), std::make_move_iterator(local.begin()), std::make_move_iterator(local.end()));
+    }
+    template <typename T1, typename T2>
+    void operator()(std::pair<T1, T2> &result, std::pair<T1, T2> &&local) const {
+      (*this)(result.first, std::move(local.first));
+      (*this)(result.second, std::move(local.second));
+    }
+  };
+
+  std::string report() const {
+    using ms = std::chrono::duration<double, std::milli>;
+    std::lock_guard<std::mutex> lock(stages_mutex_);
+    std::stringstream ss;
+    ss << "thread pool (" << num_threads_ << " threads) stages:";
+    for (const auto &[name, stage] : stages_) {
+      ss << "\n  " << name << ": " << stage.calls << " calls, " << ms(stage.total).count() / stage.calls
+         << " ms avg, " << ms(stage.max).count() << " ms max, "
+         << static_cast<double>(stage.items) / stage.calls << " items avg, "
+         << static_cast<double>(stage.steals) / stage.calls << " steals avg";
+    }
+    return ss.str();
+  }
+
+ private:
+  struct Range {
+    alignas(64) std::atomic<size_t> next{0};
+    size_t end = 0;
+  };
+
+  struct Stage {
+    size_t calls = 0;
+    size_t items = 0;
+    size_t steals = 0;
+    clock::duration total = clock::duration(0);
+    clock::duration max = clock::duration(0);
+  };
+
+  struct StageLess {
+    bool operator()(const char *a, const char *b) const { return std::strcmp(a, b) < 0; }
+  };
+
+  using Invoke = void (*)(const void *, size_t, size_t, size_t);
+
+  template <typename Chunk>
+  void parallelChunks(const char *stage, size_t begin, size_t end, const Chunk &chunk) {
+    if (end <= begin) return;
+    const size_t num_items = end - begin;
+    const auto start = clock::now();
+    if (num_threads_ == 1 || num_items == 1 || in_pool_) {
+      chunk(0, begin, end);
+      const auto now = clock::now();
+      STEAM_ICP_TRACE_EVENT(stage, start, now);
+      record(stage, num_items, 0, now - start);
+      return;
+    }
+
+    std::lock_guard<std::mutex> job_lock(job_mutex_);
+    const size_t num_participants = std::min(num_threads_, num_items);
+    const size_t block = num_items / num_participants;
+    const size_t remainder = num_items % num_participants;
+    size_t first = begin;
+    for (size_t p = 0; p < num_threads_; ++p) {
+      const size_t size = p < num_participants ? block + (p < remainder ? 1 : 0) : 0;
+      ranges_[p].next.store(first, std::memory_order_relaxed);
+      ranges_[p].end = first + size;
+      first += size;
+    }
+    grain_ = std::max<size_t>(1, num_items / (num_participants * 8));
+    stage_ = stage;
+    func_ = &chunk;
+    invoke_ = [](const void *func, size_t participant, size_t first, size_t last) {
+      (*static_cast<const Chunk *>(func))(participant, first, last);
+    };
+    steals_.store(0, std::memory_order_relaxed);
+    active_.store(num_threads_ - 1, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      generation_.fetch_add(1, std::memory_order_release);
+    }
+    cv_.notify_all();
+
+    in_pool_ = true;
+    work(0);
+    in_pool_ = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_cv_.wait(lock, [this] { return active_.load(std::memory_order_acquire) == 0; });
+    }
+    record(stage, num_items, steals_.load(std::memory_order_relaxed), clock::now() - start);
+    if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+
+  // own block first, then the chunks left in the blocks of the others
+  void work(size_t participant) {
+    STEAM_ICP_TRACE_SCOPE(stage_);
+    for (size_t k = 0; k < num_threads_; ++k) {
+      auto &range = ranges_[(participant + k) % num_threads_];
+      while (true) {
+        const size_t first = range.next.fetch_add(grain_, std::memory_order_relaxed);
+        if (first >= range.end) break;
+        if (k > 0) steals_.fetch_add(1, std::memory_order_relaxed);
+        try {
+          invoke_(func_, participant, first, std::min(first + grain_, range.end));
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          if (!error_) error_ = std::current_exception();
+        }
+      }
+    }
+  }
+
+  void run(size_t index) {
+    pin(index);
+    STEAM_ICP_TRACE_THREAD_NAME("pool worker " + std::to_string(index));
+    in_pool_ = true;
+    uint64_t seen = 0;
+    while (true) {
+      // loops come in bursts within a frame, spin a little before sleeping
+      for (int spin = 0; spin < kSpin && generation_.load(std::memory_order_acquire) == seen; ++spin)
+        std::this_thread::yield();
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return stop_ || generation_.load(std::memory_order_acquire) != seen; });
+        if (stop_) return;
+        seen = generation_.load(std::memory_order_acquire);
+      }
+      work(index);
+      if (active_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_cv_.notify_one();
+      }
+    }
+  }
+
+  void pin(size_t index) const {
+    if (cores_.empty()) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cores_[index % cores_.size()], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+      LOG(WARNING) << "could not pin thread pool worker " << index << " to core " << cores_[index % cores_.size()]
+                   << std::endl;
+  }
+
+  void record(const char *name, size_t num_items, size_t num_steals, clock::duration elapsed) {
+    std::lock_guard<std::mutex> lock(stages_mutex_);
+    auto &stage = stages_[name];
+    stage.calls++;
+    stage.items += num_items;
+    stage.steals += num_steals;
+    stage.total += elapsed;
+    stage.max = std::max(stage.max, elapsed);
+  }
+
+  static constexpr int kSpin = 256;
+  static inline thread_local bool in_pool_ = false;
+
+  const size_t num_threads_;
+  const std::vector<int> cores_;
+
+  // current loop, set by the calling thread before waking up the workers
+  std::mutex job_mutex_;
+  std::unique_ptr<Range[]> ranges_;
+  size_t grain_ = 1;
+  const char *stage_ = nullptr;
+  const void *func_ = nullptr;
+  Invoke invoke_ = nullptr;
+  std::atomic<size_t> steals_{0};
+  std::atomic<size_t> active_{0};
+  std::exception_ptr error_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable done_cv_;
+  std::atomic<uint64_t> generation_{0};
+  bool stop_ = false;
+
+  mutable std::mutex stages_mutex_;
+  std::map<const char *, Stage, StageLess> stages_;
+
+  // started last, once every member above is initialized
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace steam_icp
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <initializer_list>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "steam_icp/utils/trace.hpp"
+
+namespace steam_icp {
+
+/**
+ * \brief Fixed table of named steady_clock accumulators, for the stages timed within a call (e.g. the ICP loop).
+ * The table lives on the stack, start() and stop() are a clock read and a few plain stores. A table is owned by one
+ * thread; timers are not meant to be shared.
+ * With tracing compiled in, every started-stopped interval is also recorded as a trace event named after the stage.
+ */
+class TimerTable {
+ public:
+  using clock = std::chrono::steady_clock;
+  static constexpr size_t kMaxStages = 8;
+
+  class Timer {
+   public:
+    void start() {
+      if (running_) return;
+      running_ = true;
+      reference_ = clock::now();
+    }
+
+    void stop() {
+      if (!running_) return;
+      const auto now = clock::now();
+      accumulated_ += now - reference_;
+      running_ = false;
+      STEAM_ICP_TRACE_EVENT(name_, reference_, now);
+    }
+
+    void reset() {
+      running_ = false;
+      accumulated_ = clock::duration(0);
+    }
+
+    template <class duration_t = std::chrono::milliseconds>
+    typename duration_t::rep count() const {
+      const auto elapsed = running_ ? accumulated_ + (clock::now() - reference_) : accumulated_;
+      return std::chrono::duration_cast<duration_t>(elapsed).count();
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const Timer &timer) { return os << timer.count() << "ms"; }
+
+   private:
+    friend class TimerTable;
+
+    const char *name_ = "";
+    bool running_ = false;
+    clock::time_point reference_;
+    clock::duration accumulated_ = clock::duration(0);
+  };
+
+  /// Names must be string literals.
+  TimerTable(std::initializer_list<const char *> names) : size_(names.size()) {
+    if (size_ > kMaxStages)
+      throw std::runtime_error{"TimerTable holds at most " + std::to_string(kMaxStages) + " stages"};
+    size_t i = 0;
+    for (const char *name : names) timers_[i++].name_ = name;
+  }
+
+  size_t size() const { return size_; }
+  Timer &operator[](size_t i) { return timers_[i]; }
+  const Timer &operator[](size_t i) const { return timers_[i]; }
+  const char *name(size_t i) const { return timers_[i].name_; }
+
+  /// Name padded with dots, for aligned logs.
+  std::string label(size_t i) const {
+    std::string label = std::string(timers_[i].name_) + " ";
+    if (label.size() < kLabelWidth) label.append(kLabelWidth - label.size() - 1, '.').append(" ");
+    return label;
+  }
+
+ private:
+  static constexpr size_t kLabelWidth = 33;
+
+  std::array<Timer, kMaxStages> timers_;
+  const size_t size_;
+};
+
+}  // namespace steam_icp
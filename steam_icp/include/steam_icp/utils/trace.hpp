@@ -0,0 +1,163 @@
+#pragma once
+
+/**
+ * \brief Chrome trace (chrome://tracing, ui.perfetto.dev) recording of the pipeline, compiled in with
+ * -DSTEAM_ICP_TRACING=ON and compiled out entirely otherwise, all macros then expanding to nothing.
+ *
+ * Every thread records complete (begin, end) events into its own ring buffer of STEAM_ICP_TRACE_BUFFER_EVENTS
+ * events, written by that thread only and without locks or allocations; the oldest events are overwritten once the
+ * buffer is full. Buffers outlive their threads and are written out by STEAM_ICP_TRACE_FLUSH(path), meant to be
+ * called once the pipeline is idle.
+ *
+ *   STEAM_ICP_TRACE_SCOPE("name");                   // from here to the end of the scope
+ *   STEAM_ICP_TRACE_EVENT("name", begin, end);       // steady_clock time points, e.g. of a paused timer
+ *   STEAM_ICP_TRACE_THREAD_NAME(name);               // std::string, shown instead of the thread id
+ *
+ * Event names must be string literals (or otherwise outlive the flush).
+ */
+
+#ifdef STEAM_ICP_TRACING
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef STEAM_ICP_TRACE_BUFFER_EVENTS
+#define STEAM_ICP_TRACE_BUFFER_EVENTS (1 << 18)
+#endif
+
+namespace steam_icp {
+namespace trace {
+
+using clock = std::chrono::steady_clock;
+
+struct Event {
+  const char *name;
+  clock::time_point begin;
+  clock::time_point end;
+};
+
+class ThreadBuffer {
+ public:
+  static constexpr uint64_t kCapacity = STEAM_ICP_TRACE_BUFFER_EVENTS;
+  static_assert((kCapacity & (kCapacity - 1)) == 0, "the trace buffer size must be a power of two");
+
+  explicit ThreadBuffer(uint32_t tid) : tid_(tid), events_(new Event[kCapacity]) {}
+
+  void record(const char *name, clock::time_point begin, clock::time_point end) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    events_[head & (kCapacity - 1)] = Event{name, begin, end};
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  uint32_t tid() const { return tid_; }
+  uint64_t head() const { return head_.load(std::memory_order_acquire); }
+  const Event &at(uint64_t index) const { return events_[index & (kCapacity - 1)]; }
+
+  std::string name;
+
+ private:
+  const uint32_t tid_;
+  std::unique_ptr<Event[]> events_;
+  std::atomic<uint64_t> head_{0};
+};
+
+class Tracer {
+ public:
+  static Tracer &get() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  /// Buffer of the calling thread, registered on first use.
+  ThreadBuffer &buffer() {
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer == nullptr) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      buffers_.emplace_back(std::make_unique<ThreadBuffer>(static_cast<uint32_t>(buffers_.size())));
+      buffer = buffers_.back().get();
+    }
+    return *buffer;
+  }
+
+  void flush(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ofstream out(path, std::ios::out);
+    if (!out.is_open()) throw std::runtime_error{"failed to open " + path};
+    const auto pid = getpid();
+    const auto us = [](clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); };
+    out << "{\"traceEvents\":[\n" << std::fixed << std::setprecision(3);
+    bool first = true;
+    const auto separator = [&]() -> std::ostream & {
+      if (!first) out << ",\n";
+      first = false;
+      return out;
+    };
+    for (const auto &buffer : buffers_) {
+      separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->tid()
+                  << ",\"args\":{\"name\":\""
+                  << (buffer->name.empty() ? "thread " + std::to_string(buffer->tid()) : buffer->name) << "\"}}";
+      const uint64_t head = buffer->head();
+      const uint64_t tail = head > ThreadBuffer::kCapacity ? head - ThreadBuffer::kCapacity : 0;
+      for (uint64_t i = tail; i < head; ++i) {
+        const auto &event = buffer->at(i);
+        separator() << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << pid
+                    << ",\"tid\":" << buffer->tid() << ",\"ts\":" << us(event.begin - origin_)
+                    << ",\"dur\":" << us(event.end - event.begin) << "}";
+      }
+    }
+    out << "\n]}\n";
+  }
+
+ private:
+  Tracer() : origin_(clock::now()) {}
+
+  const clock::time_point origin_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+};
+
+inline void event(const char *name, clock::time_point begin, clock::time_point end) {
+  Tracer::get().buffer().record(name, begin, end);
+}
+
+class Scope {
+ public:
+  explicit Scope(const char *name) : name_(name), begin_(clock::now()) {}
+  ~Scope() { event(name_, begin_, clock::now()); }
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+
+ private:
+  const char *const name_;
+  const clock::time_point begin_;
+};
+
+}  // namespace trace
+}  // namespace steam_icp
+
+#define STEAM_ICP_TRACE_CONCAT_(a, b) a##b
+#define STEAM_ICP_TRACE_CONCAT(a, b) STEAM_ICP_TRACE_CONCAT_(a, b)
+#define STEAM_ICP_TRACE_SCOPE(name) \
+  const steam_icp::trace::Scope STEAM_ICP_TRACE_CONCAT(steam_icp_trace_scope_, __LINE__)(name)
+#define STEAM_ICP_TRACE_EVENT(name, begin, end) steam_icp::trace::event(name, begin, end)
+#define STEAM_ICP_TRACE_THREAD_NAME(thread_name) (steam_icp::trace::Tracer::get().buffer().name = (thread_name))
+#define STEAM_ICP_TRACE_FLUSH(path) steam_icp::trace::Tracer::get().flush(path)
+
+#else
+
+#define STEAM_ICP_TRACE_SCOPE(name)
+#define STEAM_ICP_TRACE_EVENT(name, begin, end) ((void)0)
+#define STEAM_ICP_TRACE_THREAD_NAME(thread_name) ((void)0)
+#define STEAM_ICP_TRACE_FLUSH(path) ((void)0)
+
+#endif
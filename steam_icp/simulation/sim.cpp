@@ -1,10 +1,11 @@
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
 namespace fs = std::filesystem;
 
 #include "glog/logging.h"
 
 #include "nav_msgs/msg/odometry.hpp"
-#include "pcl_conversions/pcl_conversions.h"
 #include "rclcpp/rclcpp.hpp"
 #include "sensor_msgs/msg/point_cloud2.hpp"
 #include "tf2/convert.h"
@@ -12,15 +13,10 @@ namespace fs = std::filesystem;
 #include "tf2_ros/static_transform_broadcaster.h"
 #include "tf2_ros/transform_broadcaster.h"
 
-#define PCL_NO_PRECOMPILE
-#include <pcl/io/pcd_io.h>
-#include <pcl/pcl_macros.h>
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-
 #include "lgmath.hpp"
 
 #include "steam_icp/point.hpp"
+#include "steam_icp/utils/point_cloud2.hpp"
 
 #include <unistd.h>
 #include <random>
@@ -45,60 +41,6 @@ struct Point3D {
   int beam_id = -1;              // The beam id of the point
 };
 
-#define PCL_ADD_FLEXIBLE     \
-  union EIGEN_ALIGN16 {      \
-    __uint128_t raw_flex1;   \
-    float data_flex1[4];     \
-    struct {                 \
-      float flex11;          \
-      float flex12;          \
-      float flex13;          \
-      float flex14;          \
-    };                       \
-    struct {                 \
-      float alpha_timestamp; \
-      float timestamp;       \
-      float radial_velocity; \
-    };                       \
-  };
-
-struct EIGEN_ALIGN16 PCLPoint3D {
-  PCL_ADD_POINT4D;
-  PCL_ADD_FLEXIBLE;
-  PCL_MAKE_ALIGNED_OPERATOR_NEW
-
-  inline PCLPoint3D() {
-    x = y = z = 0.0f;
-    data[3] = 1.0f;
-    raw_flex1 = 0;
-  }
-
-  inline PCLPoint3D(const PCLPoint3D &p) {
-    x = p.x;
-    y = p.y;
-    z = p.z;
-    data[3] = 1.0f;
-    raw_flex1 = p.raw_flex1;
-  }
-
-  inline PCLPoint3D(const Point3D &p) {
-    x = (float)p.pt[0];
-    y = (float)p.pt[1];
-    z = (float)p.pt[2];
-    data[3] = 1.0f;
-    alpha_timestamp = p.alpha_timestamp;
-    timestamp = p.timestamp;
-    radial_velocity = p.radial_velocity;
-  }
-
-  inline PCLPoint3D(const Eigen::Vector3d &p) {
-    x = (float)p[0];
-    y = (float)p[1];
-    z = (float)p[2];
-    data[3] = 1.0f;
-  }
-};
-
 struct SimulationOptions {
   std::string output_dir = "/sim_output";  // output path (relative or absolute) to save simulation data
   std::string root_path = "";
@@ -324,20 +266,6 @@ Eigen::Vector3d rot_to_yaw_pitch_roll(Eigen::Matrix3d C) {
 
 }  // namespace simulation
 
-// clang-format off
-POINT_CLOUD_REGISTER_POINT_STRUCT(
-    simulation::PCLPoint3D,
-    // cartesian coordinates
-    (float, x, x)
-    (float, y, y)
-    (float, z, z)
-    // random stuff
-    (float, flex11, flex11)
-    (float, flex12, flex12)
-    (float, flex13, flex13)
-    (float, flex14, flex14))
-// clang-format on
-
 int main(int argc, char **argv) {
   using namespace simulation;
 
@@ -347,17 +275,7 @@ int main(int argc, char **argv) {
   auto tf_static_bc = std::make_shared<tf2_ros::StaticTransformBroadcaster>(node);
   auto tf_bc = std::make_shared<tf2_ros::TransformBroadcaster>(node);
   auto raw_points_publisher = node->create_publisher<sensor_msgs::msg::PointCloud2>("/simulation_raw", 2);
-
-  auto to_pc2_msg = [](const auto &points, const std::string &frame_id = "map") {
-    pcl::PointCloud<PCLPoint3D> points_pcl;
-    points_pcl.reserve(points.size());
-    for (auto &pt : points) points_pcl.emplace_back(pt);
-    sensor_msgs::msg::PointCloud2 points_msg;
-    pcl::toROSMsg(points_pcl, points_msg);
-    points_msg.header.frame_id = frame_id;
-    // points_msg.header.stamp = rclcpp::Time(stamp);
-    return points_msg;
-  };
+  steam_icp::PointCloud2Serializer raw_points_serializer;
 
   // Logging
   FLAGS_log_dir = node->declare_parameter<std::string>("log_dir", "/tmp");
@@ -587,8 +505,7 @@ int main(int argc, char **argv) {
     fout.close();
 
     // publish pointcloud
-    auto raw_points_msg = to_pc2_msg(points, "sensor");
-    raw_points_publisher->publish(raw_points_msg);
+    raw_points_publisher->publish(raw_points_serializer.serialize(points, "sensor"));
 
     if (min_diff_t_mid_s != 0) {
       const int64_t dtns = tns + (delta_ns / 2) - t_mid_min_ns;
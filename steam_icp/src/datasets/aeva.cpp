@@ -4,58 +4,20 @@
 #include <filesystem>
 #include <fstream>
 
+#include "steam_icp/datasets/lidar_bin.hpp"
 #include "steam_icp/datasets/utils.hpp"
+#include "steam_icp/utils/csv.hpp"
 
 namespace steam_icp {
 
 namespace {
 std::vector<Point3D> readPointCloud(const std::string &path, const double &time_sec, const double &min_dist,
                                     const double &max_dist) {
-  std::vector<Point3D> frame;
-  // read bin file
-  std::ifstream ifs(path, std::ios::binary);
-  std::vector<char> buffer(std::istreambuf_iterator<char>(ifs), {});
-  unsigned float_offset = 4;
-  unsigned fields = 5;  // x, y, z, v, t
-  unsigned point_step = float_offset * fields;
-  unsigned numPointsIn = std::floor(buffer.size() / point_step);
-
-  auto getFloatFromByteArray = [](char *byteArray, unsigned index) -> float { return *((float *)(byteArray + index)); };
-
-  double frame_last_timestamp = -1000000000.0;
-  double frame_first_timestamp = std::numeric_limits<double>::max();
-  frame.reserve(numPointsIn);
-  for (unsigned i(0); i < numPointsIn; i++) {
-    Point3D new_point;
-
-    int bufpos = i * point_step;
-    int offset = 0;
-    new_point.raw_pt[0] = getFloatFromByteArray(buffer.data(), bufpos + offset * float_offset);
-    ++offset;
-    new_point.raw_pt[1] = getFloatFromByteArray(buffer.data(), bufpos + offset * float_offset);
-    ++offset;
-    new_point.raw_pt[2] = getFloatFromByteArray(buffer.data(), bufpos + offset * float_offset);
-    new_point.pt = new_point.raw_pt;
-
-    ++offset;
-    new_point.radial_velocity = getFloatFromByteArray(buffer.data(), bufpos + offset * float_offset);
-    ++offset;
-    new_point.alpha_timestamp = getFloatFromByteArray(buffer.data(), bufpos + offset * float_offset);
-
-    if (new_point.alpha_timestamp < frame_first_timestamp) {
-      frame_first_timestamp = new_point.alpha_timestamp;
-    }
-
-    if (new_point.alpha_timestamp > frame_last_timestamp) {
-      frame_last_timestamp = new_point.alpha_timestamp;
-    }
-
-    double r = new_point.raw_pt.norm();
-    if ((r > min_dist) && (r < max_dist)) {
-      frame.push_back(new_point);
-    }
-  }
-  frame.shrink_to_fit();
+  const LidarBinLayout layout{5, 3, 4, -1};  // x, y, z, v, t
+  auto bin = readLidarBin(MappedFile(path), layout, min_dist, max_dist);
+  const double frame_first_timestamp = bin.first_time;
+  const double frame_last_timestamp = bin.last_time;
+  std::vector<Point3D> frame = std::move(bin.points);
 
   for (int i(0); i < (int)frame.size(); i++) {
     frame[i].timestamp = time_sec + frame[i].alpha_timestamp;
@@ -66,28 +28,6 @@ std::vector<Point3D> readPointCloud(const std::string &path, const double &time_
   return frame;
 }
 
-/* -------------------------------------------------------------------------------------------------------------- */
-ArrayPoses loadPoses(const std::string &file_path) {
-  ArrayPoses poses;
-  std::ifstream pFile(file_path);
-  if (pFile.is_open()) {
-    while (!pFile.eof()) {
-      std::string line;
-      std::getline(pFile, line);
-      if (line.empty()) continue;
-      std::stringstream ss(line);
-      Eigen::Matrix4d P = Eigen::Matrix4d::Identity();
-      ss >> P(0, 0) >> P(0, 1) >> P(0, 2) >> P(0, 3) >> P(1, 0) >> P(1, 1) >> P(1, 2) >> P(1, 3) >> P(2, 0) >>
-          P(2, 1) >> P(2, 2) >> P(2, 3);
-      poses.push_back(P);
-    }
-    pFile.close();
-  } else {
-    throw std::runtime_error{"unable to open file: " + file_path};
-  }
-  return poses;
-}
-
 }  // namespace
 
 AevaSequence::AevaSequence(const Options &options) : Sequence(options) {
@@ -100,13 +40,8 @@ AevaSequence::AevaSequence(const Options &options) : Sequence(options) {
   std::sort(filenames_.begin(), filenames_.end());
   //
   std::string timestamp_file = options_.root_path + "/" + options_.sequence + "/timestamps.txt";
-  std::ifstream ifs(timestamp_file, std::ios::in);
-  for (std::string line; std::getline(ifs, line);) {
-    std::stringstream str(line);
-    double timestamp;
-    str >> timestamp;
-    timestamps_.push_back(timestamp);
-  }
+  const CsvTable timestamps(timestamp_file, {' ', 0, 1});
+  timestamps_.assign(timestamps.row(0), timestamps.row(0) + timestamps.rows());
   if ((int)timestamps_.size() != last_frame_)
     throw std::runtime_error{"timestamp file and point cloud file number mismatch"};
 
@@ -116,14 +51,24 @@ AevaSequence::AevaSequence(const Options &options) : Sequence(options) {
   init_frame_ = std::max(0, options_.init_frame);
 }
 
+void AevaSequence::setInitFrame(int frame_index) {
+  if (frame_index < 0 || frame_index >= last_frame_)
+    throw std::out_of_range{"frame " + std::to_string(frame_index) + " is not in sequence " + name()};
+  init_frame_ = curr_frame_ = frame_index;
+}
+
 DataFrame AevaSequence::next() {
   if (!hasNext()) throw std::runtime_error("No more frames in sequence");
-  int curr_frame = curr_frame_++;
-  auto filename = filenames_.at(curr_frame);
+  return frameAt(curr_frame_++);
+}
+
+DataFrame AevaSequence::frameAt(size_t index) const {
+  if (index >= filenames_.size())
+    throw std::out_of_range{"frame " + std::to_string(index) + " is not in sequence " + name()};
   DataFrame frame;
-  auto timestamp = timestamps_.at(curr_frame);
+  auto timestamp = timestamps_[index];
   frame.timestamp = timestamp;
-  frame.pointcloud = readPointCloud(dir_path_ + "/" + filename, timestamp, options_.min_dist_sensor_center,
+  frame.pointcloud = readPointCloud(dir_path_ + "/" + filenames_[index], timestamp, options_.min_dist_sensor_center,
                                     options_.max_dist_sensor_center);
 
   return frame;
@@ -156,7 +101,7 @@ void AevaSequence::save(const std::string &path, const Trajectory &trajectory) c
 auto AevaSequence::evaluate(const std::string &path, const Trajectory &trajectory) const -> SeqError {
   //
   std::string ground_truth_file = options_.root_path + "/" + options_.sequence + "/aeva_poses.txt";
-  const auto gt_poses_full = loadPoses(ground_truth_file);
+  const auto gt_poses_full = loadKittiPoses(ground_truth_file);
   const ArrayPoses gt_poses(gt_poses_full.begin() + init_frame_, gt_poses_full.begin() + last_frame_);
 
   //
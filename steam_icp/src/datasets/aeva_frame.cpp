@@ -0,0 +1,176 @@
+#include "steam_icp/datasets/aeva_frame.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "steam_icp/utils/csv.hpp"
+
+namespace steam_icp {
+
+AevaVelocityCalibration AevaVelocityCalibration::load(const std::string &dir) {
+  const auto read = [&dir](const std::string &name) {
+    CsvTable table(dir + "/" + name);
+    if (table.rows() == 0) throw std::runtime_error{"empty Aeva calibration table " + dir + "/" + name};
+    return table;
+  };
+  const auto rounded = [](double value) { return static_cast<double>(static_cast<float>(value)); };
+
+  AevaVelocityCalibration calibration;
+  const CsvTable rt_parts = read("rt_part.csv");
+  if (rt_parts.rows() < kNumBeams) throw std::runtime_error{"rt_part.csv holds fewer than 4 beams in " + dir};
+  const int P = calibration.num_parts = rt_parts.cols();
+  for (int b = 0; b < kNumBeams; ++b)
+    for (int p = 0; p < P; ++p) calibration.rt_parts.push_back(rounded(rt_parts(b, p)));
+
+  for (int b = 0; b < kNumBeams; ++b) {
+    const CsvTable azi_ranges = read("azi_minmax_" + std::to_string(b) + ".csv");
+    const CsvTable vel_means = read("vel_mean_" + std::to_string(b) + ".csv");
+    if (azi_ranges.rows() < size_t(P) || vel_means.rows() < size_t(P))
+      throw std::runtime_error{"Aeva calibration of beam " + std::to_string(b) + " has fewer partitions than rt_part"};
+    const int bins = vel_means.cols();
+    calibration.num_bins.push_back(bins);
+    for (int p = 0; p < P; ++p) {
+      const double min = rounded(azi_ranges(p, 0)), max = rounded(azi_ranges(p, 1));
+      calibration.azi_min.push_back(min);
+      calibration.azi_res.push_back((max - min) / bins);
+      calibration.bin_begin.push_back(calibration.vel_means.size());
+      for (int k = 0; k < bins; ++k) calibration.vel_means.push_back(rounded(vel_means(p, k)));
+    }
+  }
+  return calibration;
+}
+
+namespace {
+
+// columns of a frame, reused from one frame to the next
+struct AevaFrameColumns {
+  std::vector<double> x, y, z, v, t, alpha, azimuth;
+  std::vector<int> beam, part;
+
+  void resize(size_t n) {
+    for (auto *column : {&x, &y, &z, &v, &t, &alpha, &azimuth})
+      if (column->size() < n) column->resize(n);
+    for (auto *column : {&beam, &part})
+      if (column->size() < n) column->resize(n);
+  }
+};
+
+// atan2 within kAzimuthError, as straight line arithmetic so that it vectorizes (odd polynomial of Abramowitz and
+// Stegun 4.4.49 for atan over [0, 1], |error| <= 2e-8, folded onto the four quadrants)
+constexpr double kAzimuthError = 1e-6;
+
+inline double approxAtan2(double y, double x) {
+  const double ax = std::abs(x), ay = std::abs(y);
+  const double hi = std::max(ax, ay), lo = std::min(ax, ay);
+  const double r = lo / (hi > 0.0 ? hi : 1.0), r2 = r * r;
+  double a = 0.0028662257;
+  a = a * r2 - 0.0161657367;
+  a = a * r2 + 0.0429096138;
+  a = a * r2 - 0.0752896400;
+  a = a * r2 + 0.1065626393;
+  a = a * r2 - 0.1420889944;
+  a = a * r2 + 0.1999355085;
+  a = a * r2 - 0.3333314528;
+  a = (a * r2 + 1.0) * r;
+  a = ay > ax ? M_PI_2 - a : a;
+  a = std::signbit(x) ? M_PI - a : a;
+  return std::signbit(y) ? -a : a;
+}
+
+/**
+ * Subtracts the mean velocity of its (beam, partition, azimuth bin) from every point. The bin is taken from the
+ * approximate azimuth whenever the error bound cannot move it across a bin edge, and from std::atan2 otherwise, so
+ * that every point lands in the exact same bin as with std::atan2 alone.
+ */
+void calibrateRadialVelocity(const AevaVelocityCalibration &calibration, AevaFrameColumns &c, size_t count) {
+  using Calibration = AevaVelocityCalibration;
+  const int P = calibration.num_parts;
+
+  // partition of the relative time, -1 for points without a valid beam
+  for (size_t i = 0; i < count; ++i) {
+    const int b = c.beam[i];
+    if (b < 0 || b >= Calibration::kNumBeams) {
+      c.part[i] = -1;
+      continue;
+    }
+    // partitions start in increasing order, the last one takes every time from its start on
+    const double *parts = calibration.rt_parts.data() + b * P;
+    int below = 0;
+    for (int k = 1; k < P - 1; ++k) below += c.alpha[i] > parts[k];
+    c.part[i] = b * P + (c.alpha[i] >= parts[P - 1] ? P - 1 : below);
+  }
+
+  for (size_t i = 0; i < count; ++i) c.azimuth[i] = approxAtan2(c.y[i], c.x[i]);
+
+  for (size_t i = 0; i < count; ++i) {
+    const int bp = c.part[i];
+    if (bp < 0) continue;
+    const int b = bp / P;
+    const double azi_min = calibration.azi_min[bp], azi_res = calibration.azi_res[bp];
+    const int last = calibration.num_bins[b] - 1;
+    const double lower = std::floor((c.azimuth[i] - kAzimuthError - azi_min) / azi_res);
+    const double upper = std::floor((c.azimuth[i] + kAzimuthError - azi_min) / azi_res);
+    int bin;
+    if (lower == upper || (lower >= last && upper >= last) || (lower <= 0 && upper <= 0))
+      bin = std::clamp(static_cast<int>(lower), 0, last);
+    else  // near a bin edge
+      bin = std::clamp(static_cast<int>(std::floor((std::atan2(c.y[i], c.x[i]) - azi_min) / azi_res)), 0, last);
+    c.v[i] -= calibration.vel_means[calibration.bin_begin[bp] + bin];
+  }
+}
+
+}  // namespace
+
+std::vector<Point3D> readAevaFrame(const MappedFile &file, double time_delta_sec, double min_dist, double max_dist,
+                                   const AevaVelocityCalibration *calibration) {
+  // x, y, z, i, v, t, b
+  const size_t stride = calibration != nullptr ? 7 : 6;
+  const size_t n = file.count<float>() / stride;
+  const float *data = file.as<float>();
+
+  // range filter and time bounds, the kept records compacted into columns
+  thread_local AevaFrameColumns c;
+  c.resize(n);
+  float first_time = std::numeric_limits<float>::max(), last_time = std::numeric_limits<float>::lowest();
+  const double min_dist2 = min_dist * min_dist, max_dist2 = max_dist * max_dist;
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const float *record = data + i * stride;
+    first_time = std::min(first_time, record[5]);
+    last_time = std::max(last_time, record[5]);
+    const double x = record[0], y = record[1], z = record[2];
+    c.x[count] = x;
+    c.y[count] = y;
+    c.z[count] = z;
+    c.v[count] = record[4];
+    c.t[count] = record[5];
+    c.beam[count] = calibration != nullptr ? static_cast<int>(record[6]) : -1;
+    const double r2 = x * x + y * y + z * z;
+    count += (r2 > min_dist2) & (r2 < max_dist2);
+  }
+
+  // relative time in [0, 1]
+  const double frame_first_timestamp = first_time, frame_last_timestamp = last_time;
+  for (size_t i = 0; i < count; ++i)
+    c.alpha[i] = std::min(1.0, std::max(0.0, 1 - (frame_last_timestamp - c.t[i]) /
+                                                     (frame_last_timestamp - frame_first_timestamp)));
+
+  if (calibration != nullptr) calibrateRadialVelocity(*calibration, c, count);
+
+  std::vector<Point3D> frame;
+  frame.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    Point3D &point = frame.emplace_back();
+    point.raw_pt = Eigen::Vector3d(c.x[i], c.y[i], c.z[i]);
+    point.pt = point.raw_pt;
+    point.radial_velocity = c.v[i];
+    point.timestamp = c.t[i] + time_delta_sec;
+    point.alpha_timestamp = c.alpha[i];
+    point.beam_id = c.beam[i];
+  }
+  return frame;
+}
+
+}  // namespace steam_icp
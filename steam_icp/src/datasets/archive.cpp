@@ -0,0 +1,284 @@
+#include "steam_icp/datasets/archive.hpp"
+#include "steam_icp/datasets/quantized_archive.hpp"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace steam_icp {
+
+namespace {
+
+size_t pointsSize(size_t num_points) {
+  return 6 * archiveAligned(num_points * sizeof(float)) + archiveAligned(num_points * 4);
+}
+
+// 64 bit FNV-1a
+class Hasher {
+ public:
+  void add(const void *data, size_t size) {
+    const auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) hash_ = (hash_ ^ bytes[i]) * 0x100000001b3ull;
+  }
+  template <typename T>
+  void add(const T &value) {
+    static_assert(std::is_arithmetic_v<T>);
+    add(&value, sizeof(value));
+  }
+  void add(const std::string &value) { add(value.data(), value.size() + 1); }
+
+  uint64_t hash() const { return hash_; }
+
+ private:
+  uint64_t hash_ = 0xcbf29ce484222325ull;
+};
+
+// Whether the archive at path, of the given magic, was written by this version with the frame options of options.
+bool archiveMatches(const std::string &path, const char (&magic)[8], const Sequence::Options &options) {
+  ArchiveHeader header{};
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, magic, sizeof(header.magic)) != 0)
+    throw std::runtime_error{"not a frame archive: " + path};
+  if (header.version != ArchiveHeader::kVersion) {
+    LOG(WARNING) << "Frame archive " << path << " has version " << header.version << " instead of "
+                 << ArchiveHeader::kVersion << ", it needs to be written again" << std::endl;
+    return false;
+  }
+  if (header.options_hash != frameOptionsHash(options)) {
+    LOG(WARNING) << "Frame archive " << path << " was written with other frame options than the current ones"
+                 << std::endl;
+    return false;
+  }
+  const int64_t init_frame = std::max(0, options.init_frame);
+  const int64_t end_frame = header.first_frame + header.num_frames;
+  if (static_cast<int64_t>(header.first_frame) > init_frame ||
+      (end_frame < options.last_frame && !(header.flags & ArchiveHeader::kToSequenceEnd))) {
+    LOG(WARNING) << "Frame archive " << path << " holds frames [" << header.first_frame << ", " << end_frame
+                 << "), not all of [" << init_frame << ", " << options.last_frame << ")" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+uint64_t frameOptionsHash(const Sequence::Options &options) {
+  Hasher hasher;
+  hasher.add(options.dataset);
+  hasher.add(options.min_dist_sensor_center);
+  hasher.add(options.max_dist_sensor_center);
+  hasher.add(options.radar_resolution);
+  hasher.add(options.radar_range_offset);
+  for (const int value : {options.modified_cacfar_width, options.modified_cacfar_guard,
+                          options.modified_cacfar_width_0438, options.modified_cacfar_guard_0438})
+    hasher.add(value);
+  for (const double value : {options.modified_cacfar_threshold, options.modified_cacfar_threshold2,
+                             options.modified_cacfar_threshold3, options.modified_cacfar_threshold_0438,
+                             options.modified_cacfar_threshold2_0438, options.modified_cacfar_threshold3_0438})
+    hasher.add(value);
+  hasher.add(options.lidar_timestamp_round);
+  hasher.add(options.lidar_timestamp_round_hz);
+  return hasher.hash();
+}
+
+void writeMeasurements(ArchiveWriter &writer, const DataFrame &frame) {
+  thread_local std::vector<double> measurements;
+  measurements.clear();
+  for (const auto &imu : frame.imu_data_vec) {
+    measurements.emplace_back(imu.timestamp);
+    measurements.insert(measurements.end(), imu.ang_vel.data(), imu.ang_vel.data() + 3);
+    measurements.insert(measurements.end(), imu.lin_acc.data(), imu.lin_acc.data() + 3);
+  }
+  writer.column(measurements);
+  measurements.clear();
+  for (const auto &pose : frame.pose_data_vec) {
+    measurements.emplace_back(pose.timestamp);
+    for (int r = 0; r < 3; ++r)
+      for (int c = 0; c < 4; ++c) measurements.emplace_back(pose.pose(r, c));
+  }
+  writer.column(measurements);
+}
+
+void readMeasurements(const char *block, size_t num_imu, size_t num_poses, DataFrame &frame) {
+  const auto imu = reinterpret_cast<const double *>(block);
+  frame.imu_data_vec.resize(num_imu);
+  for (size_t i = 0; i < num_imu; ++i) {
+    const double *record = imu + 7 * i;
+    frame.imu_data_vec[i].timestamp = record[0];
+    frame.imu_data_vec[i].ang_vel = Eigen::Map<const Eigen::Vector3d>(record + 1);
+    frame.imu_data_vec[i].lin_acc = Eigen::Map<const Eigen::Vector3d>(record + 4);
+  }
+  const auto poses = imu + archiveAligned(num_imu * 7 * sizeof(double)) / sizeof(double);
+  frame.pose_data_vec.resize(num_poses);
+  for (size_t i = 0; i < num_poses; ++i) {
+    const double *record = poses + 13 * i;
+    frame.pose_data_vec[i].timestamp = record[0];
+    using Matrix34dRowMajor = Eigen::Matrix<double, 3, 4, Eigen::RowMajor>;
+    frame.pose_data_vec[i].pose.topRows<3>() = Eigen::Map<const Matrix34dRowMajor>(record + 1);
+  }
+}
+
+void writeGroundTruth(ArchiveWriter &writer, const ArrayPoses &poses) {
+  for (const auto &pose : poses) writer.write(pose.data(), 16 * sizeof(double));
+}
+
+ArrayPoses readGroundTruth(const char *data, size_t num_poses) {
+  const auto gt = reinterpret_cast<const double *>(data);
+  ArrayPoses poses(num_poses);
+  for (size_t i = 0; i < num_poses; ++i) poses[i] = Eigen::Map<const Eigen::Matrix4d>(gt + 16 * i);
+  return poses;
+}
+
+void writeArchive(Sequence &sequence, const std::string &path) {
+  const std::string tmp_path = path + ".tmp";
+  ArchiveWriter writer(tmp_path);
+  ArchiveHeader header{};
+  std::memcpy(header.magic, ArchiveHeader::kMagic, sizeof(header.magic));
+  header.version = ArchiveHeader::kVersion;
+  header.flags = sequence.hasGroundTruth() ? ArchiveHeader::kHasGroundTruth : 0;
+  header.first_frame = sequence.currFrame();
+  header.options_hash = frameOptionsHash(sequence.options());
+  writer.write(&header, sizeof(header));
+  writer.pad();
+
+  std::vector<ArchiveFrame> index;
+  std::vector<float> x, y, z, radial_velocity, alpha_timestamp, dt;
+  std::vector<int32_t> beam_id;
+  while (sequence.hasNext()) {
+    const DataFrame frame = sequence.next();
+    const auto &points = frame.pointcloud;
+    ArchiveFrame entry{};
+    entry.timestamp = frame.timestamp;
+    entry.offset = writer.offset();
+    entry.num_points = points.size();
+    entry.num_imu = frame.imu_data_vec.size();
+    entry.num_poses = frame.pose_data_vec.size();
+
+    for (auto *column : {&x, &y, &z, &radial_velocity, &alpha_timestamp, &dt}) column->resize(points.size());
+    beam_id.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+      x[i] = points[i].raw_pt[0];
+      y[i] = points[i].raw_pt[1];
+      z[i] = points[i].raw_pt[2];
+      radial_velocity[i] = points[i].radial_velocity;
+      alpha_timestamp[i] = points[i].alpha_timestamp;
+      dt[i] = points[i].timestamp - frame.timestamp;
+      beam_id[i] = points[i].beam_id;
+    }
+    for (const auto *column : {&x, &y, &z, &radial_velocity, &alpha_timestamp, &dt}) writer.column(*column);
+    writer.column(beam_id);
+
+    writeMeasurements(writer, frame);
+    index.emplace_back(entry);
+  }
+
+  header.num_frames = index.size();
+  // the sequence ran out of frames before its last_frame option
+  if (static_cast<int64_t>(header.first_frame + header.num_frames) < sequence.options().last_frame)
+    header.flags |= ArchiveHeader::kToSequenceEnd;
+  header.index_offset = writer.offset();
+  writer.column(index);
+  const ArrayPoses gt_poses = sequence.groundTruthPoses();
+  header.num_gt_poses = gt_poses.size();
+  header.gt_offset = writer.offset();
+  writeGroundTruth(writer, gt_poses);
+  writer.writeAt(0, &header, sizeof(header));
+  writer.close();
+  std::filesystem::rename(tmp_path, path);
+  LOG(INFO) << "Wrote " << index.size() << " frames of " << sequence.name() << " to " << path << std::endl;
+}
+
+ArchiveSequence::ArchiveSequence(const std::string &path, const Options &options,
+                                 std::function<Sequence::Ptr()> make_source)
+    : Sequence(options), file_(path, false), make_source_(std::move(make_source)) {
+  header_ = file_.as<ArchiveHeader>();
+  if (file_.size() < sizeof(ArchiveHeader) ||
+      std::memcmp(header_->magic, ArchiveHeader::kMagic, sizeof(header_->magic)) != 0)
+    throw std::runtime_error{"not a frame archive: " + path};
+  if (header_->version != ArchiveHeader::kVersion)
+    throw std::runtime_error{"unsupported frame archive version " + std::to_string(header_->version) + ": " + path};
+  if (header_->index_offset + header_->num_frames * sizeof(ArchiveFrame) > file_.size() ||
+      header_->gt_offset + header_->num_gt_poses * 16 * sizeof(double) > file_.size())
+    throw std::runtime_error{"truncated frame archive: " + path};
+  index_ = reinterpret_cast<const ArchiveFrame *>(file_.data() + header_->index_offset);
+
+  const int first_frame = header_->first_frame;
+  last_frame_ = std::min<int64_t>(options_.last_frame, first_frame + header_->num_frames);
+  init_frame_ = curr_frame_ = std::max(options_.init_frame, first_frame);
+  LOG(INFO) << "Replaying frames [" << init_frame_ << ", " << last_frame_ << ") of " << name() << " from " << path
+            << std::endl;
+}
+
+void ArchiveSequence::setInitFrame(int frame_index) {
+  if (frame_index < static_cast<int>(header_->first_frame) || frame_index >= last_frame_)
+    throw std::out_of_range{"frame " + std::to_string(frame_index) + " is not in the archive of " + name()};
+  init_frame_ = curr_frame_ = frame_index;
+}
+
+DataFrame ArchiveSequence::next() {
+  if (!hasNext()) throw std::runtime_error("No more frames in sequence");
+  const int curr_frame = curr_frame_++;
+  // start reading the next frame in while this one is unpacked and registered
+  if (hasNext()) {
+    const auto &next = index_[curr_frame_ - header_->first_frame];
+    file_.prefetch(next.offset, pointsSize(next.num_points) + measurementsSize(next.num_imu, next.num_poses));
+  }
+  return read(curr_frame);
+}
+
+DataFrame ArchiveSequence::read(size_t index, bool with_measurements) const {
+  if (index < header_->first_frame || index >= header_->first_frame + header_->num_frames)
+    throw std::out_of_range{"frame " + std::to_string(index) + " is not in the archive of " + name()};
+  const auto &entry = index_[index - header_->first_frame];
+  const size_t n = entry.num_points;
+  const char *block = file_.data() + entry.offset;
+  const size_t column_size = archiveAligned(n * sizeof(float));
+  const auto column = [&](int c) { return reinterpret_cast<const float *>(block + c * column_size); };
+  const float *x = column(0), *y = column(1), *z = column(2), *radial_velocity = column(3),
+              *alpha_timestamp = column(4), *dt = column(5);
+  const auto beam_id = reinterpret_cast<const int32_t *>(column(6));
+
+  DataFrame frame;
+  frame.timestamp = entry.timestamp;
+  frame.pointcloud.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    auto &point = frame.pointcloud[i];
+    point.raw_pt = Eigen::Vector3d(x[i], y[i], z[i]);
+    point.pt = point.raw_pt;
+    point.radial_velocity = radial_velocity[i];
+    point.alpha_timestamp = alpha_timestamp[i];
+    point.timestamp = entry.timestamp + dt[i];
+    point.beam_id = beam_id[i];
+  }
+  if (!with_measurements) return frame;
+
+  readMeasurements(block + pointsSize(n), entry.num_imu, entry.num_poses, frame);
+  return frame;
+}
+
+const Sequence::Ptr &ArchiveSequence::source() const {
+  std::call_once(source_once_, [this] { source_ = make_source_(); });
+  return source_;
+}
+
+Sequence::Ptr Dataset::open(const Sequence::Options &options, const std::function<Sequence::Ptr()> &make) {
+  if (!options.archive_dir.empty()) {
+    const auto path = archivePath(options.archive_dir, options.sequence);
+    if (std::filesystem::is_regular_file(path) && archiveMatches(path, ArchiveHeader::kMagic, options))
+      return std::make_shared<ArchiveSequence>(path, options, make);
+    const auto quantized_path = quantizedArchivePath(options.archive_dir, options.sequence);
+    if (std::filesystem::is_regular_file(quantized_path) &&
+        archiveMatches(quantized_path, QuantizedArchiveHeader::kMagic, options))
+      return std::make_shared<QuantizedArchiveSequence>(quantized_path, options, make);
+    LOG(WARNING) << "No usable frame archive " << path << " or " << quantized_path << ", reading the raw frames"
+                 << std::endl;
+  }
+  return make();
+}
+
+}  // namespace steam_icp
@@ -4,8 +4,8 @@
 #include <filesystem>
 #include <fstream>
 
+#include "steam_icp/datasets/kitti_ply.hpp"
 #include "steam_icp/datasets/utils.hpp"
-#include "steam_icp/utils/ply_file.h"
 
 namespace steam_icp {
 
@@ -30,90 +30,6 @@ inline std::string frame_file_name(int frame_id) {
   return "frame_" + ss.str() + ".ply";
 }
 
-std::vector<Point3D> readPointCloud(const std::string &path, const double &min_dist, const double &max_dist) {
-  std::vector<Point3D> frame;
-  // read ply frame file
-  PlyFile plyFileIn(path, fileOpenMode_IN);
-  char *dataIn = nullptr;
-  int sizeOfPointsIn = 0;
-  int numPointsIn = 0;
-  plyFileIn.readFile(dataIn, sizeOfPointsIn, numPointsIn);
-
-  // Specific Parameters for KITTI_raw
-  const double KITTI_MIN_Z = -5.0;                          // Bad returns under the ground
-  const double KITTI_GLOBAL_VERTICAL_ANGLE_OFFSET = 0.205;  // Issue in intrinsic calibration of KITTI Velodyne HDL64
-
-  double frame_last_timestamp = 0.0;
-  double frame_first_timestamp = 1000000000.0;
-  frame.reserve(numPointsIn);
-  for (int i(0); i < numPointsIn; i++) {
-    unsigned long long int offset = (unsigned long long int)i * (unsigned long long int)sizeOfPointsIn;
-    Point3D new_point;
-    new_point.raw_pt[0] = *((float *)(dataIn + offset));
-    offset += sizeof(float);
-    new_point.raw_pt[1] = *((float *)(dataIn + offset));
-    offset += sizeof(float);
-    new_point.raw_pt[2] = *((float *)(dataIn + offset));
-    offset += sizeof(float);
-    new_point.pt = new_point.raw_pt;
-    new_point.alpha_timestamp = *((float *)(dataIn + offset));
-    offset += sizeof(float);
-
-    if (new_point.alpha_timestamp < frame_first_timestamp) {
-      frame_first_timestamp = new_point.alpha_timestamp;
-    }
-
-    if (new_point.alpha_timestamp > frame_last_timestamp) {
-      frame_last_timestamp = new_point.alpha_timestamp;
-    }
-
-    double r = new_point.raw_pt.norm();
-    if ((r > min_dist) && (r < max_dist) && (new_point.raw_pt[2] > KITTI_MIN_Z)) {
-      frame.push_back(new_point);
-    }
-  }
-  frame.shrink_to_fit();
-
-  for (int i(0); i < (int)frame.size(); i++) {
-    frame[i].alpha_timestamp = std::min(1.0, std::max(0.0, 1 - (frame_last_timestamp - frame[i].alpha_timestamp) /
-                                                                   (frame_last_timestamp - frame_first_timestamp)));
-  }
-  delete[] dataIn;
-
-  // Intrinsic calibration of the vertical angle of laser fibers (take the same correction for all lasers)
-  for (int i = 0; i < (int)frame.size(); i++) {
-    Eigen::Vector3d rotationVector = frame[i].pt.cross(Eigen::Vector3d(0., 0., 1.));
-    rotationVector.normalize();
-    Eigen::Matrix3d rotationScan;
-    rotationScan = Eigen::AngleAxisd(KITTI_GLOBAL_VERTICAL_ANGLE_OFFSET * M_PI / 180.0, rotationVector);
-    frame[i].raw_pt = rotationScan * frame[i].raw_pt;
-    frame[i].pt = rotationScan * frame[i].pt;
-  }
-  return frame;
-}
-
-/* -------------------------------------------------------------------------------------------------------------- */
-ArrayPoses loadPoses(const std::string &file_path) {
-  ArrayPoses poses;
-  std::ifstream pFile(file_path);
-  if (pFile.is_open()) {
-    while (!pFile.eof()) {
-      std::string line;
-      std::getline(pFile, line);
-      if (line.empty()) continue;
-      std::stringstream ss(line);
-      Eigen::Matrix4d P = Eigen::Matrix4d::Identity();
-      ss >> P(0, 0) >> P(0, 1) >> P(0, 2) >> P(0, 3) >> P(1, 0) >> P(1, 1) >> P(1, 2) >> P(1, 3) >> P(2, 0) >>
-          P(2, 1) >> P(2, 2) >> P(2, 3);
-      poses.push_back(P);
-    }
-    pFile.close();
-  } else {
-    throw std::runtime_error{"unable to open file: " + file_path};
-  }
-  return poses;
-}
-
 /* -------------------------------------------------------------------------------------------------------------- */
 ArrayPoses transformTrajectory(const Trajectory &trajectory) {
   // For KITTI_raw the evaluation counts the middle of the frame as the pose which is compared to the ground truth
@@ -171,12 +87,25 @@ Kitti360Sequence::Kitti360Sequence(const Options &options) : Sequence(options) {
   has_ground_truth_ = ((init_frame_ == 0) && last_frame_ == (LENGTH_SEQUENCE_KITTI_360[sequence_id_] + 1));
 }
 
+void Kitti360Sequence::setInitFrame(int frame_index) {
+  if (frame_index < 0 || frame_index >= last_frame_)
+    throw std::out_of_range{"frame " + std::to_string(frame_index) + " is not in sequence " + name()};
+  init_frame_ = curr_frame_ = frame_index;
+  has_ground_truth_ = ((init_frame_ == 0) && last_frame_ == (LENGTH_SEQUENCE_KITTI_360[sequence_id_] + 1));
+}
+
 DataFrame Kitti360Sequence::next() {
   if (!hasNext()) throw std::runtime_error("No more frames in sequence");
-  int curr_frame = curr_frame_++;
+  return frameAt(curr_frame_++);
+}
+
+DataFrame Kitti360Sequence::frameAt(size_t index) const {
+  if (index > size_t(LENGTH_SEQUENCE_KITTI_360[sequence_id_]))
+    throw std::out_of_range{"frame " + std::to_string(index) + " is not in sequence " + name()};
+  const int curr_frame = index;
   auto filename = dir_path_ + frame_file_name(curr_frame);
   DataFrame frame;
-  frame.pointcloud = readPointCloud(filename, options_.min_dist_sensor_center, options_.max_dist_sensor_center);
+  frame.pointcloud = readKittiPly(filename, options_.min_dist_sensor_center, options_.max_dist_sensor_center);
   auto &pc = frame.pointcloud;
   for (auto &point : pc) point.timestamp = (static_cast<double>(curr_frame) + point.alpha_timestamp) / 10.0;
   frame.timestamp = static_cast<double>(curr_frame) / 10.0 + 0.05;
@@ -206,7 +135,7 @@ void Kitti360Sequence::save(const std::string &path, const Trajectory &trajector
 auto Kitti360Sequence::evaluate(const std::string &path, const Trajectory &trajectory) const -> SeqError {
   //
   std::string ground_truth_file = options_.root_path + "/" + options_.sequence + "/" + options_.sequence + ".txt";
-  const auto gt_poses = loadPoses(ground_truth_file);
+  const auto gt_poses = loadKittiPoses(ground_truth_file);
 
   //
   const auto poses = transformTrajectory(trajectory);
@@ -0,0 +1,74 @@
+#include "steam_icp/datasets/kitti_ply.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "steam_icp/utils/ply_view.hpp"
+
+namespace steam_icp {
+
+namespace {
+
+// Specific Parameters for KITTI_raw
+constexpr double KITTI_MIN_Z = -5.0;                          // Bad returns under the ground
+constexpr double KITTI_GLOBAL_VERTICAL_ANGLE_OFFSET = 0.205;  // Issue in intrinsic calibration of KITTI Velodyne HDL64
+
+}  // namespace
+
+void correctVerticalAngle(double *x, double *y, double *z, size_t n, double angle) {
+  const double c = std::cos(angle), s = std::sin(angle);
+  // as Eigen arrays, whose packet sqrt vectorizes where std::sqrt (errno) does not
+  Eigen::Map<Eigen::ArrayXd> X(x, n), Y(y, n), Z(z, n);
+  const Eigen::ArrayXd rho = (X.square() + Y.square()).sqrt();
+  // no rotation axis on the vertical, the rotation then reduces to a scaling by c (as with a zero AngleAxisd axis)
+  const Eigen::ArrayXd k = (rho > 0.0).select(c - s * Z / rho, c);
+  X *= k;
+  Y *= k;
+  Z = c * Z + s * rho;
+}
+
+std::vector<Point3D> readKittiPly(const std::string &path, double min_dist, double max_dist,
+                                  double timestamp_round_dt) {
+  const PlyView ply(path);
+  if (ply.properties().size() < 4) throw std::runtime_error{"expected x, y, z and time in KITTI frame " + path};
+  const auto xs = ply.column<float>(0), ys = ply.column<float>(1), zs = ply.column<float>(2);
+  const auto ts = ply.column<float>(3);
+  const size_t n = ply.numVertices();
+
+  // one pass over the records: time bounds over all of them, the kept ones compacted into columns
+  std::vector<double> x(n), y(n), z(n), t(n);
+  double frame_last_timestamp = 0.0;
+  double frame_first_timestamp = 1000000000.0;
+  const double min_dist2 = min_dist * min_dist, max_dist2 = max_dist * max_dist;
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const double xi = xs[i], yi = ys[i], zi = zs[i];
+    double ti = ts[i];
+    if (timestamp_round_dt > 0.0) ti -= std::fmod(ti, timestamp_round_dt);
+    frame_first_timestamp = ti < frame_first_timestamp ? ti : frame_first_timestamp;
+    frame_last_timestamp = ti > frame_last_timestamp ? ti : frame_last_timestamp;
+    x[count] = xi;
+    y[count] = yi;
+    z[count] = zi;
+    t[count] = ti;
+    const double r2 = xi * xi + yi * yi + zi * zi;
+    count += (r2 > min_dist2) & (r2 < max_dist2) & (zi > KITTI_MIN_Z);
+  }
+
+  // Intrinsic calibration of the vertical angle of laser fibers (take the same correction for all lasers)
+  correctVerticalAngle(x.data(), y.data(), z.data(), count, KITTI_GLOBAL_VERTICAL_ANGLE_OFFSET * M_PI / 180.0);
+
+  std::vector<Point3D> frame(count);
+  for (size_t i = 0; i < count; ++i) {
+    auto &point = frame[i];
+    point.raw_pt = Eigen::Vector3d(x[i], y[i], z[i]);
+    point.pt = point.raw_pt;
+    point.timestamp = t[i];
+    point.alpha_timestamp = std::min(1.0, std::max(0.0, 1 - (frame_last_timestamp - t[i]) /
+                                                                (frame_last_timestamp - frame_first_timestamp)));
+  }
+  return frame;
+}
+
+}  // namespace steam_icp
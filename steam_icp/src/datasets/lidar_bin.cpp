@@ -0,0 +1,82 @@
+#include "steam_icp/datasets/lidar_bin.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace steam_icp {
+
+namespace {
+
+// range filter over the whole frame, branch free over a compile time stride so that it vectorizes
+template <int kFields>
+size_t rangeMask(const float *data, size_t n, int fields, double min_dist2, double max_dist2, uint8_t *keep) {
+  const int stride = kFields > 0 ? kFields : fields;
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const float *record = data + i * stride;
+    const double x = record[0], y = record[1], z = record[2];
+    const double r2 = x * x + y * y + z * z;
+    keep[i] = static_cast<uint8_t>((r2 > min_dist2) & (r2 < max_dist2));
+    count += keep[i];
+  }
+  return count;
+}
+
+template <typename T>
+void timeBounds(const T *times, size_t n, size_t stride, double &first, double &last) {
+  T min = std::numeric_limits<T>::max(), max = std::numeric_limits<T>::lowest();
+  for (size_t i = 0; i < n; ++i) {
+    const T t = times[i * stride];
+    min = t < min ? t : min;
+    max = t > max ? t : max;
+  }
+  first = min;
+  last = max;
+}
+
+}  // namespace
+
+LidarBinFrame readLidarBin(const MappedFile &file, const LidarBinLayout &layout, double min_dist, double max_dist,
+                           const double *times) {
+  LidarBinFrame frame;
+  const size_t n = numLidarBinRecords(file, layout);
+  const float *data = file.as<float>();
+  const size_t stride = layout.num_fields;
+  frame.num_records = n;
+  if (n == 0) return frame;
+
+  if (times != nullptr)
+    timeBounds(times, n, 1, frame.first_time, frame.last_time);
+  else if (layout.time >= 0)
+    timeBounds(data + layout.time, n, stride, frame.first_time, frame.last_time);
+
+  std::vector<uint8_t> keep(n);
+  const double min_dist2 = min_dist * min_dist, max_dist2 = max_dist * max_dist;
+  size_t count = 0;
+  switch (layout.num_fields) {
+    case 5: count = rangeMask<5>(data, n, 5, min_dist2, max_dist2, keep.data()); break;
+    case 6: count = rangeMask<6>(data, n, 6, min_dist2, max_dist2, keep.data()); break;
+    case 7: count = rangeMask<7>(data, n, 7, min_dist2, max_dist2, keep.data()); break;
+    default: count = rangeMask<0>(data, n, layout.num_fields, min_dist2, max_dist2, keep.data()); break;
+  }
+
+  frame.points.resize(count);
+  auto point = frame.points.begin();
+  for (size_t i = 0; i < n; ++i) {
+    if (!keep[i]) continue;
+    const float *record = data + i * stride;
+    point->raw_pt = Eigen::Vector3d(record[0], record[1], record[2]);
+    point->pt = point->raw_pt;
+    if (layout.radial_velocity >= 0) point->radial_velocity = record[layout.radial_velocity];
+    if (times != nullptr)
+      point->alpha_timestamp = times[i];
+    else if (layout.time >= 0)
+      point->alpha_timestamp = record[layout.time];
+    if (layout.beam_id >= 0) point->beam_id = static_cast<int>(record[layout.beam_id]);
+    ++point;
+  }
+  return frame;
+}
+
+}  // namespace steam_icp
@@ -2,206 +2,68 @@
 
 #include <glog/logging.h>
 
-#define PCL_NO_PRECOMPILE
-#include <pcl/io/pcd_io.h>
-#include <pcl/pcl_macros.h>
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-
 #include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include "steam_icp/datasets/utils.hpp"
+#include "steam_icp/utils/csv.hpp"
+#include "steam_icp/utils/pcd_view.hpp"
 namespace fs = std::filesystem;
 
 namespace steam_icp {
 
-struct EIGEN_ALIGN16 NCPoint  // enforce SSE padding for correct memory alignment
-{
-  // PCL_ADD_POINT3D;  // preferred way of adding a XYZ+padding
-
-  // float test;
-  float x, y, z, intensity;
-  std::uint32_t t;
-  std::uint16_t reflectivity;
-  uint8_t ring;
-  std::uint16_t noise;
-  std::uint32_t range;
-
-  PCL_MAKE_ALIGNED_OPERATOR_NEW  // make sure our new allocators are aligned
-};
-}  // namespace steam_icp
-
-// clang-format off
-POINT_CLOUD_REGISTER_POINT_STRUCT(steam_icp::NCPoint,
-                                  (float, x, x)
-                                  (float, y, y)
-                                  (float, z, z)
-                                  (float, intensity, intensity)
-                                  (std::uint32_t, t, t)
-                                  (std::uint16_t, reflectivity, reflectivity)
-                                  (std::uint8_t, ring, ring)
-                                  (std::uint16_t, noise, noise)
-                                  (std::uint32_t, range, range)
-)
-// clang-format on
-
-namespace steam_icp {
-
-ArrayPoses loadPredPoses(const std::string &file_path) {
-  ArrayPoses poses;
-  std::ifstream pFile(file_path);
-  std::string line;
-  if (pFile.is_open()) {
-    while (!pFile.eof()) {
-      std::getline(pFile, line);
-      if (line.empty()) continue;
-      std::stringstream ss(line);
-      Eigen::Matrix4d P = Eigen::Matrix4d::Identity();
-      ss >> P(0, 0) >> P(0, 1) >> P(0, 2) >> P(0, 3) >> P(1, 0) >> P(1, 1) >> P(1, 2) >> P(1, 3) >> P(2, 0) >>
-          P(2, 1) >> P(2, 2) >> P(2, 3);
-      poses.push_back(P);
-    }
-    pFile.close();
-  } else {
-    throw std::runtime_error{"unable to open file: " + file_path};
-  }
-  return poses;
-}
-
+// sec, nsec, x, y, z, qx, qy, qz, qw
 ArrayPoses loadGTPoses(const std::string &file_path) {
-  ArrayPoses poses;
-  std::ifstream pose_file(file_path);
-  if (pose_file.is_open()) {
-    std::string line;
-    std::getline(pose_file, line);  // header
-    for (; std::getline(pose_file, line);) {
-      if (line.empty()) continue;
-      std::stringstream ss(line);
-
-      // int sec = 0;
-      // int nsec = 0;
-      Eigen::Matrix4d T_ms = Eigen::Matrix4d::Identity();
-      double qx = 0, qy = 0, qz = 0, qw = 0;
-
-      for (int i = 0; i < 9; ++i) {
-        std::string value;
-        std::getline(ss, value, ',');
-
-        // if (i == 0)
-        //   sec = std::stol(value);
-        // else if (i == 1)
-        //   nsec = std::stol(value);
-        if (i == 2)
-          T_ms(0, 3) = std::stod(value);
-        else if (i == 3)
-          T_ms(1, 3) = std::stod(value);
-        else if (i == 4)
-          T_ms(2, 3) = std::stod(value);
-        else if (i == 5)
-          qx = std::stod(value);
-        else if (i == 6)
-          qy = std::stod(value);
-        else if (i == 7)
-          qz = std::stod(value);
-        else if (i == 8)
-          qw = std::stod(value);
-      }
-      // T_ms.block<3, 3>(0, 0) = rpy2rot(r, p, y);
-      Eigen::Quaterniond q(qw, qx, qy, qz);
-      T_ms.block<3, 3>(0, 0) = q.toRotationMatrix();
-
-      // (void)timestamp;
-
-      poses.push_back(T_ms);
-    }
-  } else {
-    throw std::runtime_error{"unable to open file: " + file_path};
+  const CsvTable table(file_path, {',', 1, 9});
+  ArrayPoses poses(table.rows(), Eigen::Matrix4d::Identity());
+  for (size_t i = 0; i < table.rows(); ++i) {
+    const double *row = table.row(i);
+    poses[i].block<3, 1>(0, 3) << row[2], row[3], row[4];
+    poses[i].block<3, 3>(0, 0) = Eigen::Quaterniond(row[8], row[5], row[6], row[7]).toRotationMatrix();
   }
   return poses;
 }
 
-std::vector<Point3D> readPointCloud(const std::string &path, const std::string &precision_time_path,
-                                    const double &time_delta_sec, const double &min_dist, const double &max_dist,
-                                    const bool round_timestamps, const double &timestamp_round_hz) {
-  pcl::PointCloud<NCPoint>::Ptr cloud(new pcl::PointCloud<NCPoint>);
-  if (pcl::io::loadPCDFile<NCPoint>(path, *cloud) == -1)  //* load the file
-  {
-    PCL_ERROR("Couldn't read file test_pcd.pcd \n");
-  }
-
-  std::vector<Point3D> frame;
-
-  const unsigned numPointsIn = cloud->points.size();
+/// Ouster scan of the Newer College dataset: PCD with float x, y, z and the time of each point in ns as uint32 t,
+/// among other fields (intensity, reflectivity, ring, noise, range) that are not read.
+std::vector<Point3D> readPointCloud(const std::string &path, const double &time_delta_sec, const double &min_dist,
+                                    const double &max_dist, const bool round_timestamps,
+                                    const double &timestamp_round_hz) {
+  const PcdView pcd(path);
+  const auto xs = pcd.column<float>("x"), ys = pcd.column<float>("y"), zs = pcd.column<float>("z");
+  const auto ts = pcd.column<uint32_t>("t");
+  const size_t numPointsIn = pcd.numPoints();
   const double timestamp_round_dt = 1.0 / timestamp_round_hz;
 
+  // one pass: range filter, rounding and time bounds (over the kept points), compacted straight into the frame
+  std::vector<Point3D> frame(numPointsIn);
   double frame_last_timestamp = std::numeric_limits<double>::min();
   double frame_first_timestamp = std::numeric_limits<double>::max();
-  frame.reserve(numPointsIn);
-
   const double min_dist2 = min_dist * min_dist;
   const double max_dist2 = max_dist * max_dist;
-  for (unsigned i(0); i < numPointsIn; i++) {
-    Point3D new_point;
-
-    new_point.raw_pt[0] = cloud->points[i].x;
-    new_point.raw_pt[1] = cloud->points[i].y;
-    new_point.raw_pt[2] = cloud->points[i].z;
-
-    const double r2 = new_point.raw_pt[0] * new_point.raw_pt[0] + new_point.raw_pt[1] * new_point.raw_pt[1] +
-                      new_point.raw_pt[2] * new_point.raw_pt[2];
+  size_t count = 0;
+  for (size_t i = 0; i < numPointsIn; ++i) {
+    const Eigen::Vector3d raw_pt(xs[i], ys[i], zs[i]);
+    const double r2 = raw_pt.squaredNorm();
     if ((r2 <= min_dist2) || (r2 >= max_dist2)) continue;
 
-    new_point.pt = new_point.raw_pt;
-    // intensity and ring number skipped
+    double alpha_timestamp = ts[i] * 1.0e-9;
+    if (round_timestamps) alpha_timestamp -= fmod(alpha_timestamp, timestamp_round_dt);
+    frame_first_timestamp = std::min(frame_first_timestamp, alpha_timestamp);
+    frame_last_timestamp = std::max(frame_last_timestamp, alpha_timestamp);
 
-    new_point.alpha_timestamp = cloud->points[i].t * 1.0e-9;
-
-    if (round_timestamps)
-      new_point.alpha_timestamp = new_point.alpha_timestamp - fmod(new_point.alpha_timestamp, timestamp_round_dt);
-
-    if (new_point.alpha_timestamp < frame_first_timestamp) {
-      frame_first_timestamp = new_point.alpha_timestamp;
-    }
-    if (new_point.alpha_timestamp > frame_last_timestamp) {
-      frame_last_timestamp = new_point.alpha_timestamp;
-    }
-    frame.push_back(new_point);
+    auto &point = frame[count++];
+    point.raw_pt = raw_pt;
+    point.pt = raw_pt;
+    point.alpha_timestamp = alpha_timestamp;
   }
+  frame.resize(count);
   frame.shrink_to_fit();
 
-  // std::set<double> unique_timeset;
-  // for (const auto &point : frame) {
-  //   unique_timeset.insert(point.alpha_timestamp);
-  // }
-  // std::vector<double> unique_timevec(unique_timeset.begin(), unique_timeset.end());
-  // double ts_hz = unique_timeset.size() / (unique_timevec.back() - unique_timevec[0]);
-  // std::cout << "ts_hz: " << ts_hz << std::endl;
-  // int downsample = std::floor(ts_hz / timestamp_round_hz);
-  // std::cout << "downsample: " << downsample << std::endl;
-  // std::vector<double> unique_timevec2;
-  // for (int i = 0; i < unique_timevec.size(); i += downsample) unique_timevec2.push_back(unique_timevec[i]);
-
-  // for (int i(0); i < (int)frame.size(); i++) {
-  //   const auto p = std::equal_range(unique_timevec2.begin(), unique_timevec2.end(), frame[i].alpha_timestamp);
-  //   if (p.first == unique_timevec2.end()) {
-  //     frame[i].alpha_timestamp = *p.first;
-  //   } else {
-  //     frame[i].alpha_timestamp =
-  //         fabs(frame[i].alpha_timestamp - *p.first) < fabs(frame[i].alpha_timestamp - *p.second) ? *p.first :
-  //         *p.second;
-  //   }
-  //   if (frame[i].alpha_timestamp < frame_first_timestamp) {
-  //     frame_first_timestamp = frame[i].alpha_timestamp;
-  //   }
-  //   if (frame[i].alpha_timestamp > frame_last_timestamp) {
-  //     frame_last_timestamp = frame[i].alpha_timestamp;
-  //   }
-  // }
-  for (int i(0); i < (int)frame.size(); i++) {
-    frame[i].timestamp = frame[i].alpha_timestamp + time_delta_sec;
-    frame[i].alpha_timestamp = std::min(1.0, std::max(0.0, 1 - (frame_last_timestamp - frame[i].alpha_timestamp) /
-                                                                   (frame_last_timestamp - frame_first_timestamp)));
+  for (auto &point : frame) {
+    point.timestamp = point.alpha_timestamp + time_delta_sec;
+    point.alpha_timestamp = std::min(1.0, std::max(0.0, 1 - (frame_last_timestamp - point.alpha_timestamp) /
+                                                                (frame_last_timestamp - frame_first_timestamp)));
   }
 
   return frame;
@@ -267,15 +129,8 @@ NewerCollegeSequence::NewerCollegeSequence(const Options &options) : Sequence(op
   initial_timestamp_ = timestamps_[0];
   std::cout << "initial timestamp: " << initial_timestamp_ << std::endl;
 
-  fs::path root_path{options_.root_path};
-  std::string ground_truth_file = options_.root_path + "/" + options_.sequence + "/ground_truth/registered_poses.csv";
-  const auto gt_poses_full = loadGTPoses(ground_truth_file);
-  const ArrayPoses gt_poses(gt_poses_full.begin() + init_frame_, gt_poses_full.begin() + last_frame_);
-  T_i_r_gt_poses = gt_poses;
-
   // std::string imu_path = options_.root_path + "/" + options_.sequence + "/raw_format/realsense_imu/data.csv";
   std::string imu_path = options_.root_path + "/" + options_.sequence + "/raw_format/ouster_imu/data.csv";
-  std::ifstream imu_file(imu_path);
 
   // Eigen::Matrix3d C_imu = Eigen::Matrix3d::Zero();
   // const double x = std::cos(M_PI / 4.0);
@@ -283,69 +138,58 @@ NewerCollegeSequence::NewerCollegeSequence(const Options &options) : Sequence(op
   // std::cout << "C_imu: " << C_imu << std::endl;
 
   // const double initial_timestamp_sec = initial_timestamp_ * filename_to_time_convert_factor_;
-  if (imu_file.is_open()) {
-    std::string line;
-    std::getline(imu_file, line);  // header
-    for (; std::getline(imu_file, line);) {
-      if (line.empty()) continue;
-
-      std::stringstream ss(line);
-
-      steam::IMUData imu_data;
-      std::string value;
-      std::getline(ss, value, ',');  // counter
-      std::string sec, nsec;
-      std::getline(ss, sec, ',');
-      std::getline(ss, nsec, ',');
-      const uint64_t tns = std::stoll(sec) * uint64_t(1000000000) + std::stoll(nsec);
+  if (fs::exists(imu_path)) {
+    // counter, sec, nsec, ang_vel, lin_acc
+    const CsvTable imu_table(imu_path, {',', 1, 9});
+    imu_data_vec_.resize(imu_table.rows());
+    for (size_t i = 0; i < imu_table.rows(); ++i) {
+      const double *row = imu_table.row(i);
+      auto &imu_data = imu_data_vec_[i];
+      const uint64_t tns = uint64_t(row[1]) * uint64_t(1000000000) + uint64_t(row[2]);
       imu_data.timestamp = double(tns - uint64_t(initial_timestamp_)) * double(1.0e-9);
-      std::getline(ss, value, ',');
-      imu_data.ang_vel[0] = std::stod(value);
-      std::getline(ss, value, ',');
-      imu_data.ang_vel[1] = std::stod(value);
-      std::getline(ss, value, ',');
-      imu_data.ang_vel[2] = std::stod(value);
-
-      std::getline(ss, value, ',');
-      imu_data.lin_acc[0] = std::stod(value);
-      std::getline(ss, value, ',');
-      imu_data.lin_acc[1] = std::stod(value);
-      std::getline(ss, value, ',');
-      imu_data.lin_acc[2] = std::stod(value);
+      imu_data.ang_vel << row[3], row[4], row[5];
+      imu_data.lin_acc << row[6], row[7], row[8];
 
       // imu_data.ang_vel = C_imu * imu_data.ang_vel;
       // imu_data.lin_acc = C_imu * imu_data.lin_acc;
-
-      imu_data_vec_.emplace_back(imu_data);
     }
   }
   LOG(INFO) << "Loaded IMU Data: " << imu_data_vec_.size() << std::endl;
 }
 
+void NewerCollegeSequence::setInitFrame(int frame_index) {
+  if (frame_index < 0 || frame_index >= last_frame_)
+    throw std::out_of_range{"frame " + std::to_string(frame_index) + " is not in sequence " + name()};
+  init_frame_ = curr_frame_ = frame_index;
+}
+
+ArrayPoses NewerCollegeSequence::loadGroundTruth() const {
+  return loadGTPoses(options_.root_path + "/" + options_.sequence + "/ground_truth/registered_poses.csv");
+}
+
+ArrayPoses NewerCollegeSequence::groundTruthPoses() const {
+  const auto gt_poses = loadGroundTruth();
+  return ArrayPoses(gt_poses.begin() + init_frame_, gt_poses.begin() + last_frame_);
+}
+
 DataFrame NewerCollegeSequence::next() {
   if (!hasNext()) throw std::runtime_error("No more frames in sequence");
-  int curr_frame = curr_frame_++;
-  auto filename = filenames_.at(curr_frame);
+  return frameAt(curr_frame_++);
+}
 
-  std::vector<std::string> elems;
-  std::stringstream ss(filename);
-  std::string item;
-  while (std::getline(ss, item, '_')) {
-    elems.push_back(item);
-  }
-  // std::string sec = elems[1];
-  // std::string nsec = elems[2].substr(0, elems[2].find("."));
-  // filename_to_time_convert_factor_ = 1.0e-9;
+DataFrame NewerCollegeSequence::frameAt(size_t index) const {
+  if (index >= filenames_.size())
+    throw std::out_of_range{"frame " + std::to_string(index) + " is not in sequence " + name()};
+  const auto &filename = filenames_[index];
 
   DataFrame frame;
   // int64_t time_delta = std::stoll(sec) * uint64_t(1e9) + std::stoll(nsec) - initial_timestamp_;
-  uint64_t time_delta = timestamps_[curr_frame] - initial_timestamp_;
+  uint64_t time_delta = timestamps_[index] - initial_timestamp_;
   double time_delta_sec = double(time_delta) * filename_to_time_convert_factor_;
   frame.timestamp = time_delta_sec;
-  const auto precision_time_file = options_.root_path + "/" + options_.sequence + "/lidar_times/" + filename;
-  frame.pointcloud = readPointCloud(dir_path_ + "/" + filename, precision_time_file, time_delta_sec,
-                                    options_.min_dist_sensor_center, options_.max_dist_sensor_center,
-                                    options_.lidar_timestamp_round, options_.lidar_timestamp_round_hz);
+  frame.pointcloud = readPointCloud(dir_path_ + "/" + filename, time_delta_sec, options_.min_dist_sensor_center,
+                                    options_.max_dist_sensor_center, options_.lidar_timestamp_round,
+                                    options_.lidar_timestamp_round_hz);
 
   // get IMU data for this pointcloud:
   double tmin = std::numeric_limits<double>::max();
@@ -357,17 +201,7 @@ DataFrame NewerCollegeSequence::next() {
   LOG(INFO) << "ts: " << frame.timestamp << " tmin: " << tmin << " tmax: " << tmax << std::endl;
   // frame.timestamp = (tmax + tmin) / 2.0;
   
-  frame.imu_data_vec.reserve(10);
-  for (; curr_imu_idx_ < imu_data_vec_.size(); curr_imu_idx_++) {
-    if (imu_data_vec_[curr_imu_idx_].timestamp < tmin) {
-      continue;
-    } else if (imu_data_vec_[curr_imu_idx_].timestamp >= tmin && imu_data_vec_[curr_imu_idx_].timestamp < tmax) {
-      frame.imu_data_vec.emplace_back(imu_data_vec_[curr_imu_idx_]);
-    } else {
-      break;
-    }
-  }
-  frame.imu_data_vec.shrink_to_fit();
+  frame.imu_data_vec = measurementsBetween(imu_data_vec_, tmin, tmax);
   LOG(INFO) << "IMU data : " << frame.imu_data_vec.size() << std::endl;
   return frame;
 }
@@ -461,10 +295,8 @@ void NewerCollegeSequence::save(const std::string &path, const Trajectory &traje
 }
 
 auto NewerCollegeSequence::evaluate(const std::string &path, const Trajectory &trajectory) const -> SeqError {
-  //
-  std::string ground_truth_file = options_.root_path + "/" + options_.sequence + "/ground_truth/registered_poses.csv";
-  const auto gt_poses_full = loadGTPoses(ground_truth_file);
   int last_frame = std::min(last_frame_, int(init_frame_ + trajectory.size()));
+  const auto gt_poses_full = loadGroundTruth();
   const ArrayPoses gt_poses(gt_poses_full.begin() + init_frame_, gt_poses_full.begin() + last_frame);
 
   //
@@ -483,11 +315,9 @@ auto NewerCollegeSequence::evaluate(const std::string &path, const Trajectory &t
 }
 
 auto NewerCollegeSequence::evaluate(const std::string &path) const -> SeqError {
+  const auto gt_poses = loadGroundTruth();
   //
-  std::string ground_truth_file = options_.root_path + "/" + options_.sequence + "/ground_truth/registered_poses.csv";
-  const auto gt_poses = loadGTPoses(ground_truth_file);
-  //
-  const auto poses = loadPredPoses(path + "/" + options_.sequence + "_poses.txt");
+  const auto poses = loadKittiPoses(path + "/" + options_.sequence + "_poses.txt");
   //
   if (gt_poses.size() == 0 || gt_poses.size() != poses.size())
     throw std::runtime_error{"estimated and ground truth poses are not the same size."};
@@ -0,0 +1,71 @@
+#include "steam_icp/datasets/prefetching_sequence.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "steam_icp/utils/trace.hpp"
+
+namespace steam_icp {
+
+namespace {
+
+// how long the loader (consumer) sleeps while the queue is full (empty)
+constexpr auto kPollPeriod = std::chrono::microseconds(100);
+
+}  // namespace
+
+PrefetchingSequence::PrefetchingSequence(const Sequence::Ptr &sequence, int depth)
+    : Sequence(sequence->options()),
+      sequence_(sequence),
+      queue_(std::max(depth, 1)),
+      curr_frame_(sequence->currFrame()),
+      exhausted_(!sequence->hasNext()) {
+  if (!exhausted_) thread_ = std::thread(&PrefetchingSequence::run, this);
+}
+
+PrefetchingSequence::~PrefetchingSequence() {
+  stop_.store(true, std::memory_order_relaxed);
+  if (thread_.joinable()) thread_.join();
+}
+
+DataFrame PrefetchingSequence::next() {
+  if (exhausted_) throw std::runtime_error("no more frames in sequence " + name());
+  Prefetched prefetched;
+  while (!queue_.tryPop(prefetched)) {
+    if (failed_.load(std::memory_order_acquire)) {
+      // frames loaded before the failure are still handed out
+      if (queue_.tryPop(prefetched)) break;
+      exhausted_ = true;
+      std::rethrow_exception(error_);
+    }
+    std::this_thread::sleep_for(kPollPeriod);
+  }
+  curr_frame_++;
+  exhausted_ = prefetched.last;
+  return std::move(prefetched.frame);
+}
+
+void PrefetchingSequence::run() {
+  STEAM_ICP_TRACE_THREAD_NAME("prefetch");
+  try {
+    bool last = false;
+    while (!last && !stop_.load(std::memory_order_relaxed)) {
+      Prefetched prefetched{[this] {
+                              STEAM_ICP_TRACE_SCOPE("load frame");
+                              return sequence_->next();
+                            }(),
+                            false};
+      prefetched.last = last = !sequence_->hasNext();
+      while (!queue_.tryPush(std::move(prefetched))) {
+        if (stop_.load(std::memory_order_relaxed)) return;
+        std::this_thread::sleep_for(kPollPeriod);
+      }
+    }
+  } catch (...) {
+    error_ = std::current_exception();
+    failed_.store(true, std::memory_order_release);
+  }
+}
+
+}  // namespace steam_icp
@@ -0,0 +1,249 @@
+#include "steam_icp/datasets/quantized_archive.hpp"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace steam_icp {
+
+namespace {
+
+// differences of 32 bit codes span 33 bits, so are zigzag coded in 64; only those that fit a narrower code are stored
+uint64_t zigzag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+int32_t unzigzag(uint32_t value) { return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1); }
+
+// bytes per code, 8 standing for codes that do not fit in 32 bits
+uint32_t widthOf(uint64_t max_code) {
+  return max_code == 0 ? 0 : max_code <= 0xff ? 1 : max_code <= 0xffff ? 2 : max_code <= 0xffffffff ? 4 : 8;
+}
+
+/// Codes of values, max_width bytes at most, and how to decode them; differences are taken when allowed and narrower.
+QuantizedColumn quantize(const std::vector<double> &values, double resolution, uint32_t max_width, bool allow_delta,
+                         std::vector<uint32_t> &codes) {
+  QuantizedColumn column{};
+  codes.resize(values.size());
+  if (values.empty()) return column;
+  const auto [min, max] = std::minmax_element(values.begin(), values.end());
+  const double max_code = max_width == 2 ? 65535.0 : 4294967295.0;
+  column.offset = *min;
+  column.step = std::max(resolution, (*max - *min) / max_code);
+  uint32_t max_direct = 0;
+  for (size_t i = 0; i < values.size(); ++i) {
+    codes[i] = static_cast<uint32_t>(std::min(max_code, std::round((values[i] - column.offset) / column.step)));
+    max_direct = std::max(max_direct, codes[i]);
+  }
+  column.width = widthOf(max_direct);
+  if (!allow_delta || column.width <= 1) return column;
+
+  // the first code is a difference to 0, as the decoder starts its running sum there
+  const auto delta = [&](size_t i) { return zigzag(int64_t(codes[i]) - (i > 0 ? int64_t(codes[i - 1]) : 0)); };
+  uint64_t max_delta = 0;
+  for (size_t i = 0; i < codes.size(); ++i) max_delta = std::max(max_delta, delta(i));
+  if (widthOf(max_delta) >= column.width) return column;
+  for (size_t i = codes.size(); i-- > 0;) codes[i] = static_cast<uint32_t>(delta(i));
+  column.width = widthOf(max_delta);
+  column.delta = 1;
+  return column;
+}
+
+template <typename Code>
+void writeCodes(ArchiveWriter &writer, const std::vector<uint32_t> &codes) {
+  thread_local std::vector<Code> narrow;
+  narrow.assign(codes.begin(), codes.end());
+  writer.column(narrow);
+}
+
+// straight line over the codes, so that it vectorizes; differences are summed up in the same pass, from code
+template <typename Code>
+void decodeCodes(const Code *codes, size_t n, const QuantizedColumn &column, uint32_t &code, double *values) {
+  const double offset = column.offset, step = column.step;
+  if (!column.delta) {
+    for (size_t i = 0; i < n; ++i) values[i] = offset + step * codes[i];
+    return;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    code += unzigzag(codes[i]);
+    values[i] = offset + step * code;
+  }
+}
+
+/// Values [begin, begin + n) of a column; code carries the running sum of differences from one range to the next.
+void decodeColumn(const char *block, size_t begin, size_t n, const QuantizedColumn &column, uint32_t &code,
+                  double *values) {
+  const char *codes = block + column.position;
+  switch (column.width) {
+    case 0: std::fill(values, values + n, column.offset); break;
+    case 1: decodeCodes(reinterpret_cast<const uint8_t *>(codes) + begin, n, column, code, values); break;
+    case 2: decodeCodes(reinterpret_cast<const uint16_t *>(codes) + begin, n, column, code, values); break;
+    case 4: decodeCodes(reinterpret_cast<const uint32_t *>(codes) + begin, n, column, code, values); break;
+    default: throw std::runtime_error{"invalid code width " + std::to_string(column.width) + " in quantized archive"};
+  }
+}
+
+}  // namespace
+
+void writeQuantizedArchive(Sequence &sequence, const std::string &path, const QuantizationOptions &options) {
+  const std::string tmp_path = path + ".tmp";
+  ArchiveWriter writer(tmp_path);
+  QuantizedArchiveHeader header{};
+  std::memcpy(header.magic, QuantizedArchiveHeader::kMagic, sizeof(header.magic));
+  header.version = ArchiveHeader::kVersion;
+  header.flags = sequence.hasGroundTruth() ? ArchiveHeader::kHasGroundTruth : 0;
+  header.first_frame = sequence.currFrame();
+  header.options_hash = frameOptionsHash(sequence.options());
+  writer.write(&header, sizeof(header));
+  writer.pad();
+
+  struct ColumnEncoding {
+    double resolution;
+    uint32_t max_width;
+    bool allow_delta;
+  };
+  const ColumnEncoding encodings[QuantizedArchiveFrame::kNumColumns] = {
+      {options.position, 2, false}, {options.position, 2, false}, {options.position, 2, false},
+      {options.velocity, 2, false}, {options.alpha, 4, true},     {options.time, 4, true},
+      {1.0, 4, false}};
+
+  std::vector<QuantizedArchiveFrame> index;
+  std::vector<double> values[QuantizedArchiveFrame::kNumColumns];
+  std::vector<uint32_t> codes;
+  size_t num_points = 0;
+  while (sequence.hasNext()) {
+    const DataFrame frame = sequence.next();
+    const auto &points = frame.pointcloud;
+    QuantizedArchiveFrame entry{};
+    entry.timestamp = frame.timestamp;
+    entry.offset = writer.offset();
+    entry.num_points = points.size();
+    entry.num_imu = frame.imu_data_vec.size();
+    entry.num_poses = frame.pose_data_vec.size();
+
+    for (auto &column : values) column.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+      values[0][i] = points[i].raw_pt[0];
+      values[1][i] = points[i].raw_pt[1];
+      values[2][i] = points[i].raw_pt[2];
+      values[3][i] = points[i].radial_velocity;
+      values[4][i] = points[i].alpha_timestamp;
+      values[5][i] = points[i].timestamp - frame.timestamp;
+      values[6][i] = points[i].beam_id;
+    }
+    for (int c = 0; c < QuantizedArchiveFrame::kNumColumns; ++c) {
+      const auto &encoding = encodings[c];
+      auto &column = entry.columns[c];
+      column = quantize(values[c], encoding.resolution, encoding.max_width, encoding.allow_delta, codes);
+      column.position = writer.offset() - entry.offset;
+      switch (column.width) {
+        case 1: writeCodes<uint8_t>(writer, codes); break;
+        case 2: writeCodes<uint16_t>(writer, codes); break;
+        case 4: writeCodes<uint32_t>(writer, codes); break;
+      }
+    }
+
+    entry.measurements_offset = writer.offset() - entry.offset;
+    writeMeasurements(writer, frame);
+    entry.size = writer.offset() - entry.offset;
+    num_points += points.size();
+    index.emplace_back(entry);
+  }
+
+  header.num_frames = index.size();
+  // the sequence ran out of frames before its last_frame option
+  if (static_cast<int64_t>(header.first_frame + header.num_frames) < sequence.options().last_frame)
+    header.flags |= ArchiveHeader::kToSequenceEnd;
+  header.index_offset = writer.offset();
+  writer.column(index);
+  const ArrayPoses gt_poses = sequence.groundTruthPoses();
+  header.num_gt_poses = gt_poses.size();
+  header.gt_offset = writer.offset();
+  writeGroundTruth(writer, gt_poses);
+  writer.writeAt(0, &header, sizeof(header));
+  const size_t size = writer.offset();
+  writer.close();
+  std::filesystem::rename(tmp_path, path);
+  LOG(INFO) << "Wrote " << index.size() << " frames of " << sequence.name() << " to " << path << ", "
+            << (num_points > 0 ? double(size) / num_points : 0.0) << " bytes per point" << std::endl;
+}
+
+QuantizedArchiveSequence::QuantizedArchiveSequence(const std::string &path, const Options &options,
+                                                   std::function<Sequence::Ptr()> make_source)
+    : Sequence(options), file_(path, false), make_source_(std::move(make_source)) {
+  header_ = file_.as<QuantizedArchiveHeader>();
+  if (file_.size() < sizeof(QuantizedArchiveHeader) ||
+      std::memcmp(header_->magic, QuantizedArchiveHeader::kMagic, sizeof(header_->magic)) != 0)
+    throw std::runtime_error{"not a quantized frame archive: " + path};
+  if (header_->version != ArchiveHeader::kVersion)
+    throw std::runtime_error{"unsupported frame archive version " + std::to_string(header_->version) + ": " + path};
+  if (header_->index_offset + header_->num_frames * sizeof(QuantizedArchiveFrame) > file_.size() ||
+      header_->gt_offset + header_->num_gt_poses * 16 * sizeof(double) > file_.size())
+    throw std::runtime_error{"truncated frame archive: " + path};
+  index_ = reinterpret_cast<const QuantizedArchiveFrame *>(file_.data() + header_->index_offset);
+
+  const int first_frame = header_->first_frame;
+  last_frame_ = std::min<int64_t>(options_.last_frame, first_frame + header_->num_frames);
+  init_frame_ = curr_frame_ = std::max(options_.init_frame, first_frame);
+  LOG(INFO) << "Replaying frames [" << init_frame_ << ", " << last_frame_ << ") of " << name() << " from " << path
+            << std::endl;
+}
+
+void QuantizedArchiveSequence::setInitFrame(int frame_index) {
+  if (frame_index < static_cast<int>(header_->first_frame) || frame_index >= last_frame_)
+    throw std::out_of_range{"frame " + std::to_string(frame_index) + " is not in the archive of " + name()};
+  init_frame_ = curr_frame_ = frame_index;
+}
+
+DataFrame QuantizedArchiveSequence::next() {
+  if (!hasNext()) throw std::runtime_error("No more frames in sequence");
+  const int curr_frame = curr_frame_++;
+  // start reading the next frame in while this one is decoded and registered
+  if (hasNext()) {
+    const auto &next = index_[curr_frame_ - header_->first_frame];
+    file_.prefetch(next.offset, next.size);
+  }
+  return read(curr_frame);
+}
+
+DataFrame QuantizedArchiveSequence::read(size_t index, bool with_measurements) const {
+  if (index < header_->first_frame || index >= header_->first_frame + header_->num_frames)
+    throw std::out_of_range{"frame " + std::to_string(index) + " is not in the archive of " + name()};
+  const auto &entry = index_[index - header_->first_frame];
+  const size_t n = entry.num_points;
+  const char *block = file_.data() + entry.offset;
+
+  DataFrame frame;
+  frame.timestamp = entry.timestamp;
+  frame.pointcloud.resize(n);
+
+  // decoded a chunk at a time, small enough for the columns to stay in cache until unpacked into the points
+  constexpr size_t kChunk = 1024;
+  constexpr int kNumColumns = QuantizedArchiveFrame::kNumColumns;
+  double values[kNumColumns][kChunk];
+  uint32_t codes[kNumColumns] = {};
+  for (size_t begin = 0; begin < n; begin += kChunk) {
+    const size_t count = std::min(kChunk, n - begin);
+    for (int c = 0; c < kNumColumns; ++c) decodeColumn(block, begin, count, entry.columns[c], codes[c], values[c]);
+    for (size_t i = 0; i < count; ++i) {
+      auto &point = frame.pointcloud[begin + i];
+      point.raw_pt = Eigen::Vector3d(values[0][i], values[1][i], values[2][i]);
+      point.pt = point.raw_pt;
+      point.radial_velocity = values[3][i];
+      point.alpha_timestamp = values[4][i];
+      point.timestamp = entry.timestamp + values[5][i];
+      point.beam_id = static_cast<int>(values[6][i]);
+    }
+  }
+  if (!with_measurements) return frame;
+
+  readMeasurements(block + entry.measurements_offset, entry.num_imu, entry.num_poses, frame);
+  return frame;
+}
+
+const Sequence::Ptr &QuantizedArchiveSequence::source() const {
+  std::call_once(source_once_, [this] { source_ = make_source_(); });
+  return source_;
+}
+
+}  // namespace steam_icp
@@ -0,0 +1,192 @@
+#include "steam_icp/datasets/sequence_index.hpp"
+
+#include <sys/stat.h>
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+namespace steam_icp {
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'I', 'C', 'P', 'I', 'D', 'X', '1'};
+
+// size and modification time (ns) of path, -1 if it does not exist
+void appendStamp(const std::string &path, std::vector<int64_t> &stamps) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0) {
+    stamps.insert(stamps.end(), {-1, -1});
+    return;
+  }
+  stamps.push_back(st.st_size);
+  stamps.push_back(int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec);
+}
+
+// reads a cache file front to back, failing (false) rather than reading past its end
+class CacheReader {
+ public:
+  CacheReader(const char *data, size_t size) : p_(data), end_(data + size) {}
+
+  template <typename T>
+  bool read(T &value) {
+    if (size_t(end_ - p_) < sizeof(T)) return false;
+    std::memcpy(&value, p_, sizeof(T));
+    p_ += sizeof(T);
+    return true;
+  }
+
+  template <typename T>
+  bool read(std::vector<T> &values) {
+    uint64_t size;
+    if (!read(size) || size > size_t(end_ - p_) / sizeof(T)) return false;
+    values.resize(size);
+    std::memcpy(values.data(), p_, size * sizeof(T));
+    p_ += size * sizeof(T);
+    return true;
+  }
+
+ private:
+  const char *p_;
+  const char *end_;
+};
+
+template <typename T>
+void writeVector(std::ofstream &ofs, const std::vector<T> &values) {
+  const uint64_t size = values.size();
+  ofs.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  ofs.write(reinterpret_cast<const char *>(values.data()), size * sizeof(T));
+}
+
+}  // namespace
+
+SequenceIndex::SequenceIndex(const std::string &frames_dir, const std::vector<Csv> &csvs,
+                             const std::string &cache_path) {
+  appendStamp(frames_dir, stamps_);
+  for (const auto &csv : csvs) {
+    csvs_.push_back({csv, nullptr, {}, {}});
+    appendStamp(csv.path, stamps_);
+  }
+  if (cache_path.empty() || !load(cache_path)) {
+    build(frames_dir);
+    if (!cache_path.empty()) save(cache_path);
+  }
+  // mapped, not read: only the pages of the rows asked for are
+  for (auto &rows : csvs_)
+    if (rows.offsets.size() > 1) rows.file = std::make_unique<MappedFile>(rows.csv.path, false);
+}
+
+bool SequenceIndex::load(const std::string &cache_path) {
+  if (!std::filesystem::is_regular_file(cache_path)) return false;
+  const MappedFile file(cache_path);
+  CacheReader reader(file.data(), file.size());
+  char magic[sizeof(kMagic)];
+  std::vector<int64_t> stamps;
+  if (!reader.read(magic) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) return false;
+  if (!reader.read(stamps) || stamps != stamps_) return false;
+
+  std::vector<char> names;
+  if (!reader.read(timestamps_) || !reader.read(names)) return false;
+  filenames_.clear();
+  for (auto p = names.begin(); p != names.end();) {
+    const auto end = std::find(p, names.end(), '\0');
+    filenames_.emplace_back(p, end);
+    p = end == names.end() ? end : end + 1;
+  }
+  if (filenames_.size() != timestamps_.size()) return false;
+  for (auto &rows : csvs_)
+    if (!reader.read(rows.timestamps) || !reader.read(rows.offsets) || rows.timestamps.size() != rows.offsets.size())
+      return false;
+  return true;
+}
+
+void SequenceIndex::build(const std::string &frames_dir) {
+  filenames_.clear();
+  for (const auto &entry : std::filesystem::directory_iterator(frames_dir))
+    if (entry.is_regular_file()) filenames_.emplace_back(entry.path().filename().string());
+  std::sort(filenames_.begin(), filenames_.end());
+  timestamps_.assign(filenames_.size(), 0);
+  for (size_t i = 0; i < filenames_.size(); ++i)
+    std::from_chars(filenames_[i].data(), filenames_[i].data() + filenames_[i].size(), timestamps_[i]);
+
+  for (auto &rows : csvs_) {
+    rows.timestamps.clear();
+    rows.offsets.clear();
+    if (!std::filesystem::is_regular_file(rows.csv.path)) continue;
+    const MappedFile file(rows.csv.path);
+    const char *const data = file.data();
+    const char *const end = data + file.size();
+    // the same lines as CsvTable: header lines skipped, then every non blank line is a row
+    size_t line = 0, row = 0;
+    for (const char *p = data; p < end; ++line) {
+      const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+      if (eol == nullptr) eol = end;
+      const char *first = p;
+      while (first < eol && (*first == ' ' || *first == '\t' || *first == '\r')) ++first;
+      if (line >= rows.csv.skip_rows && first < eol) {
+        if (row++ % kCsvStride == 0) {
+          if (*first == '+') ++first;
+          double timestamp = std::numeric_limits<double>::quiet_NaN();
+          parseDouble(first, eol, timestamp);
+          rows.timestamps.push_back(timestamp);
+          rows.offsets.push_back(p - data);
+        }
+      }
+      p = eol + 1;
+    }
+    rows.timestamps.push_back(std::numeric_limits<double>::infinity());
+    rows.offsets.push_back(file.size());
+  }
+}
+
+void SequenceIndex::save(const std::string &cache_path) const {
+  const std::string tmp_path = cache_path + ".tmp";
+  std::error_code error;
+  const auto index_dir = std::filesystem::path(cache_path).parent_path();
+  if (!index_dir.empty()) std::filesystem::create_directories(index_dir, error);  // failing, the open below warns
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) {
+      LOG(WARNING) << "Cannot write the sequence index " << cache_path << ", it is rebuilt every run" << std::endl;
+      return;
+    }
+    std::vector<char> names;
+    for (const auto &filename : filenames_)
+      names.insert(names.end(), filename.c_str(), filename.c_str() + filename.size() + 1);
+    ofs.write(kMagic, sizeof(kMagic));
+    writeVector(ofs, stamps_);
+    writeVector(ofs, timestamps_);
+    writeVector(ofs, names);
+    for (const auto &rows : csvs_) {
+      writeVector(ofs, rows.timestamps);
+      writeVector(ofs, rows.offsets);
+    }
+    if (!ofs) {
+      LOG(WARNING) << "Failed to write the sequence index " << cache_path << std::endl;
+      return;
+    }
+  }
+  std::filesystem::rename(tmp_path, cache_path, error);
+  if (error)
+    LOG(WARNING) << "Failed to write the sequence index " << cache_path << ": " << error.message() << std::endl;
+}
+
+CsvTable SequenceIndex::rowsBetween(size_t csv, double tmin, double tmax) const {
+  const auto &rows = csvs_.at(csv);
+  if (rows.file == nullptr || !(tmin < tmax)) return CsvTable();
+  // every row from the last sample before tmin to the first one at or after tmax, and one sample more on either side
+  // so that the caller can filter on times computed with a different rounding
+  const auto samples_end = rows.timestamps.end() - 1;  // the end of file sentinel
+  const size_t first = std::lower_bound(rows.timestamps.begin(), samples_end, tmin) - rows.timestamps.begin();
+  const size_t last = std::lower_bound(rows.timestamps.begin(), samples_end, tmax) - rows.timestamps.begin();
+  const size_t begin = first >= 2 ? first - 2 : 0;
+  const size_t end = std::min(last + 1, rows.offsets.size() - 1);
+  const char *data = rows.file->data();
+  return CsvTable(data + rows.offsets[begin], data + rows.offsets[end], {rows.csv.delimiter, 0, rows.csv.num_columns});
+}
+
+}  // namespace steam_icp
@@ -1,14 +1,39 @@
 #include "steam_icp/datasets/utils.hpp"
 
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 
 #include "lgmath.hpp"
 
+#include "steam_icp/utils/csv.hpp"
+
 namespace steam_icp {
 
 namespace {
 
+inline Eigen::Matrix3d roll(const double &r) {
+  Eigen::Matrix3d res;
+  res << 1., 0., 0., 0., std::cos(r), std::sin(r), 0., -std::sin(r), std::cos(r);
+  return res;
+}
+
+inline Eigen::Matrix3d pitch(const double &p) {
+  Eigen::Matrix3d res;
+  res << std::cos(p), 0., -std::sin(p), 0., 1., 0., std::sin(p), 0., std::cos(p);
+  return res;
+}
+
+inline Eigen::Matrix3d yaw(const double &y) {
+  Eigen::Matrix3d res;
+  res << std::cos(y), std::sin(y), 0., -std::sin(y), std::cos(y), 0., 0., 0., 1.;
+  return res;
+}
+
+inline Eigen::Matrix3d rpy2rot(const double &r, const double &p, const double &y) {
+  return roll(r) * pitch(p) * yaw(y);
+}
+
 double translationError(const Eigen::Matrix4d &pose_error) { return pose_error.block<3, 1>(0, 3).norm(); }
 
 double translationError2D(const Eigen::Matrix4d &pose_error) { return pose_error.block<2, 1>(0, 3).norm(); }
@@ -92,6 +117,41 @@ void computeMeanRPE(const ArrayPoses &poses_gt, const ArrayPoses &poses_result,
 
 }  // namespace
 
+ArrayPoses loadKittiPoses(const std::string &file_path) {
+  const CsvTable table(file_path, {' ', 0, 12});
+  ArrayPoses poses(table.rows(), Eigen::Matrix4d::Identity());
+  for (size_t i = 0; i < table.rows(); ++i)
+    poses[i].topRows<3>() = Eigen::Map<const Eigen::Matrix<double, 3, 4, Eigen::RowMajor>>(table.row(i));
+  return poses;
+}
+
+ArrayPoses loadBoreasPoses(const std::string &file_path) {
+  const CsvTable table(file_path, {',', 1, 10});
+  ArrayPoses poses(table.rows(), Eigen::Matrix4d::Identity());
+  for (size_t i = 0; i < table.rows(); ++i) {
+    const double *row = table.row(i);
+    poses[i].block<3, 1>(0, 3) << row[1], row[2], row[3];
+    poses[i].block<3, 3>(0, 0) = rpy2rot(row[7], row[8], row[9]);
+  }
+  return poses;
+}
+
+std::vector<steam::IMUData> boreasImu(const CsvTable &table, double initial_timestamp_sec) {
+  Eigen::Matrix3d imu_body_raw_to_applanix, yfwd2xfwd;
+  imu_body_raw_to_applanix << 0, -1, 0, -1, 0, 0, 0, 0, -1;
+  yfwd2xfwd << 0, 1, 0, -1, 0, 0, 0, 0, 1;
+  const Eigen::Matrix3d imu_to_robot = yfwd2xfwd * imu_body_raw_to_applanix;
+  std::vector<steam::IMUData> imu_data_vec(table.rows());
+  for (size_t i = 0; i < table.rows(); ++i) {
+    const double *row = table.row(i);
+    auto &imu_data = imu_data_vec[i];
+    imu_data.timestamp = row[0] - initial_timestamp_sec;
+    imu_data.ang_vel = imu_to_robot * Eigen::Vector3d(row[3], row[2], row[1]);
+    imu_data.lin_acc = imu_to_robot * Eigen::Vector3d(row[6], row[5], row[4]);
+  }
+  return imu_data_vec;
+}
+
 // step_size: every 10 frame (= every second for LiDAR at 10Hz)
 // for the Navtech, use 4 (=every second at 4Hz)
 Sequence::SeqError evaluateOdometry(const std::string &filename, const ArrayPoses &poses_gt,
@@ -1,10 +1,22 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
 namespace fs = std::filesystem;
 
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "glog/logging.h"
 
 #include "nav_msgs/msg/odometry.hpp"
-#include "pcl_conversions/pcl_conversions.h"
 #include "rclcpp/rclcpp.hpp"
 #include "sensor_msgs/msg/point_cloud2.hpp"
 #include "tf2/convert.h"
@@ -12,80 +24,42 @@ namespace fs = std::filesystem;
 #include "tf2_ros/static_transform_broadcaster.h"
 #include "tf2_ros/transform_broadcaster.h"
 
-#define PCL_NO_PRECOMPILE
-#include <pcl/io/pcd_io.h>
-#include <pcl/pcl_macros.h>
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-
 #include "lgmath.hpp"
 
 #include "steam_icp/dataset.hpp"
+#include "steam_icp/datasets/archive.hpp"
+#include "steam_icp/datasets/quantized_archive.hpp"
+#include "steam_icp/datasets/prefetching_sequence.hpp"
 #include "steam_icp/odometry.hpp"
 #include "steam_icp/point.hpp"
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/async_worker.hpp"
+#include "steam_icp/utils/point_cloud2.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
-#define PCL_ADD_FLEXIBLE     \
-  union EIGEN_ALIGN16 {      \
-    __uint128_t raw_flex1;   \
-    float data_flex1[4];     \
-    struct {                 \
-      float flex11;          \
-      float flex12;          \
-      float flex13;          \
-      float flex14;          \
-    };                       \
-    struct {                 \
-      float alpha_timestamp; \
-      float timestamp;       \
-      float radial_velocity; \
-    };                       \
-  };
-
-struct EIGEN_ALIGN16 PCLPoint3D {
-  PCL_ADD_POINT4D;
-  PCL_ADD_FLEXIBLE;
-  PCL_MAKE_ALIGNED_OPERATOR_NEW
-
-  inline PCLPoint3D() {
-    x = y = z = 0.0f;
-    data[3] = 1.0f;
-    raw_flex1 = 0;
-  }
-
-  inline PCLPoint3D(const PCLPoint3D &p) {
-    x = p.x;
-    y = p.y;
-    z = p.z;
-    data[3] = 1.0f;
-    raw_flex1 = p.raw_flex1;
-  }
-
-  inline PCLPoint3D(const Point3D &p) {
-    x = (float)p.pt[0];
-    y = (float)p.pt[1];
-    z = (float)p.pt[2];
-    data[3] = 1.0f;
-    alpha_timestamp = p.alpha_timestamp;
-    timestamp = p.timestamp;
-    radial_velocity = p.radial_velocity;
-  }
-
-  inline PCLPoint3D(const Eigen::Vector3d &p) {
-    x = (float)p[0];
-    y = (float)p[1];
-    z = (float)p[2];
-    data[3] = 1.0f;
-  }
-};
-
 // Parameters to run the SLAM
 struct SLAMOptions {
   bool suspend_on_failure = false;  // Whether to suspend the execution once an error is detected
   bool eval_only = false;
   std::string output_dir = "./outputs";  // The output path (relative or absolute) to save the pointclouds
+  int prefetch_depth = 0;                // Number of frames loaded ahead on a background thread, 0 to disable
+
+  // With all_sequences, run up to num_parallel_sequences sequences at once, each in its own worker process
+  int num_parallel_sequences = 1;
+  int threads_per_sequence = 0;  // num_threads of every worker's odometry, 0 keeps the configured one
+  std::string errors_file = "";  // per-segment errors of every evaluated sequence, written at the end if set
+
+  // Parameter sweep: each entry is a ';' separated list of name:=value overrides, every one of them runs on the same
+  // frames, loaded once per sequence and kept in memory
+  std::vector<std::string> sweep_configs;
+  int sweep_num_parallel = 1;  // configurations running at the same time
+
+  // Pack the frames of every sequence into dataset_options.archive_dir (see datasets/archive.hpp) and exit
+  bool write_archives = false;
+  // ... as quantized archives (see datasets/quantized_archive.hpp), with these resolutions
+  bool quantize_archives = false;
+  QuantizationOptions archive_quantization;
 
   struct {
     bool odometry = true;
@@ -93,6 +67,11 @@ struct SLAMOptions {
     bool sampled_points = true;
     bool map_points = true;
     Eigen::Matrix4d T_sr = Eigen::Matrix4d::Identity();
+    bool async = false;           // publish from a worker thread, dropping stale snapshots under backpressure
+    int queue_depth = 2;          // snapshots waiting to be published before the oldest is dropped
+    double max_rate_hz = 0.0;     // 0 publishes every frame
+    int map_every_n_frames = 1;   // the map is the most expensive message, publish it less often
+    double map_voxel_size = 0.0;  // keep one map point per voxel of this size, 0 publishes the full map
   } visualization_options;
 
   std::string dataset;
@@ -102,6 +81,33 @@ struct SLAMOptions {
   Odometry::Options::Ptr odometry_options;
 };
 
+// Everything published for one frame, moved out of the registration loop so that publishing can happen elsewhere
+struct VisualizationSnapshot {
+  VisualizationSnapshot() = default;
+  VisualizationSnapshot(VisualizationSnapshot &&) = default;
+  VisualizationSnapshot &operator=(VisualizationSnapshot &&) = default;
+  VisualizationSnapshot(const VisualizationSnapshot &) = delete;
+  VisualizationSnapshot &operator=(const VisualizationSnapshot &) = delete;
+
+  bool has_pose = false;
+  Eigen::Matrix4d T_wr = Eigen::Matrix4d::Identity();
+  std::vector<Point3D> raw_points;
+  std::vector<Point3D> sampled_points;
+  bool has_map = false;
+  ArrayVector3d map_points;
+};
+
+// Keeps the first point falling into each voxel
+void voxel_decimate(ArrayVector3d &points, double voxel_size) {
+  std::unordered_set<Voxel> occupied;
+  occupied.reserve(points.size());
+  size_t num_kept = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (occupied.insert(Voxel::Coordinates(points[i], voxel_size)).second) points[num_kept++] = points[i];
+  }
+  points.resize(num_kept);
+}
+
 #define ROS2_PARAM_NO_LOG(node, receiver, prefix, param, type) \
   receiver = node->declare_parameter<type>(prefix + #param, receiver);
 #define ROS2_PARAM(node, receiver, prefix, param, type)   \
@@ -122,6 +128,23 @@ steam_icp::SLAMOptions loadOptions(const rclcpp::Node::SharedPtr &node) {
     if (!options.output_dir.empty() && options.output_dir[options.output_dir.size() - 1] != '/')
       options.output_dir += '/';
     ROS2_PARAM_CLAUSE(node, options, prefix, eval_only, bool);
+    ROS2_PARAM_CLAUSE(node, options, prefix, prefetch_depth, int);
+    ROS2_PARAM_CLAUSE(node, options, prefix, num_parallel_sequences, int);
+    ROS2_PARAM_CLAUSE(node, options, prefix, threads_per_sequence, int);
+    ROS2_PARAM_CLAUSE(node, options, prefix, errors_file, std::string);
+    ROS2_PARAM_NO_LOG(node, options.sweep_configs, prefix, sweep_configs, std::vector<std::string>);
+    for (const auto &config : options.sweep_configs)
+      LOG(WARNING) << "Parameter " << prefix + "sweep_configs" << " += " << config << std::endl;
+    ROS2_PARAM_CLAUSE(node, options, prefix, sweep_num_parallel, int);
+    ROS2_PARAM_CLAUSE(node, options, prefix, write_archives, bool);
+    ROS2_PARAM_CLAUSE(node, options, prefix, quantize_archives, bool);
+
+    auto &archive_quantization = options.archive_quantization;
+    prefix = "archive_quantization.";
+    ROS2_PARAM_CLAUSE(node, archive_quantization, prefix, position, double);
+    ROS2_PARAM_CLAUSE(node, archive_quantization, prefix, velocity, double);
+    ROS2_PARAM_CLAUSE(node, archive_quantization, prefix, time, double);
+    ROS2_PARAM_CLAUSE(node, archive_quantization, prefix, alpha, double);
   }
 
   /// dataset options
@@ -140,6 +163,9 @@ steam_icp::SLAMOptions loadOptions(const rclcpp::Node::SharedPtr &node) {
     ROS2_PARAM_CLAUSE(node, dataset_options, prefix, max_dist_sensor_center, float);
     ROS2_PARAM_CLAUSE(node, dataset_options, prefix, lidar_timestamp_round, bool);
     ROS2_PARAM_CLAUSE(node, dataset_options, prefix, lidar_timestamp_round_hz, float);
+    ROS2_PARAM_CLAUSE(node, dataset_options, prefix, archive_dir, std::string);
+    ROS2_PARAM_CLAUSE(node, dataset_options, prefix, index_dir, std::string);
+    if (options.dataset_options.index_dir.empty()) options.dataset_options.index_dir = options.output_dir + "index";
 
     if (options.dataset == "BoreasNavtech") {
       ROS2_PARAM_CLAUSE(node, dataset_options, prefix, radar_resolution, double);
@@ -167,6 +193,12 @@ steam_icp::SLAMOptions loadOptions(const rclcpp::Node::SharedPtr &node) {
     ROS2_PARAM_CLAUSE(node, visualization_options, prefix, raw_points, bool);
     ROS2_PARAM_CLAUSE(node, visualization_options, prefix, sampled_points, bool);
     ROS2_PARAM_CLAUSE(node, visualization_options, prefix, map_points, bool);
+    ROS2_PARAM_CLAUSE(node, visualization_options, prefix, async, bool);
+    ROS2_PARAM_CLAUSE(node, visualization_options, prefix, queue_depth, int);
+    ROS2_PARAM_CLAUSE(node, visualization_options, prefix, max_rate_hz, double);
+    ROS2_PARAM_CLAUSE(node, visualization_options, prefix, map_every_n_frames, int);
+    ROS2_PARAM_CLAUSE(node, visualization_options, prefix, map_voxel_size, double);
+    if (visualization_options.map_every_n_frames < 1) visualization_options.map_every_n_frames = 1;
 
     if (options.dataset != "BoreasAeva" && options.dataset != "BoreasNavtech" && options.dataset != "BoreasVelodyne") {
       std::vector<double> T_sr_vec;
@@ -228,6 +260,21 @@ steam_icp::SLAMOptions loadOptions(const rclcpp::Node::SharedPtr &node) {
     ROS2_PARAM_CLAUSE(node, odometry_options, prefix, threshold_translation_norm, double);
     ROS2_PARAM_CLAUSE(node, odometry_options, prefix, min_number_keypoints, int);
 
+    ROS2_PARAM_CLAUSE(node, odometry_options, prefix, max_num_variables, int);
+    ROS2_PARAM_CLAUSE(node, odometry_options, prefix, max_num_cost_terms, int);
+    ROS2_PARAM_CLAUSE(node, odometry_options, prefix, solve_time_budget_ms, double);
+
+    ROS2_PARAM_CLAUSE(node, odometry_options, prefix, keyframe_translation_threshold_m, double);
+    ROS2_PARAM_CLAUSE(node, odometry_options, prefix, keyframe_rotation_threshold_deg, double);
+    ROS2_PARAM_CLAUSE(node, odometry_options, prefix, keyframe_min_overlap, double);
+    ROS2_PARAM_CLAUSE(node, odometry_options, prefix, keyframe_max_elapsed_s, double);
+    ROS2_PARAM_CLAUSE(node, odometry_options, prefix, pipelined_map_update, bool);
+    std::vector<int64_t> thread_pool_cores;
+    ROS2_PARAM_NO_LOG(node, thread_pool_cores, prefix, thread_pool_cores, std::vector<int64_t>);
+    odometry_options.thread_pool_cores.assign(thread_pool_cores.begin(), thread_pool_cores.end());
+    for (const auto core : thread_pool_cores)
+      LOG(WARNING) << "Parameter " << prefix + "thread_pool_cores" << " += " << core << std::endl;
+
     ROS2_PARAM_CLAUSE(node, odometry_options, prefix, debug_print, bool);
     ROS2_PARAM_CLAUSE(node, odometry_options, prefix, debug_path, std::string);
 
@@ -239,6 +286,22 @@ steam_icp::SLAMOptions loadOptions(const rclcpp::Node::SharedPtr &node) {
       ROS2_PARAM_CLAUSE(node, elastic_icp_options, prefix, beta_location_consistency, double);
       ROS2_PARAM_CLAUSE(node, elastic_icp_options, prefix, beta_constant_velocity, double);
       ROS2_PARAM_CLAUSE(node, elastic_icp_options, prefix, max_dist_to_plane, double);
+      std::string p2p_loss_func;
+      ROS2_PARAM(node, p2p_loss_func, prefix, p2p_loss_func, std::string);
+      if (p2p_loss_func == "L2")
+        elastic_icp_options.p2p_loss_func = ElasticOdometry::LOSS_FUNC::L2;
+      else if (p2p_loss_func == "DCS")
+        elastic_icp_options.p2p_loss_func = ElasticOdometry::LOSS_FUNC::DCS;
+      else if (p2p_loss_func == "CAUCHY")
+        elastic_icp_options.p2p_loss_func = ElasticOdometry::LOSS_FUNC::CAUCHY;
+      else if (p2p_loss_func == "GM")
+        elastic_icp_options.p2p_loss_func = ElasticOdometry::LOSS_FUNC::GM;
+      else {
+        LOG(WARNING) << "Parameter " << prefix + "p2p_loss_func"
+                     << " not specified. Using default value: "
+                     << "L2";
+      }
+      ROS2_PARAM_CLAUSE(node, elastic_icp_options, prefix, p2p_loss_sigma, double);
       ROS2_PARAM_CLAUSE(node, elastic_icp_options, prefix, convergence_threshold, double);
       ROS2_PARAM_CLAUSE(node, elastic_icp_options, prefix, num_threads, int);
     } else if (options.odometry == "CeresElastic") {
@@ -1121,6 +1184,7 @@ steam_icp::SLAMOptions loadOptions(const rclcpp::Node::SharedPtr &node) {
       ROS2_PARAM_CLAUSE(node, steam_icp_options, prefix, use_imu, bool);
       ROS2_PARAM_CLAUSE(node, steam_icp_options, prefix, use_accel, bool);
       ROS2_PARAM_CLAUSE(node, steam_icp_options, prefix, r_imu_ang, double);
+      ROS2_PARAM_CLAUSE(node, steam_icp_options, prefix, preint_gyro, bool);
       ROS2_PARAM_CLAUSE(node, steam_icp_options, prefix, p0_bias_gyro, double);
       ROS2_PARAM_CLAUSE(node, steam_icp_options, prefix, q_bias_gyro, double);
       ROS2_PARAM_CLAUSE(node, steam_icp_options, prefix, acc_loss_func, std::string);
@@ -1159,21 +1223,275 @@ steam_icp::SLAMOptions loadOptions(const rclcpp::Node::SharedPtr &node) {
   return options;
 }
 
-}  // namespace steam_icp
+// Boreas extrinsics depend on the sequence: reads them from its calibration files and sets them in the visualization
+// and odometry options
+Eigen::Matrix4d setBoreasCalibration(SLAMOptions &options, const std::string &sequence) {
+  Eigen::Matrix4d T_sr = Eigen::Matrix4d::Identity();
+  fs::path root_path{options.dataset_options.root_path};
+  Eigen::Matrix4d yfwd2xfwd, zup2zdown;
+  yfwd2xfwd << 0, 1, 0, 0, -1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1;
+  zup2zdown << 1, 0, 0, 0, 0, -1, 0, 0, 0, 0, -1, 0, 0, 0, 0, 1;
+  if (options.dataset == "BoreasVelodyne") {
+    std::ifstream ifs(root_path / sequence / "calib" / "T_applanix_lidar.txt", std::ios::in);
+    Eigen::Matrix4d T_applanix_lidar_mat;
+    for (size_t row = 0; row < 4; row++)
+      for (size_t col = 0; col < 4; col++) ifs >> T_applanix_lidar_mat(row, col);
+    T_sr = (yfwd2xfwd * T_applanix_lidar_mat).inverse();
+  } else if (options.dataset == "BoreasNavtech") {
+    std::ifstream ifs1(root_path / sequence / "calib" / "T_applanix_lidar.txt", std::ios::in);
+    std::ifstream ifs2(root_path / sequence / "calib" / "T_radar_lidar.txt", std::ios::in);
+    Eigen::Matrix4d T_applanix_lidar_mat;
+    for (size_t row = 0; row < 4; row++)
+      for (size_t col = 0; col < 4; col++) ifs1 >> T_applanix_lidar_mat(row, col);
+    Eigen::Matrix4d T_radar_lidar_mat;
+    for (size_t row = 0; row < 4; row++)
+      for (size_t col = 0; col < 4; col++) ifs2 >> T_radar_lidar_mat(row, col);
+    T_sr = (yfwd2xfwd * T_applanix_lidar_mat * (zup2zdown * T_radar_lidar_mat).inverse()).inverse();
+  } else if (options.dataset == "BoreasAeva") {
+    std::ifstream ifs(root_path / sequence / "calib" / "T_applanix_aeva.txt", std::ios::in);
+    Eigen::Matrix4d T_applanix_lidar_mat;
+    for (size_t row = 0; row < 4; row++)
+      for (size_t col = 0; col < 4; col++) ifs >> T_applanix_lidar_mat(row, col);
+    T_sr = (yfwd2xfwd * T_applanix_lidar_mat).inverse();
+  }
+  options.visualization_options.T_sr = T_sr;
+  if (options.odometry == "STEAM") {
+    auto &steam_icp_options = dynamic_cast<SteamOdometry::Options &>(*options.odometry_options);
+    steam_icp_options.T_sr = T_sr;
+  }
+  if (options.odometry == "STEAMLIO") {
+    auto &steam_icp_options = dynamic_cast<SteamLioOdometry::Options &>(*options.odometry_options);
+    steam_icp_options.T_sr = T_sr;
+  }
+  if (options.odometry == "DiscreteLIO") {
+    auto &steam_icp_options = dynamic_cast<DiscreteLIOOdometry::Options &>(*options.odometry_options);
+    steam_icp_options.T_sr = T_sr;
+  }
+  if (options.odometry == "STEAMRIO") {
+    auto &steam_icp_options = dynamic_cast<SteamRioOdometry::Options &>(*options.odometry_options);
+    steam_icp_options.T_sr = T_sr;
+  }
+  if (options.odometry == "STEAMRO") {
+    auto &steam_icp_options = dynamic_cast<SteamRoOdometry::Options &>(*options.odometry_options);
+    steam_icp_options.T_sr = T_sr;
+  }
+  return T_sr;
+}
 
-// clang-format off
-POINT_CLOUD_REGISTER_POINT_STRUCT(
-    steam_icp::PCLPoint3D,
-    // cartesian coordinates
-    (float, x, x)
-    (float, y, y)
-    (float, z, z)
-    // random stuff
-    (float, flex11, flex11)
-    (float, flex12, flex12)
-    (float, flex13, flex13)
-    (float, flex14, flex14))
-// clang-format on
+// Loads the frames of each sequence once, then registers them with every configuration of sweep_configs, up to
+// sweep_num_parallel at a time. A configuration is read by loadOptions from a node getting its overrides on top of the
+// global parameters, which must not override the dataset options the frames were loaded with. Trajectories,
+// evaluations and debug output go to <output_dir>/sweep_<i>/, the errors and registration times of all configurations
+// to <output_dir>/<sequence>_sweep.txt.
+int runSweep(const SLAMOptions &options) {
+  const auto &configs = options.sweep_configs;
+  const auto sweep_dir = [&](size_t i) { return options.output_dir + "sweep_" + std::to_string(i) + "/"; };
+  std::vector<SLAMOptions> config_options;
+  for (size_t i = 0; i < configs.size(); ++i) {
+    std::vector<std::string> args{"--ros-args"};
+    std::stringstream ss(configs[i]);
+    std::string override_param;
+    while (std::getline(ss, override_param, ';')) {
+      const auto first = override_param.find_first_not_of(" \t");
+      if (first == std::string::npos) continue;
+      const auto param = override_param.substr(first, override_param.find_last_not_of(" \t") - first + 1);
+      // frames are loaded once with the global dataset options, an override of them would silently not apply
+      if (param.rfind("dataset_options.", 0) == 0 || param.rfind("dataset:=", 0) == 0)
+        throw std::invalid_argument{"sweep configuration " + std::to_string(i) + " overrides the dataset (" + param +
+                                    "), which is shared by all configurations"};
+      args.emplace_back("-p");
+      args.emplace_back(param);
+    }
+    LOG(WARNING) << "Loading sweep configuration " << i << ": " << configs[i] << std::endl;
+    const auto node =
+        rclcpp::Node::make_shared("steam_icp_sweep_" + std::to_string(i), rclcpp::NodeOptions().arguments(args));
+    config_options.emplace_back(loadOptions(node));
+    // the odometry writes its debug trajectory on destruction, keep those of concurrent configurations apart
+    config_options.back().odometry_options->debug_path = sweep_dir(i);
+    fs::create_directories(sweep_dir(i));
+  }
+  const bool boreas =
+      options.dataset == "BoreasAeva" || options.dataset == "BoreasVelodyne" || options.dataset == "BoreasNavtech";
+
+  struct Result {
+    bool success = false;
+    size_t num_frames = 0;
+    double registration_ms = 0.0;
+    bool evaluated = false;
+    Sequence::SeqError error;
+  };
+
+  const auto dataset = Dataset::Get(options.dataset, options.dataset_options);
+  while (auto seq = dataset->next()) {
+    LOG(WARNING) << "Loading sequence " << seq->name() << " for the sweep" << std::endl;
+    std::vector<DataFrame> frames;
+    frames.reserve(seq->numFrames());
+    while (seq->hasNext()) frames.emplace_back(seq->next());
+
+    std::vector<Result> results(configs.size());
+    std::atomic<size_t> next_config{0};
+    const auto run = [&] {
+      for (size_t i = next_config++; i < configs.size(); i = next_config++) {
+        auto &config = config_options[i];
+        auto &result = results[i];
+        try {
+          if (boreas) setBoreasCalibration(config, seq->name());
+          const auto odometry = Odometry::Get(config.odometry, *config.odometry_options);
+
+          const auto begin = std::chrono::steady_clock::now();
+          result.success = true;
+          for (const auto &frame : frames) {
+            if (!odometry->registerFrame(frame).success) {
+              result.success = false;
+              break;
+            }
+            odometry->telemetry().nextFrame();
+            result.num_frames++;
+          }
+          result.registration_ms =
+              std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+          if (!result.success) {
+            LOG(ERROR) << "Sweep configuration " << i << " failed on sequence " << seq->name() << " after "
+                       << result.num_frames << " frames." << std::endl;
+            continue;
+          }
+
+          const auto output_dir = sweep_dir(i);
+          seq->save(output_dir, odometry->trajectory());
+          odometry->telemetry().write(output_dir + seq->name());
+          if (seq->hasGroundTruth()) {
+            result.error = seq->evaluate(output_dir, odometry->trajectory());
+            result.evaluated = true;
+          }
+        } catch (const std::exception &e) {
+          LOG(ERROR) << "Sweep configuration " << i << " failed on sequence " << seq->name() << ": " << e.what()
+                     << std::endl;
+          result.success = false;
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < std::max(options.sweep_num_parallel, 1); ++t) threads.emplace_back(run);
+    for (auto &thread : threads) thread.join();
+
+    std::ofstream ofs(options.output_dir + seq->name() + "_sweep.txt");
+    ofs << "# config success num_frames registration_ms_per_frame mean_t_rpe mean_r_rpe mean_t_rpe_2d mean_r_rpe_2d "
+           "mean_ape max_ape overrides\n";
+    for (size_t i = 0; i < configs.size(); ++i) {
+      const auto &result = results[i];
+      const auto &error = result.error;
+      const double ms_per_frame = result.num_frames > 0 ? result.registration_ms / result.num_frames : 0.0;
+      std::stringstream row;
+      row << i << " " << result.success << " " << result.num_frames << " " << ms_per_frame << " ";
+      if (result.evaluated)
+        row << error.mean_t_rpe << " " << error.mean_r_rpe << " " << error.mean_t_rpe_2d << " " << error.mean_r_rpe_2d
+            << " " << error.mean_ape << " " << error.max_ape;
+      else
+        row << "nan nan nan nan nan nan";
+      row << " \"" << configs[i] << "\"";
+      ofs << row.str() << "\n";
+      LOG(WARNING) << "Sweep " << seq->name() << " : " << row.str() << std::endl;
+    }
+  }
+  return 0;
+}
+
+// Runs every sequence in a worker process of this executable, at most num_parallel_sequences at a time. Workers get
+// the original arguments plus overrides selecting their sequence, their own output and log directories, their thread
+// budget and no visualization. The KITTI metric over all sequences is computed from the errors they write out.
+int runBatch(int argc, char **argv, const SLAMOptions &options, const std::vector<std::string> &sequences,
+             const std::string &log_dir) {
+  const std::string threads_prefix = (options.odometry == "Elastic" || options.odometry == "CeresElastic")
+                                         ? "odometry_options.elastic."
+                                         : "odometry_options.steam.";
+  const auto quoted = [](const std::string &value) { return "'" + value + "'"; };  // keeps "00" a string
+  const auto output_dir = [&](const std::string &sequence) { return options.output_dir + sequence + "/"; };
+
+  const auto spawn = [&](size_t index) {
+    const auto &sequence = sequences[index];
+    std::vector<std::string> args(argv, argv + argc);
+    args.emplace_back("--ros-args");
+    const auto set = [&](const std::string &name, const std::string &value) {
+      args.emplace_back("-p");
+      args.emplace_back(name + ":=" + value);
+    };
+    args.emplace_back("-r");
+    args.emplace_back("__node:=steam_icp_" + std::to_string(index));
+    set("dataset_options.all_sequences", "false");
+    set("dataset_options.sequence", quoted(sequence));
+    set("output_dir", quoted(output_dir(sequence)));
+    set("log_dir", quoted(log_dir + "/" + sequence));
+    set("errors_file", quoted(output_dir(sequence) + "errors.txt"));
+    set("dataset_options.index_dir", quoted(options.dataset_options.index_dir));  // one index for the whole batch
+    set("num_parallel_sequences", "1");
+    for (const auto &topic : {"odometry", "raw_points", "sampled_points", "map_points"})
+      set(std::string("visualization_options.") + topic, "false");
+    if (options.threads_per_sequence > 0) {
+      set(threads_prefix + "num_threads", std::to_string(options.threads_per_sequence));
+      if (options.dataset == "BoreasNavtech")
+        set("dataset_options.modified_cacfar_num_threads", std::to_string(options.threads_per_sequence));
+    }
+
+    std::vector<char *> c_args;
+    for (auto &arg : args) c_args.emplace_back(arg.data());
+    c_args.emplace_back(nullptr);
+    pid_t pid;
+    const int error = posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, c_args.data(), environ);
+    if (error != 0)
+      throw std::runtime_error{"failed to start worker for sequence " + sequence + ": " + strerror(error)};
+    LOG(WARNING) << "Started worker " << pid << " on sequence " << sequence << std::endl;
+    return pid;
+  };
+
+  std::map<pid_t, size_t> running;
+  std::vector<int> exit_codes(sequences.size(), -1);
+  size_t next = 0;
+  while (next < sequences.size() || !running.empty()) {
+    while (next < sequences.size() && running.size() < (size_t)options.num_parallel_sequences) {
+      running.emplace(spawn(next), next);
+      next++;
+    }
+    int status;
+    const pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error{std::string("waiting on workers failed: ") + strerror(errno)};
+    }
+    const auto it = running.find(pid);
+    if (it == running.end()) continue;
+    exit_codes[it->second] = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    LOG(WARNING) << "Sequence " << sequences[it->second] << " finished with exit code " << exit_codes[it->second]
+                 << std::endl;
+    running.erase(it);
+  }
+
+  // error report in case there is ground truth
+  bool success = true;
+  double all_seq_rpe_t = 0.0;
+  double all_seq_rpe_r = 0.0;
+  double num_total_errors = 0.0;
+  for (size_t i = 0; i < sequences.size(); ++i) {
+    success = success && exit_codes[i] == 0;
+    std::ifstream ifs(output_dir(sequences[i]) + "errors.txt");
+    int num_errors = 0;
+    double t_err, r_err;
+    while (ifs >> t_err >> r_err) {
+      all_seq_rpe_t += t_err;
+      all_seq_rpe_r += r_err;
+      num_errors++;
+    }
+    num_total_errors += num_errors;
+    LOG(WARNING) << "Sequence " << sequences[i] << ": exit code " << exit_codes[i] << ", " << num_errors
+                 << " evaluated segments" << std::endl;
+  }
+  if (num_total_errors > 0) {
+    LOG(WARNING) << "KITTI metric translation/rotation : " << (all_seq_rpe_t / num_total_errors) * 100 << " "
+                 << (all_seq_rpe_r / num_total_errors) * 180.0 / M_PI << std::endl;
+  }
+  return success ? 0 : 1;
+}
+
+}  // namespace steam_icp
 
 int main(int argc, char **argv) {
   using namespace steam_icp;
@@ -1186,17 +1504,7 @@ int main(int argc, char **argv) {
   auto raw_points_publisher = node->create_publisher<sensor_msgs::msg::PointCloud2>("/steam_icp_raw", 2);
   auto sampled_points_publisher = node->create_publisher<sensor_msgs::msg::PointCloud2>("/steam_icp_sampled", 2);
   auto map_points_publisher = node->create_publisher<sensor_msgs::msg::PointCloud2>("/steam_icp_map", 2);
-
-  auto to_pc2_msg = [](const auto &points, const std::string &frame_id = "map") {
-    pcl::PointCloud<PCLPoint3D> points_pcl;
-    points_pcl.reserve(points.size());
-    for (auto &pt : points) points_pcl.emplace_back(pt);
-    sensor_msgs::msg::PointCloud2 points_msg;
-    pcl::toROSMsg(points_pcl, points_msg);
-    points_msg.header.frame_id = frame_id;
-    // points_msg.header.stamp = rclcpp::Time(stamp);
-    return points_msg;
-  };
+  PointCloud2Serializer raw_points_serializer, sampled_points_serializer, map_points_serializer;
 
   // Logging
   FLAGS_log_dir = node->declare_parameter<std::string>("log_dir", "/tmp");
@@ -1204,10 +1512,47 @@ int main(int argc, char **argv) {
   fs::create_directories(FLAGS_log_dir);
   google::InitGoogleLogging(argv[0]);
   LOG(WARNING) << "Logging to " << FLAGS_log_dir;
+  STEAM_ICP_TRACE_THREAD_NAME("main");
 
   // Read parameters
   auto options = loadOptions(node);
 
+  // Pack the frames of every sequence, read from the raw files
+  if (options.write_archives) {
+    if (options.dataset_options.archive_dir.empty()) throw std::runtime_error{"write_archives requires archive_dir"};
+    fs::create_directories(options.dataset_options.archive_dir);
+    Dataset::Options dataset_options = options.dataset_options;
+    dataset_options.archive_dir.clear();
+    const auto dataset = Dataset::Get(options.dataset, dataset_options);
+    while (auto seq = dataset->next()) {
+      if (options.quantize_archives)
+        writeQuantizedArchive(*seq, quantizedArchivePath(options.dataset_options.archive_dir, seq->name()),
+                              options.archive_quantization);
+      else
+        writeArchive(*seq, archivePath(options.dataset_options.archive_dir, seq->name()));
+    }
+    rclcpp::shutdown();
+    return 0;
+  }
+
+  // Run every configuration of the sweep on frames loaded once
+  if (!options.sweep_configs.empty()) {
+    fs::create_directories(options.output_dir);
+    const int ret = runSweep(options);
+    STEAM_ICP_TRACE_FLUSH(options.output_dir + "trace.json");
+    rclcpp::shutdown();
+    return ret;
+  }
+
+  // Run the sequences in parallel worker processes, each one is a separate run of this executable
+  if (options.dataset_options.all_sequences && options.num_parallel_sequences > 1) {
+    fs::create_directories(options.output_dir);
+    const auto dataset = Dataset::Get(options.dataset, options.dataset_options);
+    const int ret = runBatch(argc, argv, options, dataset->sequences(), FLAGS_log_dir);
+    rclcpp::shutdown();
+    return ret;
+  }
+
   // Publish sensor vehicle transformations
   if (options.dataset != "BoreasAeva" && options.dataset != "BoreasNavtech" && options.dataset != "BoreasVelodyne") {
     auto T_rs_msg = tf2::eigenToTransform(Eigen::Affine3d(options.visualization_options.T_sr.inverse()));
@@ -1216,6 +1561,43 @@ int main(int argc, char **argv) {
     tf_static_bc->sendTransform(T_rs_msg);
   }
 
+  // Publishing, either inline or on a worker thread
+  auto publish_snapshot = [&](VisualizationSnapshot &&snapshot) {
+    if (snapshot.has_pose) {
+      /// odometry
+      nav_msgs::msg::Odometry odometry;
+      odometry.header.frame_id = "map";
+      // odometry.header.stamp = rclcpp::Time(stamp);
+      odometry.pose.pose = tf2::toMsg(Eigen::Affine3d(snapshot.T_wr));
+      odometry_publisher->publish(odometry);
+
+      /// tf
+      auto T_wr_msg = tf2::eigenToTransform(Eigen::Affine3d(snapshot.T_wr));
+      T_wr_msg.header.frame_id = "map";
+      // T_wr_msg.header.stamp = rclcpp::Time(stamp);
+      T_wr_msg.child_frame_id = "vehicle";
+      tf_bc->sendTransform(T_wr_msg);
+    }
+    if (!snapshot.raw_points.empty()) {
+      /// raw points
+      raw_points_publisher->publish(raw_points_serializer.serialize(snapshot.raw_points, "sensor"));
+    }
+    if (!snapshot.sampled_points.empty()) {
+      /// sampled points
+      sampled_points_publisher->publish(sampled_points_serializer.serialize(snapshot.sampled_points, "map"));
+    }
+    if (snapshot.has_map) {
+      /// map points
+      if (options.visualization_options.map_voxel_size > 0.0)
+        voxel_decimate(snapshot.map_points, options.visualization_options.map_voxel_size);
+      map_points_publisher->publish(map_points_serializer.serialize(snapshot.map_points, "map"));
+    }
+  };
+  std::unique_ptr<AsyncWorker<VisualizationSnapshot>> visualizer;
+  if (options.visualization_options.async)
+    visualizer = std::make_unique<AsyncWorker<VisualizationSnapshot>>(options.visualization_options.queue_depth,
+                                                                      publish_snapshot);
+
   // Build the Output_dir
   LOG(WARNING) << "Creating directory " << options.output_dir << std::endl;
   fs::create_directories(options.output_dir);
@@ -1226,59 +1608,15 @@ int main(int argc, char **argv) {
   // Error report in case there is ground truth
   std::vector<Sequence::SeqError> sequence_errors;
 
-  while (auto seq = dataset->next()) {
+  // time to first frame: opening a sequence (listing its frames, reading its measurements) plus loading its first
+  // frame, without the calibration and odometry setup in between
+  for (auto open_begin = std::chrono::steady_clock::now(); auto seq = dataset->next();
+       open_begin = std::chrono::steady_clock::now()) {
+    const auto open_time = std::chrono::steady_clock::now() - open_begin;
     LOG(WARNING) << "Running odometry on sequence: " << seq->name() << std::endl;
 
     if (options.dataset == "BoreasAeva" || options.dataset == "BoreasVelodyne" || options.dataset == "BoreasNavtech") {
-      Eigen::Matrix4d T_sr = Eigen::Matrix4d::Identity();
-      fs::path root_path{options.dataset_options.root_path};
-      Eigen::Matrix4d yfwd2xfwd, zup2zdown;
-      yfwd2xfwd << 0, 1, 0, 0, -1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1;
-      zup2zdown << 1, 0, 0, 0, 0, -1, 0, 0, 0, 0, -1, 0, 0, 0, 0, 1;
-      if (options.dataset == "BoreasVelodyne") {
-        std::ifstream ifs(root_path / seq->name() / "calib" / "T_applanix_lidar.txt", std::ios::in);
-        Eigen::Matrix4d T_applanix_lidar_mat;
-        for (size_t row = 0; row < 4; row++)
-          for (size_t col = 0; col < 4; col++) ifs >> T_applanix_lidar_mat(row, col);
-        T_sr = (yfwd2xfwd * T_applanix_lidar_mat).inverse();
-      } else if (options.dataset == "BoreasNavtech") {
-        std::ifstream ifs1(root_path / seq->name() / "calib" / "T_applanix_lidar.txt", std::ios::in);
-        std::ifstream ifs2(root_path / seq->name() / "calib" / "T_radar_lidar.txt", std::ios::in);
-        Eigen::Matrix4d T_applanix_lidar_mat;
-        for (size_t row = 0; row < 4; row++)
-          for (size_t col = 0; col < 4; col++) ifs1 >> T_applanix_lidar_mat(row, col);
-        Eigen::Matrix4d T_radar_lidar_mat;
-        for (size_t row = 0; row < 4; row++)
-          for (size_t col = 0; col < 4; col++) ifs2 >> T_radar_lidar_mat(row, col);
-        T_sr = (yfwd2xfwd * T_applanix_lidar_mat * (zup2zdown * T_radar_lidar_mat).inverse()).inverse();
-      } else if (options.dataset == "BoreasAeva") {
-        std::ifstream ifs(root_path / seq->name() / "calib" / "T_applanix_aeva.txt", std::ios::in);
-        Eigen::Matrix4d T_applanix_lidar_mat;
-        for (size_t row = 0; row < 4; row++)
-          for (size_t col = 0; col < 4; col++) ifs >> T_applanix_lidar_mat(row, col);
-        T_sr = (yfwd2xfwd * T_applanix_lidar_mat).inverse();
-      }
-      options.visualization_options.T_sr = T_sr;
-      if (options.odometry == "STEAM") {
-        auto &steam_icp_options = dynamic_cast<SteamOdometry::Options &>(*options.odometry_options);
-        steam_icp_options.T_sr = T_sr;
-      }
-      if (options.odometry == "STEAMLIO") {
-        auto &steam_icp_options = dynamic_cast<SteamLioOdometry::Options &>(*options.odometry_options);
-        steam_icp_options.T_sr = T_sr;
-      }
-      if (options.odometry == "DiscreteLIO") {
-        auto &steam_icp_options = dynamic_cast<DiscreteLIOOdometry::Options &>(*options.odometry_options);
-        steam_icp_options.T_sr = T_sr;
-      }
-      if (options.odometry == "STEAMRIO") {
-        auto &steam_icp_options = dynamic_cast<SteamRioOdometry::Options &>(*options.odometry_options);
-        steam_icp_options.T_sr = T_sr;
-      }
-      if (options.odometry == "STEAMRO") {
-        auto &steam_icp_options = dynamic_cast<SteamRoOdometry::Options &>(*options.odometry_options);
-        steam_icp_options.T_sr = T_sr;
-      }
+      const Eigen::Matrix4d T_sr = setBoreasCalibration(options, seq->name());
       LOG(WARNING) << "(BOREAS)Parameter T_sr = " << std::endl << T_sr << std::endl;
       auto T_rs_msg = tf2::eigenToTransform(Eigen::Affine3d(T_sr.inverse()));
       T_rs_msg.header.frame_id = "vehicle";
@@ -1310,36 +1648,38 @@ int main(int argc, char **argv) {
       continue;
     }
 
-    // timers
-    std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-    timer.emplace_back("loading ..................... ", std::make_unique<Stopwatch<>>(false));
-    timer.emplace_back("registration ................ ", std::make_unique<Stopwatch<>>(false));
-    timer.emplace_back("visualization ............... ", std::make_unique<Stopwatch<>>(false));
-
     const auto odometry = Odometry::Get(options.odometry, *options.odometry_options);
-
-    odometry->T_i_r_gt_poses = seq->T_i_r_gt_poses;
+    auto &telemetry = odometry->telemetry();
+
+    // load frames in the background, the loading timer then only measures waiting on the queue; the loader runs its
+    // parallel loops on the pool of the odometry, whose loops are serialized with them, and keeps that pool alive
+    // until its thread is joined, whichever of the two is destroyed first on the way out
+    if (options.prefetch_depth > 0) {
+      seq->shareThreadPool(odometry->sharedThreadPool());
+      seq = std::make_shared<PrefetchingSequence>(seq, options.prefetch_depth);
+    }
+    const auto first_frame_begin = std::chrono::steady_clock::now();
 
     bool odometry_success = true;
     int k = 0;
+    std::chrono::steady_clock::time_point last_visualization;
     while (seq->hasNext()) {
       LOG(INFO) << "Processing frame " << seq->currFrame() << std::endl;
 
-      timer[0].second->start();
+      Telemetry::Scope loading(telemetry, "load");
       DataFrame frame = seq->next();
-      timer[0].second->stop();
-
-      timer[2].second->start();
-      if (options.visualization_options.raw_points) {
-        auto &raw_points = frame.pointcloud;
-        auto raw_points_msg = to_pc2_msg(raw_points, "sensor");
-        raw_points_publisher->publish(raw_points_msg);
+      loading.stop();
+      if (k == 0) {
+        const auto elapsed = open_time + (std::chrono::steady_clock::now() - first_frame_begin);
+        LOG(WARNING) << "Time to first frame of " << seq->name() << ": "
+                     << std::chrono::duration<double, std::milli>(elapsed).count() << " ms" << std::endl;
       }
-      timer[2].second->stop();
+      // stages of the loader, which ran ahead on its own thread when prefetching
+      for (const auto &[stage, ms] : frame.load_timings) telemetry.add(std::string("load/") + stage, ms);
 
-      timer[1].second->start();
-      const auto summary = odometry->registerFrame(frame);
-      timer[1].second->stop();
+      Telemetry::Scope registration(telemetry, "registration");
+      auto summary = odometry->registerFrame(frame);
+      registration.stop();
       if (!summary.success) {
         LOG(ERROR) << "Error running odometry for sequence " << seq->name() << ", at frame index " << seq->currFrame()
                    << std::endl;
@@ -1349,47 +1689,40 @@ int main(int argc, char **argv) {
         break;
       }
 
-      timer[2].second->start();
-      if (options.visualization_options.odometry) {
-        Eigen::Matrix4d T_ws = Eigen::Matrix4d::Identity();
-        T_ws.block<3, 3>(0, 0) = summary.R_ms;
-        T_ws.block<3, 1>(0, 3) = summary.t_ms;
-        Eigen::Matrix4d T_wr = T_ws * options.visualization_options.T_sr;
-
-        /// odometry
-        nav_msgs::msg::Odometry odometry;
-        odometry.header.frame_id = "map";
-        // odometry.header.stamp = rclcpp::Time(stamp);
-        odometry.pose.pose = tf2::toMsg(Eigen::Affine3d(T_wr));
-        odometry_publisher->publish(odometry);
-
-        /// tf
-        auto T_wr_msg = tf2::eigenToTransform(Eigen::Affine3d(T_wr));
-        T_wr_msg.header.frame_id = "map";
-        // T_wr_msg.header.stamp = rclcpp::Time(stamp);
-        T_wr_msg.child_frame_id = "vehicle";
-        tf_bc->sendTransform(T_wr_msg);
-      }
-      if (options.visualization_options.sampled_points) {
-        /// sampled points
-        auto &sampled_points = summary.corrected_points;
-        auto sampled_points_msg = to_pc2_msg(sampled_points, "map");
-        sampled_points_publisher->publish(sampled_points_msg);
-      }
-      if (options.visualization_options.map_points) {
-        /// map points
-        auto map_points = odometry->map();
-        auto map_points_msg = to_pc2_msg(map_points, "map");
-        map_points_publisher->publish(map_points_msg);
+      Telemetry::Scope visualization(telemetry, "visualization");
+      const auto &visualization_options = options.visualization_options;
+      const auto now = std::chrono::steady_clock::now();
+      if (visualization_options.max_rate_hz <= 0.0 ||
+          now - last_visualization >= std::chrono::duration<double>(1.0 / visualization_options.max_rate_hz)) {
+        last_visualization = now;
+        VisualizationSnapshot snapshot;
+        if (visualization_options.odometry) {
+          Eigen::Matrix4d T_ws = Eigen::Matrix4d::Identity();
+          T_ws.block<3, 3>(0, 0) = summary.R_ms;
+          T_ws.block<3, 1>(0, 3) = summary.t_ms;
+          snapshot.has_pose = true;
+          snapshot.T_wr = T_ws * visualization_options.T_sr;
+        }
+        // the frame and the summary are not used past this point
+        if (visualization_options.raw_points) snapshot.raw_points = std::move(frame.pointcloud);
+        if (visualization_options.sampled_points) snapshot.sampled_points = std::move(summary.corrected_points);
+        if (visualization_options.map_points && k % visualization_options.map_every_n_frames == 0) {
+          snapshot.has_map = true;
+          snapshot.map_points = odometry->map();
+        }
+        if (visualizer)
+          visualizer->push(std::move(snapshot));
+        else
+          publish_snapshot(std::move(snapshot));
       }
-      timer[2].second->stop();
+      visualization.stop();
+      telemetry.nextFrame();
 
       if (!rclcpp::ok()) {
         LOG(WARNING) << "Shutting down due to ctrl-c." << std::endl;
         // dump timing information
-        for (size_t i = 0; i < timer.size(); i++) {
-          LOG(WARNING) << "Average " << timer[i].first << (timer[i].second->count() / (double)k) << " ms" << std::endl;
-        }
+        LOG(WARNING) << telemetry.report() << std::endl;
+        telemetry.write(options.output_dir + seq->name());
         // transform and save the estimated trajectory
         seq->save(options.output_dir, odometry->trajectory());
 
@@ -1410,6 +1743,7 @@ int main(int argc, char **argv) {
         // clang-format on
         LOG(WARNING) << std::endl;
 
+        STEAM_ICP_TRACE_FLUSH(options.output_dir + "trace.json");
         return 0;
       }
       k++;
@@ -1422,10 +1756,8 @@ int main(int argc, char **argv) {
     }
 
     // dump timing information
-    for (size_t i = 0; i < timer.size(); i++) {
-      LOG(WARNING) << "Average " << timer[i].first << (timer[i].second->count() / (double)seq->numFrames()) << " ms"
-                   << std::endl;
-    }
+    LOG(WARNING) << telemetry.report() << std::endl;
+    telemetry.write(options.output_dir + seq->name());
 
     // transform and save the estimated trajectory
     seq->save(options.output_dir, odometry->trajectory());
@@ -1469,6 +1801,18 @@ int main(int argc, char **argv) {
     LOG(WARNING) << "KITTI metric translation/rotation : " << (all_seq_rpe_t / num_total_errors) * 100 << " "
                  << (all_seq_rpe_r / num_total_errors) * 180.0 / M_PI << std::endl;
   }
+  if (!options.errors_file.empty()) {
+    std::ofstream ofs(options.errors_file);
+    ofs << std::setprecision(17);
+    for (const auto &seq_error : sequence_errors)
+      for (const auto &tab_error : seq_error.tab_errors) ofs << tab_error.t_err << " " << tab_error.r_err << "\n";
+  }
+
+  if (visualizer) {
+    LOG(WARNING) << "Dropped " << visualizer->numDropped() << " stale visualization snapshots" << std::endl;
+    visualizer.reset();
+  }
+  STEAM_ICP_TRACE_FLUSH(options.output_dir + "trace.json");
 
   rclcpp::shutdown();
 
@@ -1,12 +1,14 @@
 #include "steam_icp/odometry/ceres_elastic_icp.hpp"
 
 #include <iomanip>
+#include <mutex>
 #include <random>
 
 #include <ceres/ceres.h>
 #include <glog/logging.h>
 
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/timer_table.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
@@ -398,6 +400,7 @@ auto CeresElasticOdometry::registerFrame(const DataFrame &const_frame) -> Regist
   int index_frame = trajectory_.size();
   trajectory_.emplace_back();
 
+  Telemetry::Scope initialization(telemetry(), "registration/initialization");
   //
   initializeTimestamp(index_frame, const_frame);
 
@@ -406,6 +409,7 @@ auto CeresElasticOdometry::registerFrame(const DataFrame &const_frame) -> Regist
 
   //
   auto frame = initializeFrame(index_frame, const_frame.pointcloud);
+  initialization.stop();
 
   //
   if (index_frame > 0) {
@@ -417,7 +421,7 @@ auto CeresElasticOdometry::registerFrame(const DataFrame &const_frame) -> Regist
     grid_sampling(frame, keypoints, sample_voxel_size);
 
     // icp
-    summary.success = icp(index_frame, keypoints);
+    summary.success = readMap([&] { return icp(index_frame, keypoints); });
     summary.keypoints = keypoints;
     if (!summary.success) return summary;
   } else {
@@ -426,7 +430,9 @@ auto CeresElasticOdometry::registerFrame(const DataFrame &const_frame) -> Regist
   trajectory_[index_frame].points = frame;
 
   // add points
-  updateMap(index_frame, index_frame);
+  Telemetry::Scope update_map(telemetry(), "registration/updatemap");
+  if (scheduleMapUpdate(index_frame)) updateMap(index_frame, index_frame);
+  update_map.stop();
 
   summary.corrected_points = frame;
 
@@ -518,10 +524,7 @@ std::vector<Point3D> CeresElasticOdometry::initializeFrame(int index_frame, cons
 }
 
 void CeresElasticOdometry::updateMap(int index_frame, int update_frame) {
-  const double kSizeVoxelMap = options_.size_voxel_map;
-  const double kMinDistancePoints = options_.min_distance_points;
-  const int kMaxNumPointsInVoxel = options_.max_num_points_in_voxel;
-
+  STEAM_ICP_TRACE_SCOPE("updateMap");
   // update frame
   auto &frame = trajectory_[update_frame].points;
 
@@ -538,17 +541,13 @@ void CeresElasticOdometry::updateMap(int index_frame, int update_frame) {
     point.pt = R * point.raw_pt + t;
   }
 
-  map_.add(frame, kSizeVoxelMap, kMaxNumPointsInVoxel, kMinDistancePoints);
-  frame.clear();
-  frame.shrink_to_fit();
-
-  // remove points
-  const double kMaxDistance = options_.max_distance;
+  // insert the points and remove the far away ones, in the background when pipelined
   const Eigen::Vector3d location = trajectory_[index_frame].end_t;
-  map_.remove(location, kMaxDistance);
+  addToMap(std::move(frame), location, false);
 }
 
 bool CeresElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
+  STEAM_ICP_TRACE_SCOPE("icp");
   bool icp_success = true;
 
   // For the 50 first frames, visit 2 voxels
@@ -573,29 +572,22 @@ bool CeresElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints)
   Eigen::Vector3d end_t = current_estimate.end_t;
 
   // timers
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("Update Transform ............... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Association .................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Optimization ................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Alignment ...................... ", std::make_unique<Stopwatch<>>(false));
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> inner_timer;
-  inner_timer.emplace_back("Search Neighbors ............. ", std::make_unique<Stopwatch<>>(false));
-  inner_timer.emplace_back("Compute Normal ............... ", std::make_unique<Stopwatch<>>(false));
-  inner_timer.emplace_back("Add Cost Term ................ ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"Update Transform", "Association", "Optimization", "Alignment"};
+  TimerTable inner_timer{"Search Neighbors", "Compute Normal", "Add Cost Term"};
   bool innerloop_time = (options_.num_threads == 1);
 
   int number_keypoints_used = 0;
 
   auto transform_keypoints = [&]() {
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (auto &keypoint : keypoints) {
+    threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t i) {
+      auto &keypoint = keypoints[i];
       const double &alpha_timestamp = keypoint.alpha_timestamp;
       Eigen::Quaterniond q = begin_quat.slerp(alpha_timestamp, end_quat);
       q.normalize();
       Eigen::Matrix3d R = q.toRotationMatrix();
       Eigen::Vector3d t = (1.0 - alpha_timestamp) * begin_t + alpha_timestamp * end_t;
       keypoint.pt = R * keypoint.raw_pt + t;
-    }
+    });
   };
 
   double lambda_weight = std::abs(options_.weight_alpha);
@@ -613,31 +605,31 @@ bool CeresElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints)
 
     number_keypoints_used = 0;
 
-    timer[0].second->start();
+    timer[0].start();
     transform_keypoints();
-    timer[0].second->stop();
+    timer[0].stop();
 
-    timer[1].second->start();
+    timer[1].start();
 
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
+    std::mutex cost_term_mutex;
+    threadPool().parallelFor("icp.association", 0, keypoints.size(), [&](size_t i) {
       const auto &keypoint = keypoints[i];
       const auto &pt_keypoint = keypoint.pt;
       const auto &alpha_timestamp = keypoint.alpha_timestamp;
 
-      if (innerloop_time) inner_timer[0].second->start();
+      if (innerloop_time) inner_timer[0].start();
 
       // Neighborhood search
       ArrayVector3d vector_neighbors =
           map_.searchNeighbors(pt_keypoint, nb_voxels_visited, options_.size_voxel_map, options_.max_number_neighbors);
 
-      if (innerloop_time) inner_timer[0].second->stop();
+      if (innerloop_time) inner_timer[0].stop();
 
       if ((int)vector_neighbors.size() < kMinNumNeighbors) {
-        continue;
+        return;
       }
 
-      if (innerloop_time) inner_timer[1].second->start();
+      if (innerloop_time) inner_timer[1].start();
 
       // Compute normals from neighbors
       auto neighborhood = compute_neighborhood_distribution(vector_neighbors);
@@ -651,21 +643,21 @@ bool CeresElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints)
                             lambda_neighborhood * std::exp(-(vector_neighbors[0] - pt_keypoint).norm() /
                                                            (kMaxPointToPlane * kMinNumNeighbors));
 
-      if (innerloop_time) inner_timer[1].second->stop();
+      if (innerloop_time) inner_timer[1].stop();
 
-      if (innerloop_time) inner_timer[2].second->start();
+      if (innerloop_time) inner_timer[2].start();
 
       const double dist_to_plane = std::abs((keypoint.pt - vector_neighbors[0]).transpose() * neighborhood.normal);
       if (dist_to_plane < kMaxPointToPlane) {
         builder.SetResidualBlock(i, vector_neighbors[0], neighborhood.normal, weight, alpha_timestamp);
-#pragma omp critical(odometry_cost_term)
-        { number_keypoints_used++; }
+        std::lock_guard<std::mutex> lock(cost_term_mutex);
+        number_keypoints_used++;
       }
 
-      if (innerloop_time) inner_timer[2].second->stop();
-    }
+      if (innerloop_time) inner_timer[2].stop();
+    });
 
-    timer[1].second->stop();
+    timer[1].stop();
 
     if (number_keypoints_used < options_.min_number_keypoints) {
       LOG(ERROR) << "[CT_ICP]Error : not enough keypoints selected in ct-icp !" << std::endl;
@@ -674,7 +666,7 @@ bool CeresElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints)
       break;
     }
 
-    timer[2].second->start();
+    timer[2].start();
 
     auto problem = builder.GetProblem();
 
@@ -717,9 +709,9 @@ bool CeresElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints)
       std::cout << summary.BriefReport() << std::endl;
     }
 
-    timer[2].second->stop();
+    timer[2].stop();
 
-    timer[3].second->start();
+    timer[3].start();
 
     // Update (changes trajectory data)
     begin_quat.normalize();
@@ -736,7 +728,7 @@ bool CeresElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints)
     current_estimate.setMidPose(
         getMidPose(current_estimate.begin_R, current_estimate.end_R, current_estimate.begin_t, current_estimate.end_t));
 
-    timer[3].second->stop();
+    timer[3].stop();
 
     if ((index_frame > 1) &&
         (diff_rot < options_.threshold_orientation_norm && diff_trans < options_.threshold_translation_norm)) {
@@ -747,18 +739,21 @@ bool CeresElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints)
     }
   }
 
-  timer[0].second->start();
+  timer[0].start();
   transform_keypoints();
-  timer[0].second->stop();
+  timer[0].stop();
 
   LOG(INFO) << "Number of keypoints used in CT-ICP : " << number_keypoints_used << std::endl;
 
+  recordTimers("registration/icp", timer);
+  if (innerloop_time) recordTimers("registration/icp/inner_loop", inner_timer);
+
   /// Debug print
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
     for (size_t i = 0; i < inner_timer.size(); i++)
-      LOG(INFO) << "Elapsed (Inner Loop) " << inner_timer[i].first << *(inner_timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed (Inner Loop) " << inner_timer.label(i) << inner_timer[i] << std::endl;
     LOG(INFO) << "Number iterations CT-ICP : " << options_.num_iters_icp << std::endl;
     LOG(INFO) << "Translation Begin: " << trajectory_[index_frame].begin_t.transpose() << std::endl;
     LOG(INFO) << "Translation End: " << trajectory_[index_frame].end_t.transpose() << std::endl;
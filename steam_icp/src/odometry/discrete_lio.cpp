@@ -1,13 +1,17 @@
 #include "steam_icp/odometry/discrete_lio.hpp"
 
 #include <iomanip>
+#include <mutex>
 #include <random>
+#include <tuple>
 
 #include <glog/logging.h>
 
 #include "steam.hpp"
 
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/loss_kernels.hpp"
+#include "steam_icp/utils/timer_table.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
@@ -42,12 +46,7 @@ void sub_sample_frame(std::vector<Point3D> &frame, double size_voxel, int num_th
 void grid_sampling(const std::vector<Point3D> &frame, std::vector<Point3D> &keypoints, double size_voxel_subsampling,
                    int num_threads) {
   keypoints.clear();
-  std::vector<Point3D> frame_sub;
-  frame_sub.resize(frame.size());
-#pragma omp parallel for num_threads(2)
-  for (int i = 0; i < (int)frame_sub.size(); i++) {
-    frame_sub[i] = frame[i];
-  }
+  std::vector<Point3D> frame_sub(frame);
   sub_sample_frame(frame_sub, size_voxel_subsampling, num_threads);
   keypoints.reserve(frame_sub.size());
   std::transform(frame_sub.begin(), frame_sub.end(), std::back_inserter(keypoints), [](const auto c) { return c; });
@@ -120,6 +119,7 @@ auto DiscreteLIOOdometry::registerFrame(const DataFrame &const_frame) -> Registr
   int index_frame = trajectory_.size();
   trajectory_.emplace_back();
 
+  Telemetry::Scope initialization(telemetry(), "registration/initialization");
   //
   initializeTimestamp(index_frame, const_frame);
 
@@ -128,6 +128,7 @@ auto DiscreteLIOOdometry::registerFrame(const DataFrame &const_frame) -> Registr
 
   //
   auto frame = initializeFrame(index_frame, const_frame.pointcloud);
+  initialization.stop();
 
   //
   std::vector<Point3D> keypoints;
@@ -139,7 +140,8 @@ auto DiscreteLIOOdometry::registerFrame(const DataFrame &const_frame) -> Registr
     grid_sampling(frame, keypoints, sample_voxel_size, options_.num_threads);
 
     // icp
-    summary.success = icp(index_frame, keypoints, const_frame.imu_data_vec, const_frame.pose_data_vec);
+    summary.success =
+        readMap([&] { return icp(index_frame, keypoints, const_frame.imu_data_vec, const_frame.pose_data_vec); });
     summary.keypoints = keypoints;
     if (!summary.success) return summary;
   } else {
@@ -189,15 +191,14 @@ auto DiscreteLIOOdometry::registerFrame(const DataFrame &const_frame) -> Registr
   const Eigen::Matrix3d r = T.block<3, 3>(0, 0);
 
   // add points
+  Telemetry::Scope update_map(telemetry(), "registration/updatemap");
   if (index_frame == 0) {
-    updateMap(index_frame, index_frame);
+    if (scheduleMapUpdate(index_frame)) updateMap(index_frame, index_frame);
   } else if ((index_frame - options_.delay_adding_points) > 0) {
-    // if ((t - t_prev_).norm() > options_.keyframe_translation_threshold_m || fabs(AngularDistance(r, r_prev_)) > options_.keyframe_rotation_threshold_deg) {
+    if (scheduleMapUpdate(index_frame - options_.delay_adding_points))
       updateMap(index_frame, (index_frame - options_.delay_adding_points));
-      t_prev_ = t;
-      r_prev_ = r;
-    // }
   }
+  update_map.stop();
 
   summary.corrected_points = keypoints;
 
@@ -210,11 +211,18 @@ auto DiscreteLIOOdometry::registerFrame(const DataFrame &const_frame) -> Registr
 void DiscreteLIOOdometry::initializeTimestamp(int index_frame, const DataFrame &const_frame) {
   double min_timestamp = std::numeric_limits<double>::max();
   double max_timestamp = std::numeric_limits<double>::min();
-#pragma omp parallel for num_threads(2) reduction(min : min_timestamp) reduction(max : max_timestamp)
-  for (const auto &point : const_frame.pointcloud) {
-    if (point.timestamp > max_timestamp) max_timestamp = point.timestamp;
-    if (point.timestamp < min_timestamp) min_timestamp = point.timestamp;
-  }
+  using Bounds = std::pair<double, double>;
+  const auto &points = const_frame.pointcloud;
+  std::tie(min_timestamp, max_timestamp) = threadPool().parallelReduce(
+      "initialize_timestamp", 0, points.size(), Bounds(min_timestamp, max_timestamp),
+      [&](size_t i, Bounds &bounds) {
+        if (points[i].timestamp > bounds.second) bounds.second = points[i].timestamp;
+        if (points[i].timestamp < bounds.first) bounds.first = points[i].timestamp;
+      },
+      [](Bounds &result, Bounds &&local) {
+        result.first = std::min(result.first, local.first);
+        result.second = std::max(result.second, local.second);
+      });
   trajectory_[index_frame].begin_timestamp = min_timestamp;
   trajectory_[index_frame].end_timestamp = max_timestamp;
   // purpose: eval trajectory at the exact file stamp to match ground truth
@@ -259,26 +267,23 @@ std::vector<Point3D> DiscreteLIOOdometry::initializeFrame(int index_frame, const
   auto q_end = Eigen::Quaterniond(trajectory_[index_frame].end_R);
   Eigen::Vector3d t_begin = trajectory_[index_frame].begin_t;
   Eigen::Vector3d t_end = trajectory_[index_frame].end_t;
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned int i = 0; i < frame.size(); ++i) {
+  threadPool().parallelFor("initialize_frame.transform", 0, frame.size(), [&](size_t i) {
     auto &point = frame[i];
     double alpha_timestamp = point.alpha_timestamp;
     Eigen::Matrix3d R = q_begin.slerp(alpha_timestamp, q_end).normalized().toRotationMatrix();
     Eigen::Vector3d t = (1.0 - alpha_timestamp) * t_begin + alpha_timestamp * t_end;
     //
     point.pt = R * point.raw_pt + t;
-  }
+  });
 
   return frame;
 }
 
 void DiscreteLIOOdometry::updateMap(int index_frame, int update_frame) {
+  STEAM_ICP_TRACE_SCOPE("updateMap");
   using namespace steam::se3;
   using namespace steam::traj;
   Time mid_steam_time = Time(trajectory_[update_frame].getEvalTime());
-  const double kSizeVoxelMap = options_.size_voxel_map;
-  const double kMinDistancePoints = options_.min_distance_points;
-  const int kMaxNumPointsInVoxel = options_.max_num_points_in_voxel;
   // update frame
   auto &frame = trajectory_[update_frame].points;
   if (update_frame > 0) {
@@ -314,14 +319,9 @@ void DiscreteLIOOdometry::updateMap(int index_frame, int update_frame) {
 //         }
   }
   // Add the undistorted point to the map
-  map_.add(frame, kSizeVoxelMap, kMaxNumPointsInVoxel, kMinDistancePoints);
-  if (options_.filter_lifetimes) map_.update_and_filter_lifetimes();
-  frame.clear();
-  frame.shrink_to_fit();
-  // remove points
-  const double kMaxDistance = options_.max_distance;
+  // insert the points and remove the far away ones, in the background when pipelined
   const Eigen::Vector3d location = trajectory_[index_frame].end_t;
-  map_.remove(location, kMaxDistance);
+  addToMap(std::move(frame), location, options_.filter_lifetimes);
 }
 
 Eigen::Matrix<double, 6, 1> DiscreteLIOOdometry::initialize_gravity(const std::vector<steam::IMUData> &imu_data_vec) {
@@ -502,8 +502,8 @@ void DiscreteLIOOdometry::transform_keypoints(
   std::map<double, Eigen::Matrix4d> T_ms_cache_map;
   const Eigen::Matrix4d T_sr = T_rs.inverse();
   const Eigen::Matrix4d T_s0_m = T_sr * T_r0_m;
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int jj = 0; jj < (int)unique_point_times.size(); jj++) {
+  std::mutex T_ms_cache_map_mutex;
+  threadPool().parallelFor("transform_keypoints.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
     const auto &ts = unique_point_times[jj];
     int start_index = 0, end_index = 0;
     for (size_t k = 0; k < imu_pose_times.size(); ++k) {
@@ -515,10 +515,10 @@ void DiscreteLIOOdometry::transform_keypoints(
       end_index = k;
     }
     if ((ts == imu_pose_times[start_index]) || (start_index == end_index) || (imu_pose_times[start_index] == imu_pose_times[end_index])) {
-#pragma omp critical
+      std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
       T_ms_cache_map[ts] = T_mr_vec[start_index].second * T_rs;
     } else if (ts == imu_pose_times[end_index]) {
-#pragma omp critical
+      std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
       T_ms_cache_map[ts] = T_mr_vec[end_index].second * T_rs;
     } else {
       double alpha = (ts - imu_pose_times[start_index]) / (imu_pose_times[end_index] - imu_pose_times[start_index]);
@@ -527,13 +527,12 @@ void DiscreteLIOOdometry::transform_keypoints(
       Eigen::Matrix4d T_ms = T_mr_vec[start_index].second * lgmath::se3::vec2tran(xi * alpha).matrix() * T_rs;
       if (undistort_only)
         T_ms = T_s0_m * T_ms;  // T_s0_s
-#pragma omp critical
+      std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
       T_ms_cache_map[ts] = T_ms;
     }
-  }
+  });
 
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int jj = 0; jj < (int)keypoints.size(); jj++) {
+  threadPool().parallelFor("transform_keypoints.transform", 0, keypoints.size(), [&](size_t jj) {
     auto &keypoint = keypoints[jj];
     const Eigen::Matrix4d &T_ms = T_ms_cache_map[keypoint.timestamp];
     if (undistort_only) {
@@ -543,12 +542,13 @@ void DiscreteLIOOdometry::transform_keypoints(
       keypoint.pt = T_ms.block<3, 3>(0, 0) * keypoint.raw_pt + T_ms.block<3, 1>(0, 3);
     }
     
-  }
+  });
 }
 
 bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
                           const std::vector<steam::IMUData> &imu_data_vec,
                           const std::vector<PoseData> &pose_data_vec) {
+  STEAM_ICP_TRACE_SCOPE("icp");
   using namespace steam;
   using namespace steam::se3;
   using namespace steam::traj;
@@ -746,6 +746,7 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
         const auto &var = trajectory_vars_.at(i);
         if (var.time <= marg_steam_time) {
           end_marg_time = var.time.seconds();
+          if (i < marginalized_until_) continue;  // already marginalized early
           marg_vars.emplace_back(var.T_mr);
           marg_vars.emplace_back(var.v_rm_inm);
           marg_vars.emplace_back(var.imu_biases);
@@ -758,6 +759,20 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       sliding_window_filter_->marginalizeVariable(marg_vars);
       LOG(INFO) << "Marginalizing time (inclusive): " << begin_marg_time << " - " << end_marg_time
                 << ", with num states: " << num_states << std::endl;
+
+      // bound the window: marginalize the oldest remaining states early, never those the current frame attaches to
+      marginalized_until_ = std::max(marginalized_until_, to_marginalize_);
+      int num_early_states = 0;
+      while (marginalized_until_ < prev_trajectory_var_index &&
+             marginalization_policy_.exceeded(*sliding_window_filter_, num_early_states)) {
+        const auto &var = trajectory_vars_.at(marginalized_until_);
+        std::vector<StateVarBase::Ptr> early_vars{var.T_mr, var.v_rm_inm, var.imu_biases};
+        sliding_window_filter_->marginalizeVariable(early_vars);
+        marginalized_until_++;
+        num_early_states++;
+      }
+      if (num_early_states > 0)
+        LOG(INFO) << "Marginalized " << num_early_states << " additional states to bound the window" << std::endl;
     }
   }
 
@@ -831,11 +846,7 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   auto &current_estimate = trajectory_.at(index_frame);
 
   // timers
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("Update Transform ............... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Association .................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Optimization ................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Alignment ...................... ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"Update Transform", "Association", "Optimization", "Alignment"};
 
 #define USE_P2P_SUPER_COST_TERM true
   auto p2p_options = P2PGlobalSuperCostTerm::Options();
@@ -859,14 +870,13 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       imu_data_vec);
 
   // Transform points into the robot frame just once:
-  timer[0].second->start();
+  timer[0].start();
   const Eigen::Matrix4d T_rs_mat = options_.T_sr.inverse();
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int i = 0; i < (int)keypoints.size(); i++) {
+  threadPool().parallelFor("icp.keypoints_to_robot", 0, keypoints.size(), [&](size_t i) {
     auto &keypoint = keypoints[i];
     keypoint.raw_pt = T_rs_mat.block<3, 3>(0, 0) * keypoint.raw_pt + T_rs_mat.block<3, 1>(0, 3);
-  }
-  timer[0].second->stop();
+  });
+  timer[0].stop();
   auto &p2p_matches = p2p_super_cost_term->get();
   p2p_matches.clear();
   int N_matches = 0;
@@ -878,43 +888,28 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     swf_inside_icp = true;
   }
 
-  const auto p2p_loss_func = [this]() -> BaseLossFunc::Ptr {
-    switch (options_.p2p_loss_func) {
-      case STEAM_LOSS_FUNC::L2:
-        return L2LossFunc::MakeShared();
-      case STEAM_LOSS_FUNC::DCS:
-        return DcsLossFunc::MakeShared(options_.p2p_loss_sigma);
-      case STEAM_LOSS_FUNC::CAUCHY:
-        return CauchyLossFunc::MakeShared(options_.p2p_loss_sigma);
-      case STEAM_LOSS_FUNC::GM:
-        return GemanMcClureLossFunc::MakeShared(options_.p2p_loss_sigma);
-      default:
-        return nullptr;
-    }
-    return nullptr;
-  }();
+  const auto p2p_loss_func = loss::makeSteamLoss(options_.p2p_loss_func, options_.p2p_loss_sigma);
 
   // De-skew points just once:
   // transform_keypoints(unique_point_times, keypoints, imu_data_vec, curr_time, trajectory_vars_.size() - 1, true, Eigen::Matrix4d::Identity());
 
   auto transform_keypoints_simple = [&]() {
     const auto T_mr = trajectory_vars_.back().T_mr->evaluate().matrix();
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)keypoints.size(); jj++) {
+    threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t jj) {
       auto &keypoint = keypoints[jj];
       keypoint.pt = T_mr.block<3, 3>(0, 0) * keypoint.raw_pt + T_mr.block<3, 1>(0, 3);
-    }
+    });
   };
 
   //
   for (int iter(0); iter < options_.num_iters_icp; iter++) {
-    timer[0].second->start();
+    timer[0].start();
     // transform_keypoints_simple();
     transform_keypoints(unique_point_times, keypoints, imu_data_vec, curr_time, trajectory_vars_.size() - 1, false, Eigen::Matrix4d::Identity());
     // create undistorted copy of keypoints
     std::vector<Point3D> undistorted_points(keypoints);
     transform_keypoints(unique_point_times, undistorted_points, imu_data_vec, curr_time, trajectory_vars_.size() - 1, true, Eigen::Matrix4d::Identity());
-    timer[0].second->stop();
+    timer[0].stop();
 
     // initialize problem
     const auto problem = [&]() -> Problem::Ptr {
@@ -929,14 +924,11 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
     meas_cost_terms.clear();
 
-    timer[1].second->start();
+    timer[1].start();
 
-#pragma omp declare reduction(merge_meas : std::vector<BaseCostTerm::ConstPtr> : omp_out.insert( \
-        omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp declare reduction( \
-        merge_matches : std::vector<P2PMatch> : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp parallel for num_threads(options_.num_threads) reduction(merge_matches : p2p_matches) reduction(merge_meas : meas_cost_terms)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
+    using Associations = std::pair<std::vector<BaseCostTerm::ConstPtr>, std::vector<P2PMatch>>;
+    const auto associate = [&](size_t i, Associations &local) {
+      auto &[meas_cost_terms, p2p_matches] = local;
       const auto &keypoint = keypoints[i];
       const auto &pt_keypoint = keypoint.pt;
 
@@ -953,7 +945,7 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
         Eigen::Vector3d closest_pt = vector_neighbors[0];
         const double dist_to_plane = std::abs((keypoint.pt - closest_pt).transpose() * neighborhood.normal);
         if (dist_to_plane >= options_.p2p_max_dist)
-          continue;
+          return;
         Eigen::Vector3d closest_normal = weight * neighborhood.normal;
 #if USE_P2P_SUPER_COST_TERM
         p2p_matches.emplace_back(P2PMatch(keypoint.timestamp, closest_pt, closest_normal, keypoint.raw_pt));
@@ -966,7 +958,11 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
         meas_cost_terms.emplace_back(cost);
 #endif
       }
-    }
+    };
+    auto associations = threadPool().parallelReduce("icp.association", 0, keypoints.size(), Associations(),
+                                                    associate, ThreadPool::Append());
+    ThreadPool::Append()(meas_cost_terms, std::move(associations.first));
+    ThreadPool::Append()(p2p_matches, std::move(associations.second));
 
 #if USE_P2P_SUPER_COST_TERM
     N_matches = p2p_matches.size();
@@ -982,7 +978,7 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     for (const auto &cost : prior_cost_terms) problem->addCostTerm(cost);
     problem->addCostTerm(preint_cost_term);
 
-    timer[1].second->stop();
+    timer[1].stop();
 
     if (N_matches < options_.min_number_keypoints) {
       LOG(ERROR) << "[ICP]Error : not enough keypoints selected in ct-icp !" << std::endl;
@@ -991,7 +987,7 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       break;
     }
 
-    timer[2].second->start();
+    timer[2].start();
 
     // Solve
     GaussNewtonSolverNVA::Params params;
@@ -1004,11 +1000,14 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       params.line_search = false;
     if (swf_inside_icp) params.reuse_previous_pattern = false;
     GaussNewtonSolverNVA solver(*problem, params);
-    solver.optimize();
+    if (swf_inside_icp)
+      marginalization_policy_.solve(solver);
+    else
+      solver.optimize();
 
-    timer[2].second->stop();
+    timer[2].stop();
 
-    timer[3].second->start();
+    timer[3].start();
 
     double diff_trans = 0, diff_rot = 0, diff_vel = 0;
     const auto mid_T_mr = trajectory_vars_.back().T_mr->evaluate().matrix();
@@ -1026,7 +1025,7 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     current_estimate.end_R = mid_T_ms.block<3, 3>(0, 0);
     current_estimate.end_t = mid_T_ms.block<3, 1>(0, 3);
 
-    timer[3].second->stop();
+    timer[3].stop();
 
     LOG(INFO) << "diff_trans: " << diff_trans << " diff_rot: " << diff_rot << " diff_vel: " << diff_vel << std::endl;
     std::cout << "T_mr: " << trajectory_vars_.back().T_mr->evaluate().matrix() << std::endl;
@@ -1045,6 +1044,7 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   LOG(INFO) << "Optimizing in a sliding window!" << std::endl;
 
+  const size_t num_cost_terms_before = sliding_window_filter_->getNumberOfCostTerms();
   for (const auto &meas_cost_term : meas_cost_terms) sliding_window_filter_->addCostTerm(meas_cost_term);
   for (const auto &pose_meas_cost_term : pose_meas_cost_terms) sliding_window_filter_->addCostTerm(pose_meas_cost_term);
   sliding_window_filter_->addCostTerm(preint_cost_term);
@@ -1056,16 +1056,13 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   LOG(INFO) << "number of variables: " << sliding_window_filter_->getNumberOfVariables() << std::endl;
   LOG(INFO) << "number of cost terms: " << sliding_window_filter_->getNumberOfCostTerms() << std::endl;
-  if (sliding_window_filter_->getNumberOfVariables() > 100)
-    throw std::runtime_error{"too many variables in the filter!"};
-  if (sliding_window_filter_->getNumberOfCostTerms() > 100000)
-    throw std::runtime_error{"too many cost terms in the filter!"};
+  marginalization_policy_.update(*sliding_window_filter_, num_cost_terms_before);
 
   GaussNewtonSolverNVA::Params params;
   params.max_iterations = 20;
   params.reuse_previous_pattern = false;
   GaussNewtonSolverNVA solver(*sliding_window_filter_, params);
-  if (!swf_inside_icp) solver.optimize();
+  if (!swf_inside_icp) marginalization_policy_.solve(solver);
 
   const auto mid_T_mr = trajectory_vars_.back().T_mr->evaluate().matrix();
   const auto mid_T_ms = mid_T_mr * options_.T_sr.inverse();
@@ -1078,9 +1075,11 @@ bool DiscreteLIOOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   LOG(INFO) << "Number of keypoints used in ICP : " << N_matches << std::endl;
 
+  recordTimers("registration/icp", timer);
+
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
   }
 
   std::cout << "T_mr: " << trajectory_vars_.back().T_mr->evaluate().matrix() << std::endl;
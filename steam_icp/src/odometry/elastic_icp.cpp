@@ -1,11 +1,14 @@
 #include "steam_icp/odometry/elastic_icp.hpp"
 
 #include <iomanip>
+#include <mutex>
 #include <random>
 
 #include <glog/logging.h>
 
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/loss_kernels.hpp"
+#include "steam_icp/utils/timer_table.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
@@ -166,6 +169,7 @@ auto ElasticOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
   int index_frame = trajectory_.size();
   trajectory_.emplace_back();
 
+  Telemetry::Scope initialization(telemetry(), "registration/initialization");
   //
   initializeTimestamp(index_frame, const_frame);
 
@@ -174,6 +178,7 @@ auto ElasticOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
 
   //
   auto frame = initializeFrame(index_frame, const_frame.pointcloud);
+  initialization.stop();
 
   //
   if (index_frame > 0) {
@@ -185,7 +190,7 @@ auto ElasticOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
     grid_sampling(frame, keypoints, sample_voxel_size);
 
     // icp
-    summary.success = icp(index_frame, keypoints);
+    summary.success = readMap([&] { return icp(index_frame, keypoints); });
     summary.keypoints = keypoints;
     if (!summary.success) return summary;
   } else {
@@ -194,7 +199,9 @@ auto ElasticOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
   trajectory_[index_frame].points = frame;
 
   // add points
-  updateMap(index_frame, index_frame);
+  Telemetry::Scope update_map(telemetry(), "registration/updatemap");
+  if (scheduleMapUpdate(index_frame)) updateMap(index_frame, index_frame);
+  update_map.stop();
 
   summary.corrected_points = frame;
 
@@ -286,10 +293,7 @@ std::vector<Point3D> ElasticOdometry::initializeFrame(int index_frame, const std
 }
 
 void ElasticOdometry::updateMap(int index_frame, int update_frame) {
-  const double kSizeVoxelMap = options_.size_voxel_map;
-  const double kMinDistancePoints = options_.min_distance_points;
-  const int kMaxNumPointsInVoxel = options_.max_num_points_in_voxel;
-
+  STEAM_ICP_TRACE_SCOPE("updateMap");
   // update frame
   auto &frame = trajectory_[update_frame].points;
 
@@ -306,17 +310,13 @@ void ElasticOdometry::updateMap(int index_frame, int update_frame) {
     point.pt = R * point.raw_pt + t;
   }
 
-  map_.add(frame, kSizeVoxelMap, kMaxNumPointsInVoxel, kMinDistancePoints);
-  frame.clear();
-  frame.shrink_to_fit();
-
-  // remove points
-  const double kMaxDistance = options_.max_distance;
+  // insert the points and remove the far away ones, in the background when pipelined
   const Eigen::Vector3d location = trajectory_[index_frame].end_t;
-  map_.remove(location, kMaxDistance);
+  addToMap(std::move(frame), location, false);
 }
 
 bool ElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
+  STEAM_ICP_TRACE_SCOPE("icp");
   bool icp_success = true;
 
   // For the 50 first frames, visit 2 voxels
@@ -334,22 +334,15 @@ bool ElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
   auto &current_estimate = trajectory_.at(index_frame);
 
   // timers
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("Update Transform ............... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Association .................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Optimization ................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Alignment ...................... ", std::make_unique<Stopwatch<>>(false));
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> inner_timer;
-  inner_timer.emplace_back("Search Neighbors ............. ", std::make_unique<Stopwatch<>>(false));
-  inner_timer.emplace_back("Compute Normal ............... ", std::make_unique<Stopwatch<>>(false));
-  inner_timer.emplace_back("Add Cost Term ................ ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"Update Transform", "Association", "Optimization", "Alignment"};
+  TimerTable inner_timer{"Search Neighbors", "Compute Normal", "Add Cost Term"};
   bool innerloop_time = (options_.num_threads == 1);
 
   int number_keypoints_used = 0;
 
   auto transform_keypoints = [&]() {
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (auto &keypoint : keypoints) {
+    threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t i) {
+      auto &keypoint = keypoints[i];
       const double &alpha_timestamp = keypoint.alpha_timestamp;
       Eigen::Quaterniond begin_quat = Eigen::Quaterniond(current_estimate.begin_R);
       Eigen::Quaterniond end_quat = Eigen::Quaterniond(current_estimate.end_R);
@@ -360,7 +353,7 @@ bool ElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
       Eigen::Matrix3d R = q.toRotationMatrix();
       Eigen::Vector3d t = (1.0 - alpha_timestamp) * begin_t + alpha_timestamp * end_t;
       keypoint.pt = R * keypoint.raw_pt + t;
-    }
+    });
   };
 
   //
@@ -371,100 +364,104 @@ bool ElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
 
     number_keypoints_used = 0;
 
-    timer[0].second->start();
+    timer[0].start();
     transform_keypoints();
-    timer[0].second->stop();
-
-    timer[1].second->start();
-
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
-      const auto &keypoint = keypoints[i];
-      const auto &pt_keypoint = keypoint.pt;
-      const auto &alpha_timestamp = keypoint.alpha_timestamp;
-
-      if (innerloop_time) inner_timer[0].second->start();
+    timer[0].stop();
 
-      // Neighborhood search
-      ArrayVector3d vector_neighbors =
-          map_.searchNeighbors(pt_keypoint, nb_voxels_visited, options_.size_voxel_map, options_.max_number_neighbors);
+    timer[1].start();
 
-      if (innerloop_time) inner_timer[0].second->stop();
-
-      if ((int)vector_neighbors.size() < kMinNumNeighbors) {
-        continue;
-      }
-
-      if (innerloop_time) inner_timer[1].second->start();
-
-      // Compute normals from neighbors
-      auto neighborhood = compute_neighborhood_distribution(vector_neighbors);
-
-      if (neighborhood.normal.dot(current_estimate.begin_t - pt_keypoint) < 0) {
-        neighborhood.normal = -1.0 * neighborhood.normal;
-      }
+    // the loss is resolved once per iteration, the association loop is instantiated per loss kernel
+    std::mutex cost_term_mutex;
+    loss::dispatchLossKernel(options_.p2p_loss_func, options_.p2p_loss_sigma, [&](const auto &kernel) {
+      threadPool().parallelFor("icp.association", 0, keypoints.size(), [&](size_t i) {
+        const auto &keypoint = keypoints[i];
+        const auto &pt_keypoint = keypoint.pt;
+        const auto &alpha_timestamp = keypoint.alpha_timestamp;
 
-      const double planarity_weight = std::pow(neighborhood.a2D, options_.power_planarity);
-      const double weight = planarity_weight;
+        if (innerloop_time) inner_timer[0].start();
 
-      if (innerloop_time) inner_timer[1].second->stop();
+        // Neighborhood search
+        ArrayVector3d vector_neighbors = map_.searchNeighbors(pt_keypoint, nb_voxels_visited, options_.size_voxel_map,
+                                                              options_.max_number_neighbors);
 
-      if (innerloop_time) inner_timer[2].second->start();
+        if (innerloop_time) inner_timer[0].stop();
 
-      const double dist_to_plane = std::abs((keypoint.pt - vector_neighbors[0]).transpose() * neighborhood.normal);
-      if (dist_to_plane < kMaxPointToPlane) {
-        Eigen::Vector3d closest_pt = vector_neighbors[0];
-        Eigen::Vector3d closest_normal = weight * neighborhood.normal;
-
-        double scalar = closest_normal[0] * (pt_keypoint[0] - closest_pt[0]) +
-                        closest_normal[1] * (pt_keypoint[1] - closest_pt[1]) +
-                        closest_normal[2] * (pt_keypoint[2] - closest_pt[2]);
-
-        Eigen::Vector3d frame_idx_previous_origin_begin = current_estimate.begin_R * keypoint.raw_pt;
-        Eigen::Vector3d frame_idx_previous_origin_end = current_estimate.end_R * keypoint.raw_pt;
-
-        double cbx = (1 - alpha_timestamp) * (frame_idx_previous_origin_begin[1] * closest_normal[2] -
-                                              frame_idx_previous_origin_begin[2] * closest_normal[1]);
-        double cby = (1 - alpha_timestamp) * (frame_idx_previous_origin_begin[2] * closest_normal[0] -
-                                              frame_idx_previous_origin_begin[0] * closest_normal[2]);
-        double cbz = (1 - alpha_timestamp) * (frame_idx_previous_origin_begin[0] * closest_normal[1] -
-                                              frame_idx_previous_origin_begin[1] * closest_normal[0]);
-
-        double nbx = (1 - alpha_timestamp) * closest_normal[0];
-        double nby = (1 - alpha_timestamp) * closest_normal[1];
-        double nbz = (1 - alpha_timestamp) * closest_normal[2];
+        if ((int)vector_neighbors.size() < kMinNumNeighbors) {
+          return;
+        }
 
-        double cex = (alpha_timestamp) * (frame_idx_previous_origin_end[1] * closest_normal[2] -
-                                          frame_idx_previous_origin_end[2] * closest_normal[1]);
-        double cey = (alpha_timestamp) * (frame_idx_previous_origin_end[2] * closest_normal[0] -
-                                          frame_idx_previous_origin_end[0] * closest_normal[2]);
-        double cez = (alpha_timestamp) * (frame_idx_previous_origin_end[0] * closest_normal[1] -
-                                          frame_idx_previous_origin_end[1] * closest_normal[0]);
+        if (innerloop_time) inner_timer[1].start();
 
-        double nex = (alpha_timestamp)*closest_normal[0];
-        double ney = (alpha_timestamp)*closest_normal[1];
-        double nez = (alpha_timestamp)*closest_normal[2];
+        // Compute normals from neighbors
+        auto neighborhood = compute_neighborhood_distribution(vector_neighbors);
 
-        Eigen::VectorXd u(12);
-        u << cbx, cby, cbz, nbx, nby, nbz, cex, cey, cez, nex, ney, nez;
+        if (neighborhood.normal.dot(current_estimate.begin_t - pt_keypoint) < 0) {
+          neighborhood.normal = -1.0 * neighborhood.normal;
+        }
 
-#pragma omp critical(odometry_cost_term)
-        {
-          for (int i = 0; i < 12; i++) {
-            for (int j = 0; j < 12; j++) {
-              A(i, j) = A(i, j) + u[i] * u[j];
+        const double planarity_weight = std::pow(neighborhood.a2D, options_.power_planarity);
+        const double weight = planarity_weight;
+
+        if (innerloop_time) inner_timer[1].stop();
+
+        if (innerloop_time) inner_timer[2].start();
+
+        const double dist_to_plane = std::abs((keypoint.pt - vector_neighbors[0]).transpose() * neighborhood.normal);
+        if (dist_to_plane < kMaxPointToPlane) {
+          Eigen::Vector3d closest_pt = vector_neighbors[0];
+          Eigen::Vector3d closest_normal = weight * neighborhood.normal;
+
+          double scalar = closest_normal[0] * (pt_keypoint[0] - closest_pt[0]) +
+                          closest_normal[1] * (pt_keypoint[1] - closest_pt[1]) +
+                          closest_normal[2] * (pt_keypoint[2] - closest_pt[2]);
+          const double loss_weight = kernel.weight(dist_to_plane * dist_to_plane);
+
+          Eigen::Vector3d frame_idx_previous_origin_begin = current_estimate.begin_R * keypoint.raw_pt;
+          Eigen::Vector3d frame_idx_previous_origin_end = current_estimate.end_R * keypoint.raw_pt;
+
+          double cbx = (1 - alpha_timestamp) * (frame_idx_previous_origin_begin[1] * closest_normal[2] -
+                                                frame_idx_previous_origin_begin[2] * closest_normal[1]);
+          double cby = (1 - alpha_timestamp) * (frame_idx_previous_origin_begin[2] * closest_normal[0] -
+                                                frame_idx_previous_origin_begin[0] * closest_normal[2]);
+          double cbz = (1 - alpha_timestamp) * (frame_idx_previous_origin_begin[0] * closest_normal[1] -
+                                                frame_idx_previous_origin_begin[1] * closest_normal[0]);
+
+          double nbx = (1 - alpha_timestamp) * closest_normal[0];
+          double nby = (1 - alpha_timestamp) * closest_normal[1];
+          double nbz = (1 - alpha_timestamp) * closest_normal[2];
+
+          double cex = (alpha_timestamp) * (frame_idx_previous_origin_end[1] * closest_normal[2] -
+                                            frame_idx_previous_origin_end[2] * closest_normal[1]);
+          double cey = (alpha_timestamp) * (frame_idx_previous_origin_end[2] * closest_normal[0] -
+                                            frame_idx_previous_origin_end[0] * closest_normal[2]);
+          double cez = (alpha_timestamp) * (frame_idx_previous_origin_end[0] * closest_normal[1] -
+                                            frame_idx_previous_origin_end[1] * closest_normal[0]);
+
+          double nex = (alpha_timestamp)*closest_normal[0];
+          double ney = (alpha_timestamp)*closest_normal[1];
+          double nez = (alpha_timestamp)*closest_normal[2];
+
+          Eigen::VectorXd u(12);
+          u << cbx, cby, cbz, nbx, nby, nbz, cex, cey, cez, nex, ney, nez;
+
+          {
+            std::lock_guard<std::mutex> lock(cost_term_mutex);
+            for (int i = 0; i < 12; i++) {
+              for (int j = 0; j < 12; j++) {
+                A(i, j) = A(i, j) + loss_weight * u[i] * u[j];
+              }
+              b(i) = b(i) - loss_weight * u[i] * scalar;
             }
-            b(i) = b(i) - u[i] * scalar;
-          }
 
-          number_keypoints_used++;
+            number_keypoints_used++;
+          }
         }
-      }
 
-      if (innerloop_time) inner_timer[2].second->stop();
-    }
+        if (innerloop_time) inner_timer[2].stop();
+      });
+    });
 
-    timer[1].second->stop();
+    timer[1].stop();
 
     if (number_keypoints_used < options_.min_number_keypoints) {
       LOG(ERROR) << "[CT_ICP]Error : not enough keypoints selected in ct-icp !" << std::endl;
@@ -473,7 +470,7 @@ bool ElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
       break;
     }
 
-    timer[2].second->start();
+    timer[2].start();
 
     // Normalize equation
     for (int i(0); i < 12; i++) {
@@ -537,9 +534,9 @@ bool ElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
     rotation_end(2, 2) = cos(beta_end) * cos(alpha_end);
     Eigen::Vector3d translation_end = Eigen::Vector3d(x_bundle(9), x_bundle(10), x_bundle(11));
 
-    timer[2].second->stop();
+    timer[2].stop();
 
-    timer[3].second->start();
+    timer[3].start();
 
     // Update (changes trajectory data)
     current_estimate.begin_R = rotation_begin * current_estimate.begin_R;
@@ -550,7 +547,7 @@ bool ElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
     current_estimate.setMidPose(
         getMidPose(current_estimate.begin_R, current_estimate.end_R, current_estimate.begin_t, current_estimate.end_t));
 
-    timer[3].second->stop();
+    timer[3].stop();
 
     if ((index_frame > 1) && (x_bundle.norm() < options_.convergence_threshold)) {
       if (options_.debug_print) {
@@ -560,18 +557,21 @@ bool ElasticOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
     }
   }
 
-  timer[0].second->start();
+  timer[0].start();
   transform_keypoints();
-  timer[0].second->stop();
+  timer[0].stop();
 
   LOG(INFO) << "Number of keypoints used in CT-ICP : " << number_keypoints_used << std::endl;
 
+  recordTimers("registration/icp", timer);
+  if (innerloop_time) recordTimers("registration/icp/inner_loop", inner_timer);
+
   /// Debug print
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
     for (size_t i = 0; i < inner_timer.size(); i++)
-      LOG(INFO) << "Elapsed (Inner Loop) " << inner_timer[i].first << *(inner_timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed (Inner Loop) " << inner_timer.label(i) << inner_timer[i] << std::endl;
     LOG(INFO) << "Number iterations CT-ICP : " << options_.num_iters_icp << std::endl;
     LOG(INFO) << "Translation Begin: " << trajectory_[index_frame].begin_t.transpose() << std::endl;
     LOG(INFO) << "Translation End: " << trajectory_[index_frame].end_t.transpose() << std::endl;
@@ -7,7 +7,9 @@
 
 #include "steam.hpp"
 
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/loss_kernels.hpp"
+#include "steam_icp/utils/timer_table.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
@@ -236,6 +238,7 @@ auto SteamOdometry::registerFrame(const DataFrame &const_frame) -> RegistrationS
   int index_frame = trajectory_.size();
   trajectory_.emplace_back();
 
+  Telemetry::Scope initialization(telemetry(), "registration/initialization");
   //
   initializeTimestamp(index_frame, const_frame);
 
@@ -244,6 +247,7 @@ auto SteamOdometry::registerFrame(const DataFrame &const_frame) -> RegistrationS
 
   //
   auto frame = initializeFrame(index_frame, const_frame.pointcloud);
+  initialization.stop();
 
   //
   if (index_frame > 0) {
@@ -255,7 +259,7 @@ auto SteamOdometry::registerFrame(const DataFrame &const_frame) -> RegistrationS
     grid_sampling(frame, keypoints, sample_voxel_size);
 
     // icp
-    summary.success = icp(index_frame, keypoints);
+    summary.success = readMap([&] { return icp(index_frame, keypoints); });
     summary.keypoints = keypoints;
     if (!summary.success) return summary;
   } else {
@@ -292,11 +296,14 @@ auto SteamOdometry::registerFrame(const DataFrame &const_frame) -> RegistrationS
   trajectory_[index_frame].points = frame;
 
   // add points
+  Telemetry::Scope update_map(telemetry(), "registration/updatemap");
   if (index_frame == 0) {
-    updateMap(index_frame, index_frame);
+    if (scheduleMapUpdate(index_frame)) updateMap(index_frame, index_frame);
   } else if ((index_frame - options_.delay_adding_points) > 0) {
-    updateMap(index_frame, (index_frame - options_.delay_adding_points));
+    if (scheduleMapUpdate(index_frame - options_.delay_adding_points))
+      updateMap(index_frame, (index_frame - options_.delay_adding_points));
   }
+  update_map.stop();
 
   summary.corrected_points = frame;
 
@@ -384,10 +391,7 @@ std::vector<Point3D> SteamOdometry::initializeFrame(int index_frame, const std::
 }
 
 void SteamOdometry::updateMap(int index_frame, int update_frame) {
-  const double kSizeVoxelMap = options_.size_voxel_map;
-  const double kMinDistancePoints = options_.min_distance_points;
-  const int kMaxNumPointsInVoxel = options_.max_num_points_in_voxel;
-
+  STEAM_ICP_TRACE_SCOPE("updateMap");
   // update frame
   auto &frame = trajectory_[update_frame].points;
 #if false
@@ -428,8 +432,7 @@ void SteamOdometry::updateMap(int index_frame, int update_frame) {
   LOG(INFO) << "Adding points to map between (inclusive): " << begin_steam_time.seconds() << " - "
             << end_steam_time.seconds() << ", with num states: " << num_states << std::endl;
 
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned i = 0; i < frame.size(); i++) {
+  threadPool().parallelFor("update_map.deskew", 0, frame.size(), [&](size_t i) {
     const double query_time = frame[i].timestamp;
 
     const auto T_rm_intp_eval = update_trajectory->getPoseInterpolator(Time(query_time));
@@ -440,20 +443,16 @@ void SteamOdometry::updateMap(int index_frame, int update_frame) {
     const Eigen::Vector3d t = T_ms.block<3, 1>(0, 3);
     //
     frame[i].pt = R * frame[i].raw_pt + t;
-  }
+  });
 #endif
 
-  map_.add(frame, kSizeVoxelMap, kMaxNumPointsInVoxel, kMinDistancePoints);
-  frame.clear();
-  frame.shrink_to_fit();
-
-  // remove points
-  const double kMaxDistance = options_.max_distance;
+  // insert the points and remove the far away ones, in the background when pipelined
   const Eigen::Vector3d location = trajectory_[index_frame].end_t;
-  map_.remove(location, kMaxDistance);
+  addToMap(std::move(frame), location, false);
 }
 
 bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
+  STEAM_ICP_TRACE_SCOPE("icp");
   using namespace steam;
   using namespace steam::se3;
   using namespace steam::traj;
@@ -553,6 +552,7 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
         const auto &var = trajectory_vars_.at(i);
         if (var.time <= marg_steam_time) {
           end_marg_time = var.time.seconds();
+          if (i < marginalized_until_) continue;  // already marginalized early
           marg_vars.emplace_back(var.T_rm);
           marg_vars.emplace_back(var.w_mr_inr);
           num_states++;
@@ -565,6 +565,20 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
       //
       LOG(INFO) << "Marginalizing time (inclusive): " << begin_marg_time << " - " << end_marg_time
                 << ", with num states: " << num_states << std::endl;
+
+      // bound the window: marginalize the oldest remaining states early, never those the current frame attaches to
+      marginalized_until_ = std::max(marginalized_until_, to_marginalize_);
+      int num_early_states = 0;
+      while (marginalized_until_ < prev_trajectory_var_index &&
+             marginalization_policy_.exceeded(*sliding_window_filter_, num_early_states)) {
+        const auto &var = trajectory_vars_.at(marginalized_until_);
+        std::vector<StateVarBase::Ptr> early_vars{var.T_rm, var.w_mr_inr};
+        sliding_window_filter_->marginalizeVariable(early_vars);
+        marginalized_until_++;
+        num_early_states++;
+      }
+      if (num_early_states > 0)
+        LOG(INFO) << "Marginalized " << num_early_states << " additional states to bound the window" << std::endl;
     }
   }
 
@@ -591,34 +605,31 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
   auto &current_estimate = trajectory_.at(index_frame);
 
   // timers
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("Update Transform ............... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Association .................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Optimization ................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Alignment ...................... ", std::make_unique<Stopwatch<>>(false));
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> inner_timer;
-  inner_timer.emplace_back("Search Neighbors ............. ", std::make_unique<Stopwatch<>>(false));
-  inner_timer.emplace_back("Compute Normal ............... ", std::make_unique<Stopwatch<>>(false));
-  inner_timer.emplace_back("Add Cost Term ................ ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"Update Transform", "Association", "Optimization", "Alignment"};
+  TimerTable inner_timer{"Search Neighbors", "Compute Normal", "Add Cost Term"};
   bool innerloop_time = (options_.num_threads == 1);
 
   auto transform_keypoints = [&]() {
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
+    threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t i) {
       auto &keypoint = keypoints[i];
       const auto &T_ms_intp_eval = T_ms_intp_eval_vec[i];
 
       const auto T_ms = T_ms_intp_eval->evaluate().matrix();
       keypoint.pt = T_ms.block<3, 3>(0, 0) * keypoint.raw_pt + T_ms.block<3, 1>(0, 3);
-    }
+    });
   };
 
+  // loss functions are immutable, build them once and share them across all measurement cost terms
+  const auto p2p_loss_func = loss::makeSteamLoss(options_.p2p_loss_func, options_.p2p_loss_sigma);
+  const auto rv_loss_func = loss::makeSteamLoss(options_.rv_loss_func, options_.rv_loss_threshold);
+  const auto p2prv_loss_func = GemanMcClureLossFunc::MakeShared(options_.rv_loss_threshold);
+
   //
   int num_iter_icp = index_frame < options_.init_num_frames ? 15 : options_.num_iters_icp;
   for (int iter(0); iter < num_iter_icp; iter++) {
-    timer[0].second->start();
+    timer[0].start();
     transform_keypoints();
-    timer[0].second->stop();
+    timer[0].stop();
 
     // initialize problem
 #if true
@@ -635,28 +646,25 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
     meas_cost_terms.clear();
     meas_cost_terms.reserve(keypoints.size());
 
-    timer[1].second->start();
+    timer[1].start();
 
-#pragma omp declare reduction(merge_meas : std::vector<BaseCostTerm::ConstPtr> : omp_out.insert( \
-        omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp parallel for num_threads(options_.num_threads) reduction(merge_meas : meas_cost_terms)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
+    const auto associate = [&](size_t i, std::vector<BaseCostTerm::ConstPtr> &meas_cost_terms) {
       const auto &keypoint = keypoints[i];
       const auto &pt_keypoint = keypoint.pt;
 
-      if (innerloop_time) inner_timer[0].second->start();
+      if (innerloop_time) inner_timer[0].start();
 
       // Neighborhood search
       ArrayVector3d vector_neighbors =
           map_.searchNeighbors(pt_keypoint, nb_voxels_visited, options_.size_voxel_map, options_.max_number_neighbors);
 
-      if (innerloop_time) inner_timer[0].second->stop();
+      if (innerloop_time) inner_timer[0].stop();
 
       if ((int)vector_neighbors.size() < kMinNumNeighbors) {
-        continue;
+        return;
       }
 
-      if (innerloop_time) inner_timer[1].second->start();
+      if (innerloop_time) inner_timer[1].start();
 
       // Compute normals from neighbors
       auto neighborhood = compute_neighborhood_distribution(vector_neighbors);
@@ -664,9 +672,9 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
       const double planarity_weight = std::pow(neighborhood.a2D, options_.power_planarity);
       const double weight = planarity_weight;
 
-      if (innerloop_time) inner_timer[1].second->stop();
+      if (innerloop_time) inner_timer[1].stop();
 
-      if (innerloop_time) inner_timer[2].second->start();
+      if (innerloop_time) inner_timer[2].start();
 
       const double dist_to_plane = std::abs((keypoint.pt - vector_neighbors[0]).transpose() * neighborhood.normal);
       double max_dist_to_plane = options_.p2p_max_dist;
@@ -689,10 +697,8 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
           const auto rv_error = p2p::radialVelError(w_ms_ins_intp_eval, keypoint.raw_pt, keypoint.radial_velocity);
           const auto error_func = p2p::p2prvError(p2p_error, rv_error);
 
-          // const auto loss_func = L2LossFunc::MakeShared(); /// \todo what loss threshold to use???
-          const auto loss_func = GemanMcClureLossFunc::MakeShared(options_.rv_loss_threshold);
-
-          const auto cost = WeightedLeastSqCostTerm<4>::MakeShared(error_func, noise_model, loss_func);
+          /// \todo what loss threshold to use???
+          const auto cost = WeightedLeastSqCostTerm<4>::MakeShared(error_func, noise_model, p2prv_loss_func);
 
           meas_cost_terms.emplace_back(cost);
 
@@ -703,23 +709,7 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
           const auto &T_ms_intp_eval = T_ms_intp_eval_vec[i];
           const auto error_func = p2p::p2pError(T_ms_intp_eval, closest_pt, keypoint.raw_pt);
 
-          const auto loss_func = [this]() -> BaseLossFunc::Ptr {
-            switch (options_.p2p_loss_func) {
-              case STEAM_LOSS_FUNC::L2:
-                return L2LossFunc::MakeShared();
-              case STEAM_LOSS_FUNC::DCS:
-                return DcsLossFunc::MakeShared(options_.p2p_loss_sigma);
-              case STEAM_LOSS_FUNC::CAUCHY:
-                return CauchyLossFunc::MakeShared(options_.p2p_loss_sigma);
-              case STEAM_LOSS_FUNC::GM:
-                return GemanMcClureLossFunc::MakeShared(options_.p2p_loss_sigma);
-              default:
-                return nullptr;
-            }
-            return nullptr;
-          }();
-
-          const auto cost = WeightedLeastSqCostTerm<3>::MakeShared(error_func, noise_model, loss_func);
+          const auto cost = WeightedLeastSqCostTerm<3>::MakeShared(error_func, noise_model, p2p_loss_func);
           meas_cost_terms.emplace_back(cost);
         }
       }
@@ -732,33 +722,20 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
         const auto error_func = p2p::radialVelError(w_ms_ins_intp_eval, keypoint.raw_pt, keypoint.radial_velocity);
 
         if (std::abs(error_func->value().value()) < options_.rv_max_error) {
-          const auto loss_func = [this]() -> BaseLossFunc::Ptr {
-            switch (options_.rv_loss_func) {
-              case STEAM_LOSS_FUNC::L2:
-                return L2LossFunc::MakeShared();
-              case STEAM_LOSS_FUNC::DCS:
-                return DcsLossFunc::MakeShared(options_.rv_loss_threshold);
-              case STEAM_LOSS_FUNC::CAUCHY:
-                return CauchyLossFunc::MakeShared(options_.rv_loss_threshold);
-              case STEAM_LOSS_FUNC::GM:
-                return GemanMcClureLossFunc::MakeShared(options_.rv_loss_threshold);
-              default:
-                return nullptr;
-            }
-            return nullptr;
-          }();
-
-          const auto cost = WeightedLeastSqCostTerm<1>::MakeShared(error_func, noise_model, loss_func);
+          const auto cost = WeightedLeastSqCostTerm<1>::MakeShared(error_func, noise_model, rv_loss_func);
           meas_cost_terms.emplace_back(cost);
         }
       }
 
-      if (innerloop_time) inner_timer[2].second->stop();
-    }
+      if (innerloop_time) inner_timer[2].stop();
+    };
+    auto associations = threadPool().parallelReduce(
+        "icp.association", 0, keypoints.size(), std::vector<BaseCostTerm::ConstPtr>(), associate, ThreadPool::Append());
+    ThreadPool::Append()(meas_cost_terms, std::move(associations));
 
     for (const auto &cost : meas_cost_terms) problem.addCostTerm(cost);
 
-    timer[1].second->stop();
+    timer[1].stop();
 
     if ((int)meas_cost_terms.size() < options_.min_number_keypoints) {
       LOG(ERROR) << "[CT_ICP]Error : not enough keypoints selected in ct-icp !" << std::endl;
@@ -767,7 +744,7 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
       break;
     }
 
-    timer[2].second->start();
+    timer[2].start();
 
     // Solve
     GaussNewtonSolver::Params params;
@@ -776,9 +753,9 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
     GaussNewtonSolver solver(problem, params);
     solver.optimize();
 
-    timer[2].second->stop();
+    timer[2].stop();
 
-    timer[3].second->start();
+    timer[3].start();
 
     // Update (changes trajectory data)
     double diff_trans = 0, diff_rot = 0;
@@ -805,7 +782,7 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
     current_estimate.end_R = end_T_ms.block<3, 3>(0, 0);
     current_estimate.end_t = end_T_ms.block<3, 1>(0, 3);
 
-    timer[3].second->stop();
+    timer[3].stop();
 
     if ((index_frame > 1) &&
         (diff_rot < options_.threshold_orientation_norm && diff_trans < options_.threshold_translation_norm)) {
@@ -819,6 +796,7 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
   LOG(INFO) << "Optimizing in a sliding window!" << std::endl;
   {
     //
+    const size_t num_cost_terms_before = sliding_window_filter_->getNumberOfCostTerms();
     steam_trajectory->addPriorCostTerms(*sliding_window_filter_);  // ** this includes state priors (like for x_0)
     for (const auto &prior_cost_term : prior_cost_terms) sliding_window_filter_->addCostTerm(prior_cost_term);
     for (const auto &meas_cost_term : meas_cost_terms) sliding_window_filter_->addCostTerm(meas_cost_term);
@@ -826,16 +804,13 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
     //
     LOG(INFO) << "number of variables: " << sliding_window_filter_->getNumberOfVariables() << std::endl;
     LOG(INFO) << "number of cost terms: " << sliding_window_filter_->getNumberOfCostTerms() << std::endl;
-    if (sliding_window_filter_->getNumberOfVariables() > 100)
-      throw std::runtime_error{"too many variables in the filter!"};
-    if (sliding_window_filter_->getNumberOfCostTerms() > 100000)
-      throw std::runtime_error{"too many cost terms in the filter!"};
+    marginalization_policy_.update(*sliding_window_filter_, num_cost_terms_before);
 
     GaussNewtonSolver::Params params;
     params.max_iterations = 20;
     params.reuse_previous_pattern = false;
     GaussNewtonSolver solver(*sliding_window_filter_, params);
-    solver.optimize();
+    marginalization_policy_.solve(solver);
   }
 
   // clang-format off
@@ -860,18 +835,21 @@ bool SteamOdometry::icp(int index_frame, std::vector<Point3D> &keypoints) {
   const auto w = steam_trajectory->getVelocityInterpolator(curr_end_steam_time)->evaluate();
   std::cout << "w(-1) " << w << std::endl;
 
-  timer[0].second->start();
+  timer[0].start();
   transform_keypoints();
-  timer[0].second->stop();
+  timer[0].stop();
 
   LOG(INFO) << "Number of keypoints used in CT-ICP : " << meas_cost_terms.size() << std::endl;
 
+  recordTimers("registration/icp", timer);
+  if (innerloop_time) recordTimers("registration/icp/inner_loop", inner_timer);
+
   /// Debug print
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
     for (size_t i = 0; i < inner_timer.size(); i++)
-      LOG(INFO) << "Elapsed (Inner Loop) " << inner_timer[i].first << *(inner_timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed (Inner Loop) " << inner_timer.label(i) << inner_timer[i] << std::endl;
     LOG(INFO) << "Number iterations CT-ICP : " << options_.num_iters_icp << std::endl;
     LOG(INFO) << "Translation Begin: " << trajectory_[index_frame].begin_t.transpose() << std::endl;
     LOG(INFO) << "Translation End: " << trajectory_[index_frame].end_t.transpose() << std::endl;
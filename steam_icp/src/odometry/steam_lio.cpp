@@ -1,13 +1,17 @@
 #include "steam_icp/odometry/steam_lio.hpp"
 
 #include <iomanip>
+#include <mutex>
 #include <random>
+#include <tuple>
 
 #include <glog/logging.h>
 
 #include "steam.hpp"
 
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/loss_kernels.hpp"
+#include "steam_icp/utils/timer_table.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
@@ -42,12 +46,7 @@ void sub_sample_frame(std::vector<Point3D> &frame, double size_voxel, int num_th
 void grid_sampling(const std::vector<Point3D> &frame, std::vector<Point3D> &keypoints, double size_voxel_subsampling,
                    int num_threads) {
   keypoints.clear();
-  std::vector<Point3D> frame_sub;
-  frame_sub.resize(frame.size());
-#pragma omp parallel for num_threads(2)
-  for (int i = 0; i < (int)frame_sub.size(); i++) {
-    frame_sub[i] = frame[i];
-  }
+  std::vector<Point3D> frame_sub(frame);
   sub_sample_frame(frame_sub, size_voxel_subsampling, num_threads);
   keypoints.reserve(frame_sub.size());
   std::transform(frame_sub.begin(), frame_sub.end(), std::back_inserter(keypoints), [](const auto c) { return c; });
@@ -109,6 +108,19 @@ SteamLioOdometry::SteamLioOdometry(const Options &options) : Odometry(options),
   T_sr_var_->locked() = true;
 
   sliding_window_filter_ = steam::SlidingWindowFilter::MakeShared(options_.num_threads);
+
+  Eigen::Matrix<double, 3, 3> R_acc = Eigen::Matrix<double, 3, 3>::Identity();
+  R_acc.diagonal() = options_.r_imu_acc;
+  Eigen::Matrix<double, 3, 3> R_ang = Eigen::Matrix<double, 3, 3>::Identity();
+  R_ang.diagonal() = options_.r_imu_ang;
+  acc_noise_model_ = steam::StaticNoiseModel<3>::MakeShared(R_acc);
+  gyro_noise_model_ = steam::StaticNoiseModel<3>::MakeShared(R_ang);
+  acc_loss_func_ = steam::CauchyLossFunc::MakeShared(1.0);
+  gyro_loss_func_ = steam::L2LossFunc::MakeShared();
+  Eigen::Matrix<double, 6, 6> bias_cov = Eigen::Matrix<double, 6, 6>::Identity();
+  bias_cov.block<3, 3>(0, 0).diagonal() = options_.q_bias_accel;
+  bias_cov.block<3, 3>(3, 3) = Eigen::Matrix<double, 3, 3>::Identity() * options_.q_bias_gyro;
+  bias_noise_model_ = steam::StaticNoiseModel<6>::MakeShared(bias_cov);
 }
 
 SteamLioOdometry::~SteamLioOdometry() {
@@ -182,10 +194,7 @@ Trajectory SteamLioOdometry::trajectory() {
 auto SteamLioOdometry::registerFrame(const DataFrame &const_frame) -> RegistrationSummary {
   RegistrationSummary summary;
 
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("initialization ..................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("icp ................................ ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("updateMap .......................... ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"initialization", "icp", "updateMap"};
 
   // add a new frame
   int index_frame = trajectory_.size();
@@ -198,9 +207,9 @@ auto SteamLioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
   initializeMotion(index_frame);
 
   //
-  timer[0].second->start();
+  timer[0].start();
   auto frame = initializeFrame(index_frame, const_frame.pointcloud);
-  timer[0].second->stop();
+  timer[0].stop();
 
   //
   std::vector<Point3D> keypoints;
@@ -209,16 +218,16 @@ auto SteamLioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
         index_frame < options_.init_num_frames ? options_.init_sample_voxel_size : options_.sample_voxel_size;
 
     // downsample
-    timer[0].second->start();
+    timer[0].start();
     grid_sampling(frame, keypoints, sample_voxel_size, options_.num_threads);
-    timer[0].second->stop();
+    timer[0].stop();
 
     // icp
     const auto &imu_data_vec = const_frame.imu_data_vec;
     const auto &pose_data_vec = const_frame.pose_data_vec;
-    timer[1].second->start();
-    summary.success = icp(index_frame, keypoints, imu_data_vec, pose_data_vec);
-    timer[1].second->stop();
+    timer[1].start();
+    summary.success = readMap([&] { return icp(index_frame, keypoints, imu_data_vec, pose_data_vec); });
+    timer[1].stop();
     summary.keypoints = keypoints;
     if (!summary.success) return summary;
   } else {
@@ -227,7 +236,7 @@ auto SteamLioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
     using namespace steam::vspace;
     using namespace steam::traj;
 
-    timer[0].second->start();
+    timer[0].start();
 
     // initial state
     lgmath::se3::Transformation T_rm;
@@ -277,18 +286,19 @@ auto SteamLioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
     trajectory_[index_frame].end_dw_mr_inr_cov = P0_accel;
 
     summary.success = true;
-    timer[0].second->stop();
+    timer[0].stop();
   }
   trajectory_[index_frame].points = frame;
 
   // add points
-  timer[2].second->start();
+  timer[2].start();
   if (index_frame == 0) {
-    updateMap(index_frame, index_frame);
+    if (scheduleMapUpdate(index_frame)) updateMap(index_frame, index_frame);
   } else if ((index_frame - options_.delay_adding_points) > 0) {
-    updateMap(index_frame, (index_frame - options_.delay_adding_points));
+    if (scheduleMapUpdate(index_frame - options_.delay_adding_points))
+      updateMap(index_frame, (index_frame - options_.delay_adding_points));
   }
-  timer[2].second->stop();
+  timer[2].stop();
 
   summary.corrected_points = keypoints;
 
@@ -310,10 +320,12 @@ auto SteamLioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
   summary.R_ms = trajectory_[index_frame].end_R;
   summary.t_ms = trajectory_[index_frame].end_t;
 
+  recordTimers("registration", timer);
+
   LOG(INFO) << "OUTER LOOP TIMERS" << std::endl;
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
   }
 
   return summary;
@@ -322,11 +334,18 @@ auto SteamLioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
 void SteamLioOdometry::initializeTimestamp(int index_frame, const DataFrame &const_frame) {
   double min_timestamp = std::numeric_limits<double>::max();
   double max_timestamp = std::numeric_limits<double>::min();
-#pragma omp parallel for num_threads(2) reduction(min : min_timestamp) reduction(max : max_timestamp)
-  for (const auto &point : const_frame.pointcloud) {
-    if (point.timestamp > max_timestamp) max_timestamp = point.timestamp;
-    if (point.timestamp < min_timestamp) min_timestamp = point.timestamp;
-  }
+  using Bounds = std::pair<double, double>;
+  const auto &points = const_frame.pointcloud;
+  std::tie(min_timestamp, max_timestamp) = threadPool().parallelReduce(
+      "initialize_timestamp", 0, points.size(), Bounds(min_timestamp, max_timestamp),
+      [&](size_t i, Bounds &bounds) {
+        if (points[i].timestamp > bounds.second) bounds.second = points[i].timestamp;
+        if (points[i].timestamp < bounds.first) bounds.first = points[i].timestamp;
+      },
+      [](Bounds &result, Bounds &&local) {
+        result.first = std::min(result.first, local.first);
+        result.second = std::max(result.second, local.second);
+      });
   trajectory_[index_frame].begin_timestamp = min_timestamp;
   trajectory_[index_frame].end_timestamp = max_timestamp;
   // purpose: eval trajectory at the exact file stamp to match ground truth
@@ -397,20 +416,19 @@ std::vector<Point3D> SteamLioOdometry::initializeFrame(int index_frame, const st
 
   std::map<double, Eigen::Matrix4d> T_ms_cache_map;
 
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned jj = 0; jj < unique_point_times.size(); jj++) {
+  std::mutex T_ms_cache_map_mutex;
+  threadPool().parallelFor("initialize_frame.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
     const auto &ts = unique_point_times[jj];
     const auto T_rm_intp_eval = extrap_trajectory->getPoseInterpolator(steam::traj::Time(ts));
     const Eigen::Matrix4d T_ms = T_rm_intp_eval->value().inverse().matrix() * T_rs;
-#pragma omp critical
+    std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
     T_ms_cache_map[ts] = T_ms;
-  }
+  });
 
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned i = 0; i < frame.size(); ++i) {
+  threadPool().parallelFor("initialize_frame.deskew", 0, frame.size(), [&](size_t i) {
     const Eigen::Matrix4d &T_ms = T_ms_cache_map[frame[i].timestamp];
     frame[i].pt = T_ms.block<3, 3>(0, 0) * frame[i].raw_pt + T_ms.block<3, 1>(0, 3);
-  }
+  });
 
 #else
   // initialize points
@@ -418,25 +436,21 @@ std::vector<Point3D> SteamLioOdometry::initializeFrame(int index_frame, const st
   auto q_end = Eigen::Quaterniond(trajectory_[index_frame].end_R);
   Eigen::Vector3d t_begin = trajectory_[index_frame].begin_t;
   Eigen::Vector3d t_end = trajectory_[index_frame].end_t;
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned int i = 0; i < frame.size(); ++i) {
+  threadPool().parallelFor("initialize_frame.transform", 0, frame.size(), [&](size_t i) {
     auto &point = frame[i];
     double alpha_timestamp = point.alpha_timestamp;
     Eigen::Matrix3d R = q_begin.slerp(alpha_timestamp, q_end).normalized().toRotationMatrix();
     Eigen::Vector3d t = (1.0 - alpha_timestamp) * t_begin + alpha_timestamp * t_end;
     //
     point.pt = R * point.raw_pt + t;
-  }
+  });
 #endif
 
   return frame;
 }
 
 void SteamLioOdometry::updateMap(int index_frame, int update_frame) {
-  const double kSizeVoxelMap = options_.size_voxel_map;
-  const double kMinDistancePoints = options_.min_distance_points;
-  const int kMaxNumPointsInVoxel = options_.max_num_points_in_voxel;
-
+  STEAM_ICP_TRACE_SCOPE("updateMap");
   // update frame
   auto &frame = trajectory_[update_frame].points;
 #if false
@@ -482,31 +496,24 @@ void SteamLioOdometry::updateMap(int index_frame, int update_frame) {
 
   std::map<double, Eigen::Matrix4d> T_ms_cache_map;
   const Eigen::Matrix4d T_rs = options_.T_sr.inverse();
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int jj = 0; jj < (int)unique_point_times.size(); jj++) {
+  std::mutex T_ms_cache_map_mutex;
+  threadPool().parallelFor("update_map.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
     const auto &ts = unique_point_times[jj];
     const auto T_rm_intp_eval = update_trajectory->getPoseInterpolator(Time(ts));
     const Eigen::Matrix4d T_ms = T_rm_intp_eval->value().inverse().matrix() * T_rs;
-#pragma omp critical
+    std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
     T_ms_cache_map[ts] = T_ms;
-  }
+  });
 
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned i = 0; i < frame.size(); i++) {
+  threadPool().parallelFor("update_map.deskew", 0, frame.size(), [&](size_t i) {
     const Eigen::Matrix4d &T_ms = T_ms_cache_map[frame[i].timestamp];
     frame[i].pt = T_ms.block<3, 3>(0, 0) * frame[i].raw_pt + T_ms.block<3, 1>(0, 3);
-  }
+  });
 #endif
 
-  map_.add(frame, kSizeVoxelMap, kMaxNumPointsInVoxel, kMinDistancePoints);
-  if (options_.filter_lifetimes) map_.update_and_filter_lifetimes();
-  frame.clear();
-  frame.shrink_to_fit();
-
-  // remove points
-  const double kMaxDistance = options_.max_distance;
+  // insert the points and remove the far away ones, in the background when pipelined
   const Eigen::Vector3d location = trajectory_[index_frame].end_t;
-  map_.remove(location, kMaxDistance);
+  addToMap(std::move(frame), location, options_.filter_lifetimes);
 }
 
 Eigen::Matrix<double, 6, 1> SteamLioOdometry::initialize_gravity(const std::vector<steam::IMUData> &imu_data_vec) {
@@ -572,6 +579,7 @@ Eigen::Matrix<double, 6, 1> SteamLioOdometry::initialize_gravity(const std::vect
 bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
                            const std::vector<steam::IMUData> &imu_data_vec,
                            const std::vector<PoseData> &pose_data_vec) {
+  STEAM_ICP_TRACE_SCOPE("icp");
   using namespace steam;
   using namespace steam::se3;
   using namespace steam::traj;
@@ -581,16 +589,10 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   bool icp_success = true;
 
   // timers
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("Update Transform ............... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Association .................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Optimization ................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Alignment ...................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Initialization ................. ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Marginalization ................ ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"Update Transform", "Association", "Optimization", "Alignment", "Initialization", "Marginalization"};
 
   ///
-  timer[4].second->start();
+  timer[4].start();
   // const auto steam_trajectory = const_acc::Interface::MakeShared(options_.qc_diag);
   const auto steam_trajectory = singer::Interface::MakeShared(options_.ad_diag, options_.qc_diag);
   std::vector<StateVarBase::Ptr> steam_state_vars;
@@ -805,11 +807,11 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     }
   }
 
-  timer[4].second->stop();
+  timer[4].stop();
 
   /// update sliding window variables
   {
-    timer[5].second->start();
+    timer[5].start();
     //
     if (index_frame == 1) {
       const auto &prev_var = trajectory_vars_.at(prev_trajectory_var_index);
@@ -851,6 +853,7 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
         const auto &var = trajectory_vars_.at(i);
         if (var.time <= marg_steam_time) {
           end_marg_time = var.time.seconds();
+          if (i < marginalized_until_) continue;  // already marginalized early
           marg_vars.emplace_back(var.T_rm);
           marg_vars.emplace_back(var.w_mr_inr);
           marg_vars.emplace_back(var.dw_mr_inr);
@@ -867,12 +870,30 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       sliding_window_filter_->marginalizeVariable(marg_vars);
       LOG(INFO) << "Marginalizing time (inclusive): " << begin_marg_time << " - " << end_marg_time
                 << ", with num states: " << num_states << std::endl;
+
+      // bound the window: marginalize the oldest remaining states early, never those the current frame attaches to
+      marginalized_until_ = std::max(marginalized_until_, to_marginalize_);
+      int num_early_states = 0;
+      while (marginalized_until_ < prev_trajectory_var_index &&
+             marginalization_policy_.exceeded(*sliding_window_filter_, num_early_states)) {
+        const auto &var = trajectory_vars_.at(marginalized_until_);
+        std::vector<StateVarBase::Ptr> early_vars{var.T_rm, var.w_mr_inr, var.dw_mr_inr};
+        if (options_.use_imu) {
+          early_vars.emplace_back(var.imu_biases);
+          if (!var.T_mi->locked()) early_vars.emplace_back(var.T_mi);
+        }
+        sliding_window_filter_->marginalizeVariable(early_vars);
+        marginalized_until_++;
+        num_early_states++;
+      }
+      if (num_early_states > 0)
+        LOG(INFO) << "Marginalized " << num_early_states << " additional states to bound the window" << std::endl;
     }
-    timer[5].second->stop();
+    timer[5].stop();
   }
 
   // Get evaluator for query points
-  timer[4].second->start();
+  timer[4].start();
 
   std::set<double> unique_point_times_;
   for (const auto &keypoint : keypoints) {
@@ -942,15 +963,7 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     imu_super_cost_term->set(imu_data_vec);
     imu_super_cost_term->init();
 #else
-    imu_cost_terms.reserve(imu_data_vec.size());
-    Eigen::Matrix<double, 3, 3> R_acc = Eigen::Matrix<double, 3, 3>::Identity();
-    R_acc.diagonal() = options_.r_imu_acc;
-    Eigen::Matrix<double, 3, 3> R_ang = Eigen::Matrix<double, 3, 3>::Identity();
-    R_ang.diagonal() = options_.r_imu_ang;
-    const auto acc_noise_model = StaticNoiseModel<3>::MakeShared(R_acc);
-    const auto gyro_noise_model = StaticNoiseModel<3>::MakeShared(R_ang);
-    const auto acc_loss_func = CauchyLossFunc::MakeShared(1.0);
-    const auto gyro_loss_func = L2LossFunc::MakeShared();
+    imu_cost_terms.reserve(2 * imu_data_vec.size());
     for (const auto &imu_data : imu_data_vec) {
       size_t i = prev_trajectory_var_index;
       for (; i < trajectory_vars_.size() - 1; i++) {
@@ -962,7 +975,7 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
           imu_data.timestamp >= trajectory_vars_[i + 1].time.seconds())
         throw std::runtime_error("imu stamp not within knot times");
 
-      const auto bias_intp_eval = VSpaceInterpolator<6>::MakeShared(
+      const auto bias_intp_eval = cost_term_pool_->make<VSpaceInterpolator<6>>(
           Time(imu_data.timestamp), trajectory_vars_[i].imu_biases, trajectory_vars_[i].time,
           trajectory_vars_[i + 1].imu_biases, trajectory_vars_[i + 1].time);
 
@@ -972,42 +985,42 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
       const auto acc_error_func = [&]() -> AccelerationErrorEvaluator::Ptr {
         if (options_.T_mi_init_only) {
-          return imu::AccelerationError(T_rm_intp_eval, dw_mr_inr_intp_eval, bias_intp_eval, trajectory_vars_[i].T_mi,
-                                        imu_data.lin_acc);
+          return cost_term_pool_->make<AccelerationErrorEvaluator>(T_rm_intp_eval, dw_mr_inr_intp_eval, bias_intp_eval,
+                                                                   trajectory_vars_[i].T_mi, imu_data.lin_acc);
         } else {
-          const auto T_mi_intp_eval =
-              PoseInterpolator::MakeShared(Time(imu_data.timestamp), trajectory_vars_[i].T_mi, trajectory_vars_[i].time,
-                                           trajectory_vars_[i + 1].T_mi, trajectory_vars_[i + 1].time);
-          return imu::AccelerationError(T_rm_intp_eval, dw_mr_inr_intp_eval, bias_intp_eval, T_mi_intp_eval,
-                                        imu_data.lin_acc);
+          const auto T_mi_intp_eval = cost_term_pool_->make<PoseInterpolator>(
+              Time(imu_data.timestamp), trajectory_vars_[i].T_mi, trajectory_vars_[i].time,
+              trajectory_vars_[i + 1].T_mi, trajectory_vars_[i + 1].time);
+          return cost_term_pool_->make<AccelerationErrorEvaluator>(T_rm_intp_eval, dw_mr_inr_intp_eval, bias_intp_eval,
+                                                                   T_mi_intp_eval, imu_data.lin_acc);
         }
       }();
 
       acc_error_func->setGravity(options_.gravity);
       acc_error_func->setTime(Time(imu_data.timestamp));
-      const auto gyro_error_func = imu::GyroError(w_mr_inr_intp_eval, bias_intp_eval, imu_data.ang_vel);
+      const auto gyro_error_func =
+          cost_term_pool_->make<GyroErrorEvaluator>(w_mr_inr_intp_eval, bias_intp_eval, imu_data.ang_vel);
       gyro_error_func->setTime(Time(imu_data.timestamp));
 
-      const auto acc_cost = WeightedLeastSqCostTerm<3>::MakeShared(acc_error_func, acc_noise_model, acc_loss_func);
-      if (options_.use_accel)
+      if (options_.use_accel) {
+        const auto acc_cost =
+            cost_term_pool_->make<WeightedLeastSqCostTerm<3>>(acc_error_func, acc_noise_model_, acc_loss_func_);
         imu_cost_terms.emplace_back(acc_cost);
-      const auto gyro_cost = WeightedLeastSqCostTerm<3>::MakeShared(gyro_error_func, gyro_noise_model, gyro_loss_func);
+      }
+      const auto gyro_cost =
+          cost_term_pool_->make<WeightedLeastSqCostTerm<3>>(gyro_error_func, gyro_noise_model_, gyro_loss_func_);
       imu_cost_terms.emplace_back(gyro_cost);
     }
 #endif
 
     // Get IMU prior cost terms
     {
-      Eigen::Matrix<double, 6, 6> bias_cov = Eigen::Matrix<double, 6, 6>::Identity();
-      bias_cov.block<3, 3>(0, 0).diagonal() = options_.q_bias_accel;
-      bias_cov.block<3, 3>(3, 3) = Eigen::Matrix<double, 3, 3>::Identity() * options_.q_bias_gyro;
-      auto noise_model = StaticNoiseModel<6>::MakeShared(bias_cov);
       auto loss_func = L2LossFunc::MakeShared();
       size_t i = prev_trajectory_var_index;
       for (; i < trajectory_vars_.size() - 1; i++) {
         const auto nbk = vspace::NegationEvaluator<6>::MakeShared(trajectory_vars_[i + 1].imu_biases);
         auto bias_error = vspace::AdditionEvaluator<6>::MakeShared(trajectory_vars_[i].imu_biases, nbk);
-        const auto bias_prior_factor = WeightedLeastSqCostTerm<6>::MakeShared(bias_error, noise_model, loss_func);
+        const auto bias_prior_factor = WeightedLeastSqCostTerm<6>::MakeShared(bias_error, bias_noise_model_, loss_func);
         imu_prior_cost_terms.emplace_back(bias_prior_factor);
       }
     }
@@ -1036,15 +1049,15 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   interp_mats_.clear();
 
-  timer[0].second->start();
+  timer[0].start();
   const auto &time1 = prev_steam_time.seconds();
   const auto &time2 = knot_times.back();
   const double T = time2 - time1;
   const Eigen::Matrix<double, 6, 1> ones = Eigen::Matrix<double, 6, 1>::Ones();
   const auto Qinv_T = steam_trajectory->getQinvPublic(T, ones);
   const auto Tran_T = steam_trajectory->getTranPublic(T);
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned int i = 0; i < unique_point_times.size(); ++i) {
+  std::mutex interp_mats_mutex;
+  threadPool().parallelFor("icp.interp_mats", 0, unique_point_times.size(), [&](size_t i) {
     const double &time = unique_point_times[i];
     const double tau = time - time1;
     const double kappa = time2 - time;
@@ -1053,10 +1066,10 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     const Matrix18d Tran_tau = steam_trajectory->getTranPublic(tau);
     const Matrix18d omega = (Q_tau * Tran_kappa.transpose() * Qinv_T);
     const Matrix18d lambda = (Tran_tau - omega * Tran_T);
-#pragma omp critical
+    std::lock_guard<std::mutex> lock(interp_mats_mutex);
     interp_mats_.emplace(time, std::make_pair(omega, lambda));
-  }
-  timer[0].second->stop();
+  });
+  timer[0].stop();
 
   // We speed this up by caching common sub-expressions and creating a map for the interpolated
   // poses at only the unique measurement times
@@ -1077,8 +1090,8 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     const auto J_21_inv_curl_dw2 = (-0.5 * lgmath::se3::curlyhat(J_21_inv * w2) * w2 + J_21_inv * dw2);
 
     std::map<double, Eigen::Matrix4d> T_mr_cache_map;
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)unique_point_times.size(); jj++) {
+    std::mutex T_mr_cache_map_mutex;
+    threadPool().parallelFor("icp.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
       const auto &ts = unique_point_times[jj];
       const auto &omega = interp_mats_.at(ts).first;
       const auto &lambda = interp_mats_.at(ts).second;
@@ -1088,15 +1101,14 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       const lgmath::se3::Transformation T_i1(xi_i1);
       const lgmath::se3::Transformation T_i0 = T_i1 * T1;
       const Eigen::Matrix4d T_mr = T_i0.inverse().matrix();
-#pragma omp critical
+      std::lock_guard<std::mutex> lock(T_mr_cache_map_mutex);
       T_mr_cache_map[ts] = T_mr;
-    }
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)keypoints.size(); jj++) {
+    });
+    threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t jj) {
       auto &keypoint = keypoints[jj];
       const Eigen::Matrix4d &T_mr = T_mr_cache_map[keypoint.timestamp];
       keypoint.pt = T_mr.block<3, 3>(0, 0) * keypoint.raw_pt + T_mr.block<3, 1>(0, 3);
-    }
+    });
   };
 
 #define USE_P2P_SUPER_COST_TERM true
@@ -1115,19 +1127,18 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   const auto p2p_super_cost_term =
       P2PSuperCostTerm::MakeShared(steam_trajectory, prev_steam_time, knot_times.back(), p2p_options);
 
-  timer[4].second->stop();
+  timer[4].stop();
 
   // Transform points into the robot frame just once:
 #if USE_P2P_SUPER_COST_TERM
-  timer[0].second->start();
+  timer[0].start();
   const Eigen::Matrix4d T_rs_mat = options_.T_sr.inverse();
 
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int i = 0; i < (int)keypoints.size(); i++) {
+  threadPool().parallelFor("icp.keypoints_to_robot", 0, keypoints.size(), [&](size_t i) {
     auto &keypoint = keypoints[i];
     keypoint.raw_pt = T_rs_mat.block<3, 3>(0, 0) * keypoint.raw_pt + T_rs_mat.block<3, 1>(0, 3);
-  }
-  timer[0].second->stop();
+  });
+  timer[0].stop();
 #endif
 
   auto &p2p_matches = p2p_super_cost_term->get();
@@ -1153,6 +1164,11 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   bool swf_inside_icp = true;  // kitti-raw : false
   if (index_frame > options_.init_num_frames) swf_inside_icp = true;
 
+#if !USE_P2P_SUPER_COST_TERM
+  // shared by all point-to-point cost terms of this frame
+  const auto p2p_loss_func = loss::makeSteamLoss(options_.p2p_loss_func, options_.p2p_loss_sigma);
+#endif
+
   for (int iter(0); iter < options_.num_iters_icp; iter++) {
     // initialize problem
     const auto problem = [&]() -> Problem::Ptr {
@@ -1168,23 +1184,14 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     steam_trajectory->addPriorCostTerms(*problem);
     for (const auto &prior_cost_term : prior_cost_terms) problem->addCostTerm(prior_cost_term);
 
-    timer[1].second->start();
+    timer[1].start();
 
     meas_cost_terms.clear();
     p2p_matches.clear();
-#if USE_P2P_SUPER_COST_TERM
     p2p_matches.reserve(keypoints.size());
-#else
-    meas_cost_terms.reserve(keypoints.size());
-#endif
 
-#pragma omp declare reduction(merge_meas : std::vector<BaseCostTerm::ConstPtr> : omp_out.insert( \
-        omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp declare reduction( \
-        merge_matches : std::vector<P2PMatch> : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp parallel for num_threads(options_.num_threads) reduction(merge_matches : p2p_matches) \
-    reduction(merge_meas : meas_cost_terms)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
+    // matches only: the cost terms of the non super cost term path are made from the pool, on this thread, below
+    const auto associate = [&](size_t i, std::vector<P2PMatch> &p2p_matches) {
       const auto &keypoint = keypoints[i];
       const auto &pt_keypoint = keypoint.pt;
 
@@ -1193,7 +1200,7 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
           map_.searchNeighbors(pt_keypoint, nb_voxels_visited, options_.size_voxel_map, options_.max_number_neighbors);
 
       if ((int)vector_neighbors.size() < kMinNumNeighbors) {
-        continue;
+        return;
       }
 
       // Compute normals from neighbors
@@ -1207,48 +1214,33 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       bool use_p2p = (dist_to_plane < max_dist_to_plane);
 
       if (use_p2p) {
-#if USE_P2P_SUPER_COST_TERM
         Eigen::Vector3d closest_pt = vector_neighbors[0];
         Eigen::Vector3d closest_normal = weight * neighborhood.normal;
         p2p_matches.emplace_back(P2PMatch(keypoint.timestamp, closest_pt, closest_normal, keypoint.raw_pt));
-#else
-        Eigen::Vector3d closest_pt = vector_neighbors[0];
-        Eigen::Vector3d closest_normal = weight * neighborhood.normal;
-        /// \note query and reference point
-        ///   const auto qry_pt = keypoint.raw_pt;
-        ///   const auto ref_pt = closest_pt;
-        Eigen::Matrix3d W = (closest_normal * closest_normal.transpose() + 1e-5 * Eigen::Matrix3d::Identity());
-        const auto noise_model = StaticNoiseModel<3>::MakeShared(W, NoiseType::INFORMATION);
-        const auto &T_mr_intp_eval = T_mr_intp_eval_map[keypoint.timestamp];
-        const auto error_func = p2p::p2pError(T_mr_intp_eval, closest_pt, keypoint.raw_pt);
-        error_func->setTime(Time(keypoint.timestamp));
-
-        const auto loss_func = [this]() -> BaseLossFunc::Ptr {
-          switch (options_.p2p_loss_func) {
-            case STEAM_LOSS_FUNC::L2:
-              return L2LossFunc::MakeShared();
-            case STEAM_LOSS_FUNC::DCS:
-              return DcsLossFunc::MakeShared(options_.p2p_loss_sigma);
-            case STEAM_LOSS_FUNC::CAUCHY:
-              return CauchyLossFunc::MakeShared(options_.p2p_loss_sigma);
-            case STEAM_LOSS_FUNC::GM:
-              return GemanMcClureLossFunc::MakeShared(options_.p2p_loss_sigma);
-            default:
-              return nullptr;
-          }
-          return nullptr;
-        }();
-
-        const auto cost = WeightedLeastSqCostTerm<3>::MakeShared(error_func, noise_model, loss_func);
-        meas_cost_terms.emplace_back(cost);
-#endif
       }
-    }
-
-#if USE_P2P_SUPER_COST_TERM
+    };
+    ThreadPool::Append()(p2p_matches, threadPool().parallelReduce("icp.association", 0, keypoints.size(),
+                                                                  std::vector<P2PMatch>(), associate,
+                                                                  ThreadPool::Append()));
     N_matches = p2p_matches.size();
-#else
-    N_matches = meas_cost_terms.size();
+
+#if !USE_P2P_SUPER_COST_TERM
+    meas_cost_terms.reserve(p2p_matches.size());
+    for (const auto &match : p2p_matches) {
+      /// \note query and reference point
+      ///   const auto qry_pt = match.query;
+      ///   const auto ref_pt = match.reference;
+      Eigen::Matrix3d W = (match.normal * match.normal.transpose() + 1e-5 * Eigen::Matrix3d::Identity());
+      const auto noise_model = cost_term_pool_->make<StaticNoiseModel<3>>(W, NoiseType::INFORMATION);
+      const auto &T_mr_intp_eval = T_mr_intp_eval_map[match.timestamp];
+      const auto error_func =
+          cost_term_pool_->make<p2p::P2PErrorEvaluator>(T_mr_intp_eval, match.reference, match.query);
+      error_func->setTime(Time(match.timestamp));
+
+      const auto cost = cost_term_pool_->make<WeightedLeastSqCostTerm<3>>(error_func, noise_model, p2p_loss_func);
+      meas_cost_terms.emplace_back(cost);
+    }
+    p2p_matches.clear();
 #endif
 
     p2p_super_cost_term->initP2PMatches();
@@ -1263,7 +1255,7 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       problem->addCostTerm(imu_super_cost_term);
     }
 
-    timer[1].second->stop();
+    timer[1].stop();
 
     if (N_matches < options_.min_number_keypoints) {
       LOG(ERROR) << "[CT_ICP]Error : not enough keypoints selected in ct-icp !" << std::endl;
@@ -1272,7 +1264,7 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       break;
     }
 
-    timer[2].second->start();
+    timer[2].start();
 
     // Solve
     GaussNewtonSolverNVA::Params params;
@@ -1284,11 +1276,14 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       params.line_search = false;
     if (swf_inside_icp) params.reuse_previous_pattern = false;
     GaussNewtonSolverNVA solver(*problem, params);
-    solver.optimize();
+    if (swf_inside_icp)
+      marginalization_policy_.solve(solver);
+    else
+      solver.optimize();
 
-    timer[2].second->stop();
+    timer[2].stop();
 
-    timer[3].second->start();
+    timer[3].start();
     // Update (changes trajectory data)
     double diff_trans = 0, diff_rot = 0, diff_vel = 0, diff_acc = 0;
 
@@ -1328,7 +1323,7 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     current_estimate.end_R = end_T_ms.block<3, 3>(0, 0);
     current_estimate.end_t = end_T_ms.block<3, 1>(0, 3);
 
-    timer[3].second->stop();
+    timer[3].stop();
 
     if (options_.use_imu) {
       Eigen::Matrix<double, 6, 1> b;
@@ -1356,11 +1351,12 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       }
       if (options_.break_icp_early) break;
     }
-    timer[0].second->start();
+    timer[0].start();
     transform_keypoints();
-    timer[0].second->stop();
+    timer[0].stop();
   }
 
+  const size_t num_cost_terms_before = sliding_window_filter_->getNumberOfCostTerms();
   steam_trajectory->addPriorCostTerms(*sliding_window_filter_);  // ** this includes state priors (like for x_0)
   for (const auto &prior_cost_term : prior_cost_terms) sliding_window_filter_->addCostTerm(prior_cost_term);
   for (const auto &meas_cost_term : meas_cost_terms) sliding_window_filter_->addCostTerm(meas_cost_term);
@@ -1375,16 +1371,13 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   LOG(INFO) << "number of variables: " << sliding_window_filter_->getNumberOfVariables() << std::endl;
   LOG(INFO) << "number of cost terms: " << sliding_window_filter_->getNumberOfCostTerms() << std::endl;
-  if (sliding_window_filter_->getNumberOfVariables() > 100)
-    throw std::runtime_error{"too many variables in the filter!"};
-  if (sliding_window_filter_->getNumberOfCostTerms() > 100000)
-    throw std::runtime_error{"too many cost terms in the filter!"};
+  marginalization_policy_.update(*sliding_window_filter_, num_cost_terms_before);
 
   GaussNewtonSolverNVA::Params params;
   params.verbose = options_.verbose;
   params.max_iterations = (unsigned int)options_.max_iterations;
   GaussNewtonSolverNVA solver(*sliding_window_filter_, params);
-  if (!swf_inside_icp) solver.optimize();
+  if (!swf_inside_icp) marginalization_policy_.solve(solver);
 
   if (options_.T_mi_init_only && !use_T_mi_gt) {
     size_t i = prev_trajectory_var_index + 1;
@@ -1450,10 +1443,12 @@ bool SteamLioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   
 
 
+  recordTimers("registration/icp", timer);
+
   /// Debug print
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
     LOG(INFO) << "Number iterations CT-ICP : " << options_.num_iters_icp << std::endl;
     LOG(INFO) << "Translation Begin: " << trajectory_[index_frame].begin_t.transpose() << std::endl;
     LOG(INFO) << "Translation End: " << trajectory_[index_frame].end_t.transpose() << std::endl;
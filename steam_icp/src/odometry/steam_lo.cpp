@@ -1,13 +1,17 @@
 #include "steam_icp/odometry/steam_lo.hpp"
 
 #include <iomanip>
+#include <mutex>
 #include <random>
+#include <tuple>
 
 #include <glog/logging.h>
 
 #include "steam.hpp"
 
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/loss_kernels.hpp"
+#include "steam_icp/utils/timer_table.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
@@ -42,12 +46,7 @@ void sub_sample_frame(std::vector<Point3D> &frame, double size_voxel, int num_th
 void grid_sampling(const std::vector<Point3D> &frame, std::vector<Point3D> &keypoints, double size_voxel_subsampling,
                    int num_threads) {
   keypoints.clear();
-  std::vector<Point3D> frame_sub;
-  frame_sub.resize(frame.size());
-#pragma omp parallel for num_threads(2)
-  for (int i = 0; i < (int)frame_sub.size(); i++) {
-    frame_sub[i] = frame[i];
-  }
+  std::vector<Point3D> frame_sub(frame);
   sub_sample_frame(frame_sub, size_voxel_subsampling, num_threads);
   keypoints.reserve(frame_sub.size());
   std::transform(frame_sub.begin(), frame_sub.end(), std::back_inserter(keypoints), [](const auto c) { return c; });
@@ -188,6 +187,7 @@ auto SteamLoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
   int index_frame = trajectory_.size();
   trajectory_.emplace_back();
 
+  Telemetry::Scope initialization(telemetry(), "registration/initialization");
   //
   initializeTimestamp(index_frame, const_frame);
 
@@ -196,6 +196,7 @@ auto SteamLoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
 
   //
   auto frame = initializeFrame(index_frame, const_frame.pointcloud);
+  initialization.stop();
 
   //
   std::vector<Point3D> keypoints;
@@ -207,7 +208,7 @@ auto SteamLoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
     grid_sampling(frame, keypoints, sample_voxel_size, options_.num_threads);
 
     // icp
-    summary.success = icp(index_frame, keypoints, const_frame.imu_data_vec);
+    summary.success = readMap([&] { return icp(index_frame, keypoints, const_frame.imu_data_vec); });
     summary.keypoints = keypoints;
     if (!summary.success) return summary;
   } else {
@@ -254,19 +255,15 @@ auto SteamLoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
   }
   trajectory_[index_frame].points = frame;
 
-  const Eigen::Vector3d t = trajectory_[index_frame].end_t;
-  const Eigen::Matrix3d r = trajectory_[index_frame].end_R;
-
   // add points
+  Telemetry::Scope update_map(telemetry(), "registration/updatemap");
   if (index_frame == 0) {
-    updateMap(index_frame, index_frame);
+    if (scheduleMapUpdate(index_frame)) updateMap(index_frame, index_frame);
   } else if ((index_frame - options_.delay_adding_points) > 0) {
-    // if ((t - t_prev_).norm() > options_.keyframe_translation_threshold_m || fabs(AngularDistance(r, r_prev_)) > options_.keyframe_rotation_threshold_deg) {
+    if (scheduleMapUpdate(index_frame - options_.delay_adding_points))
       updateMap(index_frame, (index_frame - options_.delay_adding_points));
-      t_prev_ = t;
-      r_prev_ = r;
-    // }
   }
+  update_map.stop();
 
   summary.corrected_points = keypoints;
 
@@ -294,11 +291,18 @@ auto SteamLoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
 void SteamLoOdometry::initializeTimestamp(int index_frame, const DataFrame &const_frame) {
   double min_timestamp = std::numeric_limits<double>::max();
   double max_timestamp = std::numeric_limits<double>::min();
-#pragma omp parallel for num_threads(2) reduction(min : min_timestamp) reduction(max : max_timestamp)
-  for (const auto &point : const_frame.pointcloud) {
-    if (point.timestamp > max_timestamp) max_timestamp = point.timestamp;
-    if (point.timestamp < min_timestamp) min_timestamp = point.timestamp;
-  }
+  using Bounds = std::pair<double, double>;
+  const auto &points = const_frame.pointcloud;
+  std::tie(min_timestamp, max_timestamp) = threadPool().parallelReduce(
+      "initialize_timestamp", 0, points.size(), Bounds(min_timestamp, max_timestamp),
+      [&](size_t i, Bounds &bounds) {
+        if (points[i].timestamp > bounds.second) bounds.second = points[i].timestamp;
+        if (points[i].timestamp < bounds.first) bounds.first = points[i].timestamp;
+      },
+      [](Bounds &result, Bounds &&local) {
+        result.first = std::min(result.first, local.first);
+        result.second = std::max(result.second, local.second);
+      });
   trajectory_[index_frame].begin_timestamp = min_timestamp;
   trajectory_[index_frame].end_timestamp = max_timestamp;
   // purpose: eval trajectory at the exact file stamp to match ground truth
@@ -343,24 +347,20 @@ std::vector<Point3D> SteamLoOdometry::initializeFrame(int index_frame, const std
   auto q_end = Eigen::Quaterniond(trajectory_[index_frame].end_R);
   Eigen::Vector3d t_begin = trajectory_[index_frame].begin_t;
   Eigen::Vector3d t_end = trajectory_[index_frame].end_t;
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned int i = 0; i < frame.size(); ++i) {
+  threadPool().parallelFor("initialize_frame.transform", 0, frame.size(), [&](size_t i) {
     auto &point = frame[i];
     double alpha_timestamp = point.alpha_timestamp;
     Eigen::Matrix3d R = q_begin.slerp(alpha_timestamp, q_end).normalized().toRotationMatrix();
     Eigen::Vector3d t = (1.0 - alpha_timestamp) * t_begin + alpha_timestamp * t_end;
     //
     point.pt = R * point.raw_pt + t;
-  }
+  });
 
   return frame;
 }
 
 void SteamLoOdometry::updateMap(int index_frame, int update_frame) {
-  const double kSizeVoxelMap = options_.size_voxel_map;
-  const double kMinDistancePoints = options_.min_distance_points;
-  const int kMaxNumPointsInVoxel = options_.max_num_points_in_voxel;
-
+  STEAM_ICP_TRACE_SCOPE("updateMap");
   // update frame
   auto &frame = trajectory_[update_frame].points;
 #if false
@@ -409,17 +409,16 @@ void SteamLoOdometry::updateMap(int index_frame, int update_frame) {
 
   std::map<double, Eigen::Matrix4d> T_ms_cache_map;
   const Eigen::Matrix4d T_rs = options_.T_sr.inverse();
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int jj = 0; jj < (int)unique_point_times.size(); jj++) {
+  std::mutex T_ms_cache_map_mutex;
+  threadPool().parallelFor("update_map.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
     const auto &ts = unique_point_times[jj];
     const auto T_rm_intp_eval = update_trajectory->getPoseInterpolator(Time(ts));
     const Eigen::Matrix4d T_ms = T_rm_intp_eval->value().inverse().matrix() * T_rs;
-#pragma omp critical
+    std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
     T_ms_cache_map[ts] = T_ms;
-  }
+  });
 
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned i = 0; i < frame.size(); i++) {
+  threadPool().parallelFor("update_map.deskew", 0, frame.size(), [&](size_t i) {
     // const double query_time = frame[i].timestamp;
     // const auto T_rm_intp_eval = update_trajectory->getPoseInterpolator(Time(query_time));
     // const auto T_ms_intp_eval = inverse(compose(T_sr_var_, T_rm_intp_eval));
@@ -427,18 +426,12 @@ void SteamLoOdometry::updateMap(int index_frame, int update_frame) {
     const Eigen::Matrix4d &T_ms = T_ms_cache_map[frame[i].timestamp];
     //
     frame[i].pt = T_ms.block<3, 3>(0, 0) * frame[i].raw_pt + T_ms.block<3, 1>(0, 3);
-  }
+  });
 #endif
 
-  map_.add(frame, kSizeVoxelMap, kMaxNumPointsInVoxel, kMinDistancePoints);
-  if (options_.filter_lifetimes) map_.update_and_filter_lifetimes();
-  frame.clear();
-  frame.shrink_to_fit();
-
-  // remove points
-  const double kMaxDistance = options_.max_distance;
+  // insert the points and remove the far away ones, in the background when pipelined
   const Eigen::Vector3d location = trajectory_[index_frame].end_t;
-  map_.remove(location, kMaxDistance);
+  addToMap(std::move(frame), location, options_.filter_lifetimes);
 }
 
 Eigen::Matrix<double, 6, 1> SteamLoOdometry::initialize_gravity(const std::vector<steam::IMUData> &imu_data_vec) {
@@ -503,6 +496,7 @@ Eigen::Matrix<double, 6, 1> SteamLoOdometry::initialize_gravity(const std::vecto
 
 bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
                           const std::vector<steam::IMUData> &imu_data_vec) {
+  STEAM_ICP_TRACE_SCOPE("icp");
   using namespace steam;
   using namespace steam::se3;
   using namespace steam::traj;
@@ -698,6 +692,7 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
         const auto &var = trajectory_vars_.at(i);
         if (var.time <= marg_steam_time) {
           end_marg_time = var.time.seconds();
+          if (i < marginalized_until_) continue;  // already marginalized early
           marg_vars.emplace_back(var.T_rm);
           marg_vars.emplace_back(var.w_mr_inr);
           if (options_.use_imu) {
@@ -716,6 +711,24 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       //
       LOG(INFO) << "Marginalizing time (inclusive): " << begin_marg_time << " - " << end_marg_time
                 << ", with num states: " << num_states << std::endl;
+
+      // bound the window: marginalize the oldest remaining states early, never those the current frame attaches to
+      marginalized_until_ = std::max(marginalized_until_, to_marginalize_);
+      int num_early_states = 0;
+      while (marginalized_until_ < prev_trajectory_var_index &&
+             marginalization_policy_.exceeded(*sliding_window_filter_, num_early_states)) {
+        const auto &var = trajectory_vars_.at(marginalized_until_);
+        std::vector<StateVarBase::Ptr> early_vars{var.T_rm, var.w_mr_inr};
+        if (options_.use_imu) {
+          early_vars.emplace_back(var.imu_biases);
+          if (options_.use_accel && !var.T_mi->locked()) early_vars.emplace_back(var.T_mi);
+        }
+        sliding_window_filter_->marginalizeVariable(early_vars);
+        marginalized_until_++;
+        num_early_states++;
+      }
+      if (num_early_states > 0)
+        LOG(INFO) << "Marginalized " << num_early_states << " additional states to bound the window" << std::endl;
     }
   }
 
@@ -857,8 +870,8 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   const Eigen::Matrix<double, 6, 1> ones = Eigen::Matrix<double, 6, 1>::Ones();
   const auto Qinv_T = steam::traj::const_vel::getQinv(T, ones);
   const auto Tran_T = steam::traj::const_vel::getTran(T);
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned int i = 0; i < unique_point_times.size(); ++i) {
+  std::mutex interp_mats_mutex;
+  threadPool().parallelFor("icp.interp_mats", 0, unique_point_times.size(), [&](size_t i) {
     const double &time = unique_point_times[i];
     const double tau = time - time1;
     const double kappa = time2 - time;
@@ -867,9 +880,9 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     const Matrix12d Tran_tau = steam::traj::const_vel::getTran(tau);
     const Matrix12d omega = (Q_tau * Tran_kappa.transpose() * Qinv_T);
     const Matrix12d lambda = (Tran_tau - omega * Tran_T);
-#pragma omp critical
+    std::lock_guard<std::mutex> lock(interp_mats_mutex);
     interp_mats_.emplace(time, std::make_pair(omega, lambda));
-  }
+  });
 
   auto transform_keypoints = [&]() {
     const auto knot1 = steam_trajectory->get(prev_steam_time);
@@ -884,8 +897,8 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     const auto J_21_inv_w2 = J_21_inv * w2;
 
     std::map<double, Eigen::Matrix4d> T_mr_cache_map;
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)unique_point_times.size(); jj++) {
+    std::mutex T_mr_cache_map_mutex;
+    threadPool().parallelFor("icp.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
       const auto &ts = unique_point_times[jj];
       const auto &omega = interp_mats_.at(ts).first;
       const auto &lambda = interp_mats_.at(ts).second;
@@ -894,16 +907,15 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       const lgmath::se3::Transformation T_i1(xi_i1);
       const lgmath::se3::Transformation T_i0 = T_i1 * T1;
       const Eigen::Matrix4d T_mr = T_i0.inverse().matrix();
-#pragma omp critical
+      std::lock_guard<std::mutex> lock(T_mr_cache_map_mutex);
       T_mr_cache_map[ts] = T_mr;
-    }
+    });
 
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)keypoints.size(); jj++) {
+    threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t jj) {
       auto &keypoint = keypoints[jj];
       const Eigen::Matrix4d &T_mr = T_mr_cache_map[keypoint.timestamp];
       keypoint.pt = T_mr.block<3, 3>(0, 0) * keypoint.raw_pt + T_mr.block<3, 1>(0, 3);
-    }
+    });
   };
 
 #define USE_P2P_SUPER_COST_TERM true
@@ -915,11 +927,7 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   auto &current_estimate = trajectory_.at(index_frame);
 
   // timers
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("Update Transform ............... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Association .................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Optimization ................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Alignment ...................... ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"Update Transform", "Association", "Optimization", "Alignment"};
 
   auto p2p_options = P2PCVSuperCostTerm::Options();
   p2p_options.num_threads = options_.num_threads;
@@ -937,14 +945,13 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   // Transform points into the robot frame just once:
 #if USE_P2P_SUPER_COST_TERM
-  timer[0].second->start();
+  timer[0].start();
   const Eigen::Matrix4d T_rs_mat = options_.T_sr.inverse();
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int i = 0; i < (int)keypoints.size(); i++) {
+  threadPool().parallelFor("icp.keypoints_to_robot", 0, keypoints.size(), [&](size_t i) {
     auto &keypoint = keypoints[i];
     keypoint.raw_pt = T_rs_mat.block<3, 3>(0, 0) * keypoint.raw_pt + T_rs_mat.block<3, 1>(0, 3);
-  }
-  timer[0].second->stop();
+  });
+  timer[0].stop();
 #endif
 
   auto &p2p_matches = p2p_super_cost_term->get();
@@ -959,27 +966,13 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     swf_inside_icp = true;
   }
 
-  const auto p2p_loss_func = [this]() -> BaseLossFunc::Ptr {
-    switch (options_.p2p_loss_func) {
-      case STEAM_LOSS_FUNC::L2:
-        return L2LossFunc::MakeShared();
-      case STEAM_LOSS_FUNC::DCS:
-        return DcsLossFunc::MakeShared(options_.p2p_loss_sigma);
-      case STEAM_LOSS_FUNC::CAUCHY:
-        return CauchyLossFunc::MakeShared(options_.p2p_loss_sigma);
-      case STEAM_LOSS_FUNC::GM:
-        return GemanMcClureLossFunc::MakeShared(options_.p2p_loss_sigma);
-      default:
-        return nullptr;
-    }
-    return nullptr;
-  }();
+  const auto p2p_loss_func = loss::makeSteamLoss(options_.p2p_loss_func, options_.p2p_loss_sigma);
 
   //
   for (int iter(0); iter < options_.num_iters_icp; iter++) {
-    timer[0].second->start();
+    timer[0].start();
     transform_keypoints();
-    timer[0].second->stop();
+    timer[0].stop();
 
     // initialize problem
     const auto problem = [&]() -> Problem::Ptr {
@@ -1004,15 +997,11 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     meas_cost_terms.reserve(keypoints.size());
 #endif
 
-    timer[1].second->start();
+    timer[1].start();
 
-#pragma omp declare reduction(merge_meas : std::vector<BaseCostTerm::ConstPtr> : omp_out.insert( \
-        omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp declare reduction( \
-        merge_matches : std::vector<P2PMatch> : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp parallel for num_threads(options_.num_threads) reduction(merge_meas : meas_cost_terms) \
-    reduction(merge_matches : p2p_matches)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
+    using Associations = std::pair<std::vector<BaseCostTerm::ConstPtr>, std::vector<P2PMatch>>;
+    const auto associate = [&](size_t i, Associations &local) {
+      auto &[meas_cost_terms, p2p_matches] = local;
       const auto &keypoint = keypoints[i];
       const auto &pt_keypoint = keypoint.pt;
 
@@ -1029,7 +1018,7 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       Eigen::Vector3d closest_pt = vector_neighbors[0];
       const double dist_to_plane = std::abs((keypoint.pt - closest_pt).transpose() * neighborhood.normal);
       if (dist_to_plane >= options_.p2p_max_dist)
-        continue;
+        return;
 
 #if USE_P2P_SUPER_COST_TERM
         Eigen::Vector3d closest_normal = weight * neighborhood.normal;
@@ -1049,7 +1038,7 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 #endif
       } else if (options_.use_pointtopoint_factors && vector_neighbors.size()) {
         if ((keypoint.pt - vector_neighbors[0]).norm() >= options_.p2p_max_dist)
-          continue;
+          return;
         Eigen::Vector3d closest_pt = vector_neighbors[0];
         const auto noise_model = StaticNoiseModel<3>::MakeShared(Eigen::Matrix3d::Identity());
         const auto T_rm_intp_eval = steam_trajectory->getPoseInterpolator(Time(keypoint.timestamp));
@@ -1059,7 +1048,11 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
         const auto cost = WeightedLeastSqCostTerm<3>::MakeShared(error_func, noise_model, p2p_loss_func);
         meas_cost_terms.emplace_back(cost);
       }
-    }
+    };
+    auto associations = threadPool().parallelReduce("icp.association", 0, keypoints.size(), Associations(),
+                                                    associate, ThreadPool::Append());
+    ThreadPool::Append()(meas_cost_terms, std::move(associations.first));
+    ThreadPool::Append()(p2p_matches, std::move(associations.second));
 
 #if USE_P2P_SUPER_COST_TERM
     N_matches = p2p_matches.size();
@@ -1081,7 +1074,7 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       // }
     // }
 
-    timer[1].second->stop();
+    timer[1].stop();
 
     if (N_matches < options_.min_number_keypoints) {
       LOG(ERROR) << "[CT_ICP]Error : not enough keypoints selected in ct-icp !" << std::endl;
@@ -1090,7 +1083,7 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       break;
     }
 
-    timer[2].second->start();
+    timer[2].start();
 
     // Solve
     GaussNewtonSolverNVA::Params params;
@@ -1102,11 +1095,14 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       params.line_search = false;
     if (swf_inside_icp) params.reuse_previous_pattern = false;
     GaussNewtonSolverNVA solver(*problem, params);
-    solver.optimize();
+    if (swf_inside_icp)
+      marginalization_policy_.solve(solver);
+    else
+      solver.optimize();
 
-    timer[2].second->stop();
+    timer[2].stop();
 
-    timer[3].second->start();
+    timer[3].start();
 
     // Update (changes trajectory data)
     double diff_trans = 0, diff_rot = 0, diff_vel = 0;
@@ -1140,7 +1136,7 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     current_estimate.end_R = end_T_ms.block<3, 3>(0, 0);
     current_estimate.end_t = end_T_ms.block<3, 1>(0, 3);
 
-    timer[3].second->stop();
+    timer[3].stop();
 
     LOG(INFO) << "diff_trans: " << diff_trans << " diff_rot: " << diff_rot << " diff_vel: " << diff_vel << std::endl;
 
@@ -1157,6 +1153,7 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   /// optimize in a sliding window
   LOG(INFO) << "Optimizing in a sliding window!" << std::endl;
 
+  const size_t num_cost_terms_before = sliding_window_filter_->getNumberOfCostTerms();
   steam_trajectory->addPriorCostTerms(*sliding_window_filter_);  // ** this includes state priors (like for x_0)
   for (const auto &prior_cost_term : prior_cost_terms) sliding_window_filter_->addCostTerm(prior_cost_term);
   for (const auto &meas_cost_term : meas_cost_terms) sliding_window_filter_->addCostTerm(meas_cost_term);
@@ -1174,16 +1171,13 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   //
   LOG(INFO) << "number of variables: " << sliding_window_filter_->getNumberOfVariables() << std::endl;
   LOG(INFO) << "number of cost terms: " << sliding_window_filter_->getNumberOfCostTerms() << std::endl;
-  if (sliding_window_filter_->getNumberOfVariables() > 100)
-    throw std::runtime_error{"too many variables in the filter!"};
-  if (sliding_window_filter_->getNumberOfCostTerms() > 100000)
-    throw std::runtime_error{"too many cost terms in the filter!"};
+  marginalization_policy_.update(*sliding_window_filter_, num_cost_terms_before);
 
   GaussNewtonSolverNVA::Params params;
   params.max_iterations = 20;
   params.reuse_previous_pattern = false;
   GaussNewtonSolverNVA solver(*sliding_window_filter_, params);
-  if (!swf_inside_icp) solver.optimize();
+  if (!swf_inside_icp) marginalization_policy_.solve(solver);
 
   if (options_.T_mi_init_only && options_.use_accel) {
     size_t i = prev_trajectory_var_index + 1;
@@ -1218,9 +1212,9 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   current_estimate.mid_state_cov.block<12, 12>(0, 0) =
       steam_trajectory->getCovariance(covariance, trajectory_vars_[prev_trajectory_var_index].time);
 
-  // timer[0].second->start();
+  // timer[0].start();
   // transform_keypoints();
-  // timer[0].second->stop();
+  // timer[0].stop();
 
   if (options_.use_imu) {
     size_t i = prev_trajectory_var_index;
@@ -1243,16 +1237,18 @@ bool SteamLoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   const auto w = steam_trajectory->getVelocityInterpolator(curr_end_steam_time)->evaluate();
   LOG(INFO) << "w(-1) " << w.transpose() << std::endl;
 
-  // timer[0].second->start();
+  // timer[0].start();
   // transform_keypoints();
-  // timer[0].second->stop();
+  // timer[0].stop();
 
   LOG(INFO) << "Number of keypoints used in CT-ICP : " << N_matches << std::endl;
 
+  recordTimers("registration/icp", timer);
+
   /// Debug print
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
     LOG(INFO) << "Number iterations CT-ICP : " << options_.num_iters_icp << std::endl;
     LOG(INFO) << "Translation Begin: " << trajectory_[index_frame].begin_t.transpose() << std::endl;
     LOG(INFO) << "Translation End: " << trajectory_[index_frame].end_t.transpose() << std::endl;
@@ -2,12 +2,15 @@
 
 #include <iomanip>
 #include <random>
+#include <tuple>
 
 #include <glog/logging.h>
 
 #include "steam.hpp"
 
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/loss_kernels.hpp"
+#include "steam_icp/utils/timer_table.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
@@ -42,12 +45,7 @@ void sub_sample_frame(std::vector<Point3D> &frame, double size_voxel, int num_th
 void grid_sampling(const std::vector<Point3D> &frame, std::vector<Point3D> &keypoints, double size_voxel_subsampling,
                    int num_threads) {
   keypoints.clear();
-  std::vector<Point3D> frame_sub;
-  frame_sub.resize(frame.size());
-#pragma omp parallel for num_threads(2)
-  for (int i = 0; i < (int)frame_sub.size(); i++) {
-    frame_sub[i] = frame[i];
-  }
+  std::vector<Point3D> frame_sub(frame);
   sub_sample_frame(frame_sub, size_voxel_subsampling, num_threads);
   keypoints.reserve(frame_sub.size());
   std::transform(frame_sub.begin(), frame_sub.end(), std::back_inserter(keypoints), [](const auto c) { return c; });
@@ -119,8 +117,10 @@ auto SteamLoCVOdometry::registerFrame(const DataFrame &const_frame) -> Registrat
 
   int index_frame = trajectory_.size();
   trajectory_.emplace_back();
+  Telemetry::Scope initialization(telemetry(), "registration/initialization");
   initializeTimestamp(index_frame, const_frame);
   auto frame = initializeFrame(index_frame, const_frame.pointcloud);
+  initialization.stop();
 
   std::vector<Point3D> keypoints;
   if (index_frame > 0) {
@@ -129,7 +129,7 @@ auto SteamLoCVOdometry::registerFrame(const DataFrame &const_frame) -> Registrat
 
     grid_sampling(frame, keypoints, sample_voxel_size, options_.num_threads);
 
-    summary.success = icp(index_frame, keypoints, const_frame.imu_data_vec);
+    summary.success = readMap([&] { return icp(index_frame, keypoints, const_frame.imu_data_vec); });
     summary.keypoints = keypoints;
     if (!summary.success) return summary;
   } else {
@@ -158,19 +158,15 @@ auto SteamLoCVOdometry::registerFrame(const DataFrame &const_frame) -> Registrat
   }
   trajectory_[index_frame].points = frame;
 
-  const Eigen::Vector3d t = trajectory_[index_frame].end_t;
-  const Eigen::Matrix3d r = trajectory_[index_frame].end_R;
-
   // add points
+  Telemetry::Scope update_map(telemetry(), "registration/updatemap");
   if (index_frame == 0) {
-    updateMap(index_frame, index_frame);
+    if (scheduleMapUpdate(index_frame)) updateMap(index_frame, index_frame);
   } else if ((index_frame - options_.delay_adding_points) > 0) {
-    if ((t - t_prev_).norm() > options_.keyframe_translation_threshold_m || fabs(AngularDistance(r, r_prev_)) > options_.keyframe_rotation_threshold_deg) {
+    if (scheduleMapUpdate(index_frame - options_.delay_adding_points))
       updateMap(index_frame, (index_frame - options_.delay_adding_points));
-      t_prev_ = t;
-      r_prev_ = r;
-    }
   }
+  update_map.stop();
 
   summary.corrected_points = keypoints;
   summary.R_ms = trajectory_[index_frame].end_R;
@@ -181,11 +177,18 @@ auto SteamLoCVOdometry::registerFrame(const DataFrame &const_frame) -> Registrat
 void SteamLoCVOdometry::initializeTimestamp(int index_frame, const DataFrame &const_frame) {
   double min_timestamp = std::numeric_limits<double>::max();
   double max_timestamp = std::numeric_limits<double>::min();
-#pragma omp parallel for num_threads(2) reduction(min : min_timestamp) reduction(max : max_timestamp)
-  for (const auto &point : const_frame.pointcloud) {
-    if (point.timestamp > max_timestamp) max_timestamp = point.timestamp;
-    if (point.timestamp < min_timestamp) min_timestamp = point.timestamp;
-  }
+  using Bounds = std::pair<double, double>;
+  const auto &points = const_frame.pointcloud;
+  std::tie(min_timestamp, max_timestamp) = threadPool().parallelReduce(
+      "initialize_timestamp", 0, points.size(), Bounds(min_timestamp, max_timestamp),
+      [&](size_t i, Bounds &bounds) {
+        if (points[i].timestamp > bounds.second) bounds.second = points[i].timestamp;
+        if (points[i].timestamp < bounds.first) bounds.first = points[i].timestamp;
+      },
+      [](Bounds &result, Bounds &&local) {
+        result.first = std::min(result.first, local.first);
+        result.second = std::max(result.second, local.second);
+      });
   trajectory_[index_frame].begin_timestamp = min_timestamp;
   trajectory_[index_frame].end_timestamp = max_timestamp;
   // purpose: eval trajectory at the exact file stamp to match ground truth
@@ -227,11 +230,9 @@ std::vector<Point3D> SteamLoCVOdometry::initializeFrame(int index_frame, const s
 }
 
 void SteamLoCVOdometry::updateMap(int index_frame, int update_frame) {
+  STEAM_ICP_TRACE_SCOPE("updateMap");
   using namespace steam::se3;
   using namespace steam::traj;
-  const double kSizeVoxelMap = options_.size_voxel_map;
-  const double kMinDistancePoints = options_.min_distance_points;
-  const int kMaxNumPointsInVoxel = options_.max_num_points_in_voxel;
   // update frame
   auto &frame = trajectory_[update_frame].points;
   Time begin_steam_time = trajectory_[update_frame].begin_timestamp;
@@ -257,25 +258,19 @@ void SteamLoCVOdometry::updateMap(int index_frame, int update_frame) {
     const lgmath::se3::Transformation T_kj(Eigen::Matrix<double, 6, 1>(w_mr_inr * (curr_time - ts)));
     T_ms_cache_map[ts] = T_mr * T_kj.matrix() * T_rs;
   }
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned i = 0; i < frame.size(); i++) {
+  threadPool().parallelFor("update_map.deskew", 0, frame.size(), [&](size_t i) {
     const Eigen::Matrix4d &T_ms = T_ms_cache_map[frame[i].timestamp];
     frame[i].pt = T_ms.block<3, 3>(0, 0) * frame[i].raw_pt + T_ms.block<3, 1>(0, 3);
-  }
-
-  map_.add(frame, kSizeVoxelMap, kMaxNumPointsInVoxel, kMinDistancePoints);
-  if (options_.filter_lifetimes) map_.update_and_filter_lifetimes();
-  frame.clear();
-  frame.shrink_to_fit();
+  });
 
-  // remove points
-  const double kMaxDistance = options_.max_distance;
+  // insert the points and remove the far away ones, in the background when pipelined
   const Eigen::Vector3d location = trajectory_[index_frame].end_t;
-  map_.remove(location, kMaxDistance);
+  addToMap(std::move(frame), location, options_.filter_lifetimes);
 }
 
 bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
                           const std::vector<steam::IMUData> &imu_data_vec) {
+  STEAM_ICP_TRACE_SCOPE("icp");
   using namespace steam;
   using namespace steam::se3;
   using namespace steam::traj;
@@ -326,11 +321,10 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   auto transform_keypoints = [&]() {
     const auto T_mr = T_rm_var->value().inverse().matrix();
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)keypoints.size(); jj++) {
+    threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t jj) {
       auto &keypoint = keypoints[jj];
       keypoint.pt = T_mr.block<3, 3>(0, 0) * keypoint.raw_pt + T_mr.block<3, 1>(0, 3);
-    }
+    });
   };
 
   // For the N first frames, visit 2 voxels
@@ -340,37 +334,18 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   auto &current_estimate = trajectory_.at(index_frame);
 
   // timers
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("Update Transform ............... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Association .................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Optimization ................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Alignment ...................... ", std::make_unique<Stopwatch<>>(false));
-
-  auto p2p_loss_func = [this]() -> BaseLossFunc::Ptr {
-      switch (options_.p2p_loss_func) {
-        case SteamLoCVOdometry::STEAM_LOSS_FUNC::L2:
-          return L2LossFunc::MakeShared();
-        case SteamLoCVOdometry::STEAM_LOSS_FUNC::DCS:
-          return DcsLossFunc::MakeShared(options_.p2p_loss_sigma);
-        case SteamLoCVOdometry::STEAM_LOSS_FUNC::CAUCHY:
-          return CauchyLossFunc::MakeShared(options_.p2p_loss_sigma);
-        case SteamLoCVOdometry::STEAM_LOSS_FUNC::GM:
-          return GemanMcClureLossFunc::MakeShared(options_.p2p_loss_sigma);
-        default:
-          return nullptr;
-      }
-      return nullptr;
-    }();
+  TimerTable timer{"Update Transform", "Association", "Optimization", "Alignment"};
+
+  const auto p2p_loss_func = loss::makeSteamLoss(options_.p2p_loss_func, options_.p2p_loss_sigma);
 
   // Transform points into the robot frame just once:
-  timer[0].second->start();
+  timer[0].start();
   const Eigen::Matrix4d T_rs_mat = options_.T_sr.inverse();
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int i = 0; i < (int)keypoints.size(); i++) {
+  threadPool().parallelFor("icp.keypoints_to_robot", 0, keypoints.size(), [&](size_t i) {
     auto &keypoint = keypoints[i];
     keypoint.raw_pt = T_rs_mat.block<3, 3>(0, 0) * keypoint.raw_pt + T_rs_mat.block<3, 1>(0, 3);
-  }
-  timer[0].second->stop();
+  });
+  timer[0].stop();
 
   // De-skew points just once:
   std::set<double> unique_point_times_;
@@ -384,32 +359,28 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     const lgmath::se3::Transformation T_kj(Eigen::Matrix<double, 6, 1>(prev_w_mr_inr * (curr_time - ts)));
     T_kj_cache_map[ts] = T_kj.matrix();
   }
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int jj = 0; jj < (int)keypoints.size(); jj++) {
+  threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t jj) {
     auto &keypoint = keypoints[jj];
     const Eigen::Matrix4d &T_kj = T_kj_cache_map[keypoint.timestamp];
     keypoint.raw_pt = T_kj.block<3, 3>(0, 0) * keypoint.raw_pt + T_kj.block<3, 1>(0, 3);
-  }
+  });
 
   int N_matches = 0;
   const auto noise_model = StaticNoiseModel<1>::MakeShared(Eigen::Matrix<double, 1, 1>::Identity(), NoiseType::INFORMATION);
 
   for (int iter(0); iter < options_.num_iters_icp; iter++) {
-    timer[0].second->start();
+    timer[0].start();
     transform_keypoints();
-    timer[0].second->stop();
+    timer[0].stop();
 
     const auto problem = OptimizationProblem::MakeShared(options_.num_threads);
     for (const auto &var : steam_state_vars) problem->addStateVariable(var);
     meas_cost_terms.clear();
     meas_cost_terms.reserve(keypoints.size());
 
-    timer[1].second->start();
+    timer[1].start();
 
-#pragma omp declare reduction(merge_meas : std::vector<BaseCostTerm::ConstPtr> : omp_out.insert( \
-        omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp parallel for num_threads(options_.num_threads) reduction(merge_meas : meas_cost_terms)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
+    const auto associate = [&](size_t i, std::vector<BaseCostTerm::ConstPtr> &meas_cost_terms) {
       const auto &keypoint = keypoints[i];
       const auto &pt_keypoint = keypoint.pt;
 
@@ -418,7 +389,7 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
           map_.searchNeighbors(pt_keypoint, nb_voxels_visited, options_.size_voxel_map, options_.max_number_neighbors);
 
       if ((int)vector_neighbors.size() < kMinNumNeighbors) {
-        continue;
+        return;
       }
 
       // Compute normals from neighbors
@@ -429,7 +400,7 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
       const double dist_to_plane = std::abs((keypoint.pt - vector_neighbors[0]).transpose() * neighborhood.normal);
       if (dist_to_plane >= options_.p2p_max_dist)
-        continue;
+        return;
 
       Eigen::Vector3d closest_pt = vector_neighbors[0];
       Eigen::Vector3d closest_normal = weight * neighborhood.normal;
@@ -438,12 +409,15 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       error_func->setTime(Time(keypoint.timestamp));
       const auto cost = WeightedLeastSqCostTerm<1>::MakeShared(error_func, noise_model, p2p_loss_func);
       meas_cost_terms.emplace_back(cost);
-    }
+    };
+    auto associations = threadPool().parallelReduce(
+        "icp.association", 0, keypoints.size(), std::vector<BaseCostTerm::ConstPtr>(), associate, ThreadPool::Append());
+    ThreadPool::Append()(meas_cost_terms, std::move(associations));
 
     N_matches = meas_cost_terms.size();
     for (const auto &cost : meas_cost_terms) problem->addCostTerm(cost);
 
-    timer[1].second->stop();
+    timer[1].stop();
 
     if (N_matches < options_.min_number_keypoints) {
       LOG(ERROR) << "Error: not enough keypoints selected!" << std::endl;
@@ -452,7 +426,7 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       break;
     }
 
-    timer[2].second->start();
+    timer[2].start();
     GaussNewtonSolverNVA::Params params;
     params.verbose = options_.verbose;
     params.max_iterations = (unsigned int)options_.max_iterations;
@@ -462,9 +436,9 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       params.line_search = false;
     GaussNewtonSolverNVA solver(*problem, params);
     solver.optimize();
-    timer[2].second->stop();
+    timer[2].stop();
 
-    timer[3].second->start();
+    timer[3].start();
     // Compute break conditions for ICP
     double diff_trans = 0, diff_rot = 0;
     const auto begin_T_mr = T_mr_eval->evaluate().matrix();
@@ -478,7 +452,7 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     current_estimate.begin_t = begin_T_ms.block<3, 1>(0, 3);
     current_estimate.end_R = end_T_ms.block<3, 3>(0, 0);
     current_estimate.end_t = end_T_ms.block<3, 1>(0, 3);
-    timer[3].second->stop();
+    timer[3].stop();
 
     LOG(INFO) << "diff_trans(m): " << diff_trans << " diff_rot(deg): " << diff_rot << std::endl;
 
@@ -495,10 +469,12 @@ bool SteamLoCVOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   LOG(INFO) << "w(-1) " << prev_w_mr_inr.transpose() << std::endl;
   LOG(INFO) << "Number of keypoints used in ICP: " << N_matches << std::endl;
 
+  recordTimers("registration/icp", timer);
+
   /// Debug print
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
     LOG(INFO) << "Number iterations ICP: " << options_.num_iters_icp << std::endl;
     LOG(INFO) << "Translation Begin: " << trajectory_[index_frame].begin_t.transpose() << std::endl;
     LOG(INFO) << "Translation End: " << trajectory_[index_frame].end_t.transpose() << std::endl;
@@ -1,13 +1,16 @@
 #include "steam_icp/odometry/steam_lio.hpp"
 
 #include <iomanip>
+#include <mutex>
 #include <random>
+#include <tuple>
 
 #include <glog/logging.h>
 
 #include "steam.hpp"
 
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/timer_table.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
@@ -42,12 +45,7 @@ void sub_sample_frame(std::vector<Point3D> &frame, double size_voxel, int num_th
 void grid_sampling(const std::vector<Point3D> &frame, std::vector<Point3D> &keypoints, double size_voxel_subsampling,
                    int num_threads) {
   keypoints.clear();
-  std::vector<Point3D> frame_sub;
-  frame_sub.resize(frame.size());
-#pragma omp parallel for num_threads(2)
-  for (int i = 0; i < (int)frame_sub.size(); i++) {
-    frame_sub[i] = frame[i];
-  }
+  std::vector<Point3D> frame_sub(frame);
   sub_sample_frame(frame_sub, size_voxel_subsampling, num_threads);
   keypoints.reserve(frame_sub.size());
   std::transform(frame_sub.begin(), frame_sub.end(), std::back_inserter(keypoints), [](const auto c) { return c; });
@@ -136,10 +134,7 @@ Trajectory SteamRioOdometry::trajectory() {
 auto SteamRioOdometry::registerFrame(const DataFrame &const_frame) -> RegistrationSummary {
   RegistrationSummary summary;
 
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("initialization ..................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("icp ................................ ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("updateMap .......................... ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"initialization", "icp", "updateMap"};
 
   // add a new frame
   int index_frame = trajectory_.size();
@@ -152,9 +147,9 @@ auto SteamRioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
   initializeMotion(index_frame);
 
   //
-  timer[0].second->start();
+  timer[0].start();
   auto frame = initializeFrame(index_frame, const_frame.pointcloud);
-  timer[0].second->stop();
+  timer[0].stop();
 
   //
   std::vector<Point3D> keypoints(frame);
@@ -163,15 +158,15 @@ auto SteamRioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
         index_frame < options_.init_num_frames ? options_.init_sample_voxel_size : options_.sample_voxel_size;
 
     // downsample
-    timer[0].second->start();
+    timer[0].start();
     if (options_.voxel_downsample) grid_sampling(frame, keypoints, sample_voxel_size, options_.num_threads);
-    timer[0].second->stop();
+    timer[0].stop();
 
     // icp
     const auto &imu_data_vec = const_frame.imu_data_vec;
-    timer[1].second->start();
-    summary.success = icp(index_frame, keypoints, imu_data_vec);
-    timer[1].second->stop();
+    timer[1].start();
+    summary.success = readMap([&] { return icp(index_frame, keypoints, imu_data_vec); });
+    timer[1].stop();
     summary.keypoints = keypoints;
     if (!summary.success) return summary;
   } else {
@@ -180,7 +175,7 @@ auto SteamRioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
     using namespace steam::vspace;
     using namespace steam::traj;
 
-    timer[0].second->start();
+    timer[0].start();
 
     // initial state
     lgmath::se3::Transformation T_rm;
@@ -236,18 +231,19 @@ auto SteamRioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
     trajectory_[index_frame].end_dw_mr_inr_cov = P0_accel;
 
     summary.success = true;
-    timer[0].second->stop();
+    timer[0].stop();
   }
   trajectory_[index_frame].points = frame;
 
   // add points
-  timer[2].second->start();
+  timer[2].start();
   if (index_frame == 0) {
-    updateMap(index_frame, index_frame);
+    if (scheduleMapUpdate(index_frame)) updateMap(index_frame, index_frame);
   } else if ((index_frame - options_.delay_adding_points) > 0) {
-    updateMap(index_frame, (index_frame - options_.delay_adding_points));
+    if (scheduleMapUpdate(index_frame - options_.delay_adding_points))
+      updateMap(index_frame, (index_frame - options_.delay_adding_points));
   }
-  timer[2].second->stop();
+  timer[2].stop();
 
   summary.corrected_points = keypoints;
 
@@ -269,10 +265,12 @@ auto SteamRioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
   summary.R_ms = trajectory_[index_frame].end_R;
   summary.t_ms = trajectory_[index_frame].end_t;
 
+  recordTimers("registration", timer);
+
   LOG(INFO) << "OUTER LOOP TIMERS" << std::endl;
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
   }
 
   return summary;
@@ -281,11 +279,18 @@ auto SteamRioOdometry::registerFrame(const DataFrame &const_frame) -> Registrati
 void SteamRioOdometry::initializeTimestamp(int index_frame, const DataFrame &const_frame) {
   double min_timestamp = std::numeric_limits<double>::max();
   double max_timestamp = std::numeric_limits<double>::min();
-#pragma omp parallel for num_threads(2) reduction(min : min_timestamp) reduction(max : max_timestamp)
-  for (const auto &point : const_frame.pointcloud) {
-    if (point.timestamp > max_timestamp) max_timestamp = point.timestamp;
-    if (point.timestamp < min_timestamp) min_timestamp = point.timestamp;
-  }
+  using Bounds = std::pair<double, double>;
+  const auto &points = const_frame.pointcloud;
+  std::tie(min_timestamp, max_timestamp) = threadPool().parallelReduce(
+      "initialize_timestamp", 0, points.size(), Bounds(min_timestamp, max_timestamp),
+      [&](size_t i, Bounds &bounds) {
+        if (points[i].timestamp > bounds.second) bounds.second = points[i].timestamp;
+        if (points[i].timestamp < bounds.first) bounds.first = points[i].timestamp;
+      },
+      [](Bounds &result, Bounds &&local) {
+        result.first = std::min(result.first, local.first);
+        result.second = std::max(result.second, local.second);
+      });
   trajectory_[index_frame].begin_timestamp = min_timestamp;
   trajectory_[index_frame].end_timestamp = max_timestamp;
   // purpose: eval trajectory at the exact file stamp to match ground truth
@@ -345,24 +350,20 @@ std::vector<Point3D> SteamRioOdometry::initializeFrame(int index_frame, const st
   auto q_end = Eigen::Quaterniond(trajectory_[index_frame].end_R);
   Eigen::Vector3d t_begin = trajectory_[index_frame].begin_t;
   Eigen::Vector3d t_end = trajectory_[index_frame].end_t;
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned int i = 0; i < frame.size(); ++i) {
+  threadPool().parallelFor("initialize_frame.transform", 0, frame.size(), [&](size_t i) {
     auto &point = frame[i];
     double alpha_timestamp = point.alpha_timestamp;
     Eigen::Matrix3d R = q_begin.slerp(alpha_timestamp, q_end).normalized().toRotationMatrix();
     Eigen::Vector3d t = (1.0 - alpha_timestamp) * t_begin + alpha_timestamp * t_end;
     //
     point.pt = R * point.raw_pt + t;
-  }
+  });
 
   return frame;
 }
 
 void SteamRioOdometry::updateMap(int index_frame, int update_frame) {
-  const double kSizeVoxelMap = options_.size_voxel_map;
-  const double kMinDistancePoints = options_.min_distance_points;
-  const int kMaxNumPointsInVoxel = options_.max_num_points_in_voxel;
-
+  STEAM_ICP_TRACE_SCOPE("updateMap");
   // update frame
   auto &frame = trajectory_[update_frame].points;
 #if false
@@ -408,8 +409,8 @@ void SteamRioOdometry::updateMap(int index_frame, int update_frame) {
 
   std::map<double, std::pair<Eigen::Matrix4d, Eigen::Matrix<double, 6, 1>>> T_ms_cache_map;
   const Eigen::Matrix4d T_rs = options_.T_sr.inverse();
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int jj = 0; jj < (int)unique_point_times.size(); jj++) {
+  std::mutex T_ms_cache_map_mutex;
+  threadPool().parallelFor("update_map.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
     const auto &ts = unique_point_times[jj];
     const auto T_rm_intp_eval = update_trajectory->getPoseInterpolator(Time(ts));
     const auto w_mr_inr_intp_eval = update_trajectory->getVelocityInterpolator(Time(ts));
@@ -417,30 +418,23 @@ void SteamRioOdometry::updateMap(int index_frame, int update_frame) {
     const Eigen::Matrix4d T_ms = T_rm_intp_eval->value().inverse().matrix() * T_rs;
     const Eigen::Matrix<double, 6, 1> w_ms_ins = w_ms_ins_intp_eval->evaluate();
     const auto pair = std::make_pair(T_ms, w_ms_ins);
-#pragma omp critical
+    std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
     T_ms_cache_map.emplace(ts, pair);
-  }
+  });
 
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned i = 0; i < frame.size(); i++) {
+  threadPool().parallelFor("update_map.deskew", 0, frame.size(), [&](size_t i) {
     const Eigen::Matrix4d &T_ms = T_ms_cache_map[frame[i].timestamp].first;
     const Eigen::Matrix<double, 6, 1> &w_ms_ins = T_ms_cache_map[frame[i].timestamp].second;
     const Eigen::Vector3d abar = frame[i].raw_pt.normalized();
     frame[i].pt = T_ms.block<3, 3>(0, 0) *
                       (frame[i].raw_pt - options_.beta * abar * abar.transpose() * w_ms_ins.block<3, 1>(0, 0)) +
                   T_ms.block<3, 1>(0, 3);
-  }
+  });
 #endif
 
-  map_.add(frame, kSizeVoxelMap, kMaxNumPointsInVoxel, kMinDistancePoints);
-  map_.update_and_filter_lifetimes();
-  frame.clear();
-  frame.shrink_to_fit();
-
-  // remove points
-  const double kMaxDistance = options_.max_distance;
+  // insert the points and remove the far away ones, in the background when pipelined
   const Eigen::Vector3d location = trajectory_[index_frame].end_t;
-  map_.remove(location, kMaxDistance);
+  addToMap(std::move(frame), location, true);
 }
 
 Eigen::Matrix<double, 6, 1> SteamRioOdometry::initialize_gravity(const std::vector<steam::IMUData> &imu_data_vec) {
@@ -505,6 +499,7 @@ Eigen::Matrix<double, 6, 1> SteamRioOdometry::initialize_gravity(const std::vect
 
 bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
                            const std::vector<steam::IMUData> &imu_data_vec) {
+  STEAM_ICP_TRACE_SCOPE("icp");
   LOG(INFO) << "N: " << keypoints.size() << std::endl;
   using namespace steam;
   using namespace steam::se3;
@@ -515,16 +510,10 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   bool icp_success = true;
 
   // timers
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("Update Transform ............... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Association .................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Optimization ................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Alignment ...................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Initialization ................. ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Marginalization ................ ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"Update Transform", "Association", "Optimization", "Alignment", "Initialization", "Marginalization"};
 
   ///
-  timer[4].second->start();
+  timer[4].start();
   const auto steam_trajectory = const_acc::Interface::MakeShared(options_.qc_diag);
   // const auto steam_trajectory = singer::Interface::MakeShared(options_.ad_diag, options_.qc_diag);
   std::vector<StateVarBase::Ptr> steam_state_vars;
@@ -667,11 +656,11 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     }
   }
 
-  timer[4].second->stop();
+  timer[4].stop();
 
   /// update sliding window variables
   {
-    timer[5].second->start();
+    timer[5].start();
     //
     if (index_frame == 1) {
       const auto &prev_var = trajectory_vars_.at(prev_trajectory_var_index);
@@ -705,6 +694,7 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
         const auto &var = trajectory_vars_.at(i);
         if (var.time <= marg_steam_time) {
           end_marg_time = var.time.seconds();
+          if (i < marginalized_until_) continue;  // already marginalized early
           marg_vars.emplace_back(var.T_rm);
           marg_vars.emplace_back(var.w_mr_inr);
           marg_vars.emplace_back(var.dw_mr_inr);
@@ -720,12 +710,27 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       sliding_window_filter_->marginalizeVariable(marg_vars);
       LOG(INFO) << "Marginalizing time (inclusive): " << begin_marg_time << " - " << end_marg_time
                 << ", with num states: " << num_states << std::endl;
+
+      // bound the window: marginalize the oldest remaining states early, never those the current frame attaches to
+      marginalized_until_ = std::max(marginalized_until_, to_marginalize_);
+      int num_early_states = 0;
+      while (marginalized_until_ < prev_trajectory_var_index &&
+             marginalization_policy_.exceeded(*sliding_window_filter_, num_early_states)) {
+        const auto &var = trajectory_vars_.at(marginalized_until_);
+        std::vector<StateVarBase::Ptr> early_vars{var.T_rm, var.w_mr_inr, var.dw_mr_inr};
+        if (options_.use_imu) early_vars.emplace_back(var.imu_biases);
+        sliding_window_filter_->marginalizeVariable(early_vars);
+        marginalized_until_++;
+        num_early_states++;
+      }
+      if (num_early_states > 0)
+        LOG(INFO) << "Marginalized " << num_early_states << " additional states to bound the window" << std::endl;
     }
-    timer[5].second->stop();
+    timer[5].stop();
   }
 
   // Get evaluator for query points
-  timer[4].second->start();
+  timer[4].start();
   std::map<double, Evaluable<const_vel::Interface::PoseType>::ConstPtr> T_rm_intp_eval_map;
   std::map<double, Evaluable<const_vel::Interface::VelocityType>::ConstPtr> w_mr_inr_intp_eval_map;
 
@@ -786,15 +791,15 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   interp_mats_.clear();
 
-  timer[0].second->start();
+  timer[0].start();
   const auto &time1 = prev_steam_time.seconds();
   const auto &time2 = knot_times.back();
   const double T = time2 - time1;
   const Eigen::Matrix<double, 6, 1> ones = Eigen::Matrix<double, 6, 1>::Ones();
   const auto Qinv_T = steam_trajectory->getQinvPublic(T, ones);
   const auto Tran_T = steam_trajectory->getTranPublic(T);
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned int i = 0; i < unique_point_times.size(); ++i) {
+  std::mutex interp_mats_mutex;
+  threadPool().parallelFor("icp.interp_mats", 0, unique_point_times.size(), [&](size_t i) {
     const double &time = unique_point_times[i];
     const double tau = time - time1;
     const double kappa = time2 - time;
@@ -803,10 +808,10 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     const Matrix18d Tran_tau = steam_trajectory->getTranPublic(tau);
     const Matrix18d omega = (Q_tau * Tran_kappa.transpose() * Qinv_T);
     const Matrix18d lambda = (Tran_tau - omega * Tran_T);
-#pragma omp critical
+    std::lock_guard<std::mutex> lock(interp_mats_mutex);
     interp_mats_.emplace(time, std::make_pair(omega, lambda));
-  }
-  timer[0].second->stop();
+  });
+  timer[0].stop();
 
   // We speed this up by caching common sub-expressions and creating a map for the interpolated
   // poses at only the unique measurement times
@@ -831,8 +836,8 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
     std::map<double, std::pair<Eigen::Matrix4d, Eigen::Matrix<double, 6, 1>>> T_ms_cache_map;
 
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)unique_point_times.size(); jj++) {
+    std::mutex T_ms_cache_map_mutex;
+    threadPool().parallelFor("icp.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
       const auto &ts = unique_point_times[jj];
       const auto &omega = interp_mats_.at(ts).first;
       const auto &lambda = interp_mats_.at(ts).second;
@@ -848,11 +853,10 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       const Eigen::Matrix4d T_ms = T_i0.inverse().matrix() * T_rs;
       const Eigen::Matrix<double, 6, 1> w_ms_in_s = Ad_T_sr * w_i;
       const auto pair = std::make_pair(T_ms, w_ms_in_s);
-#pragma omp critical
+      std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
       T_ms_cache_map.emplace(ts, pair);
-    }
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)keypoints.size(); jj++) {
+    });
+    threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t jj) {
       auto &keypoint = keypoints[jj];
       const Eigen::Matrix4d &T_ms = T_ms_cache_map[keypoint.timestamp].first;
       const Eigen::Matrix<double, 6, 1> &w_ms_in_s = T_ms_cache_map[keypoint.timestamp].second;
@@ -864,7 +868,7 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       } else {
         keypoint.pt = T_ms.block<3, 3>(0, 0) * keypoint.raw_pt + T_ms.block<3, 1>(0, 3);
       }
-    }
+    });
   };
 
   auto p2p_options = P2PDopplerCASuperCostTerm::Options();
@@ -883,7 +887,7 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   const auto p2p_super_cost_term =
       P2PDopplerCASuperCostTerm::MakeShared(steam_trajectory, prev_steam_time, knot_times.back(), p2p_options);
 
-  timer[4].second->stop();
+  timer[4].stop();
 
   auto &p2p_matches = p2p_super_cost_term->get();
   p2p_matches.clear();
@@ -910,19 +914,15 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     steam_trajectory->addPriorCostTerms(problem);
     for (const auto &prior_cost_term : prior_cost_terms) problem.addCostTerm(prior_cost_term);
 
-    timer[1].second->start();
+    timer[1].start();
 
     meas_cost_terms.clear();
     p2p_matches.clear();
     p2p_matches.reserve(keypoints.size());
 
-#pragma omp declare reduction( \
-        merge_matches : std::vector<P2PMatch> : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp declare reduction(merge_meas : std::vector<BaseCostTerm::ConstPtr> : omp_out.insert( \
-        omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp parallel for num_threads(options_.num_threads) reduction(merge_matches : p2p_matches) \
-    reduction(merge_meas : meas_cost_terms)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
+    using Associations = std::pair<std::vector<BaseCostTerm::ConstPtr>, std::vector<P2PMatch>>;
+    const auto associate = [&](size_t i, Associations &local) {
+      auto &[meas_cost_terms, p2p_matches] = local;
       const auto &keypoint = keypoints[i];
       const auto &pt_keypoint = keypoint.pt;
 
@@ -930,15 +930,19 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       ArrayVector3d vector_neighbors =
           map_.searchNeighbors(pt_keypoint, nb_voxels_visited, options_.size_voxel_map, options_.max_number_neighbors);
 
-      if ((int)vector_neighbors.size() < kMinNumNeighbors) continue;
+      if ((int)vector_neighbors.size() < kMinNumNeighbors) return;
 
       const Eigen::Vector3d d_vec = keypoint.pt - vector_neighbors[0];
-      if (d_vec.transpose() * d_vec > max_pair_d2) continue;
+      if (d_vec.transpose() * d_vec > max_pair_d2) return;
 
       Eigen::Vector3d closest_pt = vector_neighbors[0];
       Eigen::Vector3d dummy_normal = Eigen::Vector3d::Zero();
       p2p_matches.emplace_back(P2PMatch(keypoint.timestamp, closest_pt, dummy_normal, keypoint.raw_pt));
-    }
+    };
+    auto associations = threadPool().parallelReduce("icp.association", 0, keypoints.size(), Associations(),
+                                                    associate, ThreadPool::Append());
+    ThreadPool::Append()(meas_cost_terms, std::move(associations.first));
+    ThreadPool::Append()(p2p_matches, std::move(associations.second));
 
     N_matches = p2p_matches.size();
 
@@ -953,7 +957,7 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       problem.addCostTerm(imu_super_cost_term);
     }
 
-    timer[1].second->stop();
+    timer[1].stop();
 
     if (N_matches < options_.min_number_keypoints) {
       LOG(ERROR) << "[CT_ICP]Error : not enough keypoints selected in ct-icp !" << std::endl;
@@ -962,7 +966,7 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       break;
     }
 
-    timer[2].second->start();
+    timer[2].start();
 
     // Solve
     GaussNewtonSolverNVA::Params params;
@@ -972,11 +976,15 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     params.reuse_previous_pattern = false;
 #endif
     GaussNewtonSolverNVA solver(problem, params);
+#if SWF_INSIDE_ICP
+    marginalization_policy_.solve(solver);
+#else
     solver.optimize();
+#endif
 
-    timer[2].second->stop();
+    timer[2].stop();
 
-    timer[3].second->start();
+    timer[3].start();
     // Update (changes trajectory data)
     double diff_trans = 0, diff_rot = 0, diff_vel = 0, diff_acc = 0;
 
@@ -1016,7 +1024,7 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     current_estimate.end_R = end_T_ms.block<3, 3>(0, 0);
     current_estimate.end_t = end_T_ms.block<3, 1>(0, 3);
 
-    timer[3].second->stop();
+    timer[3].stop();
 
     if (options_.use_imu) {
       Eigen::Matrix<double, 6, 1> b;
@@ -1044,11 +1052,12 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       }
       // break;
     }
-    timer[0].second->start();
+    timer[0].start();
     transform_keypoints();
-    timer[0].second->stop();
+    timer[0].stop();
   }
 
+  const size_t num_cost_terms_before = sliding_window_filter_->getNumberOfCostTerms();
   steam_trajectory->addPriorCostTerms(*sliding_window_filter_);  // ** this includes state priors (like for x_0)
   for (const auto &prior_cost_term : prior_cost_terms) sliding_window_filter_->addCostTerm(prior_cost_term);
   for (const auto &meas_cost_term : meas_cost_terms) sliding_window_filter_->addCostTerm(meas_cost_term);
@@ -1062,17 +1071,14 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   LOG(INFO) << "number of variables: " << sliding_window_filter_->getNumberOfVariables() << std::endl;
   LOG(INFO) << "number of cost terms: " << sliding_window_filter_->getNumberOfCostTerms() << std::endl;
-  if (sliding_window_filter_->getNumberOfVariables() > 100)
-    throw std::runtime_error{"too many variables in the filter!"};
-  if (sliding_window_filter_->getNumberOfCostTerms() > 100000)
-    throw std::runtime_error{"too many cost terms in the filter!"};
+  marginalization_policy_.update(*sliding_window_filter_, num_cost_terms_before);
 
   GaussNewtonSolverNVA::Params params;
   params.verbose = options_.verbose;
   params.max_iterations = (unsigned int)options_.max_iterations;
   GaussNewtonSolverNVA solver(*sliding_window_filter_, params);
 #if !SWF_INSIDE_ICP
-  solver.optimize();
+  marginalization_policy_.solve(solver);
 #endif
 
   // clang-format off
@@ -1122,10 +1128,12 @@ bool SteamRioOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   LOG(INFO) << "Number of keypoints used in CT-ICP : " << N_matches << std::endl;
 
+  recordTimers("registration/icp", timer);
+
   /// Debug print
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
     LOG(INFO) << "Number iterations CT-ICP : " << options_.num_iters_icp << std::endl;
     LOG(INFO) << "Translation Begin: " << trajectory_[index_frame].begin_t.transpose() << std::endl;
     LOG(INFO) << "Translation End: " << trajectory_[index_frame].end_t.transpose() << std::endl;
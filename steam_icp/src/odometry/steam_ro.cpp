@@ -1,13 +1,17 @@
 #include "steam_icp/odometry/steam_rio.hpp"
 
 #include <iomanip>
+#include <mutex>
 #include <random>
+#include <tuple>
 
 #include <glog/logging.h>
 
 #include "steam.hpp"
 
-#include "steam_icp/utils/stopwatch.hpp"
+#include "steam_icp/utils/loss_kernels.hpp"
+#include "steam_icp/utils/timer_table.hpp"
+#include "steam_icp/utils/trace.hpp"
 
 namespace steam_icp {
 
@@ -41,12 +45,7 @@ void sub_sample_frame(std::vector<Point3D> &frame, double size_voxel, int num_th
 void grid_sampling(const std::vector<Point3D> &frame, std::vector<Point3D> &keypoints, double size_voxel_subsampling,
                    int num_threads) {
   keypoints.clear();
-  std::vector<Point3D> frame_sub;
-  frame_sub.resize(frame.size());
-#pragma omp parallel for num_threads(2)
-  for (int i = 0; i < (int)frame_sub.size(); i++) {
-    frame_sub[i] = frame[i];
-  }
+  std::vector<Point3D> frame_sub(frame);
   sub_sample_frame(frame_sub, size_voxel_subsampling, num_threads);
   keypoints.reserve(frame_sub.size());
   std::transform(frame_sub.begin(), frame_sub.end(), std::back_inserter(keypoints), [](const auto c) { return c; });
@@ -65,6 +64,14 @@ SteamRoOdometry::SteamRoOdometry(const Options &options) : Odometry(options), op
   T_mi_var_ = steam::se3::SE3StateVar::MakeShared(T_mi);
   T_mi_var_->locked() = true;
   sliding_window_filter_ = steam::SlidingWindowFilter::MakeShared(options_.num_threads);
+
+  Eigen::Matrix<double, 1, 1> R_ang = Eigen::Matrix<double, 1, 1>::Identity() * options_.r_imu_ang;
+  gyro_noise_model_ = steam::StaticNoiseModel<1>::MakeShared(R_ang);
+  gyro_loss_func_ = steam::CauchyLossFunc::MakeShared(1.0);
+  Eigen::Matrix<double, 6, 6> bias_cov = Eigen::Matrix<double, 6, 6>::Identity();
+  bias_cov.block<3, 3>(0, 0).diagonal() = options_.q_bias_accel;
+  bias_cov.block<3, 3>(3, 3) = Eigen::Matrix<double, 3, 3>::Identity() * options_.q_bias_gyro;
+  bias_noise_model_ = steam::StaticNoiseModel<6>::MakeShared(bias_cov);
 }
 
 SteamRoOdometry::~SteamRoOdometry() {
@@ -144,6 +151,7 @@ auto SteamRoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
   int index_frame = trajectory_.size();
   trajectory_.emplace_back();
 
+  Telemetry::Scope initialization(telemetry(), "registration/initialization");
   //
   initializeTimestamp(index_frame, const_frame);
 
@@ -152,6 +160,7 @@ auto SteamRoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
 
   //
   auto frame = initializeFrame(index_frame, const_frame.pointcloud);
+  initialization.stop();
 
   //
   std::vector<Point3D> keypoints(frame);
@@ -163,7 +172,7 @@ auto SteamRoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
     if (options_.voxel_downsample) grid_sampling(frame, keypoints, sample_voxel_size, options_.num_threads);
 
     // icp
-    summary.success = icp(index_frame, keypoints, const_frame.imu_data_vec);
+    summary.success = readMap([&] { return icp(index_frame, keypoints, const_frame.imu_data_vec); });
     summary.keypoints = keypoints;
     if (!summary.success) return summary;
   } else {
@@ -202,17 +211,15 @@ auto SteamRoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
   }
   trajectory_[index_frame].points = frame;
 
-  const Eigen::Vector3d t = trajectory_[index_frame].end_t;
-
   // add points
+  Telemetry::Scope update_map(telemetry(), "registration/updatemap");
   if (index_frame == 0) {
-    updateMap(index_frame, index_frame);
+    if (scheduleMapUpdate(index_frame)) updateMap(index_frame, index_frame);
   } else if ((index_frame - options_.delay_adding_points) > 0) {
-    if ((t - t_prev_).norm() > options_.keyframe_translation_threshold_m) {
+    if (scheduleMapUpdate(index_frame - options_.delay_adding_points))
       updateMap(index_frame, (index_frame - options_.delay_adding_points));
-      t_prev_ = t;
-    }
   }
+  update_map.stop();
 
   summary.corrected_points = keypoints;
 
@@ -240,11 +247,18 @@ auto SteamRoOdometry::registerFrame(const DataFrame &const_frame) -> Registratio
 void SteamRoOdometry::initializeTimestamp(int index_frame, const DataFrame &const_frame) {
   double min_timestamp = std::numeric_limits<double>::max();
   double max_timestamp = std::numeric_limits<double>::min();
-#pragma omp parallel for num_threads(2) reduction(min : min_timestamp) reduction(max : max_timestamp)
-  for (const auto &point : const_frame.pointcloud) {
-    if (point.timestamp > max_timestamp) max_timestamp = point.timestamp;
-    if (point.timestamp < min_timestamp) min_timestamp = point.timestamp;
-  }
+  using Bounds = std::pair<double, double>;
+  const auto &points = const_frame.pointcloud;
+  std::tie(min_timestamp, max_timestamp) = threadPool().parallelReduce(
+      "initialize_timestamp", 0, points.size(), Bounds(min_timestamp, max_timestamp),
+      [&](size_t i, Bounds &bounds) {
+        if (points[i].timestamp > bounds.second) bounds.second = points[i].timestamp;
+        if (points[i].timestamp < bounds.first) bounds.first = points[i].timestamp;
+      },
+      [](Bounds &result, Bounds &&local) {
+        result.first = std::min(result.first, local.first);
+        result.second = std::max(result.second, local.second);
+      });
   trajectory_[index_frame].begin_timestamp = min_timestamp;
   trajectory_[index_frame].end_timestamp = max_timestamp;
   // purpose: eval trajectory at the exact file stamp to match ground truth
@@ -290,24 +304,20 @@ std::vector<Point3D> SteamRoOdometry::initializeFrame(int index_frame, const std
   auto q_end = Eigen::Quaterniond(trajectory_[index_frame].end_R);
   Eigen::Vector3d t_begin = trajectory_[index_frame].begin_t;
   Eigen::Vector3d t_end = trajectory_[index_frame].end_t;
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned int i = 0; i < frame.size(); ++i) {
+  threadPool().parallelFor("initialize_frame.transform", 0, frame.size(), [&](size_t i) {
     auto &point = frame[i];
     double alpha_timestamp = point.alpha_timestamp;
     Eigen::Matrix3d R = q_begin.slerp(alpha_timestamp, q_end).normalized().toRotationMatrix();
     Eigen::Vector3d t = (1.0 - alpha_timestamp) * t_begin + alpha_timestamp * t_end;
     //
     point.pt = R * point.raw_pt + t;
-  }
+  });
 
   return frame;
 }
 
 void SteamRoOdometry::updateMap(int index_frame, int update_frame) {
-  const double kSizeVoxelMap = options_.size_voxel_map;
-  const double kMinDistancePoints = options_.min_distance_points;
-  const int kMaxNumPointsInVoxel = options_.max_num_points_in_voxel;
-
+  STEAM_ICP_TRACE_SCOPE("updateMap");
   // update frame
   auto &frame = trajectory_[update_frame].points;
 #if false
@@ -352,20 +362,19 @@ void SteamRoOdometry::updateMap(int index_frame, int update_frame) {
 
   std::map<double, std::pair<Eigen::Matrix4d, Eigen::Vector3d>> T_ms_cache_map;
   const Eigen::Matrix4d T_rs = options_.T_sr.inverse();
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (int jj = 0; jj < (int)unique_point_times.size(); jj++) {
+  std::mutex T_ms_cache_map_mutex;
+  threadPool().parallelFor("update_map.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
     const auto &ts = unique_point_times[jj];
     const auto T_rm_intp_eval = update_trajectory->getPoseInterpolator(Time(ts));
     const Eigen::Matrix4d T_ms = T_rm_intp_eval->value().inverse().matrix() * T_rs;
     const auto w_mr_inr_intp_eval = update_trajectory->getVelocityInterpolator(Time(ts));
     const auto v_m_s_in_s = compose_velocity(T_sr_var_, w_mr_inr_intp_eval)->value().block<3, 1>(0, 0);
     auto pair = std::make_pair(T_ms, v_m_s_in_s);
-#pragma omp critical
+    std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
     T_ms_cache_map[ts] = pair;
-  }
+  });
 
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned i = 0; i < frame.size(); i++) {
+  threadPool().parallelFor("update_map.deskew", 0, frame.size(), [&](size_t i) {
     // const double query_time = frame[i].timestamp;
 
     // const auto T_rm_intp_eval = update_trajectory->getPoseInterpolator(Time(query_time));
@@ -390,24 +399,18 @@ void SteamRoOdometry::updateMap(int index_frame, int update_frame) {
     } else {
       frame[i].pt = T_ms.block<3, 3>(0, 0) * frame[i].raw_pt + T_ms.block<3, 1>(0, 3);
     }
-  }
+  });
 #endif
 
   // map_.clear();
-  // update the map with new points and refresh their life time and normal
-  map_.add(frame, kSizeVoxelMap, kMaxNumPointsInVoxel, kMinDistancePoints);
-  map_.update_and_filter_lifetimes();
-  frame.clear();
-  frame.shrink_to_fit();
-
-  // remove points
-  const double kMaxDistance = options_.max_distance;
+  // update the map with new points and refresh their life time and normal, in the background when pipelined
   const Eigen::Vector3d location = trajectory_[index_frame].end_t;
-  map_.remove(location, kMaxDistance);
+  addToMap(std::move(frame), location, true);
 }
 
 bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
                           const std::vector<steam::IMUData> &imu_data_vec) {
+  STEAM_ICP_TRACE_SCOPE("icp");
   using namespace steam;
   using namespace steam::se3;
   using namespace steam::traj;
@@ -539,6 +542,7 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
         const auto &var = trajectory_vars_.at(i);
         if (var.time <= marg_steam_time) {
           end_marg_time = var.time.seconds();
+          if (i < marginalized_until_) continue;  // already marginalized early
           marg_vars.emplace_back(var.T_rm);
           marg_vars.emplace_back(var.w_mr_inr);
           if (options_.use_imu) {
@@ -554,6 +558,21 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       //
       LOG(INFO) << "Marginalizing time (inclusive): " << begin_marg_time << " - " << end_marg_time
                 << ", with num states: " << num_states << std::endl;
+
+      // bound the window: marginalize the oldest remaining states early, never those the current frame attaches to
+      marginalized_until_ = std::max(marginalized_until_, to_marginalize_);
+      int num_early_states = 0;
+      while (marginalized_until_ < prev_trajectory_var_index &&
+             marginalization_policy_.exceeded(*sliding_window_filter_, num_early_states)) {
+        const auto &var = trajectory_vars_.at(marginalized_until_);
+        std::vector<StateVarBase::Ptr> early_vars{var.T_rm, var.w_mr_inr};
+        if (options_.use_imu) early_vars.emplace_back(var.imu_biases);
+        sliding_window_filter_->marginalizeVariable(early_vars);
+        marginalized_until_++;
+        num_early_states++;
+      }
+      if (num_early_states > 0)
+        LOG(INFO) << "Marginalized " << num_early_states << " additional states to bound the window" << std::endl;
     }
   }
 
@@ -572,50 +591,114 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       steam_trajectory, prev_steam_time, knot_times.back(), trajectory_vars_[prev_trajectory_var_index].imu_biases,
       trajectory_vars_[prev_trajectory_var_index + 1].imu_biases, T_mi_var_, T_mi_var_, imu_options);
 
+  // velocity of the trajectory at time, within knot interval i: interpolated from the pool, or the knot itself (steam's
+  // own lookup) when time falls on one
+  const auto velocity_at = [&](const Time &time, size_t i) -> Evaluable<const_vel::Interface::VelocityType>::ConstPtr {
+    if (time <= trajectory_vars_[i].time || time >= trajectory_vars_[i + 1].time)
+      return steam_trajectory->getVelocityInterpolator(time);
+    return cost_term_pool_->make<const_vel::VelocityInterpolator>(time, steam_trajectory->get(trajectory_vars_[i].time),
+                                                                  steam_trajectory->get(trajectory_vars_[i + 1].time));
+  };
+
   if (options_.use_imu) {
     if (index_frame > options_.init_num_frames) {
       if (options_.use_accel) {
         preint_cost_term->set(imu_data_vec);
         preint_cost_term->init();
       }
-      imu_cost_terms.reserve(imu_data_vec.size());
-      Eigen::Matrix<double, 1, 1> R_ang = Eigen::Matrix<double, 1, 1>::Identity() * options_.r_imu_ang;
-      const auto gyro_noise_model = StaticNoiseModel<1>::MakeShared(R_ang);
-      const auto gyro_loss_func = CauchyLossFunc::MakeShared(1.0);
-      for (const auto &imu_data : imu_data_vec) {
-        size_t i = prev_trajectory_var_index;
-        for (; i < trajectory_vars_.size() - 1; i++) {
-          if (imu_data.timestamp >= trajectory_vars_[i].time.seconds() &&
-              imu_data.timestamp < trajectory_vars_[i + 1].time.seconds())
-            break;
-        }
-        if (imu_data.timestamp < trajectory_vars_[i].time.seconds() ||
-            imu_data.timestamp >= trajectory_vars_[i + 1].time.seconds())
+      if (options_.preint_gyro) {
+        // Preintegrated yaw-rate factor: the piecewise-linear gyro z signal is integrated over the part of each knot
+        // interval the samples cover, [a, b], into a heading change that constrains the relative pose of the
+        // trajectory over that span: e = dtheta + log(T_rm(b) T_rm(a)^-1)_yaw - (b - a) b_yaw((a + b) / 2), the
+        // integral of the per-sample GyroErrorEvaluatorSE2 error (the bias being linear between knots). dtheta is a
+        // weighted sum of the samples, so its variance is r_imu_ang times the sum of the squared weights.
+        const size_t num_samples = imu_data_vec.size();
+        if (num_samples > 0 &&
+            (imu_data_vec.front().timestamp < trajectory_vars_[prev_trajectory_var_index].time.seconds() ||
+             imu_data_vec.back().timestamp >= trajectory_vars_.back().time.seconds()))
           throw std::runtime_error("imu stamp not within knot times");
-
-        const auto bias_intp_eval = VSpaceInterpolator<6>::MakeShared(
-            Time(imu_data.timestamp), trajectory_vars_[i].imu_biases, trajectory_vars_[i].time,
-            trajectory_vars_[i + 1].imu_biases, trajectory_vars_[i + 1].time);
-
-        const auto w_mr_inr_intp_eval = steam_trajectory->getVelocityInterpolator(Time(imu_data.timestamp));
-        const auto gyro_error_func = imu::GyroErrorSE2(w_mr_inr_intp_eval, bias_intp_eval, imu_data.ang_vel);
-        const auto gyro_cost =
-            WeightedLeastSqCostTerm<1>::MakeShared(gyro_error_func, gyro_noise_model, gyro_loss_func);
-        imu_cost_terms.emplace_back(gyro_cost);
+        const auto gyro_preint_loss_func = L2LossFunc::MakeShared();
+        Eigen::Matrix<double, 1, 6> yaw_row = Eigen::Matrix<double, 1, 6>::Zero();
+        yaw_row(0, 5) = 1.0;
+        size_t j = 0;
+        for (size_t i = prev_trajectory_var_index; i < trajectory_vars_.size() - 1 && num_samples > 1; ++i) {
+          const double a = std::max(trajectory_vars_[i].time.seconds(), imu_data_vec.front().timestamp);
+          const double b = std::min(trajectory_vars_[i + 1].time.seconds(), imu_data_vec.back().timestamp);
+          if (b <= a) continue;
+          while (j + 2 < num_samples && imu_data_vec[j + 1].timestamp <= a) j++;
+
+          // trapezoidal integral of the segments overlapping [a, b]; w is the weight accumulated by sample k so far
+          double delta_yaw = 0.0, sum_sq_weights = 0.0, w = 0.0;
+          for (size_t k = j; k + 1 < num_samples && imu_data_vec[k].timestamp < b; ++k) {
+            const double s0 = imu_data_vec[k].timestamp, s1 = imu_data_vec[k + 1].timestamp;
+            const double u = std::max(s0, a), v = std::min(s1, b);
+            if (s1 <= s0 || v <= u) {
+              sum_sq_weights += w * w;
+              w = 0.0;
+              continue;
+            }
+            const double length = v - u;
+            const double lambda = (0.5 * (u + v) - s0) / (s1 - s0);
+            delta_yaw +=
+                length * ((1.0 - lambda) * imu_data_vec[k].ang_vel(2) + lambda * imu_data_vec[k + 1].ang_vel(2));
+            w += length * (1.0 - lambda);
+            sum_sq_weights += w * w;
+            w = length * lambda;
+          }
+          sum_sq_weights += w * w;
+
+          const auto T_rm_a = steam_trajectory->getPoseInterpolator(Time(a));
+          const auto T_rm_b = steam_trajectory->getPoseInterpolator(Time(b));
+          const auto xi_ba = cost_term_pool_->make<se3::LogMapEvaluator>(cost_term_pool_->make<se3::ComposeEvaluator>(
+              T_rm_b, cost_term_pool_->make<se3::InverseEvaluator>(T_rm_a)));
+          const auto bias_intp_eval = cost_term_pool_->make<VSpaceInterpolator<6>>(
+              Time(0.5 * (a + b)), trajectory_vars_[i].imu_biases, trajectory_vars_[i].time,
+              trajectory_vars_[i + 1].imu_biases, trajectory_vars_[i + 1].time);
+          const auto predicted = cost_term_pool_->make<vspace::AdditionEvaluator<1>>(
+              cost_term_pool_->make<vspace::MatrixMultEvaluator<1, 6>>(xi_ba, -yaw_row),
+              cost_term_pool_->make<vspace::MatrixMultEvaluator<1, 6>>(bias_intp_eval, (b - a) * yaw_row));
+          const auto gyro_error_func = cost_term_pool_->make<vspace::VSpaceErrorEvaluator<1>>(
+              predicted, Eigen::Matrix<double, 1, 1>::Constant(delta_yaw));
+          const auto noise_model = cost_term_pool_->make<StaticNoiseModel<1>>(
+              Eigen::Matrix<double, 1, 1>::Constant(options_.r_imu_ang * sum_sq_weights));
+          const auto gyro_cost =
+              cost_term_pool_->make<WeightedLeastSqCostTerm<1>>(gyro_error_func, noise_model, gyro_preint_loss_func);
+          imu_cost_terms.emplace_back(gyro_cost);
+        }
+      } else {
+        imu_cost_terms.reserve(imu_data_vec.size());
+        for (const auto &imu_data : imu_data_vec) {
+          size_t i = prev_trajectory_var_index;
+          for (; i < trajectory_vars_.size() - 1; i++) {
+            if (imu_data.timestamp >= trajectory_vars_[i].time.seconds() &&
+                imu_data.timestamp < trajectory_vars_[i + 1].time.seconds())
+              break;
+          }
+          if (imu_data.timestamp < trajectory_vars_[i].time.seconds() ||
+              imu_data.timestamp >= trajectory_vars_[i + 1].time.seconds())
+            throw std::runtime_error("imu stamp not within knot times");
+
+          const auto bias_intp_eval = cost_term_pool_->make<VSpaceInterpolator<6>>(
+              Time(imu_data.timestamp), trajectory_vars_[i].imu_biases, trajectory_vars_[i].time,
+              trajectory_vars_[i + 1].imu_biases, trajectory_vars_[i + 1].time);
+
+          const auto w_mr_inr_intp_eval = velocity_at(Time(imu_data.timestamp), i);
+          const auto gyro_error_func =
+              cost_term_pool_->make<GyroErrorEvaluatorSE2>(w_mr_inr_intp_eval, bias_intp_eval, imu_data.ang_vel);
+          const auto gyro_cost =
+              cost_term_pool_->make<WeightedLeastSqCostTerm<1>>(gyro_error_func, gyro_noise_model_, gyro_loss_func_);
+          imu_cost_terms.emplace_back(gyro_cost);
+        }
       }
     }
 
     {
-      Eigen::Matrix<double, 6, 6> bias_cov = Eigen::Matrix<double, 6, 6>::Identity();
-      bias_cov.block<3, 3>(0, 0).diagonal() = options_.q_bias_accel;
-      bias_cov.block<3, 3>(3, 3) = Eigen::Matrix<double, 3, 3>::Identity() * options_.q_bias_gyro;
-      auto noise_model = StaticNoiseModel<6>::MakeShared(bias_cov);
       auto loss_func = L2LossFunc::MakeShared();
       size_t i = prev_trajectory_var_index;
       for (; i < trajectory_vars_.size() - 1; i++) {
         const auto nbk = vspace::NegationEvaluator<6>::MakeShared(trajectory_vars_[i + 1].imu_biases);
         auto bias_error = vspace::AdditionEvaluator<6>::MakeShared(trajectory_vars_[i].imu_biases, nbk);
-        const auto bias_prior_factor = WeightedLeastSqCostTerm<6>::MakeShared(bias_error, noise_model, loss_func);
+        const auto bias_prior_factor = WeightedLeastSqCostTerm<6>::MakeShared(bias_error, bias_noise_model_, loss_func);
         imu_prior_cost_terms.emplace_back(bias_prior_factor);
       }
     }
@@ -635,8 +718,8 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   const Eigen::Matrix<double, 6, 1> ones = Eigen::Matrix<double, 6, 1>::Ones();
   const auto Qinv_T = steam::traj::const_vel::getQinv(T, ones);
   const auto Tran_T = steam::traj::const_vel::getTran(T);
-#pragma omp parallel for num_threads(options_.num_threads)
-  for (unsigned int i = 0; i < unique_point_times.size(); ++i) {
+  std::mutex interp_mats_mutex;
+  threadPool().parallelFor("icp.interp_mats", 0, unique_point_times.size(), [&](size_t i) {
     const double &time = unique_point_times[i];
     const double tau = time - time1;
     const double kappa = time2 - time;
@@ -645,9 +728,9 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     const Matrix12d Tran_tau = steam::traj::const_vel::getTran(tau);
     const Matrix12d omega = (Q_tau * Tran_kappa.transpose() * Qinv_T);
     const Matrix12d lambda = (Tran_tau - omega * Tran_T);
-#pragma omp critical
+    std::lock_guard<std::mutex> lock(interp_mats_mutex);
     interp_mats_.emplace(time, std::make_pair(omega, lambda));
-  }
+  });
 
   // std::vector<Evaluable<const_vel::Interface::PoseType>::ConstPtr> T_ms_intp_eval_vec;
   // std::vector<Evaluable<const_vel::Interface::VelocityType>::ConstPtr> w_ms_ins_intp_eval_vec;
@@ -672,16 +755,8 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   auto &current_estimate = trajectory_.at(index_frame);
 
   // timers
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> timer;
-  timer.emplace_back("Update Transform ............... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Association .................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Optimization ................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Alignment ...................... ", std::make_unique<Stopwatch<>>(false));
-  timer.emplace_back("Sliding Window ................. ", std::make_unique<Stopwatch<>>(false));
-  std::vector<std::pair<std::string, std::unique_ptr<Stopwatch<>>>> inner_timer;
-  inner_timer.emplace_back("Search Neighbors ............. ", std::make_unique<Stopwatch<>>(false));
-  inner_timer.emplace_back("Compute Normal ............... ", std::make_unique<Stopwatch<>>(false));
-  inner_timer.emplace_back("Add Cost Term ................ ", std::make_unique<Stopwatch<>>(false));
+  TimerTable timer{"Update Transform", "Association", "Optimization", "Alignment", "Sliding Window"};
+  TimerTable inner_timer{"Search Neighbors", "Compute Normal", "Add Cost Term"};
   bool innerloop_time = (options_.num_threads == 1);
 
   auto transform_keypoints = [&]() {
@@ -699,8 +774,8 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     std::map<double, std::pair<Eigen::Matrix4d, Eigen::Vector3d>> T_ms_cache_map;
     const Eigen::Matrix4d T_rs = options_.T_sr.inverse();
     const auto Ad_T_s_r = lgmath::se3::tranAd(options_.T_sr);
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)unique_point_times.size(); jj++) {
+    std::mutex T_ms_cache_map_mutex;
+    threadPool().parallelFor("icp.pose_cache", 0, unique_point_times.size(), [&](size_t jj) {
       const auto &ts = unique_point_times[jj];
       const auto &omega = interp_mats_.at(ts).first;
       const auto &lambda = interp_mats_.at(ts).second;
@@ -713,12 +788,11 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       const Eigen::Matrix4d T_ms = T_i0.inverse().matrix() * T_rs;
       const Eigen::Vector3d v_m_s_in_s = (Ad_T_s_r * lgmath::se3::vec2jac(xi_i1) * xi_j1).block<3, 1>(0, 0);
       auto pair = std::make_pair(T_ms, v_m_s_in_s);
-#pragma omp critical
+      std::lock_guard<std::mutex> lock(T_ms_cache_map_mutex);
       T_ms_cache_map[ts] = pair;
-    }
+    });
 
-#pragma omp parallel for num_threads(options_.num_threads)
-    for (int jj = 0; jj < (int)keypoints.size(); jj++) {
+    threadPool().parallelFor("icp.transform_keypoints", 0, keypoints.size(), [&](size_t jj) {
       auto &keypoint = keypoints[jj];
       const Eigen::Matrix4d &T_ms = T_ms_cache_map[keypoint.timestamp].first;
       if (options_.beta != 0) {
@@ -730,7 +804,7 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       } else {
         keypoint.pt = T_ms.block<3, 3>(0, 0) * keypoint.raw_pt + T_ms.block<3, 1>(0, 3);
       }
-    }
+    });
   };
 
   //   auto transform_keypoints = [&]() {
@@ -784,10 +858,16 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
 #define SWF_INSIDE_ICP true
 
+#if !USE_P2P_SUPER_COST_TERM
+  // shared by all point-to-point cost terms of this frame
+  const auto p2p_noise_model = StaticNoiseModel<3>::MakeShared(Eigen::Matrix3d::Identity(), NoiseType::INFORMATION);
+  const auto p2p_loss_func = loss::makeSteamLoss(options_.p2p_loss_func, options_.p2p_loss_sigma);
+#endif
+
   for (int iter(0); iter < options_.num_iters_icp; iter++) {
-    timer[0].second->start();
+    timer[0].start();
     transform_keypoints();
-    timer[0].second->stop();
+    timer[0].stop();
 
     // initialize problem
 #if SWF_INSIDE_ICP
@@ -803,88 +883,64 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
     meas_cost_terms.clear();
     p2p_matches.clear();
-#if USE_P2P_SUPER_COST_TERM
     p2p_matches.reserve(keypoints.size());
-#else
-    meas_cost_terms.reserve(keypoints.size());
-#endif
 
-    timer[1].second->start();
+    timer[1].start();
 
-#pragma omp declare reduction(merge_meas : std::vector<BaseCostTerm::ConstPtr> : omp_out.insert( \
-        omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp declare reduction( \
-        merge_matches : std::vector<P2PMatch> : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
-#pragma omp parallel for num_threads(options_.num_threads) reduction(merge_meas : meas_cost_terms) \
-    reduction(merge_matches : p2p_matches)
-    for (int i = 0; i < (int)keypoints.size(); i++) {
+    // matches only: the cost terms of the non super cost term path are made from the pool, on this thread, below
+    const auto associate = [&](size_t i, std::vector<P2PMatch> &p2p_matches) {
       const auto &keypoint = keypoints[i];
       const auto &pt_keypoint = keypoint.pt;
 
-      if (innerloop_time) inner_timer[0].second->start();
+      if (innerloop_time) inner_timer[0].start();
 
       // Neighborhood search
       ArrayVector3d vector_neighbors =
           map_.searchNeighbors(pt_keypoint, nb_voxels_visited, options_.size_voxel_map, options_.max_number_neighbors);
 
-      if ((int)vector_neighbors.size() < options_.min_number_neighbors) continue;
+      if ((int)vector_neighbors.size() < options_.min_number_neighbors) return;
 
-      if (innerloop_time) inner_timer[0].second->stop();
+      if (innerloop_time) inner_timer[0].stop();
 
-      if (innerloop_time) inner_timer[1].second->start();
-      if (innerloop_time) inner_timer[1].second->stop();
+      if (innerloop_time) inner_timer[1].start();
+      if (innerloop_time) inner_timer[1].stop();
 
-      if (innerloop_time) inner_timer[2].second->start();
+      if (innerloop_time) inner_timer[2].start();
 
       const Eigen::Vector3d d_vec = keypoint.pt - vector_neighbors[0];
-      if (d_vec.transpose() * d_vec > max_pair_d2) continue;
+      if (d_vec.transpose() * d_vec > max_pair_d2) return;
 
-#if USE_P2P_SUPER_COST_TERM
       Eigen::Vector3d closest_pt = vector_neighbors[0];
       Eigen::Vector3d dummy_normal = Eigen::Vector3d::Zero();
       p2p_matches.emplace_back(P2PMatch(keypoint.timestamp, closest_pt, dummy_normal, keypoint.raw_pt));
-#else
-      Eigen::Vector3d closest_pt = vector_neighbors[0];
-      Eigen::Matrix3d W = Eigen::Matrix3d::Identity();
-      const auto noise_model = StaticNoiseModel<3>::MakeShared(W, NoiseType::INFORMATION);
 
-      const auto &T_ms_intp_eval = T_ms_intp_eval_vec[i];
+      if (innerloop_time) inner_timer[2].stop();
+    };
+    ThreadPool::Append()(p2p_matches, threadPool().parallelReduce("icp.association", 0, keypoints.size(),
+                                                                  std::vector<P2PMatch>(), associate,
+                                                                  ThreadPool::Append()));
+    N_matches = p2p_matches.size();
+
+#if USE_P2P_SUPER_COST_TERM
+    p2p_super_cost_term->initP2PMatches();
+#else
+    meas_cost_terms.reserve(p2p_matches.size());
+    for (const auto &match : p2p_matches) {
+      const Time time(match.timestamp);
+      const auto T_ms_intp_eval = inverse(compose(T_sr_var_, steam_trajectory->getPoseInterpolator(time)));
       auto error_func = [&]() -> Evaluable<Eigen::Matrix<double, 3, 1>>::Ptr {
         if (options_.beta != 0) {
-          const auto &w_ms_ins_intp_eval = w_ms_ins_intp_eval_vec[i];
-          return p2p::p2pErrorDoppler(T_ms_intp_eval, w_ms_ins_intp_eval, closest_pt, keypoint.raw_pt, options_.beta);
+          const auto w_ms_ins_intp_eval = compose_velocity(T_sr_var_, steam_trajectory->getVelocityInterpolator(time));
+          return cost_term_pool_->make<p2p::P2PErrorDopplerEvaluator>(T_ms_intp_eval, w_ms_ins_intp_eval,
+                                                                      match.reference, match.query, options_.beta);
         } else {
-          return p2p::p2pError(T_ms_intp_eval, closest_pt, keypoint.raw_pt);
-        }
-      }();
-      const auto loss_func = [this]() -> BaseLossFunc::Ptr {
-        switch (options_.p2p_loss_func) {
-          case STEAM_LOSS_FUNC::L2:
-            return L2LossFunc::MakeShared();
-          case STEAM_LOSS_FUNC::DCS:
-            return DcsLossFunc::MakeShared(options_.p2p_loss_sigma);
-          case STEAM_LOSS_FUNC::CAUCHY:
-            return CauchyLossFunc::MakeShared(options_.p2p_loss_sigma);
-          case STEAM_LOSS_FUNC::GM:
-            return GemanMcClureLossFunc::MakeShared(options_.p2p_loss_sigma);
-          default:
-            return nullptr;
+          return cost_term_pool_->make<p2p::P2PErrorEvaluator>(T_ms_intp_eval, match.reference, match.query);
         }
-        return nullptr;
       }();
-
-      const auto cost = WeightedLeastSqCostTerm<3>::MakeShared(error_func, noise_model, loss_func);
+      const auto cost = cost_term_pool_->make<WeightedLeastSqCostTerm<3>>(error_func, p2p_noise_model, p2p_loss_func);
       meas_cost_terms.emplace_back(cost);
-#endif
-
-      if (innerloop_time) inner_timer[2].second->stop();
     }
-
-#if USE_P2P_SUPER_COST_TERM
-    N_matches = p2p_matches.size();
-    p2p_super_cost_term->initP2PMatches();
-#else
-    N_matches = meas_cost_terms.size();
+    p2p_matches.clear();
 #endif
 
     for (const auto &cost : meas_cost_terms) problem.addCostTerm(cost);
@@ -895,7 +951,7 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       problem.addCostTerm(preint_cost_term);
     }
 
-    timer[1].second->stop();
+    timer[1].stop();
 
     if (N_matches < options_.min_number_keypoints) {
       LOG(ERROR) << "[CT_ICP]Error : not enough keypoints selected in ct-icp !" << std::endl;
@@ -904,7 +960,7 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
       break;
     }
 
-    timer[2].second->start();
+    timer[2].start();
 
     // Solve
     GaussNewtonSolverNVA::Params params;
@@ -918,11 +974,15 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     params.reuse_previous_pattern = false;
 #endif
     GaussNewtonSolverNVA solver(problem, params);
+#if SWF_INSIDE_ICP
+    marginalization_policy_.solve(solver);
+#else
     solver.optimize();
+#endif
 
-    timer[2].second->stop();
+    timer[2].stop();
 
-    timer[3].second->start();
+    timer[3].start();
 
     // Update (changes trajectory data)
     double diff_trans = 0, diff_rot = 0, diff_vel = 0;
@@ -956,7 +1016,7 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
     current_estimate.end_R = end_T_ms.block<3, 3>(0, 0);
     current_estimate.end_t = end_T_ms.block<3, 1>(0, 3);
 
-    timer[3].second->stop();
+    timer[3].stop();
 
     if ((index_frame > 1) &&
         (diff_rot < options_.threshold_orientation_norm && diff_trans < options_.threshold_translation_norm &&
@@ -970,9 +1030,10 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   /// optimize in a sliding window
   LOG(INFO) << "Optimizing in a sliding window!" << std::endl;
-  timer[4].second->start();
+  timer[4].start();
   // {
   //
+  const size_t num_cost_terms_before = sliding_window_filter_->getNumberOfCostTerms();
   steam_trajectory->addPriorCostTerms(*sliding_window_filter_);  // ** this includes state priors (like for x_0)
   for (const auto &prior_cost_term : prior_cost_terms) sliding_window_filter_->addCostTerm(prior_cost_term);
   for (const auto &meas_cost_term : meas_cost_terms) sliding_window_filter_->addCostTerm(meas_cost_term);
@@ -986,20 +1047,17 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   //
   LOG(INFO) << "number of variables: " << sliding_window_filter_->getNumberOfVariables() << std::endl;
   LOG(INFO) << "number of cost terms: " << sliding_window_filter_->getNumberOfCostTerms() << std::endl;
-  if (sliding_window_filter_->getNumberOfVariables() > 100)
-    throw std::runtime_error{"too many variables in the filter!"};
-  if (sliding_window_filter_->getNumberOfCostTerms() > 100000)
-    throw std::runtime_error{"too many cost terms in the filter!"};
+  marginalization_policy_.update(*sliding_window_filter_, num_cost_terms_before);
 
   GaussNewtonSolverNVA::Params params;
   params.max_iterations = 20;
   params.reuse_previous_pattern = false;
   GaussNewtonSolverNVA solver(*sliding_window_filter_, params);
 #if !SWF_INSIDE_ICP
-  solver.optimize();
+  marginalization_policy_.solve(solver);
 #endif
   // }
-  timer[4].second->stop();
+  timer[4].stop();
 
   // clang-format off
   Time curr_begin_steam_time(static_cast<double>(current_estimate.begin_timestamp));
@@ -1026,9 +1084,9 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
   current_estimate.mid_state_cov.block<12, 12>(0, 0) =
       steam_trajectory->getCovariance(covariance, trajectory_vars_[prev_trajectory_var_index].time);
 
-  // timer[0].second->start();
+  // timer[0].start();
   // transform_keypoints();
-  // timer[0].second->stop();
+  // timer[0].stop();
 
   if (options_.use_imu) {
     size_t i = prev_trajectory_var_index;
@@ -1050,13 +1108,16 @@ bool SteamRoOdometry::icp(int index_frame, std::vector<Point3D> &keypoints,
 
   LOG(INFO) << "Number of keypoints used in CT-ICP : " << N_matches << std::endl;
 
+  recordTimers("registration/icp", timer);
+  if (innerloop_time) recordTimers("registration/icp/inner_loop", inner_timer);
+
   /// Debug print
   if (options_.debug_print) {
     for (size_t i = 0; i < timer.size(); i++)
-      LOG(INFO) << "Elapsed " << timer[i].first << *(timer[i].second) << std::endl;
+      LOG(INFO) << "Elapsed " << timer.label(i) << timer[i] << std::endl;
     if (innerloop_time) {
       for (size_t i = 0; i < inner_timer.size(); i++)
-        LOG(INFO) << "Elapsed (Inner Loop) " << inner_timer[i].first << *(inner_timer[i].second) << std::endl;
+        LOG(INFO) << "Elapsed (Inner Loop) " << inner_timer.label(i) << inner_timer[i] << std::endl;
     }
     LOG(INFO) << "Number iterations CT-ICP : " << options_.num_iters_icp << std::endl;
     LOG(INFO) << "Translation Begin: " << trajectory_[index_frame].begin_t.transpose() << std::endl;
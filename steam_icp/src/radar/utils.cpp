@@ -1,31 +1,49 @@
 #include "steam_icp/radar/utils.hpp"
 
+#include <cstring>
+
+#include "steam_icp/utils/mapped_file.hpp"
+
 namespace steam_icp {
 
 void load_radar(const std::string &path, std::vector<int64_t> &timestamps, std::vector<double> &azimuths,
                 cv::Mat &fft_data) {
-  const cv::Mat raw_data = cv::imread(path, cv::IMREAD_GRAYSCALE);
+  cv::Mat raw_data;
+  decode_radar(path, raw_data);
   load_radar(raw_data, timestamps, azimuths, fft_data);
 }
 
 void load_radar(const cv::Mat &raw_data, std::vector<int64_t> &timestamps, std::vector<double> &azimuths,
-                cv::Mat &fft_data) {
+                cv::Mat &fft_data, ThreadPool *thread_pool) {
   const double encoder_conversion = 2 * M_PI / 5600;
   const uint N = raw_data.rows;
-  timestamps = std::vector<int64_t>(N, 0);
-  azimuths = std::vector<double>(N, 0);
+  timestamps.resize(N);
+  azimuths.resize(N);
   const uint range_bins = raw_data.cols - 11;
-  fft_data = cv::Mat::zeros(N, range_bins, CV_32F);
-  // #pragma omp parallel
-  for (uint i = 0; i < N; ++i) {
+  fft_data.create(N, range_bins, CV_32F);  // every element is written below
+  const auto load_row = [&](size_t i) {
     const uchar *byteArray = raw_data.ptr<uchar>(i);
-    timestamps[i] = *((int64_t *)(byteArray));
-    azimuths[i] = *((uint16_t *)(byteArray + 8)) * encoder_conversion;
+    std::memcpy(&timestamps[i], byteArray, sizeof(int64_t));
+    uint16_t encoder;
+    std::memcpy(&encoder, byteArray + 8, sizeof(uint16_t));
+    azimuths[i] = encoder * encoder_conversion;
     // The 10th byte is reserved but unused
-    for (uint j = 0; j < range_bins; ++j) {
-      fft_data.at<float>(i, j) = (float)*(byteArray + 11 + j) / 255.0;
-    }
-  }
+    const uchar *__restrict power = byteArray + 11;
+    float *__restrict fft_row = fft_data.ptr<float>(i);
+    // divided in double as before, so that the result does not change; the loop still vectorizes
+    for (uint j = 0; j < range_bins; ++j) fft_row[j] = static_cast<float>(power[j] / 255.0);
+  };
+  if (thread_pool != nullptr)
+    thread_pool->parallelFor("load_radar", 0, N, load_row);
+  else
+    for (uint i = 0; i < N; ++i) load_row(i);
+}
+
+void decode_radar(const std::string &path, cv::Mat &raw_data) {
+  const MappedFile file(path);
+  const cv::Mat png(1, static_cast<int>(file.size()), CV_8U, const_cast<char *>(file.data()));
+  cv::imdecode(png, cv::IMREAD_GRAYSCALE, &raw_data);
+  if (raw_data.empty()) throw std::runtime_error{"failed to decode radar scan " + path};
 }
 
 // clang-format off
@@ -0,0 +1,110 @@
+#include "steam_icp/utils/pcd_view.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace steam_icp {
+
+PcdView::PcdView(const std::string &path) : file_(path) {
+  const char *const begin = file_.data();
+  const char *const end = begin + file_.size();
+  const char *p = begin;
+  std::vector<std::string> names, types;
+  std::vector<size_t> sizes, counts;
+  size_t width = 0, height = 1;
+  std::string data;
+  while (data.empty()) {
+    const char *eol = p < end ? static_cast<const char *>(std::memchr(p, '\n', end - p)) : nullptr;
+    if (eol == nullptr) throw std::runtime_error{"no DATA line in PCD file " + path};
+    std::istringstream line(std::string(p, eol));
+    p = eol + 1;
+    std::string keyword;
+    line >> keyword;
+    if (keyword.empty() || keyword[0] == '#') continue;
+    const auto values = [&line](auto &out) {
+      using T = typename std::decay_t<decltype(out)>::value_type;
+      for (T value; line >> value;) out.push_back(value);
+    };
+    if (keyword == "FIELDS")
+      values(names);
+    else if (keyword == "SIZE")
+      values(sizes);
+    else if (keyword == "TYPE")
+      values(types);
+    else if (keyword == "COUNT")
+      values(counts);
+    else if (keyword == "WIDTH")
+      line >> width;
+    else if (keyword == "HEIGHT")
+      line >> height;
+    else if (keyword == "POINTS")
+      line >> num_points_;
+    else if (keyword == "DATA")
+      line >> data;
+  }
+  if (num_points_ == 0) num_points_ = width * height;
+  if (counts.empty()) counts.assign(names.size(), 1);
+  if (sizes.size() != names.size() || types.size() != names.size() || counts.size() != names.size())
+    throw std::runtime_error{"inconsistent FIELDS, SIZE, TYPE and COUNT in PCD file " + path};
+  for (size_t i = 0; i < names.size(); ++i) {
+    fields_.push_back({names[i], types[i].empty() ? '?' : types[i][0], sizes[i], counts[i]});
+    offsets_.push_back(point_size_);
+    point_size_ += sizes[i] * counts[i];
+  }
+
+  const size_t data_size = num_points_ * point_size_;
+  if (data == "binary") {
+    if (static_cast<size_t>(end - p) < data_size) throw std::runtime_error{"truncated PCD file " + path};
+    data_ = p;
+  } else if (data == "binary_compressed") {
+    uint32_t sizes_in[2];  // compressed, uncompressed
+    if (end - p < static_cast<std::ptrdiff_t>(sizeof(sizes_in))) throw std::runtime_error{"truncated PCD file " + path};
+    std::memcpy(sizes_in, p, sizeof(sizes_in));
+    p += sizeof(sizes_in);
+    if (static_cast<size_t>(end - p) < sizes_in[0] || sizes_in[1] != data_size)
+      throw std::runtime_error{"truncated PCD file " + path};
+    compressed_ = true;
+    decompressed_.resize(data_size);
+    if (data_size > 0 && lzfDecompress(reinterpret_cast<const uint8_t *>(p), sizes_in[0],
+                                       reinterpret_cast<uint8_t *>(decompressed_.data()), data_size) != data_size)
+      throw std::runtime_error{"failed to decompress PCD file " + path};
+    data_ = decompressed_.data();
+  } else {
+    throw std::runtime_error{"unsupported PCD DATA " + data + " in " + path + ", only binary and binary_compressed"};
+  }
+}
+
+size_t lzfDecompress(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size) {
+  const uint8_t *ip = in;
+  const uint8_t *const in_end = in + in_size;
+  uint8_t *op = out;
+  uint8_t *const out_end = out + out_size;
+  while (ip < in_end) {
+    size_t ctrl = *ip++;
+    if (ctrl < (1 << 5)) {
+      // literal run of ctrl + 1 bytes
+      ctrl++;
+      if (static_cast<size_t>(out_end - op) < ctrl || static_cast<size_t>(in_end - ip) < ctrl) return 0;
+      std::memcpy(op, ip, ctrl);
+      op += ctrl;
+      ip += ctrl;
+    } else {
+      // back reference, which may overlap the bytes it produces: copied byte by byte
+      size_t len = ctrl >> 5;
+      if (ip >= in_end) return 0;
+      if (len == 7) {
+        len += *ip++;
+        if (ip >= in_end) return 0;
+      }
+      const size_t distance = ((ctrl & 0x1f) << 8) + *ip++ + 1;
+      len += 2;
+      if (static_cast<size_t>(op - out) < distance || static_cast<size_t>(out_end - op) < len) return 0;
+      const uint8_t *ref = op - distance;
+      for (size_t i = 0; i < len; ++i) *op++ = *ref++;
+    }
+  }
+  return static_cast<size_t>(op - out);
+}
+
+}  // namespace steam_icp